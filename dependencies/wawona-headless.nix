@@ -0,0 +1,199 @@
+{
+  lib,
+  pkgs,
+  wawonaSrc,
+}:
+
+let
+  # Plain C compositor core: protocol implementations, seat, settings,
+  # logging and the pixman renderer. Shared with the app builds (see commonSources in wawona.nix);
+  # built here without any Apple or Android code.
+  coreSources = [
+    # Core compositor
+    "src/core/frame_scheduler.c"
+    "src/core/WawonaSettings.c"
+
+    # Logging
+    "src/logging/logging.c"
+    "src/logging/trace.c"
+
+    # Wayland protocol implementations
+    "src/compositor_implementations/wayland_compositor.c"
+    "src/compositor_implementations/wayland_output.c"
+    "src/compositor_implementations/wayland_shm.c"
+    "src/compositor_implementations/wayland_subcompositor.c"
+    "src/compositor_implementations/wayland_data_device_manager.c"
+    "src/compositor_implementations/wayland_primary_selection.c"
+    "src/compositor_implementations/wayland_protocol_stubs.c"
+    "src/compositor_implementations/wayland_viewporter.c"
+    "src/compositor_implementations/wayland_fractional_scale.c"
+    "src/compositor_implementations/wayland_fullscreen_shell.c"
+    "src/compositor_implementations/wayland_shell.c"
+    "src/compositor_implementations/wayland_gtk_shell.c"
+    "src/compositor_implementations/wayland_plasma_shell.c"
+    "src/compositor_implementations/wayland_qt_extensions.c"
+    "src/compositor_implementations/wayland_screencopy.c"
+    "src/compositor_implementations/wayland_presentation.c"
+    "src/compositor_implementations/wayland_linux_dmabuf.c"
+    "src/compositor_implementations/wayland_drm.c"
+    "src/compositor_implementations/wayland_idle_inhibit.c"
+    "src/compositor_implementations/wayland_pointer_gestures.c"
+    "src/compositor_implementations/wayland_relative_pointer.c"
+    "src/compositor_implementations/wayland_pointer_constraints.c"
+    "src/compositor_implementations/wayland_tablet.c"
+    "src/compositor_implementations/wayland_idle_manager.c"
+    "src/compositor_implementations/wayland_keyboard_shortcuts.c"
+    "src/compositor_implementations/xdg_shell.c"
+
+    # Rendering
+    "src/rendering/pixman_renderer.c"
+    "src/rendering/pixel_convert.c"
+    "src/rendering/pixel_convert_x86.c"
+    "src/rendering/pixel_convert_neon.c"
+    "src/rendering/texture_pool.c"
+    "src/rendering/scene.c"
+
+    # Input handling
+    "src/input/wayland_seat.c"
+    "src/input/input_batch.c"
+    "src/input/input_queue.c"
+    "src/input/keymap_cache.c"
+    "src/input/hit_test.c"
+
+    # Wayland protocol definitions (generated)
+    "src/protocols/primary-selection-protocol.c"
+    "src/protocols/xdg-activation-protocol.c"
+    "src/protocols/fractional-scale-protocol.c"
+    "src/protocols/cursor-shape-protocol.c"
+    "src/protocols/text-input-v3-protocol.c"
+    "src/protocols/text-input-v1-protocol.c"
+    "src/protocols/xdg-decoration-protocol.c"
+    "src/protocols/xdg-toplevel-icon-protocol.c"
+    "src/protocols/fullscreen-shell-unstable-v1-protocol.c"
+    "src/protocols/linux-dmabuf-unstable-v1-protocol.c"
+    "src/protocols/xdg-shell-protocol.c"
+    "src/protocols/viewporter-protocol.c"
+    "src/protocols/presentation-time-protocol.c"
+    "src/protocols/tablet-stub.c"
+  ];
+
+  # Headless backend: CPU compositing, virtual clock, mmap'ed dmabufs
+  headlessSources = [
+    "src/headless/headless_backend.c"
+    "src/headless/headless_bench.c"
+    "src/headless/headless_clients.c"
+    "src/headless/headless_dmabuf.c"
+    "src/headless/headless_main.c"
+  ];
+
+  includeFlags = [
+    "-Isrc"
+    "-Isrc/core"
+    "-Isrc/compositor_implementations"
+    "-Isrc/rendering"
+    "-Isrc/input"
+    "-Isrc/logging"
+    "-Isrc/stubs"
+    "-Isrc/protocols"
+    "-Isrc/headless"
+  ];
+
+  # Same warnings as commonCFlags in wawona.nix
+  headlessCFlags = [
+    "-std=gnu11"
+    "-Wall"
+    "-Wextra"
+    "-Werror"
+    "-Wstrict-prototypes"
+    "-Wmissing-prototypes"
+    "-Wold-style-definition"
+    "-Wmissing-declarations"
+    "-Wuninitialized"
+    "-Winit-self"
+    "-Wpointer-arith"
+    "-Wwrite-strings"
+    "-Wconversion"
+    "-Wformat=2"
+    "-Wformat-security"
+    "-Wundef"
+    "-Wshadow"
+    "-Wswitch-default"
+    "-Wswitch-enum"
+    "-Wunreachable-code"
+    "-Wfloat-equal"
+    "-fstack-protector-strong"
+    "-fPIC"
+    "-D_GNU_SOURCE"
+    "-D_FORTIFY_SOURCE=2"
+    "-O2"
+    "-g"
+    # Suppress warnings
+    "-Wno-unused-parameter"
+    "-Wno-unused-function"
+    "-Wno-unused-variable"
+    "-Wno-sign-conversion"
+    "-Wno-implicit-float-conversion"
+    "-Wno-missing-field-initializers"
+    "-Wno-format-nonliteral"
+    "-Wno-deprecated-declarations"
+    "-Wno-cast-qual"
+    "-Wno-empty-translation-unit"
+  ];
+
+  compileCommands =
+    sources:
+    lib.concatMapStringsSep "\n" (src: ''
+      obj="''${src//\//_}.o"
+      $CC -c ${src} ${lib.concatStringsSep " " includeFlags} \
+        ${lib.concatStringsSep " " headlessCFlags} \
+        $(pkg-config --cflags wayland-server wayland-client pixman-1 xkbcommon) \
+        -DWAWONA_XKBCOMMON_VERSION="\"$(pkg-config --modversion xkbcommon)\"" \
+        -o "$obj"
+      OBJ_FILES="$OBJ_FILES $obj"
+    '') sources;
+in
+pkgs.clangStdenv.mkDerivation {
+  name = "wawona-headless";
+  src = wawonaSrc;
+
+  nativeBuildInputs = [ pkgs.pkg-config ];
+  buildInputs = [
+    pkgs.wayland
+    pkgs.pixman
+    pkgs.libxkbcommon
+  ];
+
+  buildPhase = ''
+    runHook preBuild
+
+    # wawona-core static library
+    OBJ_FILES=""
+    ${compileCommands coreSources}
+    ar rcs libwawona-core.a $OBJ_FILES
+
+    # Headless compositor
+    OBJ_FILES=""
+    ${compileCommands headlessSources}
+    $CC $OBJ_FILES libwawona-core.a \
+      $(pkg-config --libs wayland-server wayland-client pixman-1 xkbcommon) \
+      -lpthread -lm \
+      -o wawona-headless
+
+    runHook postBuild
+  '';
+
+  installPhase = ''
+    runHook preInstall
+
+    mkdir -p $out/bin $out/lib
+    cp wawona-headless $out/bin/
+    cp libwawona-core.a $out/lib/
+
+    runHook postInstall
+  '';
+
+  meta = {
+    description = "Wawona compositor core on a headless virtual output (CI load testing)";
+    platforms = lib.platforms.linux;
+  };
+}
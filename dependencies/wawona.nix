@@ -185,6 +185,8 @@ let
     "src/core/main.m"
     "src/core/WawonaCompositor.m"
     "src/core/WawonaCompositor.h"
+    "src/core/frame_scheduler.c"
+    "src/core/frame_scheduler.h"
     "src/core/WawonaSettings.c"
     "src/core/WawonaSettings.h"
     "src/core/WawonaSettings.m"
@@ -192,8 +194,11 @@ let
     # Logging
     "src/logging/logging.c"
     "src/logging/logging.h"
+    "src/logging/trace.c"
+    "src/logging/trace.h"
 
     # Wayland protocol implementations
+    "src/compositor_implementations/wayland_compositor.c"
     "src/compositor_implementations/wayland_output.c"
     "src/compositor_implementations/wayland_output.h"
     "src/compositor_implementations/wayland_shm.c"
@@ -208,6 +213,8 @@ let
     "src/compositor_implementations/wayland_protocol_stubs.h"
     "src/compositor_implementations/wayland_viewporter.c"
     "src/compositor_implementations/wayland_viewporter.h"
+    "src/compositor_implementations/wayland_fractional_scale.c"
+    "src/compositor_implementations/wayland_fractional_scale.h"
     "src/compositor_implementations/wayland_fullscreen_shell.c"
     "src/compositor_implementations/wayland_fullscreen_shell.h"
     "src/compositor_implementations/wayland_shell.c"
@@ -270,6 +277,7 @@ let
     "src/protocols/xdg-shell-protocol.h"
     "src/protocols/viewporter-protocol.c"
     "src/protocols/viewporter-protocol.h"
+    "src/protocols/presentation-time-protocol.c"
     "src/protocols/presentation-time-protocol.h"
     "src/protocols/color-management-v1-protocol.h"
     "src/protocols/tablet-stub.c"
@@ -285,12 +293,33 @@ let
     "src/rendering/metal_waypipe.h"
     "src/rendering/rendering_backend.m"
     "src/rendering/rendering_backend.h"
+    "src/rendering/pixman_renderer.c"
+    "src/rendering/pixman_renderer.h"
+    "src/rendering/pixel_convert.c"
+    "src/rendering/pixel_convert.h"
+    "src/rendering/pixel_convert_kernels.h"
+    "src/rendering/pixel_convert_x86.c"
+    "src/rendering/pixel_convert_neon.c"
+    "src/rendering/texture_pool.c"
+    "src/rendering/texture_pool.h"
+    "src/rendering/scene.c"
+    "src/rendering/scene.h"
+    "src/rendering/software_renderer.m"
+    "src/rendering/software_renderer.h"
 
     # Input handling
     "src/input/input_handler.m"
     "src/input/input_handler.h"
     "src/input/wayland_seat.c"
     "src/input/wayland_seat.h"
+    "src/input/input_batch.c"
+    "src/input/input_batch.h"
+    "src/input/input_queue.c"
+    "src/input/input_queue.h"
+    "src/input/keymap_cache.c"
+    "src/input/keymap_cache.h"
+    "src/input/hit_test.c"
+    "src/input/hit_test.h"
     "src/input/cursor_shape_bridge.m"
 
     # UI components
@@ -860,6 +889,7 @@ in
                -Isrc/rendering -Isrc/input -Isrc/ui \
                -Isrc/logging -Isrc/stubs -Isrc/protocols -Isrc/launcher \
                -Imacos-dependencies/include \
+               -I''${PIXMAN_INC} \
                -fobjc-arc -fPIC \
                ${lib.concatStringsSep " " commonObjCFlags} \
                ${lib.concatStringsSep " " releaseObjCFlags} \
@@ -871,6 +901,7 @@ in
                -Isrc/rendering -Isrc/input -Isrc/ui \
                -Isrc/logging -Isrc/stubs -Isrc/protocols -Isrc/launcher \
                -Imacos-dependencies/include \
+               -I''${PIXMAN_INC} \
                -fPIC \
                ${lib.concatStringsSep " " commonCFlags} \
                ${lib.concatStringsSep " " releaseCFlags} \
@@ -1265,6 +1296,7 @@ in
                -Isrc/rendering -Isrc/input -Isrc/ui \
                -Isrc/logging -Isrc/stubs -Isrc/protocols \
                -Iios-dependencies/include \
+               -I''${PIXMAN_INC} \
                $LIBSSH2_INC \
                -fobjc-arc -fPIC \
                ${lib.concatStringsSep " " commonObjCFlags} \
@@ -1279,6 +1311,7 @@ in
                -Isrc/rendering -Isrc/input -Isrc/ui \
                -Isrc/logging -Isrc/stubs -Isrc/protocols \
                -Iios-dependencies/include \
+               -I''${PIXMAN_INC} \
                -fPIC \
                ${lib.concatStringsSep " " commonCFlags} \
                ${lib.concatStringsSep " " releaseObjCFlags} \
@@ -1781,6 +1814,7 @@ in
              -Isrc/rendering -Isrc/input -Isrc/ui \
              -Isrc/logging -Isrc/stubs -Isrc/protocols \
              -Iandroid-dependencies/include \
+             $(pkg-config --cflags-only-I pixman-1) \
              -fPIC \
              ${lib.concatStringsSep " " commonCFlags} \
              ${lib.concatStringsSep " " debugCFlags} \
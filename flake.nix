@@ -125,50 +125,73 @@
         exec "${wawonaBuildModule.macos}/bin/Wawona" "$@"
       '';
 
+      # Headless compositor for Linux build machines (CI load testing)
+      headlessSystems = [
+        "x86_64-linux"
+        "aarch64-linux"
+      ];
+      headlessPackages = pkgs.lib.genAttrs headlessSystems (
+        headlessSystem:
+        let
+          linuxPkgs = import nixpkgs { system = headlessSystem; };
+          wawonaHeadless = import ./dependencies/wawona-headless.nix {
+            lib = linuxPkgs.lib;
+            pkgs = linuxPkgs;
+            inherit wawonaSrc;
+          };
+        in
+        {
+          default = wawonaHeadless;
+          wawona-headless = wawonaHeadless;
+        }
+      );
+
     in
     {
-      packages.${system} = {
-        default = wawonaMacosWrapper;
-        wawona-ios = wawonaBuildModule.ios;
-        wawona-macos = wawonaMacosWrapper;
-        wawona-android = wawonaBuildModule.android;
-
-        # iOS dependencies
-        waypipe-ios = iosDeps.waypipe;
-        ffmpeg-ios = iosDeps.ffmpeg;
-        "libwayland-ios" = iosDeps.libwayland;
-        "kosmickrisp-ios" = iosDeps.kosmickrisp;
-        "lz4-ios" = iosDeps.lz4;
-        "zstd-ios" = iosDeps.zstd;
-        "expat-ios" = iosDeps.expat;
-        "libffi-ios" = iosDeps.libffi;
-        "libxml2-ios" = iosDeps.libxml2;
-        "epoll-shim-ios" = iosDeps."epoll-shim";
-        "mbedtls-ios" = iosDeps.mbedtls;
-        "libssh2-ios" = iosDeps.libssh2;
-
-        # macOS dependencies
-        waypipe-macos = macosDeps.waypipe;
-        ffmpeg-macos = macosDeps.ffmpeg;
-        "libwayland-macos" = macosDeps.libwayland;
-        "kosmickrisp-macos" = macosDeps.kosmickrisp;
-        "lz4-macos" = macosDeps.lz4;
-        "zstd-macos" = macosDeps.zstd;
-        "expat-macos" = macosDeps.expat;
-        "libffi-macos" = macosDeps.libffi;
-        "libxml2-macos" = macosDeps.libxml2;
-        "epoll-shim-macos" = macosDeps."epoll-shim";
-
-        # Android dependencies
-        waypipe-android = androidDeps.waypipe;
-        ffmpeg-android = androidDeps.ffmpeg;
-        "libwayland-android" = androidDeps.libwayland;
-        "swiftshader-android" = androidDeps.swiftshader;
-        "lz4-android" = androidDeps.lz4;
-        "zstd-android" = androidDeps.zstd;
-        "expat-android" = androidDeps.expat;
-        "libffi-android" = androidDeps.libffi;
-        "libxml2-android" = androidDeps.libxml2;
+      packages = headlessPackages // {
+        ${system} = {
+          default = wawonaMacosWrapper;
+          wawona-ios = wawonaBuildModule.ios;
+          wawona-macos = wawonaMacosWrapper;
+          wawona-android = wawonaBuildModule.android;
+
+          # iOS dependencies
+          waypipe-ios = iosDeps.waypipe;
+          ffmpeg-ios = iosDeps.ffmpeg;
+          "libwayland-ios" = iosDeps.libwayland;
+          "kosmickrisp-ios" = iosDeps.kosmickrisp;
+          "lz4-ios" = iosDeps.lz4;
+          "zstd-ios" = iosDeps.zstd;
+          "expat-ios" = iosDeps.expat;
+          "libffi-ios" = iosDeps.libffi;
+          "libxml2-ios" = iosDeps.libxml2;
+          "epoll-shim-ios" = iosDeps."epoll-shim";
+          "mbedtls-ios" = iosDeps.mbedtls;
+          "libssh2-ios" = iosDeps.libssh2;
+
+          # macOS dependencies
+          waypipe-macos = macosDeps.waypipe;
+          ffmpeg-macos = macosDeps.ffmpeg;
+          "libwayland-macos" = macosDeps.libwayland;
+          "kosmickrisp-macos" = macosDeps.kosmickrisp;
+          "lz4-macos" = macosDeps.lz4;
+          "zstd-macos" = macosDeps.zstd;
+          "expat-macos" = macosDeps.expat;
+          "libffi-macos" = macosDeps.libffi;
+          "libxml2-macos" = macosDeps.libxml2;
+          "epoll-shim-macos" = macosDeps."epoll-shim";
+
+          # Android dependencies
+          waypipe-android = androidDeps.waypipe;
+          ffmpeg-android = androidDeps.ffmpeg;
+          "libwayland-android" = androidDeps.libwayland;
+          "swiftshader-android" = androidDeps.swiftshader;
+          "lz4-android" = androidDeps.lz4;
+          "zstd-android" = androidDeps.zstd;
+          "expat-android" = androidDeps.expat;
+          "libffi-android" = androidDeps.libffi;
+          "libxml2-android" = androidDeps.libxml2;
+        };
       };
 
       apps.${system} = {
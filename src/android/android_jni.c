@@ -347,6 +347,8 @@ static int create_device(VkPhysicalDevice pd) {
         VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME,
         VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME,
         "VK_EXT_external_memory_dma_buf", // Explicit string if header missing
+        "VK_EXT_image_drm_format_modifier", // Multi-planar (YUV) dmabuf import
+        "VK_KHR_sampler_ycbcr_conversion",
         "VK_ANDROID_external_memory_android_hardware_buffer"
     };
     uint32_t desiredCount = sizeof(desired_exts)/sizeof(desired_exts[0]);
@@ -1075,8 +1077,11 @@ Java_com_aspauldingcode_wawona_WawonaNative_nativeApplySettings(JNIEnv* env, job
         .waypipeRSSupport = waypipeRSSupport,
         .enableTCPListener = enableTCPListener,
         .tcpPort = tcpPort,
+        .tcpAcceptBacklog = 128,
+        .tcpMaxConnectionsPerPeer = 8,
         .vulkanDrivers = false,
-        .eglDrivers = false
+        .eglDrivers = false,
+        .traceEnabled = false
     };
     WawonaSettings_UpdateConfig(&config);
     
@@ -0,0 +1,1694 @@
+#include "WawonaCompositor.h"
+#include "WawonaSettings.h"
+#include "frame_scheduler.h"
+#include "logging.h"
+#include "trace.h"
+#include "viewporter-protocol.h"
+#include "wayland_fractional_scale.h"
+#include "wayland_linux_dmabuf.h"
+#include "wayland_presentation.h"
+#include "wayland_subcompositor.h"
+#include "wayland_viewporter.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// wl_compositor, wl_surface and wl_region
+// Platform independent: the backend (Cocoa/UIKit, Android, headless) plugs in
+// through the callbacks on struct wl_compositor_impl.
+
+// Surface registry: doubly linked so insert and removal are O(1).
+// Mutated only on the Wayland event thread while holding the write lock;
+// other threads (renderFrame, input) iterate under the read lock. The same
+// lock covers the current state of the surfaces (buffer, size, scale,
+// damage): commits apply it with the write lock held.
+static struct wl_surface_impl *g_surface_list = NULL;
+static pthread_rwlock_t g_surface_lock = PTHREAD_RWLOCK_INITIALIZER;
+// Registry index by surface id (see wl_surface_from_id): open addressing with
+// linear probing, at most half full. Same lock as the list.
+static struct wl_surface_impl **g_surface_index = NULL;
+static size_t g_surface_index_mask = 0;  // Capacity - 1, 0 until allocated
+static size_t g_surface_index_count = 0;
+static uint64_t g_next_surface_id = 1;  // Event thread only
+// Surfaces with a pending frame callback (event thread only), so the frame
+// tick does not have to scan every surface
+static struct wl_list g_frame_callback_surfaces;
+// CLOCK_MONOTONIC time of the last presented frame in nanoseconds (0 = none yet)
+static _Atomic uint64_t g_last_present_ns = 0;
+// Output frame counter: last frame begun by the renderer (main thread)
+static _Atomic uint64_t g_frame_seq = 0;
+// Latest output frame that composited new commits, until it is presented
+// (0 = none)
+static _Atomic uint64_t g_composited_frame_pending = 0;
+// Recently presented output frames, written by the renderers' presentation
+// handlers and read on the event thread for presentation feedback
+#define PRESENTED_FRAME_HISTORY 16
+struct presented_frame {
+    uint64_t seq;
+    uint64_t present_ns;
+    uint32_t flags;
+};
+static struct presented_frame g_presented_frames[PRESENTED_FRAME_HISTORY];
+static unsigned int g_presented_frame_next = 0;
+static pthread_mutex_t g_presented_frame_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct wl_compositor_impl *g_compositor = NULL;
+// Flattened surface tree (see wl_compositor_get_draw_list). Rebuilt on the
+// event thread under the registry write lock once a commit marked it dirty.
+static struct wl_surface_draw_entry *g_draw_list = NULL;
+static int g_draw_list_count = 0;
+static int g_draw_list_capacity = 0;
+static _Atomic uint32_t g_draw_list_generation = 0;
+static bool g_draw_list_dirty = false;
+
+static void surface_destroy_resource(struct wl_resource *resource);
+static void region_destroy_resource(struct wl_resource *resource);
+static void draw_list_rebuild_locked(void);
+static void surface_source_box(const struct wl_surface_impl *surface, double *x, double *y,
+                               double *width, double *height);
+
+// --- Surface index ---
+
+static size_t
+surface_index_slot(uint64_t id)
+{
+    // Fibonacci hashing: ids are sequential
+    return (size_t)((id * 0x9E3779B97F4A7C15ull) >> 32) & g_surface_index_mask;
+}
+
+static bool
+surface_index_insert_locked(struct wl_surface_impl *surface)
+{
+    if ((g_surface_index_count + 1) * 2 > g_surface_index_mask + 1 || !g_surface_index) {
+        size_t capacity = g_surface_index ? (g_surface_index_mask + 1) * 2 : 64;
+        struct wl_surface_impl **old = g_surface_index;
+        size_t old_capacity = old ? g_surface_index_mask + 1 : 0;
+        struct wl_surface_impl **index = calloc(capacity, sizeof(*index));
+        if (!index) {
+            return false;
+        }
+        g_surface_index = index;
+        g_surface_index_mask = capacity - 1;
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old[i]) {
+                size_t slot = surface_index_slot(old[i]->id);
+                while (index[slot]) {
+                    slot = (slot + 1) & g_surface_index_mask;
+                }
+                index[slot] = old[i];
+            }
+        }
+        free(old);
+    }
+    size_t slot = surface_index_slot(surface->id);
+    while (g_surface_index[slot]) {
+        slot = (slot + 1) & g_surface_index_mask;
+    }
+    g_surface_index[slot] = surface;
+    g_surface_index_count++;
+    return true;
+}
+
+static void
+surface_index_remove_locked(struct wl_surface_impl *surface)
+{
+    if (!g_surface_index) {
+        return;
+    }
+    size_t slot = surface_index_slot(surface->id);
+    while (g_surface_index[slot] && g_surface_index[slot] != surface) {
+        slot = (slot + 1) & g_surface_index_mask;
+    }
+    if (!g_surface_index[slot]) {
+        return;
+    }
+    // Shift the rest of the probe run back so lookups never stop early
+    size_t hole = slot;
+    for (size_t next = (hole + 1) & g_surface_index_mask; g_surface_index[next];
+         next = (next + 1) & g_surface_index_mask) {
+        size_t home = surface_index_slot(g_surface_index[next]->id);
+        // Movable unless its home lies cyclically in (hole, next]
+        bool stays = hole <= next ? (home > hole && home <= next) : (home > hole || home <= next);
+        if (!stays) {
+            g_surface_index[hole] = g_surface_index[next];
+            hole = next;
+        }
+    }
+    g_surface_index[hole] = NULL;
+    g_surface_index_count--;
+}
+
+// --- Region Implementation ---
+
+struct wl_region_impl {
+    struct wl_resource *resource;
+    pixman_region32_t region;
+};
+
+static void
+region_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+    (void)client;
+    wl_resource_destroy(resource);
+}
+
+static void
+region_add(struct wl_client *client, struct wl_resource *resource,
+           int32_t x, int32_t y, int32_t width, int32_t height)
+{
+    (void)client;
+    struct wl_region_impl *region = wl_resource_get_user_data(resource);
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    pixman_region32_union_rect(&region->region, &region->region, x, y,
+                               (unsigned int)width, (unsigned int)height);
+}
+
+static void
+region_subtract(struct wl_client *client, struct wl_resource *resource,
+                int32_t x, int32_t y, int32_t width, int32_t height)
+{
+    (void)client;
+    struct wl_region_impl *region = wl_resource_get_user_data(resource);
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    pixman_region32_t rect;
+    pixman_region32_init_rect(&rect, x, y, (unsigned int)width, (unsigned int)height);
+    pixman_region32_subtract(&region->region, &region->region, &rect);
+    pixman_region32_fini(&rect);
+}
+
+static const struct wl_region_interface region_interface = {
+    region_destroy,
+    region_add,
+    region_subtract,
+};
+
+static void
+region_destroy_resource(struct wl_resource *resource)
+{
+    struct wl_region_impl *region = wl_resource_get_user_data(resource);
+    pixman_region32_fini(&region->region);
+    free(region);
+}
+
+// Contents of a wl_region argument; NULL (an unset region) is an empty region
+static void
+region_copy_from_resource(pixman_region32_t *dst, struct wl_resource *region_resource)
+{
+    if (region_resource) {
+        struct wl_region_impl *region = wl_resource_get_user_data(region_resource);
+        pixman_region32_copy(dst, &region->region);
+    } else {
+        pixman_region32_clear(dst);
+    }
+}
+
+// Everything: the input region of a surface that never set one
+static void
+region_set_infinite(pixman_region32_t *region)
+{
+    pixman_region32_fini(region);
+    pixman_region32_init_rect(region, INT32_MIN, INT32_MIN, UINT32_MAX, UINT32_MAX);
+}
+
+static void
+compositor_destroy_bound_resource(struct wl_resource *resource)
+{
+    struct wl_compositor_impl *compositor = wl_resource_get_user_data(resource);
+    if (compositor) {
+        if (compositor->client_count > 0) {
+            compositor->client_count--;
+        }
+        if (compositor->client_disconnected) {
+            compositor->client_disconnected();
+        }
+    }
+}
+
+// --- Surface State ---
+
+static void
+surface_state_handle_buffer_destroy(struct wl_listener *listener, void *data)
+{
+    (void)data;
+    struct wl_surface_state *state =
+        wl_container_of(listener, state, buffer_destroy_listener);
+
+    // A destroyed pending buffer turns the attach into a detach
+    wl_list_remove(&listener->link);
+    wl_list_init(&listener->link);
+    state->buffer = NULL;
+}
+
+static void
+surface_state_init(struct wl_surface_state *state)
+{
+    state->committed = 0;
+    state->buffer = NULL;
+    state->buffer_destroy_listener.notify = surface_state_handle_buffer_destroy;
+    wl_list_init(&state->buffer_destroy_listener.link);
+    state->dx = 0;
+    state->dy = 0;
+    state->scale = 1;
+    state->transform = WL_OUTPUT_TRANSFORM_NORMAL;
+    pixman_region32_init(&state->damage_surface);
+    pixman_region32_init(&state->damage_buffer);
+    pixman_region32_init(&state->opaque);
+    pixman_region32_init(&state->input);
+    memset(&state->viewport, 0, sizeof(state->viewport));
+    wl_list_init(&state->frame_callback_list);
+    wl_list_init(&state->presentation_feedback_list);
+}
+
+static void
+surface_discard_presentation_feedback(struct wl_list *feedback_list)
+{
+    struct wp_presentation_feedback_impl *feedback, *tmp;
+    wl_list_for_each_safe(feedback, tmp, feedback_list, link) {
+        wp_presentation_feedback_discarded(feedback);
+    }
+}
+
+static void
+surface_state_fini(struct wl_surface_state *state)
+{
+    struct wl_resource *cb, *tmp;
+    wl_resource_for_each_safe(cb, tmp, &state->frame_callback_list) {
+        wl_resource_destroy(cb);
+    }
+    surface_discard_presentation_feedback(&state->presentation_feedback_list);
+    wl_list_remove(&state->buffer_destroy_listener.link);
+    pixman_region32_fini(&state->damage_surface);
+    pixman_region32_fini(&state->damage_buffer);
+    pixman_region32_fini(&state->opaque);
+    pixman_region32_fini(&state->input);
+}
+
+static void
+surface_state_set_buffer(struct wl_surface_state *state, struct wl_resource *buffer)
+{
+    if (state->buffer == buffer) {
+        return;
+    }
+
+    wl_list_remove(&state->buffer_destroy_listener.link);
+    wl_list_init(&state->buffer_destroy_listener.link);
+    state->buffer = buffer;
+    if (buffer) {
+        wl_resource_add_destroy_listener(buffer, &state->buffer_destroy_listener);
+    }
+}
+
+static void
+surface_handle_buffer_destroy(struct wl_listener *listener, void *data)
+{
+    (void)data;
+    struct wl_surface_impl *surface =
+        wl_container_of(listener, surface, buffer_destroy_listener);
+
+    // Renderers read buffer_resource under the read lock
+    pthread_rwlock_wrlock(&g_surface_lock);
+    wl_list_remove(&listener->link);
+    wl_list_init(&listener->link);
+    surface->buffer_resource = NULL;
+    surface->buffer_release_sent = true;
+    g_draw_list_dirty = true;
+    draw_list_rebuild_locked();
+    pthread_rwlock_unlock(&g_surface_lock);
+}
+
+static void
+surface_set_current_buffer(struct wl_surface_impl *surface, struct wl_resource *buffer)
+{
+    wl_list_remove(&surface->buffer_destroy_listener.link);
+    wl_list_init(&surface->buffer_destroy_listener.link);
+    surface->buffer_resource = buffer;
+    if (buffer) {
+        wl_resource_add_destroy_listener(buffer, &surface->buffer_destroy_listener);
+    }
+}
+
+// Fold a newer state block into an older one (a synchronized subsurface
+// committing again before its parent did). Surface damage stays in surface
+// coordinates: it is converted with the geometry current when applied.
+static void
+surface_state_merge(struct wl_surface_impl *surface, struct wl_surface_state *dst,
+                    struct wl_surface_state *src)
+{
+    if (src->committed & WL_SURFACE_STATE_BUFFER) {
+        // A cached buffer that is replaced never becomes current, so nothing
+        // else would release it
+        if (dst->buffer && dst->buffer != src->buffer &&
+            dst->buffer != surface->buffer_resource) {
+            wl_buffer_send_release(dst->buffer);
+        }
+        surface_state_set_buffer(dst, src->buffer);
+        surface_state_set_buffer(src, NULL);
+        dst->dx += src->dx;
+        dst->dy += src->dy;
+        src->dx = 0;
+        src->dy = 0;
+    }
+    if (src->committed & WL_SURFACE_STATE_SCALE) {
+        dst->scale = src->scale;
+    }
+    if (src->committed & WL_SURFACE_STATE_TRANSFORM) {
+        dst->transform = src->transform;
+    }
+    if (src->committed & WL_SURFACE_STATE_OPAQUE_REGION) {
+        pixman_region32_copy(&dst->opaque, &src->opaque);
+    }
+    if (src->committed & WL_SURFACE_STATE_INPUT_REGION) {
+        pixman_region32_copy(&dst->input, &src->input);
+    }
+    if (src->committed & WL_SURFACE_STATE_VIEWPORT) {
+        dst->viewport = src->viewport;
+    }
+    dst->committed |= src->committed;
+    src->committed = 0;
+
+    pixman_region32_union(&dst->damage_surface, &dst->damage_surface, &src->damage_surface);
+    pixman_region32_union(&dst->damage_buffer, &dst->damage_buffer, &src->damage_buffer);
+    pixman_region32_clear(&src->damage_surface);
+    pixman_region32_clear(&src->damage_buffer);
+
+    wl_list_insert_list(dst->frame_callback_list.prev, &src->frame_callback_list);
+    wl_list_init(&src->frame_callback_list);
+    wl_list_insert_list(dst->presentation_feedback_list.prev, &src->presentation_feedback_list);
+    wl_list_init(&src->presentation_feedback_list);
+}
+
+// --- Draw List ---
+
+static bool
+draw_list_append(struct wl_surface_impl *surface, int32_t x, int32_t y)
+{
+    if (g_draw_list_count == g_draw_list_capacity) {
+        int capacity = g_draw_list_capacity > 0 ? g_draw_list_capacity * 2 : 32;
+        struct wl_surface_draw_entry *entries =
+            realloc(g_draw_list, (size_t)capacity * sizeof(struct wl_surface_draw_entry));
+        if (!entries) {
+            log_error("[COMPOSITOR] ", "Failed to grow the draw list to %d entries\n", capacity);
+            return false;
+        }
+        for (int i = g_draw_list_capacity; i < capacity; i++) {
+            pixman_region32_init(&entries[i].opaque);
+            pixman_region32_init(&entries[i].input);
+        }
+        g_draw_list = entries;
+        g_draw_list_capacity = capacity;
+    }
+    struct wl_surface_draw_entry *entry = &g_draw_list[g_draw_list_count++];
+    entry->surface = surface;
+    entry->x = x;
+    entry->y = y;
+    entry->width = surface->width;
+    entry->height = surface->height;
+    surface_source_box(surface, &entry->src_x, &entry->src_y, &entry->src_width,
+                       &entry->src_height);
+    pixman_region32_copy(&entry->opaque, &surface->opaque_region);
+    // The input region is clipped to the surface
+    pixman_region32_intersect_rect(&entry->input, &surface->input_region, 0, 0,
+                                   (unsigned int)(entry->width > 0 ? entry->width : 0),
+                                   (unsigned int)(entry->height > 0 ? entry->height : 0));
+    return true;
+}
+
+// A surface and its subsurfaces in paint order. (x, y) is the origin the
+// surface's own offset is relative to. A surface without a buffer is
+// unmapped, and so are all of its subsurfaces.
+static void
+draw_list_add_tree(struct wl_surface_impl *surface, int32_t x, int32_t y)
+{
+    if (!surface->buffer_resource) {
+        return;
+    }
+    x += surface->x;
+    y += surface->y;
+
+    struct wl_subsurface_impl *sub;
+    wl_list_for_each(sub, &surface->subsurfaces_below, parent_link) {
+        draw_list_add_tree(sub->surface, x + sub->x, y + sub->y);
+    }
+    draw_list_append(surface, x, y);
+    wl_list_for_each(sub, &surface->subsurfaces_above, parent_link) {
+        draw_list_add_tree(sub->surface, x + sub->x, y + sub->y);
+    }
+}
+
+// Called with the registry write lock held
+static void
+draw_list_rebuild_locked(void)
+{
+    TRACE_SCOPE("draw_list_rebuild");
+    g_draw_list_count = 0;
+
+    // Roots oldest first (the registry is newest first)
+    struct wl_surface_impl *surface = g_surface_list;
+    while (surface && surface->next) {
+        surface = surface->next;
+    }
+    for (; surface; surface = surface->prev) {
+        if (!surface->subsurface) {
+            draw_list_add_tree(surface, 0, 0);
+        }
+    }
+
+    g_draw_list_dirty = false;
+    atomic_fetch_add(&g_draw_list_generation, 1);
+    TRACE_COUNTER("draw_list_entries", g_draw_list_count);
+}
+
+static void
+draw_list_update(void)
+{
+    if (!g_draw_list_dirty) {
+        return;
+    }
+    pthread_rwlock_wrlock(&g_surface_lock);
+    draw_list_rebuild_locked();
+    pthread_rwlock_unlock(&g_surface_lock);
+}
+
+// --- Surface Implementation ---
+
+static void
+surface_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+    (void)client;
+    wl_resource_destroy(resource);
+}
+
+static void
+surface_attach(struct wl_client *client, struct wl_resource *resource,
+               struct wl_resource *buffer, int32_t x, int32_t y)
+{
+    (void)client;
+    struct wl_surface_impl *surface = wl_resource_get_user_data(resource);
+
+    // Pending state only - the buffer becomes current (and the old one is
+    // released) when the surface is committed
+    surface_state_set_buffer(&surface->pending, buffer);
+    surface->pending.dx = x;
+    surface->pending.dy = y;
+    surface->pending.committed |= WL_SURFACE_STATE_BUFFER;
+}
+
+static void
+surface_damage(struct wl_client *client, struct wl_resource *resource,
+               int32_t x, int32_t y, int32_t width, int32_t height)
+{
+    (void)client;
+    struct wl_surface_impl *surface = wl_resource_get_user_data(resource);
+
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    pixman_region32_union_rect(&surface->pending.damage_surface,
+                               &surface->pending.damage_surface, x, y,
+                               (unsigned int)width, (unsigned int)height);
+}
+
+// Convert surface-coordinate damage into buffer coordinates.
+// Applies the viewport (source crop / destination scale) and buffer scale,
+// rounding outwards so partially covered pixels are always re-uploaded.
+static void
+surface_damage_to_buffer(struct wl_surface_impl *surface, pixman_region32_t *damage,
+                         pixman_region32_t *out)
+{
+    int n_rects = 0;
+    pixman_box32_t *rects = pixman_region32_rectangles(damage, &n_rects);
+    if (n_rects == 0) {
+        return;
+    }
+
+    double scale = surface->buffer_scale > 0 ? surface->buffer_scale : 1;
+    double src_x = 0.0, src_y = 0.0;
+    double src_w = surface->buffer_width / scale;
+    double src_h = surface->buffer_height / scale;
+    double dst_w = surface->width, dst_h = surface->height;
+
+    const struct wl_surface_viewport *vp = &surface->viewport_state;
+    if (vp->has_source) {
+        src_x = vp->src_x;
+        src_y = vp->src_y;
+        src_w = vp->src_width;
+        src_h = vp->src_height;
+    }
+    if (dst_w <= 0.0 || dst_h <= 0.0) {
+        return;
+    }
+
+    double sx = src_w / dst_w;
+    double sy = src_h / dst_h;
+    for (int i = 0; i < n_rects; i++) {
+        double x1 = floor((src_x + rects[i].x1 * sx) * scale);
+        double y1 = floor((src_y + rects[i].y1 * sy) * scale);
+        double x2 = ceil((src_x + rects[i].x2 * sx) * scale);
+        double y2 = ceil((src_y + rects[i].y2 * sy) * scale);
+        if (x2 <= x1 || y2 <= y1) {
+            continue;
+        }
+        pixman_region32_union_rect(out, out, (int)x1, (int)y1,
+                                   (unsigned int)(x2 - x1), (unsigned int)(y2 - y1));
+    }
+}
+
+// Size of a buffer (shm, dmabuf or a backend buffer type). Returns false
+// for a buffer the backend does not know about (EGL).
+static bool
+buffer_get_size(struct wl_resource *buffer, int32_t *width, int32_t *height)
+{
+    struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(buffer);
+    if (shm_buffer) {
+        *width = wl_shm_buffer_get_width(shm_buffer);
+        *height = wl_shm_buffer_get_height(shm_buffer);
+        return true;
+    }
+    if (is_dmabuf_buffer(buffer)) {
+        // Checked before the backend: waypipe uses dmabuf buffers
+        struct metal_dmabuf_buffer *dmabuf_buffer = dmabuf_buffer_get(buffer);
+        if (!dmabuf_buffer) {
+            return false;
+        }
+        *width = (int32_t)dmabuf_buffer->width;
+        *height = (int32_t)dmabuf_buffer->height;
+        return true;
+    }
+    return g_compositor && g_compositor->query_buffer_size &&
+           g_compositor->query_buffer_size(buffer, width, height);
+}
+
+// Buffer size in surface coordinates: divided by the buffer scale, swapped
+// by the 90 and 270 degree transforms (the odd wl_output_transform values)
+static void
+buffer_size_to_surface(int32_t buffer_width, int32_t buffer_height, int32_t scale,
+                       int32_t transform, double *width, double *height)
+{
+    double s = scale > 0 ? scale : 1;
+    *width = ((transform & 1) ? buffer_height : buffer_width) / s;
+    *height = ((transform & 1) ? buffer_width : buffer_height) / s;
+}
+
+// Query the size of the current buffer
+static void
+surface_update_buffer_size(struct wl_surface_impl *surface)
+{
+    int32_t width = 0, height = 0;
+    if (surface->buffer_resource && buffer_get_size(surface->buffer_resource, &width, &height)) {
+        surface->buffer_width = width;
+        surface->buffer_height = height;
+    }
+}
+
+// Surface size: the viewport destination, else the viewport source size,
+// else the buffer size in surface coordinates
+static void
+surface_update_size(struct wl_surface_impl *surface)
+{
+    if (!surface->buffer_resource) {
+        return;
+    }
+
+    const struct wl_surface_viewport *vp = &surface->viewport_state;
+    if (vp->has_destination) {
+        surface->width = vp->dst_width;
+        surface->height = vp->dst_height;
+    } else if (vp->has_source) {
+        // Integer without a destination (checked on commit)
+        surface->width = (int32_t)vp->src_width;
+        surface->height = (int32_t)vp->src_height;
+    } else {
+        double width, height;
+        buffer_size_to_surface(surface->buffer_width, surface->buffer_height,
+                               surface->buffer_scale, surface->buffer_transform, &width, &height);
+        surface->width = (int32_t)width;
+        surface->height = (int32_t)height;
+    }
+}
+
+// Part of the buffer that is shown, in buffer pixels: the viewport source
+// scaled by the buffer scale, else the whole buffer
+static void
+surface_source_box(const struct wl_surface_impl *surface, double *x, double *y, double *width,
+                   double *height)
+{
+    const struct wl_surface_viewport *vp = &surface->viewport_state;
+    if (vp->has_source) {
+        double scale = surface->buffer_scale > 0 ? surface->buffer_scale : 1;
+        *x = vp->src_x * scale;
+        *y = vp->src_y * scale;
+        *width = vp->src_width * scale;
+        *height = vp->src_height * scale;
+    } else {
+        *x = 0.0;
+        *y = 0.0;
+        *width = surface->buffer_width;
+        *height = surface->buffer_height;
+    }
+}
+
+// wp_viewport errors raised by wl_surface.commit, checked against the state
+// being committed. Returns false once an error was posted.
+static bool
+surface_check_viewport(struct wl_surface_impl *surface)
+{
+    struct wl_viewport_impl *viewport = wl_viewport_from_surface(surface);
+    if (!viewport) {
+        return true;
+    }
+
+    const struct wl_surface_state *pending = &surface->pending;
+    const struct wl_surface_viewport *vp = (pending->committed & WL_SURFACE_STATE_VIEWPORT)
+                                               ? &pending->viewport
+                                               : &surface->viewport_state;
+    if (!vp->has_source) {
+        return true;
+    }
+    if (!vp->has_destination &&
+        (vp->src_width > floor(vp->src_width) || vp->src_height > floor(vp->src_height))) {
+        wl_resource_post_error(viewport->resource, WP_VIEWPORT_ERROR_BAD_SIZE,
+                               "source size %fx%f is not integer and no destination is set",
+                               vp->src_width, vp->src_height);
+        return false;
+    }
+
+    struct wl_resource *buffer = surface->buffer_resource;
+    int32_t buffer_width = surface->buffer_width, buffer_height = surface->buffer_height;
+    if (pending->committed & WL_SURFACE_STATE_BUFFER) {
+        buffer = pending->buffer;
+        if (buffer && !buffer_get_size(buffer, &buffer_width, &buffer_height)) {
+            return true;
+        }
+    }
+    if (!buffer) {
+        return true;
+    }
+    int32_t scale = (pending->committed & WL_SURFACE_STATE_SCALE) ? pending->scale
+                                                                  : surface->buffer_scale;
+    int32_t transform = (pending->committed & WL_SURFACE_STATE_TRANSFORM)
+                            ? pending->transform
+                            : surface->buffer_transform;
+    double width, height;
+    buffer_size_to_surface(buffer_width, buffer_height, scale, transform, &width, &height);
+    if (vp->src_x + vp->src_width > width || vp->src_y + vp->src_height > height) {
+        wl_resource_post_error(viewport->resource, WP_VIEWPORT_ERROR_OUT_OF_BUFFER,
+                               "source rectangle %fx%f@%f,%f extends outside the %gx%g buffer",
+                               vp->src_width, vp->src_height, vp->src_x, vp->src_y, width,
+                               height);
+        return false;
+    }
+    return true;
+}
+
+uint64_t
+wl_surface_trace_flow_id(struct wl_surface_impl *surface, uint32_t commit_seq)
+{
+    return ((uint64_t)(uintptr_t)surface << 16) ^ commit_seq;
+}
+
+// Last commit composited and the frame it went out in, as published by
+// wl_surface_mark_composited. Should the renderer composite a newer commit
+// meanwhile, the frame may be that later one.
+static uint32_t
+surface_presented_seq(struct wl_surface_impl *surface, uint64_t *composited_frame)
+{
+    uint32_t seq = atomic_load_explicit(&surface->presented_seq, memory_order_acquire);
+    *composited_frame = atomic_load_explicit(&surface->composited_frame, memory_order_relaxed);
+    return seq;
+}
+
+// Apply a state block to the current surface state in one step.
+// Buffer and scale go first so damage is converted with the new geometry.
+static void
+surface_apply_state(struct wl_surface_impl *surface, struct wl_surface_state *state)
+{
+    if (state->committed & WL_SURFACE_STATE_SCALE) {
+        surface->buffer_scale = state->scale;
+    }
+    if (state->committed & WL_SURFACE_STATE_TRANSFORM) {
+        surface->buffer_transform = state->transform;
+    }
+    if (state->committed & WL_SURFACE_STATE_OPAQUE_REGION) {
+        // Renderers cull against the copy in the draw list
+        if (!pixman_region32_equal(&surface->opaque_region, &state->opaque)) {
+            pixman_region32_copy(&surface->opaque_region, &state->opaque);
+            g_draw_list_dirty = true;
+        }
+    }
+    if (state->committed & WL_SURFACE_STATE_INPUT_REGION) {
+        // Hit-testing reads the copy in the draw list
+        if (!pixman_region32_equal(&surface->input_region, &state->input)) {
+            pixman_region32_copy(&surface->input_region, &state->input);
+            g_draw_list_dirty = true;
+        }
+    }
+    if (state->committed & WL_SURFACE_STATE_VIEWPORT) {
+        surface->viewport_state = state->viewport;
+        g_draw_list_dirty = true;
+    }
+
+    if (state->committed & WL_SURFACE_STATE_BUFFER) {
+        struct wl_resource *buffer = state->buffer;
+
+        // CRITICAL: Release old buffer if a new one is being committed
+        // This is required by Wayland protocol - when a new buffer replaces it,
+        // the old one must be released (unless the renderer already did)
+        if (surface->buffer_resource && surface->buffer_resource != buffer &&
+            !surface->buffer_release_sent) {
+            wl_buffer_send_release(surface->buffer_resource);
+            surface->buffer_release_sent = true;
+        }
+
+        surface_set_current_buffer(surface, buffer);
+        // Reset release sent flag for the new buffer (or re-attached buffer)
+        // If buffer is NULL (detach), keep the flag as-is
+        if (buffer) {
+            surface->buffer_release_sent = false;
+        }
+        surface->x += state->dx;
+        surface->y += state->dy;
+        surface_update_buffer_size(surface);
+
+        surface_state_set_buffer(state, NULL);
+        state->dx = 0;
+        state->dy = 0;
+    }
+    surface_update_size(surface);
+
+    // Fold damage into the current damage (buffer coordinates)
+    surface_damage_to_buffer(surface, &state->damage_surface, &surface->damage);
+    pixman_region32_union(&surface->damage, &surface->damage, &state->damage_buffer);
+    pixman_region32_intersect_rect(
+        &surface->damage, &surface->damage, 0, 0,
+        (unsigned int)(surface->buffer_width > 0 ? surface->buffer_width : 0),
+        (unsigned int)(surface->buffer_height > 0 ? surface->buffer_height : 0));
+    pixman_region32_clear(&state->damage_surface);
+    pixman_region32_clear(&state->damage_buffer);
+
+    // Earlier updates are superseded now: one that was composited keeps the
+    // frame it went out in, one that never made it to screen is discarded
+    struct wp_presentation_feedback_impl *feedback, *feedback_tmp;
+    uint64_t composited_frame;
+    uint32_t presented_seq = surface_presented_seq(surface, &composited_frame);
+    wl_list_for_each_safe(feedback, feedback_tmp, &surface->presentation_feedback_list, link) {
+        if (feedback->frame_seq != 0) {
+            continue;
+        }
+        if ((int32_t)(presented_seq - feedback->commit_seq) >= 0) {
+            feedback->frame_seq = composited_frame;
+        } else {
+            wp_presentation_feedback_discarded(feedback);
+        }
+    }
+
+    state->committed = 0;
+    surface->commit_seq++;
+
+    // Frame callbacks and presentation feedback become current and wait for
+    // this commit to be composited
+    bool needs_frame = false;
+    if (!wl_list_empty(&state->frame_callback_list)) {
+        wl_list_insert_list(surface->frame_callback_list.prev, &state->frame_callback_list);
+        wl_list_init(&state->frame_callback_list);
+        surface->frame_callback_seq = surface->commit_seq;
+        needs_frame = true;
+    }
+    if (!wl_list_empty(&state->presentation_feedback_list)) {
+        wl_list_for_each(feedback, &state->presentation_feedback_list, link) {
+            feedback->commit_seq = surface->commit_seq;
+        }
+        wl_list_insert_list(surface->presentation_feedback_list.prev,
+                            &state->presentation_feedback_list);
+        wl_list_init(&state->presentation_feedback_list);
+        needs_frame = true;
+    }
+
+    if (needs_frame) {
+        if (wl_list_empty(&surface->frame_callback_link)) {
+            wl_list_insert(g_frame_callback_surfaces.prev, &surface->frame_callback_link);
+        }
+
+        // Notify compositor so the frame scheduler runs
+        if (g_compositor && g_compositor->frame_callback_requested) {
+            g_compositor->frame_callback_requested();
+        }
+    }
+}
+
+static bool
+surface_is_synchronized(struct wl_surface_impl *surface)
+{
+    while (surface && surface->subsurface) {
+        if (surface->subsurface->synchronized) {
+            return true;
+        }
+        surface = surface->subsurface->parent;
+    }
+    return false;
+}
+
+static void surface_commit_state_locked(struct wl_surface_impl *surface,
+                                        struct wl_surface_state *state);
+
+// The surface's state was just applied: its children's pending stacking and
+// positions become current, and synchronized children apply what they
+// committed since (each through its own commit, so grandchildren follow)
+static void
+surface_apply_subsurfaces(struct wl_surface_impl *surface)
+{
+    if (wl_list_empty(&surface->subsurfaces_pending_below) &&
+        wl_list_empty(&surface->subsurfaces_pending_above)) {
+        return;
+    }
+
+    // Both orders hold the same subsurfaces, so re-appending each one in
+    // pending order reproduces it
+    struct wl_subsurface_impl *sub;
+    wl_list_for_each(sub, &surface->subsurfaces_pending_below, parent_pending_link) {
+        wl_list_remove(&sub->parent_link);
+        wl_list_insert(surface->subsurfaces_below.prev, &sub->parent_link);
+        sub->x = sub->pending_x;
+        sub->y = sub->pending_y;
+    }
+    wl_list_for_each(sub, &surface->subsurfaces_pending_above, parent_pending_link) {
+        wl_list_remove(&sub->parent_link);
+        wl_list_insert(surface->subsurfaces_above.prev, &sub->parent_link);
+        sub->x = sub->pending_x;
+        sub->y = sub->pending_y;
+    }
+    g_draw_list_dirty = true;
+
+    wl_list_for_each(sub, &surface->subsurfaces_below, parent_link) {
+        if (sub->has_cache) {
+            sub->has_cache = false;
+            surface_commit_state_locked(sub->surface, &sub->surface->cached);
+        }
+    }
+    wl_list_for_each(sub, &surface->subsurfaces_above, parent_link) {
+        if (sub->has_cache) {
+            sub->has_cache = false;
+            surface_commit_state_locked(sub->surface, &sub->surface->cached);
+        }
+    }
+}
+
+// Apply a committed state block (pending, or cached for a subsurface).
+// Called with the registry write lock held.
+static void
+surface_commit_state_locked(struct wl_surface_impl *surface, struct wl_surface_state *state)
+{
+    bool was_mapped = surface->buffer_resource != NULL;
+    int32_t old_x = surface->x, old_y = surface->y;
+    int32_t old_width = surface->width, old_height = surface->height;
+    int32_t old_buffer_width = surface->buffer_width, old_buffer_height = surface->buffer_height;
+
+    surface_apply_state(surface, state);
+    TRACE_FLOW_BEGIN("commit", wl_surface_trace_flow_id(surface, surface->commit_seq));
+    if ((surface->buffer_resource != NULL) != was_mapped || surface->x != old_x ||
+        surface->y != old_y || surface->width != old_width || surface->height != old_height ||
+        surface->buffer_width != old_buffer_width || surface->buffer_height != old_buffer_height) {
+        g_draw_list_dirty = true;
+    }
+    surface_apply_subsurfaces(surface);
+}
+
+// Apply a committed state block and hand the result to the renderer.
+// Renderers read the current state under the read lock, so the whole tree
+// is applied, and the draw list rebuilt, under the write lock: they see
+// either the old or the new state of every surface, with its stacking.
+static void
+surface_commit_state(struct wl_surface_impl *surface, struct wl_surface_state *state)
+{
+    pthread_rwlock_wrlock(&g_surface_lock);
+    surface_commit_state_locked(surface, state);
+    if (g_draw_list_dirty) {
+        draw_list_rebuild_locked();
+    }
+    pthread_rwlock_unlock(&g_surface_lock);
+
+    // Notify compositor to render (without the lock: the backend may wait
+    // for its main thread, which takes the read lock)
+    if (g_compositor && g_compositor->render_callback) {
+        g_compositor->render_callback(surface);
+    }
+}
+
+static void
+surface_commit_pending(struct wl_surface_impl *surface)
+{
+    if (surface_is_synchronized(surface)) {
+        // Held back until the parent commits
+        surface_state_merge(surface, &surface->cached, &surface->pending);
+        surface->subsurface->has_cache = true;
+        return;
+    }
+    surface_commit_state(surface, &surface->pending);
+}
+
+static void
+frame_callback_destroy_resource(struct wl_resource *resource)
+{
+    wl_list_remove(wl_resource_get_link(resource));
+}
+
+static void
+surface_frame(struct wl_client *client, struct wl_resource *resource, uint32_t callback)
+{
+    struct wl_surface_impl *surface = wl_resource_get_user_data(resource);
+
+    struct wl_resource *callback_resource =
+        wl_resource_create(client, &wl_callback_interface, 1, callback);
+    if (!callback_resource) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    // Queue on the pending state; surface_commit moves it to the current list.
+    // The destroy handler unlinks it, so a client going away never leaves a
+    // dangling callback behind.
+    wl_resource_set_implementation(callback_resource, NULL, NULL,
+                                   frame_callback_destroy_resource);
+    wl_list_insert(surface->pending.frame_callback_list.prev,
+                   wl_resource_get_link(callback_resource));
+}
+
+static void
+surface_set_opaque_region(struct wl_client *client, struct wl_resource *resource,
+                          struct wl_resource *region_resource)
+{
+    (void)client;
+    struct wl_surface_impl *surface = wl_resource_get_user_data(resource);
+    region_copy_from_resource(&surface->pending.opaque, region_resource);
+    surface->pending.committed |= WL_SURFACE_STATE_OPAQUE_REGION;
+}
+
+static void
+surface_set_input_region(struct wl_client *client, struct wl_resource *resource,
+                         struct wl_resource *region_resource)
+{
+    (void)client;
+    struct wl_surface_impl *surface = wl_resource_get_user_data(resource);
+    if (region_resource) {
+        region_copy_from_resource(&surface->pending.input, region_resource);
+    } else {
+        region_set_infinite(&surface->pending.input);
+    }
+    surface->pending.committed |= WL_SURFACE_STATE_INPUT_REGION;
+}
+
+static void
+surface_commit(struct wl_client *client, struct wl_resource *resource)
+{
+    (void)client;
+    struct wl_surface_impl *surface = wl_resource_get_user_data(resource);
+    TRACE_SCOPE("surface_commit");
+
+    if (!surface_check_viewport(surface)) {
+        return;
+    }
+    surface_commit_pending(surface);
+}
+
+static void
+surface_set_buffer_transform(struct wl_client *client, struct wl_resource *resource,
+                             int32_t transform)
+{
+    (void)client;
+    struct wl_surface_impl *surface = wl_resource_get_user_data(resource);
+
+    if (transform < WL_OUTPUT_TRANSFORM_NORMAL || transform > WL_OUTPUT_TRANSFORM_FLIPPED_270) {
+        wl_resource_post_error(resource, WL_SURFACE_ERROR_INVALID_TRANSFORM,
+                               "buffer transform must be a valid transform ('%d' specified)",
+                               transform);
+        return;
+    }
+    surface->pending.transform = transform;
+    surface->pending.committed |= WL_SURFACE_STATE_TRANSFORM;
+}
+
+static void
+surface_set_buffer_scale(struct wl_client *client, struct wl_resource *resource, int32_t scale)
+{
+    (void)client;
+    struct wl_surface_impl *surface = wl_resource_get_user_data(resource);
+
+    if (scale < 1) {
+        wl_resource_post_error(resource, WL_SURFACE_ERROR_INVALID_SCALE,
+                               "buffer scale must be at least one (%d specified)", scale);
+        return;
+    }
+    surface->pending.scale = scale;
+    surface->pending.committed |= WL_SURFACE_STATE_SCALE;
+}
+
+static void
+surface_damage_buffer(struct wl_client *client, struct wl_resource *resource,
+                      int32_t x, int32_t y, int32_t width, int32_t height)
+{
+    (void)client;
+    struct wl_surface_impl *surface = wl_resource_get_user_data(resource);
+
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    pixman_region32_union_rect(&surface->pending.damage_buffer,
+                               &surface->pending.damage_buffer, x, y,
+                               (unsigned int)width, (unsigned int)height);
+}
+
+static const struct wl_surface_interface surface_interface = {
+    surface_destroy,
+    surface_attach,
+    surface_damage,
+    surface_frame,
+    surface_set_opaque_region,
+    surface_set_input_region,
+    surface_commit,
+    surface_set_buffer_transform,
+    surface_set_buffer_scale,
+    surface_damage_buffer,
+};
+
+static void
+surface_destroy_resource(struct wl_resource *resource)
+{
+    struct wl_surface_impl *surface = wl_resource_get_user_data(resource);
+
+    // Leave the surface tree: its own subsurface role and its children become
+    // inert, which unmaps them
+    wl_subsurface_handle_surface_destroy(surface);
+    wl_viewport_handle_surface_destroy(surface);
+    wp_fractional_scale_handle_surface_destroy(surface);
+
+    // Unlink from the registry first so renderFrame cannot pick the surface up
+    // again once the renderer has dropped it; the draw list is rebuilt
+    // without it in the same step
+    pthread_rwlock_wrlock(&g_surface_lock);
+    surface_index_remove_locked(surface);
+    if (surface->prev) {
+        surface->prev->next = surface->next;
+    } else {
+        g_surface_list = surface->next;
+    }
+    if (surface->next) {
+        surface->next->prev = surface->prev;
+    }
+    surface->next = NULL;
+    surface->prev = NULL;
+    draw_list_rebuild_locked();
+    pthread_rwlock_unlock(&g_surface_lock);
+
+    wl_list_remove(&surface->frame_callback_link);
+    struct wl_resource *cb, *cb_tmp;
+    wl_resource_for_each_safe(cb, cb_tmp, &surface->frame_callback_list) {
+        wl_resource_destroy(cb);
+    }
+    surface_discard_presentation_feedback(&surface->presentation_feedback_list);
+
+    // CRITICAL: The renderer must drop this surface before we free it
+    // (must not hold the registry lock: the backend may wait for its render
+    // thread)
+    if (g_compositor && g_compositor->surface_destroyed) {
+        g_compositor->surface_destroyed(surface);
+    }
+
+    wl_list_remove(&surface->buffer_destroy_listener.link);
+    surface_state_fini(&surface->pending);
+    surface_state_fini(&surface->cached);
+    pixman_region32_fini(&surface->damage);
+    pixman_region32_fini(&surface->opaque_region);
+    pixman_region32_fini(&surface->input_region);
+    free(surface);
+}
+
+// --- Compositor Implementation ---
+
+static void
+compositor_create_surface(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct wl_surface_impl *surface = calloc(1, sizeof(struct wl_surface_impl));
+    if (!surface) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    surface->resource = wl_resource_create(client, &wl_surface_interface,
+                                           wl_resource_get_version(resource), id);
+    if (!surface->resource) {
+        free(surface);
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    surface->buffer_scale = 1;
+    surface->buffer_transform = WL_OUTPUT_TRANSFORM_NORMAL;
+    surface->buffer_destroy_listener.notify = surface_handle_buffer_destroy;
+    wl_list_init(&surface->buffer_destroy_listener.link);
+    pixman_region32_init(&surface->damage);
+    pixman_region32_init(&surface->opaque_region);
+    pixman_region32_init(&surface->input_region);
+    region_set_infinite(&surface->input_region);
+    surface_state_init(&surface->pending);
+    surface_state_init(&surface->cached);
+    wl_list_init(&surface->frame_callback_list);
+    wl_list_init(&surface->frame_callback_link);
+    wl_list_init(&surface->presentation_feedback_list);
+    wl_list_init(&surface->subsurfaces_below);
+    wl_list_init(&surface->subsurfaces_above);
+    wl_list_init(&surface->subsurfaces_pending_below);
+    wl_list_init(&surface->subsurfaces_pending_above);
+
+    wl_resource_set_implementation(surface->resource, &surface_interface, surface,
+                                   surface_destroy_resource);
+
+    // Add to registry
+    pthread_rwlock_wrlock(&g_surface_lock);
+    surface->id = g_next_surface_id++;
+    bool indexed = surface_index_insert_locked(surface);
+    surface->prev = NULL;
+    surface->next = g_surface_list;
+    if (g_surface_list) {
+        g_surface_list->prev = surface;
+    }
+    g_surface_list = surface;
+    pthread_rwlock_unlock(&g_surface_lock);
+    if (!indexed) {
+        // Listed all the same, so the destructor unlinks it as usual
+        wl_resource_post_no_memory(resource);
+    }
+}
+
+static void
+compositor_create_region(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct wl_region_impl *region = calloc(1, sizeof(struct wl_region_impl));
+    if (!region) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    region->resource = wl_resource_create(client, &wl_region_interface,
+                                          wl_resource_get_version(resource), id);
+    if (!region->resource) {
+        free(region);
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    wl_resource_set_implementation(region->resource, &region_interface, region,
+                                   region_destroy_resource);
+}
+
+static const struct wl_compositor_interface compositor_interface = {
+    compositor_create_surface,
+    compositor_create_region,
+};
+
+static void
+compositor_bind(struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+    struct wl_compositor_impl *compositor = data;
+
+    if (!WawonaSettings_GetMultipleClientsEnabled() && compositor->client_count > 0) {
+        log_printf("[COMPOSITOR] ",
+                   "🚫 Additional client connection rejected: multiple clients disabled\n");
+        wl_client_destroy(client);
+        return;
+    }
+
+    struct wl_resource *resource =
+        wl_resource_create(client, &wl_compositor_interface, (int)version, id);
+    if (!resource) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &compositor_interface, compositor,
+                                   compositor_destroy_bound_resource);
+    compositor->client_count++;
+    if (compositor->client_connected) {
+        compositor->client_connected();
+    }
+}
+
+// --- Public API ---
+
+struct wl_compositor_impl *
+wl_compositor_create(struct wl_display *display)
+{
+    struct wl_compositor_impl *compositor = calloc(1, sizeof(struct wl_compositor_impl));
+    if (!compositor) {
+        return NULL;
+    }
+
+    compositor->display = display;
+    compositor->global = wl_global_create(display, &wl_compositor_interface, 4,
+                                          compositor, compositor_bind);
+    if (!compositor->global) {
+        free(compositor);
+        return NULL;
+    }
+
+    wl_list_init(&g_frame_callback_surfaces);
+    g_compositor = compositor;
+    return compositor;
+}
+
+void
+wl_compositor_destroy(struct wl_compositor_impl *compositor)
+{
+    if (!compositor) {
+        return;
+    }
+    if (g_compositor == compositor) {
+        g_compositor = NULL;
+    }
+    wl_global_destroy(compositor->global);
+    free(compositor);
+
+    pthread_rwlock_wrlock(&g_surface_lock);
+    for (int i = 0; i < g_draw_list_capacity; i++) {
+        pixman_region32_fini(&g_draw_list[i].opaque);
+        pixman_region32_fini(&g_draw_list[i].input);
+    }
+    free(g_draw_list);
+    g_draw_list = NULL;
+    g_draw_list_count = 0;
+    g_draw_list_capacity = 0;
+    if (g_surface_index_count == 0) {
+        // Surfaces of clients still connected keep it until they go
+        free(g_surface_index);
+        g_surface_index = NULL;
+        g_surface_index_mask = 0;
+    }
+    pthread_rwlock_unlock(&g_surface_lock);
+}
+
+void
+wl_compositor_set_render_callback(struct wl_compositor_impl *compositor,
+                                  wl_surface_render_callback_t callback)
+{
+    if (compositor) {
+        compositor->render_callback = callback;
+    }
+}
+
+void
+wl_compositor_set_title_update_callback(struct wl_compositor_impl *compositor,
+                                        wl_title_update_callback_t callback)
+{
+    if (compositor) {
+        compositor->update_title_callback = callback;
+    }
+}
+
+void
+wl_compositor_set_frame_callback_requested(struct wl_compositor_impl *compositor,
+                                           wl_frame_callback_requested_t callback)
+{
+    if (compositor) {
+        compositor->frame_callback_requested = callback;
+    }
+}
+
+void
+wl_compositor_set_frame_presented_callback(struct wl_compositor_impl *compositor,
+                                           wl_frame_presented_callback_t callback)
+{
+    if (compositor) {
+        compositor->frame_presented = callback;
+    }
+}
+
+void
+wl_compositor_set_surface_destroyed_callback(struct wl_compositor_impl *compositor,
+                                             wl_surface_destroyed_callback_t callback)
+{
+    if (compositor) {
+        compositor->surface_destroyed = callback;
+    }
+}
+
+void
+wl_compositor_set_client_callbacks(struct wl_compositor_impl *compositor,
+                                   wl_client_count_callback_t connected,
+                                   wl_client_count_callback_t disconnected)
+{
+    if (compositor) {
+        compositor->client_connected = connected;
+        compositor->client_disconnected = disconnected;
+    }
+}
+
+void
+wl_compositor_set_buffer_size_query(struct wl_compositor_impl *compositor,
+                                    wl_buffer_size_query_t query)
+{
+    if (compositor) {
+        compositor->query_buffer_size = query;
+    }
+}
+
+void
+wl_compositor_set_frame_scheduler(struct wl_compositor_impl *compositor,
+                                  struct frame_scheduler *scheduler)
+{
+    if (compositor) {
+        compositor->frame_scheduler = scheduler;
+    }
+}
+
+void
+wl_compositor_set_seat(struct wl_seat_impl *seat)
+{
+    (void)seat;
+}
+
+void
+wl_compositor_for_each_surface(wl_surface_iterator_func_t iterator, void *data)
+{
+    pthread_rwlock_rdlock(&g_surface_lock);
+    struct wl_surface_impl *s = g_surface_list;
+    while (s) {
+        iterator(s, data);
+        s = s->next;
+    }
+    pthread_rwlock_unlock(&g_surface_lock);
+}
+
+// Readers only: surfaces are created and destroyed on the event thread, which
+// takes the lock for writing. Do not call Wayland request handlers (or
+// anything that waits on the event thread) while holding it.
+void
+wl_compositor_lock_surfaces(void)
+{
+    pthread_rwlock_rdlock(&g_surface_lock);
+}
+
+void
+wl_compositor_unlock_surfaces(void)
+{
+    pthread_rwlock_unlock(&g_surface_lock);
+}
+
+struct wl_surface_impl *
+wl_surface_from_resource(struct wl_resource *resource)
+{
+    if (wl_resource_instance_of(resource, &wl_surface_interface, &surface_interface)) {
+        return wl_resource_get_user_data(resource);
+    }
+    return NULL;
+}
+
+void
+wl_surface_damage(struct wl_surface_impl *surface, int32_t x, int32_t y,
+                  int32_t width, int32_t height)
+{
+    // Internal damage (surface coordinates)
+    if (!surface || width <= 0 || height <= 0) {
+        return;
+    }
+    pixman_region32_union_rect(&surface->pending.damage_surface,
+                               &surface->pending.damage_surface, x, y,
+                               (unsigned int)width, (unsigned int)height);
+}
+
+void
+wl_surface_commit(struct wl_surface_impl *surface)
+{
+    // Internal commit
+    surface_commit_pending(surface);
+}
+
+bool
+wl_surface_is_synchronized(struct wl_surface_impl *surface)
+{
+    return surface_is_synchronized(surface);
+}
+
+void
+wl_surface_apply_cached(struct wl_surface_impl *surface)
+{
+    if (!surface || !surface->subsurface || !surface->subsurface->has_cache) {
+        return;
+    }
+    surface->subsurface->has_cache = false;
+    surface_commit_state(surface, &surface->cached);
+}
+
+void
+wl_compositor_get_draw_list(struct wl_surface_draw_list *list)
+{
+    list->entries = g_draw_list;
+    list->count = g_draw_list_count;
+    list->generation = atomic_load(&g_draw_list_generation);
+}
+
+uint32_t
+wl_compositor_get_draw_list_generation(void)
+{
+    return atomic_load(&g_draw_list_generation);
+}
+
+void
+wl_compositor_update_draw_list(void)
+{
+    g_draw_list_dirty = true;
+    draw_list_update();
+}
+
+const pixman_region32_t *
+wl_surface_get_buffer_damage(struct wl_surface_impl *surface)
+{
+    return surface ? &surface->damage : NULL;
+}
+
+void
+wl_surface_clear_buffer_damage(struct wl_surface_impl *surface)
+{
+    if (surface) {
+        pixman_region32_clear(&surface->damage);
+    }
+}
+
+void
+wl_surface_attach_buffer(struct wl_surface_impl *surface, struct wl_resource *buffer)
+{
+    surface_state_set_buffer(&surface->pending, buffer);
+    surface->pending.committed |= WL_SURFACE_STATE_BUFFER;
+}
+
+void *
+wl_buffer_get_shm_data(struct wl_resource *buffer, int32_t *width, int32_t *height,
+                       int32_t *stride)
+{
+    struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(buffer);
+    if (!shm_buffer) {
+        return NULL;
+    }
+
+    if (width) {
+        *width = wl_shm_buffer_get_width(shm_buffer);
+    }
+    if (height) {
+        *height = wl_shm_buffer_get_height(shm_buffer);
+    }
+    if (stride) {
+        *stride = wl_shm_buffer_get_stride(shm_buffer);
+    }
+
+    wl_shm_buffer_begin_access(shm_buffer);
+    return wl_shm_buffer_get_data(shm_buffer);
+}
+
+void
+wl_buffer_end_shm_access(struct wl_resource *buffer)
+{
+    struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(buffer);
+    if (shm_buffer) {
+        wl_shm_buffer_end_access(shm_buffer);
+    }
+}
+
+struct wl_surface_impl *
+wl_get_all_surfaces(void)
+{
+    return g_surface_list;
+}
+
+struct wl_surface_impl *
+wl_surface_from_id(uint64_t id)
+{
+    if (id == 0 || !g_surface_index) {
+        return NULL;
+    }
+    for (size_t slot = surface_index_slot(id); g_surface_index[slot];
+         slot = (slot + 1) & g_surface_index_mask) {
+        if (g_surface_index[slot]->id == id) {
+            return g_surface_index[slot];
+        }
+    }
+    return NULL;
+}
+
+// --- Frame callbacks and presentation feedback ---
+
+// Presentation of output frame frame_seq, or of the first frame after it if
+// it was dropped (its content stayed on screen until then). Returns false
+// while no such frame has been presented yet.
+static bool
+lookup_presented_frame(uint64_t frame_seq, struct presented_frame *out)
+{
+    bool found = false;
+    pthread_mutex_lock(&g_presented_frame_lock);
+    for (unsigned int i = 0; i < PRESENTED_FRAME_HISTORY; i++) {
+        const struct presented_frame *frame = &g_presented_frames[i];
+        if (frame->seq >= frame_seq && (!found || frame->seq < out->seq)) {
+            *out = *frame;
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&g_presented_frame_lock);
+    return found;
+}
+
+// Send presentation feedback whose frame has reached the display
+static int
+surface_send_presentation_feedback(struct wl_surface_impl *surface, uint32_t refresh_ns)
+{
+    int count = 0;
+    uint64_t composited_frame;
+    uint32_t presented_seq = surface_presented_seq(surface, &composited_frame);
+    struct wp_presentation_feedback_impl *feedback, *tmp;
+    wl_list_for_each_safe(feedback, tmp, &surface->presentation_feedback_list, link) {
+        if (feedback->frame_seq == 0) {
+            // Later updates are not composited before this one, so stop here
+            if ((int32_t)(presented_seq - feedback->commit_seq) < 0) {
+                break;
+            }
+            feedback->frame_seq = composited_frame;
+        }
+
+        struct presented_frame frame;
+        if (!lookup_presented_frame(feedback->frame_seq, &frame)) {
+            break;
+        }
+        wp_presentation_feedback_presented(feedback, frame.present_ns, refresh_ns,
+                                           frame.seq, frame.flags);
+        count++;
+    }
+    return count;
+}
+
+int
+wl_send_frame_callbacks(void)
+{
+    if (!g_compositor || wl_list_empty(&g_frame_callback_surfaces)) {
+        return 0;
+    }
+    TRACE_SCOPE("wl_send_frame_callbacks");
+
+    // Timestamp of the last presented frame (milliseconds, CLOCK_MONOTONIC)
+    uint64_t present_ns = atomic_load(&g_last_present_ns);
+    if (present_ns == 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        present_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    }
+    uint32_t time = (uint32_t)(present_ns / 1000000ull);
+    uint32_t refresh_ns = 0;
+    if (g_compositor->frame_scheduler) {
+        refresh_ns = (uint32_t)frame_scheduler_get_refresh_ns(g_compositor->frame_scheduler);
+    }
+
+    // Only surfaces in the pending set are visited
+    int count = 0;
+    struct wl_surface_impl *surface, *tmp;
+    wl_list_for_each_safe(surface, tmp, &g_frame_callback_surfaces, frame_callback_link) {
+        // Not composited yet (hidden, occluded or still rendering): keep waiting
+        uint32_t presented_seq =
+            atomic_load_explicit(&surface->presented_seq, memory_order_acquire);
+        if ((int32_t)(presented_seq - surface->frame_callback_seq) >= 0) {
+            if (!wl_list_empty(&surface->frame_callback_list)) {
+                TRACE_FLOW_END("commit",
+                               wl_surface_trace_flow_id(surface, surface->frame_callback_seq));
+            }
+            struct wl_resource *cb, *cb_tmp;
+            wl_resource_for_each_safe(cb, cb_tmp, &surface->frame_callback_list) {
+                // Send frame callback done event (destroy unlinks it from the list)
+                wl_callback_send_done(cb, time);
+                wl_resource_destroy(cb);
+                count++;
+            }
+        }
+
+        count += surface_send_presentation_feedback(surface, refresh_ns);
+
+        if (wl_list_empty(&surface->frame_callback_list) &&
+            wl_list_empty(&surface->presentation_feedback_list)) {
+            wl_list_remove(&surface->frame_callback_link);
+            wl_list_init(&surface->frame_callback_link);
+        }
+    }
+    TRACE_COUNTER("frame_callbacks_sent", count);
+    return count;
+}
+
+uint64_t
+wl_compositor_begin_frame(void)
+{
+    return atomic_fetch_add(&g_frame_seq, 1) + 1;
+}
+
+void
+wl_surface_mark_composited(struct wl_surface_impl *surface)
+{
+    if (surface && atomic_load_explicit(&surface->presented_seq, memory_order_relaxed) !=
+                       surface->rendered_seq) {
+        // The frame first, so a reader that sees the commit sees its frame
+        uint64_t frame_seq = atomic_load(&g_frame_seq);
+        atomic_store_explicit(&surface->composited_frame, frame_seq, memory_order_relaxed);
+        atomic_store_explicit(&surface->presented_seq, surface->rendered_seq,
+                              memory_order_release);
+        atomic_store(&g_composited_frame_pending, frame_seq);
+    }
+}
+
+void
+wl_compositor_frame_presented(uint64_t frame_seq, const struct timespec *when, uint32_t flags)
+{
+    struct timespec now;
+    if (!when) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        when = &now;
+    }
+    uint64_t when_ns = (uint64_t)when->tv_sec * 1000000000ull + (uint64_t)when->tv_nsec;
+    atomic_store(&g_last_present_ns, when_ns);
+
+    pthread_mutex_lock(&g_presented_frame_lock);
+    struct presented_frame *frame = &g_presented_frames[g_presented_frame_next];
+    frame->seq = frame_seq;
+    frame->present_ns = when_ns;
+    frame->flags = flags;
+    g_presented_frame_next = (g_presented_frame_next + 1) % PRESENTED_FRAME_HISTORY;
+    pthread_mutex_unlock(&g_presented_frame_lock);
+
+    // Frame callbacks and feedback waiting for new commits can go out now.
+    // A newer frame compositing meanwhile keeps the notification for itself.
+    uint64_t composited = atomic_load(&g_composited_frame_pending);
+    if (composited != 0 && frame_seq >= composited &&
+        atomic_compare_exchange_strong(&g_composited_frame_pending, &composited, 0) &&
+        g_compositor && g_compositor->frame_presented) {
+        g_compositor->frame_presented();
+    }
+}
+
+bool
+wl_has_pending_frame_callbacks(void)
+{
+    return g_compositor && !wl_list_empty(&g_frame_callback_surfaces);
+}
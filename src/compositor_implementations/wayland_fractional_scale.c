@@ -0,0 +1,157 @@
+#include "wayland_fractional_scale.h"
+#include "fractional-scale-protocol.h"
+#include "wayland_output.h"
+#include "WawonaCompositor.h"
+#include "logging.h"
+#include <math.h>
+#include <stdlib.h>
+
+// wp_fractional_scale_v1.preferred_scale is in 1/120ths
+#define FRACTIONAL_SCALE_DENOMINATOR 120.0
+
+static uint32_t
+preferred_scale(const struct wp_fractional_scale_manager_impl *manager)
+{
+    double scale = manager->output ? manager->output->scale_factor : 1.0;
+    return (uint32_t)lround((scale > 1.0 ? scale : 1.0) * FRACTIONAL_SCALE_DENOMINATOR);
+}
+
+static void
+fractional_scale_destroy_resource(struct wl_resource *resource)
+{
+    struct wp_fractional_scale_impl *object = wl_resource_get_user_data(resource);
+    if (!object) {
+        return;
+    }
+    if (object->surface) {
+        object->surface->fractional_scale = NULL;
+    }
+    wl_list_remove(&object->link);
+    free(object);
+}
+
+static void
+fractional_scale_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+    (void)client;
+    wl_resource_destroy(resource);
+}
+
+static const struct wp_fractional_scale_v1_interface fractional_scale_interface = {
+    .destroy = fractional_scale_destroy,
+};
+
+static void
+manager_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+    (void)client;
+    wl_resource_destroy(resource);
+}
+
+static void
+manager_get_fractional_scale(struct wl_client *client, struct wl_resource *resource, uint32_t id,
+                             struct wl_resource *surface_resource)
+{
+    struct wp_fractional_scale_manager_impl *manager = wl_resource_get_user_data(resource);
+    struct wl_surface_impl *surface = wl_surface_from_resource(surface_resource);
+    if (!surface) {
+        return;
+    }
+    if (surface->fractional_scale) {
+        wl_resource_post_error(resource, WP_FRACTIONAL_SCALE_MANAGER_V1_ERROR_FRACTIONAL_SCALE_EXISTS,
+                               "wl_surface@%u already has a fractional scale object",
+                               wl_resource_get_id(surface_resource));
+        return;
+    }
+
+    struct wp_fractional_scale_impl *object = calloc(1, sizeof(struct wp_fractional_scale_impl));
+    if (!object) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    object->resource = wl_resource_create(client, &wp_fractional_scale_v1_interface,
+                                          wl_resource_get_version(resource), id);
+    if (!object->resource) {
+        free(object);
+        wl_client_post_no_memory(client);
+        return;
+    }
+    object->surface = surface;
+    surface->fractional_scale = object;
+    wl_list_insert(&manager->objects, &object->link);
+    wl_resource_set_implementation(object->resource, &fractional_scale_interface, object,
+                                   fractional_scale_destroy_resource);
+
+    // There is one output and every surface is on it, so the scale is known
+    // right away: clients can size their first buffer with it
+    wp_fractional_scale_v1_send_preferred_scale(object->resource, preferred_scale(manager));
+}
+
+static const struct wp_fractional_scale_manager_v1_interface manager_interface = {
+    .destroy = manager_destroy,
+    .get_fractional_scale = manager_get_fractional_scale,
+};
+
+static void
+handle_output_scale(struct wl_listener *listener, void *data)
+{
+    (void)data;
+    struct wp_fractional_scale_manager_impl *manager =
+        wl_container_of(listener, manager, output_scale);
+    uint32_t scale = preferred_scale(manager);
+    log_debug("[FRACTIONAL_SCALE] ", "Preferred scale is now %u/120\n", scale);
+
+    struct wp_fractional_scale_impl *object;
+    wl_list_for_each(object, &manager->objects, link) {
+        if (object->surface) {
+            wp_fractional_scale_v1_send_preferred_scale(object->resource, scale);
+        }
+    }
+}
+
+static void
+bind_manager(struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+    struct wp_fractional_scale_manager_impl *manager = data;
+    struct wl_resource *resource =
+        wl_resource_create(client, &wp_fractional_scale_manager_v1_interface, (int)version, id);
+    if (!resource) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(resource, &manager_interface, manager, NULL);
+}
+
+struct wp_fractional_scale_manager_impl *
+wp_fractional_scale_manager_create(struct wl_display *display, struct wl_output_impl *output)
+{
+    struct wp_fractional_scale_manager_impl *manager =
+        calloc(1, sizeof(struct wp_fractional_scale_manager_impl));
+    if (!manager) return NULL;
+
+    manager->display = display;
+    manager->output = output;
+    wl_list_init(&manager->objects);
+    manager->global = wl_global_create(display, &wp_fractional_scale_manager_v1_interface, 1,
+                                       manager, bind_manager);
+    if (!manager->global) {
+        free(manager);
+        return NULL;
+    }
+    if (output) {
+        manager->output_scale.notify = handle_output_scale;
+        wl_signal_add(&output->scale_signal, &manager->output_scale);
+    }
+    return manager;
+}
+
+void
+wp_fractional_scale_handle_surface_destroy(struct wl_surface_impl *surface)
+{
+    struct wp_fractional_scale_impl *object = surface->fractional_scale;
+    if (object) {
+        object->surface = NULL;
+        surface->fractional_scale = NULL;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <wayland-server.h>
+
+struct wl_output_impl;
+struct wl_surface_impl;
+
+// wp_fractional_scale_manager_v1
+// Tells clients the output's exact scale factor (wl_output_impl::scale_factor)
+// so that on 1.5x or 1.75x displays they render buffers at the native pixel
+// size and map them onto the surface with wp_viewport.set_destination,
+// instead of rendering at the next integer scale for us to downsample.
+struct wp_fractional_scale_manager_impl {
+    struct wl_global *global;
+    struct wl_display *display;
+    struct wl_output_impl *output;     // Source of the preferred scale
+    struct wl_listener output_scale;   // wl_output_impl::scale_signal
+    struct wl_list objects;            // struct wp_fractional_scale_impl::link
+};
+
+// wp_fractional_scale_v1 of a surface
+struct wp_fractional_scale_impl {
+    struct wl_resource *resource;
+    struct wl_surface_impl *surface;  // NULL once the wl_surface is destroyed
+    struct wl_list link;              // wp_fractional_scale_manager_impl::objects
+};
+
+struct wp_fractional_scale_manager_impl *wp_fractional_scale_manager_create(struct wl_display *display,
+                                                                          struct wl_output_impl *output);
+
+// Called by wayland_compositor.c before a surface is freed: its
+// wp_fractional_scale_v1 becomes inert and may be created again
+void wp_fractional_scale_handle_surface_destroy(struct wl_surface_impl *surface);
@@ -1,10 +1,20 @@
 #include "wayland_linux_dmabuf.h"
 #include "protocols/linux-dmabuf-unstable-v1-protocol.h"
 #include "metal_dmabuf.h"
+#include "logging.h"
+#include "pixel_convert.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <assert.h>
+#include "compat/macos/stubs/libinput-macos/posix-compat.h"
 
 struct params {
     struct wl_resource *resource;
@@ -13,13 +23,50 @@ struct params {
     uint32_t format;
     uint32_t flags;
     
-    int fd[4];
-    uint32_t offset[4];
-    uint32_t stride[4];
-    uint64_t modifier[4];
+    int fd[METAL_DMABUF_MAX_PLANES];
+    uint32_t offset[METAL_DMABUF_MAX_PLANES];
+    uint32_t stride[METAL_DMABUF_MAX_PLANES];
+    uint64_t modifier[METAL_DMABUF_MAX_PLANES];
     int n_planes;
+    bool used;  // create or create_immed was called
 };
 
+// Formats advertised to clients, all linear. Chroma planes of the YUV
+// formats are subsampled by 2 in both directions; the renderers sample
+// them directly (Metal shader) or convert on the CPU (pixel_convert.h).
+struct dmabuf_format {
+    uint32_t format;
+    uint32_t n_planes;
+    uint32_t bytes_per_pixel[3];  // Per plane, per sample of that plane
+    bool subsampled;
+};
+
+static const struct dmabuf_format dmabuf_formats[] = {
+    {PIXEL_FORMAT_ARGB8888, 1, {4, 0, 0}, false},
+    {PIXEL_FORMAT_XRGB8888, 1, {4, 0, 0}, false},
+    {PIXEL_FORMAT_ARGB2101010, 1, {4, 0, 0}, false},
+    {PIXEL_FORMAT_XRGB2101010, 1, {4, 0, 0}, false},
+    {PIXEL_FORMAT_ABGR2101010, 1, {4, 0, 0}, false},
+    {PIXEL_FORMAT_XBGR2101010, 1, {4, 0, 0}, false},
+    {PIXEL_FORMAT_NV12, 2, {1, 2, 0}, true},
+    {PIXEL_FORMAT_P010, 2, {2, 4, 0}, true},
+    {PIXEL_FORMAT_YUV420, 3, {1, 1, 1}, true},
+};
+
+#define DMABUF_FORMAT_COUNT (sizeof(dmabuf_formats) / sizeof(dmabuf_formats[0]))
+_Static_assert(DMABUF_FORMAT_COUNT <= ZWP_LINUX_DMABUF_V1_MAX_FORMATS, "too many dmabuf formats");
+
+static const struct dmabuf_format *
+dmabuf_format_get(uint32_t format)
+{
+    for (size_t i = 0; i < DMABUF_FORMAT_COUNT; i++) {
+        if (dmabuf_formats[i].format == format) {
+            return &dmabuf_formats[i];
+        }
+    }
+    return NULL;
+}
+
 static void
 buffer_destroy(struct wl_client *client, struct wl_resource *resource)
 {
@@ -51,7 +98,8 @@ params_resource_destroy(struct wl_resource *resource)
     struct params *params = wl_resource_get_user_data(resource);
     int i;
     
-    for (i = 0; i < params->n_planes; i++) {
+    // Planes may have been added out of order, so check every slot
+    for (i = 0; i < METAL_DMABUF_MAX_PLANES; i++) {
         if (params->fd[i] != -1) {
             close(params->fd[i]);
         }
@@ -67,7 +115,14 @@ params_add(struct wl_client *client, struct wl_resource *resource,
     struct params *params = wl_resource_get_user_data(resource);
     uint64_t modifier = ((uint64_t)modifier_hi << 32) | modifier_lo;
 
-    if (plane_idx >= 4) {
+    if (params->used) {
+        wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_ALREADY_USED,
+                               "params already used to create a buffer");
+        close(fd);
+        return;
+    }
+
+    if (plane_idx >= METAL_DMABUF_MAX_PLANES) {
         wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_PLANE_IDX,
                                "plane index %u out of bounds", plane_idx);
         close(fd);
@@ -88,17 +143,86 @@ params_add(struct wl_client *client, struct wl_resource *resource,
     params->n_planes++;
 }
 
+// Check the plane layout against the format, posting the protocol error
+// for the first problem found. Fills planes[] with the per-plane layout.
+static bool
+params_validate(struct params *params, const struct dmabuf_format *info, int32_t width,
+                int32_t height, struct metal_dmabuf_plane *planes)
+{
+    struct wl_resource *resource = params->resource;
+
+    if (width <= 0 || height <= 0) {
+        wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_INVALID_DIMENSIONS,
+                               "invalid size %dx%d", width, height);
+        return false;
+    }
+
+    if ((uint32_t)params->n_planes != info->n_planes) {
+        wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_INCOMPLETE,
+                               "format 0x%08x needs %u planes, got %d", info->format,
+                               info->n_planes, params->n_planes);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < info->n_planes; i++) {
+        if (params->fd[i] == -1) {
+            wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_INCOMPLETE,
+                                   "missing plane %u", i);
+            return false;
+        }
+
+        uint32_t plane_width = (uint32_t)width;
+        uint32_t plane_height = (uint32_t)height;
+        if (i > 0 && info->subsampled) {
+            plane_width = (plane_width + 1) / 2;
+            plane_height = (plane_height + 1) / 2;
+        }
+
+        uint64_t row_bytes = (uint64_t)plane_width * info->bytes_per_pixel[i];
+        uint64_t end = (uint64_t)params->offset[i] +
+                       (uint64_t)params->stride[i] * plane_height;
+        if (params->stride[i] < row_bytes || end > UINT32_MAX) {
+            wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_OUT_OF_BOUNDS,
+                                   "plane %u: offset %u stride %u out of bounds", i,
+                                   params->offset[i], params->stride[i]);
+            return false;
+        }
+
+        // Real dmabufs (and memfds) have a size; the IOSurface sockets used
+        // on Apple platforms do not, and lseek fails on them
+        off_t size = lseek(params->fd[i], 0, SEEK_END);
+        if (size >= 0 && end > (uint64_t)size) {
+            wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_OUT_OF_BOUNDS,
+                                   "plane %u: %llu bytes needed, dmabuf has %lld", i,
+                                   (unsigned long long)end, (long long)size);
+            return false;
+        }
+
+        planes[i].fd = params->fd[i];
+        planes[i].offset = params->offset[i];
+        planes[i].stride = params->stride[i];
+        planes[i].height = plane_height;
+    }
+    return true;
+}
+
 static void
 params_create_common(struct wl_client *client, struct wl_resource *resource,
                      uint32_t buffer_id, int32_t width, int32_t height,
-                     uint32_t format, uint32_t flags)
+                     uint32_t format, uint32_t flags, bool immediate)
 {
     struct params *params = wl_resource_get_user_data(resource);
+    struct metal_dmabuf_plane planes[METAL_DMABUF_MAX_PLANES];
     struct wl_resource *buffer_resource;
     struct metal_dmabuf_buffer *buffer;
-    int fd;
-    uint32_t stride;
-    int import_fd;
+    const struct dmabuf_format *info;
+
+    if (params->used) {
+        wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_ALREADY_USED,
+                               "params already used to create a buffer");
+        return;
+    }
+    params->used = true;
 
     if (params->n_planes == 0) {
         wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_INCOMPLETE,
@@ -106,28 +230,27 @@ params_create_common(struct wl_client *client, struct wl_resource *resource,
         return;
     }
 
-    // Currently only support 1 plane for simplified IOSurface mapping
-    // If multi-planar support is needed, we would need to handle it in metal_dmabuf
-    if (params->n_planes > 1) {
-        printf("Warning: Multi-planar dmabuf not fully supported yet, using plane 0\n");
+    info = dmabuf_format_get(format);
+    if (!info) {
+        wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_INVALID_FORMAT,
+                               "format 0x%08x not supported", format);
+        return;
     }
-    
-    fd = params->fd[0];
-    stride = params->stride[0];
-    
-    // Duplicate FD because import takes ownership or we need to keep it if import fails?
-    // metal_dmabuf_import closes the FD.
-    // So we should duplicate if we want to keep params valid?
-    // But params are destroyed after create usually.
-    // However, if we pass params->fd[0], metal_dmabuf_import closes it.
-    // We should mark it as closed in params to avoid double close in destroy.
-    
-    import_fd = dup(fd);
-    if (import_fd < 0) {
-        goto err_out;
+
+    if (!params_validate(params, info, width, height, planes)) {
+        return;
+    }
+
+    // The import takes ownership of the plane fds
+    for (uint32_t i = 0; i < info->n_planes; i++) {
+        params->fd[i] = -1;
     }
 
-    buffer = metal_dmabuf_import(import_fd, width, height, format, stride);
+    {
+        TRACE_SCOPE("dmabuf_import");
+        buffer = metal_dmabuf_import(planes, info->n_planes, (uint32_t)width, (uint32_t)height,
+                                     format);
+    }
     if (!buffer) {
         goto err_out;
     }
@@ -141,15 +264,17 @@ params_create_common(struct wl_client *client, struct wl_resource *resource,
 
     wl_resource_set_implementation(buffer_resource, &buffer_interface, buffer, buffer_resource_destroy);
 
-    // If create request (not immediate), send success event
-    if (wl_resource_get_version(resource) < ZWP_LINUX_BUFFER_PARAMS_V1_CREATE_IMMED_SINCE_VERSION) {
+    // create (not create_immed) reports the new buffer with an event
+    if (!immediate) {
         zwp_linux_buffer_params_v1_send_created(resource, buffer_resource);
     }
 
     return;
 
 err_out:
-    if (wl_resource_get_version(resource) < ZWP_LINUX_BUFFER_PARAMS_V1_CREATE_IMMED_SINCE_VERSION) {
+    log_warn("[DMABUF] ", "Failed to import %ux%u dmabuf, format 0x%08x, %u planes\n", width,
+             height, format, info->n_planes);
+    if (!immediate) {
         zwp_linux_buffer_params_v1_send_failed(resource);
     } else {
         wl_resource_post_error(resource, ZWP_LINUX_BUFFER_PARAMS_V1_ERROR_INVALID_WL_BUFFER,
@@ -161,7 +286,7 @@ static void
 params_create(struct wl_client *client, struct wl_resource *resource,
               int32_t width, int32_t height, uint32_t format, uint32_t flags)
 {
-    params_create_common(client, resource, 0, width, height, format, flags);
+    params_create_common(client, resource, 0, width, height, format, flags, false);
 }
 
 static void
@@ -169,7 +294,7 @@ params_create_immed(struct wl_client *client, struct wl_resource *resource,
                     uint32_t buffer_id, int32_t width, int32_t height,
                     uint32_t format, uint32_t flags)
 {
-    params_create_common(client, resource, buffer_id, width, height, format, flags);
+    params_create_common(client, resource, buffer_id, width, height, format, flags, true);
 }
 
 static const struct zwp_linux_buffer_params_v1_interface params_interface = {
@@ -198,7 +323,7 @@ dmabuf_create_params(struct wl_client *client, struct wl_resource *resource, uin
         return;
     }
 
-    for (i = 0; i < 4; i++) {
+    for (i = 0; i < METAL_DMABUF_MAX_PLANES; i++) {
         params->fd[i] = -1;
     }
 
@@ -214,18 +339,183 @@ dmabuf_create_params(struct wl_client *client, struct wl_resource *resource, uin
     wl_resource_set_implementation(params_resource, &params_interface, params, params_resource_destroy);
 }
 
+// --- Feedback (v4) ---
+
+// Entry of the format table (layout fixed by the protocol)
+struct dmabuf_format_table_entry {
+    uint32_t format;
+    uint32_t padding;
+    uint64_t modifier;
+};
+
+struct dmabuf_feedback {
+    struct wl_resource *resource;
+    struct wl_list link;  // zwp_linux_dmabuf_v1_impl::feedback_resources
+    bool surface;         // Surface feedback: includes the scanout tranche
+};
+
+// The table of every advertised format with the linear modifier, in a
+// sealed memfd that all clients map. Created once; indices into it are
+// the dmabuf_formats indices.
+static int
+format_table_create(uint32_t *size)
+{
+    struct dmabuf_format_table_entry table[DMABUF_FORMAT_COUNT];
+    memset(table, 0, sizeof(table));
+    for (size_t i = 0; i < DMABUF_FORMAT_COUNT; i++) {
+        table[i].format = dmabuf_formats[i].format;
+        table[i].modifier = 0;  // DRM_FORMAT_MOD_LINEAR
+    }
+
+    int fd = memfd_create("wawona-dmabuf-formats", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        log_error("[DMABUF] ", "Failed to create format table: %s\n", strerror(errno));
+        return -1;
+    }
+    if (write(fd, table, sizeof(table)) != (ssize_t)sizeof(table)) {
+        log_error("[DMABUF] ", "Failed to write format table: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+#ifdef F_ADD_SEALS
+    // Clients map the table read-only; sealing keeps it immutable for them
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+#endif
+    *size = (uint32_t)sizeof(table);
+    return fd;
+}
+
+// The DRM device clients should allocate on. Only meaningful on Linux
+// (headless, Android); IOSurface imports work with any device.
+static dev_t
+dmabuf_find_main_device(void)
+{
+#ifdef __linux__
+    struct stat st;
+    if (stat("/dev/dri/renderD128", &st) == 0 && S_ISCHR(st.st_mode)) {
+        return st.st_rdev;
+    }
+#endif
+    return 0;
+}
+
+static void
+feedback_send_tranche(struct wl_resource *resource, struct wl_array *device, uint32_t flags,
+                      const uint16_t *indices, size_t n_indices)
+{
+    struct wl_array formats;
+    wl_array_init(&formats);
+    uint16_t *out = wl_array_add(&formats, n_indices * sizeof(uint16_t));
+    if (out) {
+        memcpy(out, indices, n_indices * sizeof(uint16_t));
+        zwp_linux_dmabuf_feedback_v1_send_tranche_target_device(resource, device);
+        zwp_linux_dmabuf_feedback_v1_send_tranche_flags(resource, flags);
+        zwp_linux_dmabuf_feedback_v1_send_tranche_formats(resource, &formats);
+        zwp_linux_dmabuf_feedback_v1_send_tranche_done(resource);
+    }
+    wl_array_release(&formats);
+}
+
+// One complete feedback update. Surface feedback lists the formats the
+// backend presents directly (scanout) first; every feedback ends with the
+// composition tranche of all formats the renderer can sample.
+static void
+feedback_send(struct zwp_linux_dmabuf_v1_impl *impl, struct dmabuf_feedback *feedback,
+              bool with_table)
+{
+    struct wl_resource *resource = feedback->resource;
+    struct wl_array device;
+    wl_array_init(&device);
+    dev_t *main_device = wl_array_add(&device, sizeof(dev_t));
+    if (!main_device) {
+        wl_array_release(&device);
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+    *main_device = impl->main_device;
+
+    if (with_table) {
+        zwp_linux_dmabuf_feedback_v1_send_format_table(resource, impl->format_table_fd,
+                                                       impl->format_table_size);
+    }
+    zwp_linux_dmabuf_feedback_v1_send_main_device(resource, &device);
+
+    if (feedback->surface && impl->n_scanout_indices > 0) {
+        feedback_send_tranche(resource, &device, ZWP_LINUX_DMABUF_FEEDBACK_V1_TRANCHE_FLAGS_SCANOUT,
+                              impl->scanout_indices, impl->n_scanout_indices);
+    }
+
+    uint16_t all[DMABUF_FORMAT_COUNT];
+    for (size_t i = 0; i < DMABUF_FORMAT_COUNT; i++) {
+        all[i] = (uint16_t)i;
+    }
+    feedback_send_tranche(resource, &device, 0, all, DMABUF_FORMAT_COUNT);
+
+    zwp_linux_dmabuf_feedback_v1_send_done(resource);
+    wl_array_release(&device);
+}
+
+static void
+feedback_handle_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static const struct zwp_linux_dmabuf_feedback_v1_interface feedback_interface = {
+    .destroy = feedback_handle_destroy,
+};
+
+static void
+feedback_resource_destroy(struct wl_resource *resource)
+{
+    struct dmabuf_feedback *feedback = wl_resource_get_user_data(resource);
+    wl_list_remove(&feedback->link);
+    free(feedback);
+}
+
+static void
+dmabuf_create_feedback(struct wl_client *client, struct wl_resource *resource, uint32_t id,
+                       bool surface)
+{
+    struct zwp_linux_dmabuf_v1_impl *impl = wl_resource_get_user_data(resource);
+    struct dmabuf_feedback *feedback = calloc(1, sizeof(*feedback));
+    if (!feedback) {
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+
+    feedback->resource = wl_resource_create(client, &zwp_linux_dmabuf_feedback_v1_interface,
+                                            wl_resource_get_version(resource), id);
+    if (!feedback->resource) {
+        free(feedback);
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+    feedback->surface = surface;
+    wl_list_insert(&impl->feedback_resources, &feedback->link);
+    wl_resource_set_implementation(feedback->resource, &feedback_interface, feedback,
+                                   feedback_resource_destroy);
+
+    if (impl->format_table_fd < 0) {
+        // Without a table the feedback cannot be described; clients fall
+        // back to trying imports
+        log_warn("[DMABUF] ", "No format table, sending no feedback\n");
+        return;
+    }
+    feedback_send(impl, feedback, true);
+}
+
 static void
 dmabuf_get_default_feedback(struct wl_client *client, struct wl_resource *resource, uint32_t id)
 {
-    // Version 4+ only
-    // Stub or implement if needed
-    // For now, ignore as Waypipe likely uses v3 or handles missing feedback
+    dmabuf_create_feedback(client, resource, id, false);
 }
 
 static void
 dmabuf_get_surface_feedback(struct wl_client *client, struct wl_resource *resource, uint32_t id, struct wl_resource *surface)
 {
-    // Version 4+ only
+    // Same for every surface: the scanout tranche depends on the backend only
+    dmabuf_create_feedback(client, resource, id, true);
 }
 
 static const struct zwp_linux_dmabuf_v1_interface dmabuf_interface = {
@@ -248,30 +538,18 @@ bind_dmabuf(struct wl_client *client, void *data, uint32_t version, uint32_t id)
 
     wl_resource_set_implementation(resource, &dmabuf_interface, data, NULL);
 
-    // Advertise formats
-    // We support ARGB8888 and XRGB8888 (standard Wayland formats)
-    // In drm_fourcc.h:
-    // DRM_FORMAT_ARGB8888 'A', 'R', '2', '4' (little endian) -> 0x34325241
-    // DRM_FORMAT_XRGB8888 'X', 'R', '2', '4' -> 0x34325258
-    // Since we don't include drm_fourcc.h, we can hardcode or include it.
-    // Wayland uses WL_SHM_FORMAT_* which matches DRM_FORMAT_* usually.
-    
-    // WL_SHM_FORMAT_ARGB8888 = 0
-    // WL_SHM_FORMAT_XRGB8888 = 1
-    // Wait, DRM_FORMAT is NOT same as WL_SHM_FORMAT enum values.
-    // WL_SHM_FORMAT_ARGB8888 value IS 'AR24'.
-    
-    // Let's send standard formats.
-    zwp_linux_dmabuf_v1_send_format(resource, 0x34325241); // ARGB8888
-    zwp_linux_dmabuf_v1_send_format(resource, 0x34325258); // XRGB8888
-    
-    // Also send modifiers if version >= 3
-    if (version >= 3) {
-        // DRM_FORMAT_MOD_INVALID = 0x00ffffffffffffffULL
-        // DRM_FORMAT_MOD_LINEAR = 0
-        // We use linear buffers (IOSurface)
-        zwp_linux_dmabuf_v1_send_modifier(resource, 0x34325241, 0, 0);
-        zwp_linux_dmabuf_v1_send_modifier(resource, 0x34325258, 0, 0);
+    // Version 4 clients learn the formats from feedback (format table)
+    if (version >= ZWP_LINUX_DMABUF_V1_GET_DEFAULT_FEEDBACK_SINCE_VERSION) {
+        return;
+    }
+
+    // Advertise formats. Everything is linear (IOSurface, or memory mapped
+    // when headless), so DRM_FORMAT_MOD_LINEAR (0) is the only modifier.
+    for (size_t i = 0; i < DMABUF_FORMAT_COUNT; i++) {
+        zwp_linux_dmabuf_v1_send_format(resource, dmabuf_formats[i].format);
+        if (version >= ZWP_LINUX_DMABUF_V1_MODIFIER_SINCE_VERSION) {
+            zwp_linux_dmabuf_v1_send_modifier(resource, dmabuf_formats[i].format, 0, 0);
+        }
     }
 }
 
@@ -284,9 +562,16 @@ zwp_linux_dmabuf_v1_create(struct wl_display *display)
     if (!impl) return NULL;
 
     impl->display = display;
-    impl->global = wl_global_create(display, &zwp_linux_dmabuf_v1_interface, 3, impl, bind_dmabuf);
+    wl_list_init(&impl->feedback_resources);
+    impl->format_table_fd = format_table_create(&impl->format_table_size);
+    impl->main_device = dmabuf_find_main_device();
+
+    impl->global = wl_global_create(display, &zwp_linux_dmabuf_v1_interface, 4, impl, bind_dmabuf);
     
     if (!impl->global) {
+        if (impl->format_table_fd >= 0) {
+            close(impl->format_table_fd);
+        }
         free(impl);
         return NULL;
     }
@@ -294,6 +579,30 @@ zwp_linux_dmabuf_v1_create(struct wl_display *display)
     return impl;
 }
 
+void
+zwp_linux_dmabuf_v1_set_scanout_formats(struct zwp_linux_dmabuf_v1_impl *impl,
+                                        const uint32_t *formats, int n_formats)
+{
+    impl->n_scanout_indices = 0;
+    for (int i = 0; i < n_formats; i++) {
+        for (size_t j = 0; j < DMABUF_FORMAT_COUNT; j++) {
+            if (dmabuf_formats[j].format == formats[i] &&
+                impl->n_scanout_indices < DMABUF_FORMAT_COUNT) {
+                impl->scanout_indices[impl->n_scanout_indices++] = (uint16_t)j;
+            }
+        }
+    }
+
+    // Existing feedback objects get a full update (the table is unchanged)
+    if (impl->format_table_fd < 0) {
+        return;
+    }
+    struct dmabuf_feedback *feedback;
+    wl_list_for_each(feedback, &impl->feedback_resources, link) {
+        feedback_send(impl, feedback, false);
+    }
+}
+
 // Helpers for renderer to check if buffer is dmabuf
 int
 is_dmabuf_buffer(struct wl_resource *resource)
@@ -1,14 +1,34 @@
 #pragma once
 #include <wayland-server.h>
+#include <sys/types.h>
 #include "metal_dmabuf.h"
 
+// Upper bound on the advertised formats (format table entries)
+#define ZWP_LINUX_DMABUF_V1_MAX_FORMATS 16
+
 struct zwp_linux_dmabuf_v1_impl {
     struct wl_global *global;
     struct wl_display *display;
+
+    // v4 feedback: one format table (sealed memfd) shared by all clients,
+    // and the feedback objects to update when the backend changes
+    int format_table_fd;
+    uint32_t format_table_size;
+    dev_t main_device;
+    uint16_t scanout_indices[ZWP_LINUX_DMABUF_V1_MAX_FORMATS];
+    size_t n_scanout_indices;
+    struct wl_list feedback_resources;
 };
 
 struct zwp_linux_dmabuf_v1_impl *zwp_linux_dmabuf_v1_create(struct wl_display *display);
 
+// Formats the rendering backend presents without compositing them (e.g. as
+// CALayer contents). Surface feedback offers them in a scanout tranche
+// ahead of the composition tranche. Re-sends feedback to every client, so
+// call it on the event thread whenever the backend changes.
+void zwp_linux_dmabuf_v1_set_scanout_formats(struct zwp_linux_dmabuf_v1_impl *impl,
+                                             const uint32_t *formats, int n_formats);
+
 // Check if a buffer resource is a dmabuf buffer
 int is_dmabuf_buffer(struct wl_resource *resource);
 
@@ -1,5 +1,6 @@
 #include "wayland_output.h"
 #include <wayland-server-protocol.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -51,6 +52,13 @@ send_output_mode(struct wl_resource *resource, struct wl_output_impl *output)
                         output->refresh_rate);
 }
 
+// Scales below 1 are not meaningful for a display
+static double
+output_scale_factor(double scale)
+{
+    return scale > 1.0 ? scale : 1.0;
+}
+
 static void
 destroy_output_resource(struct wl_resource *resource)
 {
@@ -95,7 +103,7 @@ bind_output(struct wl_client *client, void *data, uint32_t version, uint32_t id)
 }
 
 struct wl_output_impl *
-wl_output_create(struct wl_display *display, int32_t width, int32_t height, int32_t scale, const char *name)
+wl_output_create(struct wl_display *display, int32_t width, int32_t height, double scale, const char *name)
 {
     struct wl_output_impl *output = calloc(1, sizeof(struct wl_output_impl));
     if (!output) return NULL;
@@ -104,11 +112,13 @@ wl_output_create(struct wl_display *display, int32_t width, int32_t height, int3
     output->width = width;
     output->height = height;
     output->name = name ? strdup(name) : NULL;
-    output->scale = scale > 0 ? scale : 1;
+    output->scale_factor = output_scale_factor(scale);
+    output->scale = (int32_t)ceil(output->scale_factor);
     output->transform = WL_OUTPUT_TRANSFORM_NORMAL;
     output->refresh_rate = 60000; // 60 Hz
     
     wl_list_init(&output->resource_list);
+    wl_signal_init(&output->scale_signal);
 
     // Use version 4 (latest stable) to ensure full protocol support including
     // scale, name, description, and done events needed for arbitrary resolution support
@@ -144,20 +154,25 @@ wl_output_destroy(struct wl_output_impl *output)
 }
 
 void
-wl_output_update_size(struct wl_output_impl *output, int32_t width, int32_t height, int32_t scale)
+wl_output_update_size(struct wl_output_impl *output, int32_t width, int32_t height, double scale)
 {
+    double new_scale_factor;
     int32_t new_scale;
     bool size_changed;
     bool scale_changed;
+    bool scale_factor_changed;
     struct wl_resource *resource;
 
     if (!output) return;
     
-    new_scale = scale > 0 ? scale : 1;
+    new_scale_factor = output_scale_factor(scale);
+    new_scale = (int32_t)ceil(new_scale_factor);
     size_changed = (output->width != width || output->height != height);
     scale_changed = (output->scale != new_scale);
+    scale_factor_changed = (new_scale_factor > output->scale_factor ||
+                            new_scale_factor < output->scale_factor);
     
-    if (!size_changed && !scale_changed) return;
+    if (!size_changed && !scale_factor_changed) return;
 
     // Update output size and notify all clients of the mode change.
     // This dynamic mode change capability is part of what Weston checks
@@ -165,6 +180,7 @@ wl_output_update_size(struct wl_output_impl *output, int32_t width, int32_t heig
     output->width = width;
     output->height = height;
     output->scale = new_scale;
+    output->scale_factor = new_scale_factor;
     wl_resource_for_each(resource, &output->resource_list) {
         // Send geometry update first (in case physical size changed)
         send_output_geometry(resource, output);
@@ -179,4 +195,8 @@ wl_output_update_size(struct wl_output_impl *output, int32_t width, int32_t heig
             wl_output_send_done(resource);
         }
     }
+
+    if (scale_factor_changed) {
+        wl_signal_emit(&output->scale_signal, output);
+    }
 }
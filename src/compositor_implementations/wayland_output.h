@@ -8,7 +8,8 @@ struct wl_output_impl {
     struct wl_display *display;
     
     int32_t width, height;
-    int32_t scale;
+    int32_t scale;              // wl_output.scale: scale_factor rounded up
+    double scale_factor;        // Pixels per surface unit, may be fractional
     int32_t transform;
     int32_t refresh_rate;
     const char *name;
@@ -17,9 +18,15 @@ struct wl_output_impl {
     // List of all wl_output resources bound to this output
     // Used to send mode change events to all clients when output size changes
     struct wl_list resource_list;
+
+    // Emitted with the output after scale_factor changed
+    struct wl_signal scale_signal;
 };
 
-struct wl_output_impl *wl_output_create(struct wl_display *display, int32_t width, int32_t height, int32_t scale, const char *name);
+// scale is the platform's backing scale factor (1.5, 2, 2.625, ...). Clients
+// limited to integer scales get it rounded up and are downsampled; clients
+// using wp_fractional_scale_v1 render at the exact factor.
+struct wl_output_impl *wl_output_create(struct wl_display *display, int32_t width, int32_t height, double scale, const char *name);
 void wl_output_destroy(struct wl_output_impl *output);
-void wl_output_update_size(struct wl_output_impl *output, int32_t width, int32_t height, int32_t scale);
+void wl_output_update_size(struct wl_output_impl *output, int32_t width, int32_t height, double scale);
 
@@ -1,10 +1,136 @@
 #include "wayland_presentation.h"
+#include "presentation-time-protocol.h"
+#include "wayland_output.h"
+#include "WawonaCompositor.h"
 #include <stdlib.h>
 
+// clk_id is interpreted as a Linux clockid_t: clients are Linux programs,
+// usually reaching us through waypipe. Timestamps are CLOCK_MONOTONIC.
+#define WAWONA_PRESENTATION_CLOCK_MONOTONIC 1
+
+static void
+feedback_destroy_resource(struct wl_resource *resource)
+{
+    struct wp_presentation_feedback_impl *feedback = wl_resource_get_user_data(resource);
+    if (!feedback) {
+        return;
+    }
+    wl_list_remove(&feedback->link);
+    free(feedback);
+}
+
+static void
+presentation_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+    (void)client;
+    wl_resource_destroy(resource);
+}
+
+static void
+presentation_feedback(struct wl_client *client, struct wl_resource *resource,
+                      struct wl_resource *surface_resource, uint32_t callback)
+{
+    struct wp_presentation_impl *presentation = wl_resource_get_user_data(resource);
+    struct wl_surface_impl *surface = wl_surface_from_resource(surface_resource);
+
+    struct wp_presentation_feedback_impl *feedback = calloc(1, sizeof(struct wp_presentation_feedback_impl));
+    if (!feedback) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    feedback->resource = wl_resource_create(client, &wp_presentation_feedback_interface,
+                                            wl_resource_get_version(resource), callback);
+    if (!feedback->resource) {
+        free(feedback);
+        wl_client_post_no_memory(client);
+        return;
+    }
+    feedback->presentation = presentation;
+    wl_list_init(&feedback->link);
+    // No requests; the destructor unlinks it from whichever list holds it
+    wl_resource_set_implementation(feedback->resource, NULL, feedback, feedback_destroy_resource);
+
+    if (!surface) {
+        wp_presentation_feedback_discarded(feedback);
+        return;
+    }
+
+    // Belongs to the content update of the next wl_surface.commit
+    wl_list_insert(surface->pending.presentation_feedback_list.prev, &feedback->link);
+}
+
+static const struct wp_presentation_interface presentation_interface = {
+    .destroy = presentation_destroy,
+    .feedback = presentation_feedback,
+};
+
+static void
+bind_presentation(struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+    struct wp_presentation_impl *presentation = data;
+    struct wl_resource *resource = wl_resource_create(client, &wp_presentation_interface, (int)version, id);
+    if (!resource) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(resource, &presentation_interface, presentation, NULL);
+    wp_presentation_send_clock_id(resource, WAWONA_PRESENTATION_CLOCK_MONOTONIC);
+}
+
 struct wp_presentation_impl *
-wp_presentation_create(struct wl_display *display)
+wp_presentation_create(struct wl_display *display, struct wl_output_impl *output)
+{
+    struct wp_presentation_impl *presentation = calloc(1, sizeof(struct wp_presentation_impl));
+    if (!presentation) {
+        return NULL;
+    }
+
+    presentation->display = display;
+    presentation->output = output;
+    presentation->global = wl_global_create(display, &wp_presentation_interface, 2,
+                                            presentation, bind_presentation);
+    if (!presentation->global) {
+        free(presentation);
+        return NULL;
+    }
+    return presentation;
+}
+
+void
+wp_presentation_feedback_presented(struct wp_presentation_feedback_impl *feedback,
+                                   uint64_t present_ns, uint32_t refresh_ns,
+                                   uint64_t seq, uint32_t flags)
+{
+    struct wl_resource *resource = feedback->resource;
+
+    // The client's wl_output objects for the output the update was shown on
+    struct wl_output_impl *output = feedback->presentation ? feedback->presentation->output : NULL;
+    if (output) {
+        struct wl_client *client = wl_resource_get_client(resource);
+        struct wl_resource *output_resource;
+        wl_resource_for_each(output_resource, &output->resource_list) {
+            if (wl_resource_get_client(output_resource) == client) {
+                wp_presentation_feedback_send_sync_output(resource, output_resource);
+            }
+        }
+    }
+
+    uint64_t sec = present_ns / 1000000000ull;
+    wp_presentation_feedback_send_presented(resource,
+                                            (uint32_t)(sec >> 32), (uint32_t)sec,
+                                            (uint32_t)(present_ns % 1000000000ull),
+                                            refresh_ns,
+                                            (uint32_t)(seq >> 32), (uint32_t)seq,
+                                            flags);
+    wl_resource_destroy(resource);
+}
+
+void
+wp_presentation_feedback_discarded(struct wp_presentation_feedback_impl *feedback)
 {
-    (void)display;
-    // Stub
-    return NULL;
+    struct wl_resource *resource = feedback->resource;
+    wp_presentation_feedback_send_discarded(resource);
+    wl_resource_destroy(resource);
 }
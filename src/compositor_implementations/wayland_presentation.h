@@ -1,9 +1,30 @@
 #pragma once
+#include <stdint.h>
 #include <wayland-server.h>
 
+struct wl_output_impl;
+
 struct wp_presentation_impl {
     struct wl_global *global;
     struct wl_display *display;
+    struct wl_output_impl *output;  // Advertised in sync_output
+};
+
+// wp_presentation_feedback for one content update. Queued on the surface's
+// pending state by wp_presentation.feedback and moved to the surface on commit.
+struct wp_presentation_feedback_impl {
+    struct wl_resource *resource;
+    struct wp_presentation_impl *presentation;
+    struct wl_list link;     // wl_surface_state / wl_surface_impl presentation_feedback_list
+    uint32_t commit_seq;     // Surface commit carrying the content update
+    uint64_t frame_seq;      // Output frame it was first composited into (0 = not yet)
 };
 
-struct wp_presentation_impl *wp_presentation_create(struct wl_display *display);
+struct wp_presentation_impl *wp_presentation_create(struct wl_display *display, struct wl_output_impl *output);
+
+// Final events; both destroy the feedback. present_ns is CLOCK_MONOTONIC,
+// refresh_ns 0 when unknown, seq the output frame counter.
+void wp_presentation_feedback_presented(struct wp_presentation_feedback_impl *feedback,
+                                        uint64_t present_ns, uint32_t refresh_ns,
+                                        uint64_t seq, uint32_t flags);
+void wp_presentation_feedback_discarded(struct wp_presentation_feedback_impl *feedback);
@@ -31,13 +31,6 @@ wl_activation_create(struct wl_display *display)
     return NULL;
 }
 
-struct wl_fractional_scale_manager_impl *
-wl_fractional_scale_create(struct wl_display *display)
-{
-    (void)display;
-    return NULL;
-}
-
 struct wl_cursor_shape_manager_impl *
 wl_cursor_shape_create(struct wl_display *display)
 {
@@ -67,6 +60,7 @@ zwp_primary_selection_device_manager_v1_create(struct wl_display *display)
 }
 
 // zwp_tablet_manager_v2_create is implemented in wayland_tablet.c
+// wp_fractional_scale_manager_create is implemented in wayland_fractional_scale.c
 // zwp_keyboard_shortcuts_inhibit_manager_v1_create is implemented in wayland_keyboard_shortcuts.c
 struct ext_idle_notifier_v1_impl *ext_idle_notifier_v1_create(struct wl_display *display) { (void)display; return NULL; }
 struct gtk_shell1_impl *gtk_shell1_create(struct wl_display *display) { (void)display; return NULL; }
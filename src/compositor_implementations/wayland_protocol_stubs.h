@@ -13,10 +13,6 @@ struct wl_activation_manager_impl {
     struct wl_global *global;
 };
 
-struct wl_fractional_scale_manager_impl {
-    struct wl_global *global;
-};
-
 struct wl_cursor_shape_manager_impl {
     struct wl_global *global;
 };
@@ -47,7 +43,6 @@ void register_protocol_stubs(struct wl_display *display);
 struct wl_decoration_manager_impl *wl_decoration_create(struct wl_display *display);
 struct wl_toplevel_icon_manager_impl *wl_toplevel_icon_create(struct wl_display *display);
 struct wl_activation_manager_impl *wl_activation_create(struct wl_display *display);
-struct wl_fractional_scale_manager_impl *wl_fractional_scale_create(struct wl_display *display);
 struct wl_cursor_shape_manager_impl *wl_cursor_shape_create(struct wl_display *display);
 struct wl_text_input_manager_impl *wl_text_input_create(struct wl_display *display);
 struct wl_text_input_manager_v1_impl *wl_text_input_v1_create(struct wl_display *display);
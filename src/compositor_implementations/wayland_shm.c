@@ -1,4 +1,5 @@
 #include "wayland_shm.h"
+#include "pixel_convert.h"
 #include <wayland-server-protocol.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -34,6 +35,14 @@ wl_shm_create(struct wl_display *display)
         free(shm);
         return NULL;
     }
+
+    // ARGB8888 and XRGB8888 are always advertised; the renderers convert
+    // the rest on upload
+    const uint32_t *formats = NULL;
+    int n_formats = pixel_convert_get_formats(&formats);
+    for (int i = 0; i < n_formats; i++) {
+        wl_display_add_shm_format(display, formats[i]);
+    }
     
     // We don't get a handle to the global from wl_display_init_shm easily,
     // but that's fine, we don't need to manage it if libwayland does.
@@ -1,7 +1,13 @@
 #include "wayland_subcompositor.h"
+#include "WawonaCompositor.h"
+#include "logging.h"
 #include <wayland-server-protocol.h>
 #include <stdlib.h>
-#include <stdio.h>
+
+// wl_subcompositor and wl_subsurface
+// The tree itself lives on struct wl_surface_impl; committing it (stacking,
+// positions, cached state of synchronized children) is done by
+// wayland_compositor.c when the parent's state is applied.
 
 static void
 subcompositor_destroy(struct wl_client *client, struct wl_resource *resource)
@@ -10,45 +16,141 @@ subcompositor_destroy(struct wl_client *client, struct wl_resource *resource)
     wl_resource_destroy(resource);
 }
 
+// Leave the parent's sibling lists (current and pending)
+static void
+subsurface_unlink(struct wl_subsurface_impl *sub)
+{
+    wl_list_remove(&sub->parent_link);
+    wl_list_init(&sub->parent_link);
+    wl_list_remove(&sub->parent_pending_link);
+    wl_list_init(&sub->parent_pending_link);
+    sub->parent = NULL;
+}
+
 static void
 subsurface_destroy(struct wl_client *client, struct wl_resource *resource)
 {
+    (void)client;
     wl_resource_destroy(resource);
 }
 
+static void
+subsurface_destroy_resource(struct wl_resource *resource)
+{
+    struct wl_subsurface_impl *sub = wl_resource_get_user_data(resource);
+    if (!sub) {
+        return;
+    }
+
+    // A commit still held back is applied first, then the surface leaves
+    // the tree, which unmaps it right away
+    if (sub->surface) {
+        wl_surface_apply_cached(sub->surface);
+        sub->surface->subsurface = NULL;
+    }
+    bool in_tree = sub->parent != NULL;
+    subsurface_unlink(sub);
+    free(sub);
+    if (in_tree) {
+        wl_compositor_update_draw_list();
+    }
+}
+
 static void
 subsurface_set_position(struct wl_client *client, struct wl_resource *resource, int32_t x, int32_t y)
 {
-    (void)client; (void)resource; (void)x; (void)y;
-    // TODO: Implement subsurface positioning
+    (void)client;
+    struct wl_subsurface_impl *sub = wl_resource_get_user_data(resource);
+    if (!sub) {
+        return;
+    }
+    sub->pending_x = x;
+    sub->pending_y = y;
+}
+
+// The subsurface of a sibling (same parent), or NULL if `sibling` is the
+// parent itself. Posts bad_surface and returns false for anything else.
+static bool
+subsurface_find_sibling(struct wl_subsurface_impl *sub, struct wl_resource *resource,
+                        struct wl_resource *sibling_resource, struct wl_subsurface_impl **sibling)
+{
+    struct wl_surface_impl *surface = wl_surface_from_resource(sibling_resource);
+    *sibling = NULL;
+    if (surface && surface == sub->parent) {
+        return true;
+    }
+    if (surface && surface != sub->surface && surface->subsurface &&
+        surface->subsurface->parent == sub->parent) {
+        *sibling = surface->subsurface;
+        return true;
+    }
+    wl_resource_post_error(resource, WL_SUBSURFACE_ERROR_BAD_SURFACE,
+                           "surface is not a sibling or the parent");
+    return false;
 }
 
 static void
 subsurface_place_above(struct wl_client *client, struct wl_resource *resource, struct wl_resource *sibling)
 {
-    (void)client; (void)resource; (void)sibling;
-    // TODO: Implement subsurface stacking
+    (void)client;
+    struct wl_subsurface_impl *sub = wl_resource_get_user_data(resource);
+    struct wl_subsurface_impl *above;
+    if (!sub || !sub->parent || !subsurface_find_sibling(sub, resource, sibling, &above)) {
+        return;
+    }
+
+    wl_list_remove(&sub->parent_pending_link);
+    if (above) {
+        wl_list_insert(&above->parent_pending_link, &sub->parent_pending_link);
+    } else {
+        // Directly above the parent: bottom of the children above it
+        wl_list_insert(&sub->parent->subsurfaces_pending_above, &sub->parent_pending_link);
+    }
 }
 
 static void
 subsurface_place_below(struct wl_client *client, struct wl_resource *resource, struct wl_resource *sibling)
 {
-    (void)client; (void)resource; (void)sibling;
-    // TODO: Implement subsurface stacking
+    (void)client;
+    struct wl_subsurface_impl *sub = wl_resource_get_user_data(resource);
+    struct wl_subsurface_impl *below;
+    if (!sub || !sub->parent || !subsurface_find_sibling(sub, resource, sibling, &below)) {
+        return;
+    }
+
+    wl_list_remove(&sub->parent_pending_link);
+    if (below) {
+        wl_list_insert(below->parent_pending_link.prev, &sub->parent_pending_link);
+    } else {
+        // Directly below the parent: top of the children below it
+        wl_list_insert(sub->parent->subsurfaces_pending_below.prev, &sub->parent_pending_link);
+    }
 }
 
 static void
 subsurface_set_sync(struct wl_client *client, struct wl_resource *resource)
 {
-    (void)client; (void)resource;
-    // TODO: Implement sync mode
+    (void)client;
+    struct wl_subsurface_impl *sub = wl_resource_get_user_data(resource);
+    if (sub) {
+        sub->synchronized = true;
+    }
 }
 
 static void
 subsurface_set_desync(struct wl_client *client, struct wl_resource *resource)
 {
-    (void)client; (void)resource;
-    // TODO: Implement desync mode
+    (void)client;
+    struct wl_subsurface_impl *sub = wl_resource_get_user_data(resource);
+    if (!sub || !sub->synchronized) {
+        return;
+    }
+    sub->synchronized = false;
+
+    // Still synchronized through an ancestor: the cache waits for that one
+    if (sub->surface && !wl_surface_is_synchronized(sub->surface)) {
+        wl_surface_apply_cached(sub->surface);
+    }
 }
 
 static const struct wl_subsurface_interface subsurface_interface = {
@@ -61,19 +163,68 @@ static const struct wl_subsurface_interface subsurface_interface = {
 };
 
 static void
-subcompositor_get_subsurface(struct wl_client *client, struct wl_resource *resource, uint32_t id, struct wl_resource *surface, struct wl_resource *parent)
+subcompositor_get_subsurface(struct wl_client *client, struct wl_resource *resource, uint32_t id,
+                             struct wl_resource *surface_resource, struct wl_resource *parent_resource)
 {
-    struct wl_resource *subsurface_resource;
-    (void)client; (void)surface; (void)parent;
-    subsurface_resource = wl_resource_create(client, &wl_subsurface_interface, wl_resource_get_version(resource), id);
-    if (!subsurface_resource) {
+    struct wl_surface_impl *surface = wl_surface_from_resource(surface_resource);
+    struct wl_surface_impl *parent = wl_surface_from_resource(parent_resource);
+    if (!surface || !parent) {
+        return;
+    }
+
+    if (surface == parent) {
+        wl_resource_post_error(resource, WL_SUBCOMPOSITOR_ERROR_BAD_SURFACE,
+                               "wl_surface@%u cannot be its own parent",
+                               wl_resource_get_id(surface_resource));
+        return;
+    }
+    if (surface->subsurface) {
+        wl_resource_post_error(resource, WL_SUBCOMPOSITOR_ERROR_BAD_SURFACE,
+                               "wl_surface@%u is already a subsurface",
+                               wl_resource_get_id(surface_resource));
+        return;
+    }
+    // The parent must not be a descendant of the surface
+    for (struct wl_surface_impl *ancestor = parent; ancestor && ancestor->subsurface;
+         ancestor = ancestor->subsurface->parent) {
+        if (ancestor->subsurface->parent == surface) {
+            wl_resource_post_error(resource, WL_SUBCOMPOSITOR_ERROR_BAD_PARENT,
+                                   "wl_surface@%u is an ancestor of its parent",
+                                   wl_resource_get_id(surface_resource));
+            return;
+        }
+    }
+
+    struct wl_subsurface_impl *sub = calloc(1, sizeof(struct wl_subsurface_impl));
+    if (!sub) {
         wl_resource_post_no_memory(resource);
         return;
     }
-    
-    // Set implementation to prevent NULL implementation crashes
-    wl_resource_set_implementation(subsurface_resource, &subsurface_interface, NULL, NULL);
-    printf("[SUBCOMPOSITOR] Created subsurface resource %d for surface %d\n", id, wl_resource_get_id(surface));
+    sub->resource = wl_resource_create(client, &wl_subsurface_interface,
+                                       wl_resource_get_version(resource), id);
+    if (!sub->resource) {
+        free(sub);
+        wl_resource_post_no_memory(resource);
+        return;
+    }
+    wl_resource_set_implementation(sub->resource, &subsurface_interface, sub,
+                                   subsurface_destroy_resource);
+
+    // Subsurfaces start synchronized, on top of their siblings. Placing it
+    // in the current order right away is invisible until it has a buffer.
+    sub->surface = surface;
+    sub->parent = parent;
+    sub->synchronized = true;
+    wl_list_insert(parent->subsurfaces_above.prev, &sub->parent_link);
+    wl_list_insert(parent->subsurfaces_pending_above.prev, &sub->parent_pending_link);
+    surface->subsurface = sub;
+    if (surface->buffer_resource) {
+        // It was drawn as a root surface until now
+        wl_compositor_update_draw_list();
+    }
+
+    log_debug("[SUBCOMPOSITOR] ", "wl_surface@%u is a subsurface of wl_surface@%u\n",
+              wl_resource_get_id(surface_resource), wl_resource_get_id(parent_resource));
 }
 
 static const struct wl_subcompositor_interface subcompositor_interface = {
@@ -96,6 +247,27 @@ bind_subcompositor(struct wl_client *client, void *data, uint32_t version, uint3
     wl_resource_set_implementation(resource, &subcompositor_interface, subcompositor, NULL);
 }
 
+void
+wl_subsurface_handle_surface_destroy(struct wl_surface_impl *surface)
+{
+    struct wl_subsurface_impl *sub, *tmp;
+
+    // Children become inert: they stay subsurfaces but are never shown again
+    wl_list_for_each_safe(sub, tmp, &surface->subsurfaces_below, parent_link) {
+        subsurface_unlink(sub);
+    }
+    wl_list_for_each_safe(sub, tmp, &surface->subsurfaces_above, parent_link) {
+        subsurface_unlink(sub);
+    }
+
+    // The role object outlives the surface until the client destroys it
+    if (surface->subsurface) {
+        subsurface_unlink(surface->subsurface);
+        surface->subsurface->surface = NULL;
+        surface->subsurface = NULL;
+    }
+}
+
 struct wl_subcompositor_impl *
 wl_subcompositor_create(struct wl_display *display)
 {
@@ -103,7 +275,7 @@ wl_subcompositor_create(struct wl_display *display)
     if (!sub) return NULL;
 
     sub->display = display;
-    
+
     sub->global = wl_global_create(display, &wl_subcompositor_interface, 1, sub, bind_subcompositor);
     if (!sub->global) {
         free(sub);
@@ -1,13 +1,41 @@
 #pragma once
 
+#include <stdbool.h>
 #include <wayland-server-core.h>
 #include <wayland-server.h>
 
+struct wl_surface_impl;
+
 struct wl_subcompositor_impl {
     struct wl_global *global;
     struct wl_display *display;
 };
 
+// wl_subsurface role
+// Position and stacking are double-buffered: set_position and
+// place_above/place_below only write the pending values, which the parent's
+// next commit makes current (see surface_apply_subsurfaces in
+// wayland_compositor.c). A synchronized subsurface commits into the cached
+// state of its surface, which is applied together with the parent.
+struct wl_subsurface_impl {
+    struct wl_resource *resource;
+    struct wl_surface_impl *surface;  // NULL once the wl_surface is destroyed
+    struct wl_surface_impl *parent;   // NULL once the parent is destroyed
+
+    // Sibling lists of the parent (subsurfaces_below/above), current and pending
+    struct wl_list parent_link;
+    struct wl_list parent_pending_link;
+
+    int32_t x, y;  // Offset from the parent
+    int32_t pending_x, pending_y;
+
+    bool synchronized;
+    bool has_cache;  // surface->cached holds a commit waiting for the parent
+};
+
 struct wl_subcompositor_impl *wl_subcompositor_create(struct wl_display *display);
 void wl_subcompositor_destroy(struct wl_subcompositor_impl *subcompositor);
 
+// Called by wayland_compositor.c before a surface is freed: makes its own
+// subsurface role and the subsurfaces of its children inert (unmapped)
+void wl_subsurface_handle_surface_destroy(struct wl_surface_impl *surface);
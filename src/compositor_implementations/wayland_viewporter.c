@@ -1,100 +1,171 @@
 #include "wayland_viewporter.h"
+#include "viewporter-protocol.h"
+#include "WawonaCompositor.h"
 #include <stdlib.h>
+#include <string.h>
 
-#include <wayland-server-core.h>
-#include <wayland-server.h>
-#include "wayland_viewporter.h"
-#include "WawonaCompositor.h"
+// wp_viewporter and wp_viewport
+// Requests only write the pending state of the surface. The errors that
+// depend on the committed buffer (bad_size, out_of_buffer) are raised by
+// wl_surface.commit in wayland_compositor.c.
 
-// Forward declarations
-static void bind_viewporter(struct wl_client *client, void *data, uint32_t version, uint32_t id);
-static void viewport_destroy(struct wl_client *client, struct wl_resource *resource);
-static void viewport_set_source(struct wl_client *client, struct wl_resource *resource,
-                                wl_fixed_t x, wl_fixed_t y, wl_fixed_t width, wl_fixed_t height);
-static void viewport_set_destination(struct wl_client *client, struct wl_resource *resource,
-                                     int32_t width, int32_t height);
+static void
+viewporter_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+    (void)client;
+    wl_resource_destroy(resource);
+}
 
-// Interface implementations (generated protocol symbols)
-extern const struct wl_interface wp_viewporter_interface;
-extern const struct wl_interface wp_viewport_interface;
+static void
+viewport_destroy_resource(struct wl_resource *resource)
+{
+    struct wl_viewport_impl *viewport = wl_resource_get_user_data(resource);
+    if (!viewport) {
+        return;
+    }
 
-// Viewporter interface implementation
-static void viewporter_destroy(struct wl_client *client, struct wl_resource *resource) {
+    // Crop and scale are removed with the next commit
+    if (viewport->surface) {
+        struct wl_surface_impl *surface = viewport->surface;
+        memset(&surface->pending.viewport, 0, sizeof(surface->pending.viewport));
+        surface->pending.committed |= WL_SURFACE_STATE_VIEWPORT;
+        surface->viewport = NULL;
+    }
+    free(viewport);
+}
+
+static void
+viewport_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+    (void)client;
     wl_resource_destroy(resource);
 }
 
-static const struct {
-    void (*destroy)(struct wl_client *, struct wl_resource *);
-    void (*set_source)(struct wl_client *, struct wl_resource *, wl_fixed_t, wl_fixed_t, wl_fixed_t, wl_fixed_t);
-    void (*set_destination)(struct wl_client *, struct wl_resource *, int32_t, int32_t);
-} viewport_interface_impl = {
+// The surface of a viewport, or NULL after posting no_surface
+static struct wl_surface_impl *
+viewport_get_surface(struct wl_resource *resource)
+{
+    struct wl_viewport_impl *viewport = wl_resource_get_user_data(resource);
+    if (!viewport->surface) {
+        wl_resource_post_error(resource, WP_VIEWPORT_ERROR_NO_SURFACE,
+                               "wl_surface of the viewport was destroyed");
+        return NULL;
+    }
+    return viewport->surface;
+}
+
+static void
+viewport_set_source(struct wl_client *client, struct wl_resource *resource, wl_fixed_t x,
+                    wl_fixed_t y, wl_fixed_t width, wl_fixed_t height)
+{
+    (void)client;
+    struct wl_surface_impl *surface = viewport_get_surface(resource);
+    if (!surface) {
+        return;
+    }
+
+    struct wl_surface_viewport *pending = &surface->pending.viewport;
+    wl_fixed_t unset = wl_fixed_from_int(-1);
+    if (x == unset && y == unset && width == unset && height == unset) {
+        pending->has_source = false;
+    } else if (x < 0 || y < 0 || width <= 0 || height <= 0) {
+        wl_resource_post_error(resource, WP_VIEWPORT_ERROR_BAD_VALUE,
+                               "source rectangle %fx%f@%f,%f is invalid",
+                               wl_fixed_to_double(width), wl_fixed_to_double(height),
+                               wl_fixed_to_double(x), wl_fixed_to_double(y));
+        return;
+    } else {
+        pending->has_source = true;
+        pending->src_x = wl_fixed_to_double(x);
+        pending->src_y = wl_fixed_to_double(y);
+        pending->src_width = wl_fixed_to_double(width);
+        pending->src_height = wl_fixed_to_double(height);
+    }
+    surface->pending.committed |= WL_SURFACE_STATE_VIEWPORT;
+}
+
+static void
+viewport_set_destination(struct wl_client *client, struct wl_resource *resource, int32_t width,
+                         int32_t height)
+{
+    (void)client;
+    struct wl_surface_impl *surface = viewport_get_surface(resource);
+    if (!surface) {
+        return;
+    }
+
+    struct wl_surface_viewport *pending = &surface->pending.viewport;
+    if (width == -1 && height == -1) {
+        pending->has_destination = false;
+    } else if (width <= 0 || height <= 0) {
+        wl_resource_post_error(resource, WP_VIEWPORT_ERROR_BAD_VALUE,
+                               "destination size %dx%d is invalid", width, height);
+        return;
+    } else {
+        pending->has_destination = true;
+        pending->dst_width = width;
+        pending->dst_height = height;
+    }
+    surface->pending.committed |= WL_SURFACE_STATE_VIEWPORT;
+}
+
+static const struct wp_viewport_interface viewport_interface = {
     .destroy = viewport_destroy,
     .set_source = viewport_set_source,
     .set_destination = viewport_set_destination,
 };
 
-static void viewporter_get_viewport(struct wl_client *client, struct wl_resource *resource,
-                                    uint32_t id, struct wl_resource *surface_resource) {
-    struct wp_viewporter_impl *viewporter = wl_resource_get_user_data(resource);
-    struct wl_surface_impl *surface;
-    struct wl_resource *vp_res;
-    struct wl_viewport_impl *vp;
-    
-    (void)viewporter;
-
-    surface = wl_resource_get_user_data(surface_resource);
+static void
+viewporter_get_viewport(struct wl_client *client, struct wl_resource *resource, uint32_t id,
+                        struct wl_resource *surface_resource)
+{
+    struct wl_surface_impl *surface = wl_surface_from_resource(surface_resource);
     if (!surface) {
-        wl_resource_post_error(resource, 0, "Invalid wl_surface for viewport");
+        return;
+    }
+    if (surface->viewport) {
+        wl_resource_post_error(resource, WP_VIEWPORTER_ERROR_VIEWPORT_EXISTS,
+                               "wl_surface@%u already has a viewport",
+                               wl_resource_get_id(surface_resource));
         return;
     }
 
-    vp_res = wl_resource_create(client, &wp_viewport_interface,
-                                                    wl_resource_get_version(resource), id);
-    if (!vp_res) {
+    struct wl_viewport_impl *viewport = calloc(1, sizeof(struct wl_viewport_impl));
+    if (!viewport) {
         wl_client_post_no_memory(client);
         return;
     }
-
-    vp = calloc(1, sizeof(struct wl_viewport_impl));
-    if (!vp) {
+    viewport->resource = wl_resource_create(client, &wp_viewport_interface,
+                                            wl_resource_get_version(resource), id);
+    if (!viewport->resource) {
+        free(viewport);
         wl_client_post_no_memory(client);
-        wl_resource_destroy(vp_res);
         return;
     }
-
-    vp->resource = vp_res;
-    vp->surface = surface;
-    vp->has_source = false;
-    vp->has_destination = false;
-
-    // Attach viewport to surface
-    surface->viewport = vp;
-
-    wl_resource_set_implementation(vp_res, (const void *)&viewport_interface_impl, vp, NULL);
+    viewport->surface = surface;
+    surface->viewport = viewport;
+    wl_resource_set_implementation(viewport->resource, &viewport_interface, viewport,
+                                   viewport_destroy_resource);
 }
 
-// Bind function for wp_viewporter global
-static const struct {
-    void (*destroy)(struct wl_client *, struct wl_resource *);
-    void (*get_viewport)(struct wl_client *, struct wl_resource *, uint32_t, struct wl_resource *);
-} viewporter_impl = {
+static const struct wp_viewporter_interface viewporter_interface = {
     .destroy = viewporter_destroy,
     .get_viewport = viewporter_get_viewport,
 };
 
-static void bind_viewporter(struct wl_client *client, void *data, uint32_t version, uint32_t id) {
+static void
+bind_viewporter(struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
     struct wp_viewporter_impl *viewporter = data;
-    struct wl_resource *res = wl_resource_create(client, &wp_viewporter_interface, (int)version, id);
-    if (!res) {
+    struct wl_resource *resource = wl_resource_create(client, &wp_viewporter_interface, (int)version, id);
+    if (!resource) {
         wl_client_post_no_memory(client);
         return;
     }
 
-    // Minimal interface for wp_viewporter
-    wl_resource_set_implementation(res, (const void *)&viewporter_impl, viewporter, NULL);
+    wl_resource_set_implementation(resource, &viewporter_interface, viewporter, NULL);
 }
 
-// Public create function
 struct wp_viewporter_impl *
 wp_viewporter_create(struct wl_display *display)
 {
@@ -110,47 +181,19 @@ wp_viewporter_create(struct wl_display *display)
     return vp;
 }
 
-// Helpers
-struct wl_viewport_impl *wl_viewport_from_surface(struct wl_surface_impl *surface) {
+struct wl_viewport_impl *
+wl_viewport_from_surface(struct wl_surface_impl *surface)
+{
     if (!surface) return NULL;
     return (struct wl_viewport_impl *)surface->viewport;
 }
 
-// Viewport methods
-static void viewport_destroy(struct wl_client *client, struct wl_resource *resource) {
-    struct wl_viewport_impl *vp;
-    (void)client;
-    vp = wl_resource_get_user_data(resource);
-    if (vp) {
-        if (vp->surface && vp->surface->viewport == vp) {
-            vp->surface->viewport = NULL;
-        }
-        free(vp);
+void
+wl_viewport_handle_surface_destroy(struct wl_surface_impl *surface)
+{
+    struct wl_viewport_impl *viewport = surface->viewport;
+    if (viewport) {
+        viewport->surface = NULL;
+        surface->viewport = NULL;
     }
-    wl_resource_destroy(resource);
-}
-
-static void viewport_set_source(struct wl_client *client, struct wl_resource *resource,
-                                wl_fixed_t x, wl_fixed_t y, wl_fixed_t width, wl_fixed_t height) {
-    struct wl_viewport_impl *vp;
-    (void)client;
-    vp = wl_resource_get_user_data(resource);
-    if (!vp) return;
-    // Convert from wl_fixed to float
-    vp->src_x = (float)wl_fixed_to_double(x);
-    vp->src_y = (float)wl_fixed_to_double(y);
-    vp->src_width = (float)wl_fixed_to_double(width);
-    vp->src_height = (float)wl_fixed_to_double(height);
-    vp->has_source = (vp->src_width > 0.0f && vp->src_height > 0.0f);
-}
-
-static void viewport_set_destination(struct wl_client *client, struct wl_resource *resource,
-                                     int32_t width, int32_t height) {
-    struct wl_viewport_impl *vp;
-    (void)client;
-    vp = wl_resource_get_user_data(resource);
-    if (!vp) return;
-    vp->dst_width = width;
-    vp->dst_height = height;
-    vp->has_destination = (width > 0 && height > 0);
 }
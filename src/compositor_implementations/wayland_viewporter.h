@@ -1,26 +1,26 @@
 #pragma once
 #include <wayland-server.h>
 
+struct wl_surface_impl;
+
 struct wp_viewporter_impl {
     struct wl_global *global;
     struct wl_display *display;
 };
 
-// Per-surface viewport state
+// wp_viewport object of a surface. The crop and scale it requests are
+// double-buffered surface state (wl_surface_state::viewport), validated and
+// applied when the surface commits.
 struct wl_viewport_impl {
     struct wl_resource *resource;
-    struct wl_surface_impl *surface;
-    bool has_source;
-    float src_x;
-    float src_y;
-    float src_width;
-    float src_height;
-    bool has_destination;
-    int32_t dst_width;
-    int32_t dst_height;
+    struct wl_surface_impl *surface;  // NULL once the wl_surface is destroyed
 };
 
 struct wp_viewporter_impl *wp_viewporter_create(struct wl_display *display);
 
 // Helper to access viewport from a wl_surface (may be NULL)
 struct wl_viewport_impl *wl_viewport_from_surface(struct wl_surface_impl *surface);
+
+// Called by wayland_compositor.c before a surface is freed: later requests
+// on its wp_viewport raise no_surface
+void wl_viewport_handle_surface_destroy(struct wl_surface_impl *surface);
@@ -1,4 +1,6 @@
 #pragma once
+#include <pixman.h>
+#include <time.h>
 #include <wayland-server-core.h>
 #include <wayland-server.h>
 
@@ -13,6 +15,8 @@ typedef struct WawonaCompositor WawonaCompositor;
 
 // Forward declaration
 struct wl_seat_impl;
+struct wl_subsurface_impl;
+struct frame_scheduler;
 
 // Wayland Compositor Protocol Implementation
 // Implements wl_compositor, wl_surface, wl_output, wl_seat
@@ -30,35 +34,163 @@ typedef void (*wl_title_update_callback_t)(struct wl_client *client);
 // Frame callback requested callback type - called when a client requests a frame callback
 typedef void (*wl_frame_callback_requested_t)(void);
 
+// Frame presented callback type - called on the presenting thread once a
+// frame that composited new commits has been presented, so the frame
+// callbacks and presentation feedback waiting for it can be sent
+typedef void (*wl_frame_presented_callback_t)(void);
+
+// Surface destroyed callback type - the backend must drop every reference to
+// the surface before returning (it is freed right after)
+typedef void (*wl_surface_destroyed_callback_t)(struct wl_surface_impl *surface);
+
+// Client connected/disconnected callback type - called when a client binds or
+// releases wl_compositor
+typedef void (*wl_client_count_callback_t)(void);
+
+// Buffer size query type - size of a buffer that is neither shm nor dmabuf
+// (e.g. EGL). Returns false if the backend does not know the buffer.
+typedef bool (*wl_buffer_size_query_t)(struct wl_resource *buffer, int32_t *width,
+                                       int32_t *height);
+
 // Compositor global
+// The core (wayland_compositor.c) is plain C and platform independent; the
+// backend (Cocoa/UIKit, Android, headless) hooks in through these callbacks.
 struct wl_compositor_impl {
     struct wl_global *global;
     struct wl_display *display;
     wl_surface_render_callback_t render_callback; // Callback for immediate rendering
     wl_title_update_callback_t update_title_callback; // Callback for updating window title
     wl_frame_callback_requested_t frame_callback_requested; // Callback when frame callback is requested
+    wl_frame_presented_callback_t frame_presented; // Callback when composited commits were presented
+    wl_surface_destroyed_callback_t surface_destroyed; // Callback before a surface is freed
+    wl_client_count_callback_t client_connected; // Callback when a client binds
+    wl_client_count_callback_t client_disconnected; // Callback when a client goes away
+    wl_buffer_size_query_t query_buffer_size; // Size of backend specific buffers
+    struct frame_scheduler *frame_scheduler; // Refresh interval for presentation feedback
+    int client_count; // Bound clients (for the multiple clients setting)
+};
+
+// Double-buffered surface state
+// Requests (attach, damage, set_buffer_scale, ...) only ever write the pending
+// block; surface_commit applies it to the current state in one step. The
+// cached block holds state committed on a synchronized subsurface until its
+// parent commits.
+enum wl_surface_state_field {
+    WL_SURFACE_STATE_BUFFER    = 1 << 0,
+    WL_SURFACE_STATE_SCALE     = 1 << 1,
+    WL_SURFACE_STATE_TRANSFORM = 1 << 2,
+    WL_SURFACE_STATE_OPAQUE_REGION = 1 << 3,
+    WL_SURFACE_STATE_INPUT_REGION  = 1 << 4,
+    WL_SURFACE_STATE_VIEWPORT  = 1 << 5,
+};
+
+// wp_viewport crop and scale. The source rectangle is in surface coordinates
+// before cropping (the buffer scale applied); the destination is the
+// surface size.
+struct wl_surface_viewport {
+    bool has_source;
+    double src_x, src_y, src_width, src_height;
+    bool has_destination;
+    int32_t dst_width, dst_height;
+};
+
+struct wl_surface_state {
+    uint32_t committed;  // Mask of wl_surface_state_field set since last apply
+    
+    // wl_surface.attach (buffer may be NULL when a detach is pending)
+    struct wl_resource *buffer;
+    struct wl_listener buffer_destroy_listener;
+    int32_t dx, dy;
+    
+    int32_t scale;
+    int32_t transform;
+    
+    // Damage in surface coordinates (wl_surface.damage) and in buffer
+    // coordinates (wl_surface.damage_buffer)
+    pixman_region32_t damage_surface;
+    pixman_region32_t damage_buffer;
+    
+    // wl_surface.set_opaque_region / set_input_region, copied from the
+    // wl_region when requested (surface coordinates)
+    pixman_region32_t opaque;
+    pixman_region32_t input;
+    
+    // wp_viewport.set_source / set_destination
+    struct wl_surface_viewport viewport;
+    
+    // wl_callback resources from wl_surface.frame (linked via wl_resource_get_link)
+    struct wl_list frame_callback_list;
+    // struct wp_presentation_feedback_impl from wp_presentation.feedback
+    struct wl_list presentation_feedback_list;
 };
 
 // Surface implementation
 struct wl_surface_impl {
     struct wl_resource *resource;
-    struct wl_surface_impl *next;
+    struct wl_surface_impl *next;  // Surface registry links (see wl_compositor_lock_surfaces)
+    struct wl_surface_impl *prev;
+    // Registry id, never reused (0 = none): other threads keep this rather
+    // than the pointer and look it up with wl_surface_from_id()
+    uint64_t id;
     
+    // Current (committed) state, read by renderers
     // Buffer management
     struct wl_resource *buffer_resource;
-    int32_t width, height;
+    struct wl_listener buffer_destroy_listener;
+    int32_t width, height;  // Surface size (buffer scale and viewport applied)
     int32_t buffer_width, buffer_height;
+    int32_t buffer_scale;
+    int32_t buffer_transform;
     bool buffer_release_sent;
     
     // Position and state
     int32_t x, y;
-    bool committed;
     
-    // Callbacks
-    struct wl_resource *frame_callback;
+    // Surface coordinates. The opaque region is a hint that those pixels
+    // have alpha 1 (empty until set); the input region is infinite until set.
+    pixman_region32_t opaque_region;
+    pixman_region32_t input_region;
+    
+    // Surface tree (wl_subsurface). Children are listed bottom to top, split
+    // at the surface itself; the pending lists are reordered by
+    // place_above/place_below and copied when this surface commits.
+    struct wl_subsurface_impl *subsurface;  // Role, NULL for a root surface
+    struct wl_list subsurfaces_below;          // struct wl_subsurface_impl::parent_link
+    struct wl_list subsurfaces_above;
+    struct wl_list subsurfaces_pending_below;  // ::parent_pending_link
+    struct wl_list subsurfaces_pending_above;
+    
+    // Commit sequence: bumped on every applied commit. Renderers remember the
+    // last sequence they consumed (rendered_seq) and skip unchanged surfaces.
+    uint32_t commit_seq;
+    uint32_t rendered_seq;
+    
+    // Damage in buffer coordinates, clipped to the buffer. Accumulates across
+    // commits until the renderer has uploaded it and clears it.
+    pixman_region32_t damage;
+    
+    // Pending and cached state blocks
+    struct wl_surface_state pending;
+    struct wl_surface_state cached;
+    
+    // Frame callbacks committed to the current state. They fire once a frame
+    // containing commit frame_callback_seq has been composited (presented_seq).
+    struct wl_list frame_callback_list;
+    struct wl_list frame_callback_link;  // Pending frame callback set (event thread only)
+    uint32_t frame_callback_seq;
+    // Written by the renderer (main thread), read on the event thread:
+    // composited_frame is stored before presented_seq is released
+    _Atomic uint32_t presented_seq;  // Last commit composited into a frame
+    _Atomic uint64_t composited_frame;  // Output frame presented_seq first appeared in
+    
+    // Presentation feedback of committed updates, oldest first. Shares the
+    // pending set (frame_callback_link) with the frame callbacks.
+    struct wl_list presentation_feedback_list;
     
     // Viewport (for viewporter protocol)
-    void *viewport;  // struct wl_viewport_impl *
+    void *viewport;  // struct wl_viewport_impl *, NULL without a wp_viewport
+    struct wl_surface_viewport viewport_state;  // Committed crop and scale
+    void *fractional_scale;  // struct wp_fractional_scale_impl *, NULL without one
     
     // User data (for linking to CALayer)
     void *user_data;
@@ -73,21 +205,69 @@ void wl_compositor_destroy(struct wl_compositor_impl *compositor);
 void wl_compositor_set_render_callback(struct wl_compositor_impl *compositor, wl_surface_render_callback_t callback);
 void wl_compositor_set_title_update_callback(struct wl_compositor_impl *compositor, wl_title_update_callback_t callback);
 void wl_compositor_set_frame_callback_requested(struct wl_compositor_impl *compositor, wl_frame_callback_requested_t callback);
+void wl_compositor_set_frame_presented_callback(struct wl_compositor_impl *compositor, wl_frame_presented_callback_t callback);
+void wl_compositor_set_surface_destroyed_callback(struct wl_compositor_impl *compositor, wl_surface_destroyed_callback_t callback);
+void wl_compositor_set_client_callbacks(struct wl_compositor_impl *compositor, wl_client_count_callback_t connected, wl_client_count_callback_t disconnected);
+void wl_compositor_set_buffer_size_query(struct wl_compositor_impl *compositor, wl_buffer_size_query_t query);
+void wl_compositor_set_frame_scheduler(struct wl_compositor_impl *compositor, struct frame_scheduler *scheduler);
 void wl_compositor_set_seat(struct wl_seat_impl *seat);
 
 // Thread-safe surface iteration
 typedef void (*wl_surface_iterator_func_t)(struct wl_surface_impl *surface, void *data);
 void wl_compositor_for_each_surface(wl_surface_iterator_func_t iterator, void *data);
 
-// Lock/Unlock surfaces mutex (for external safe access)
+// Lock/Unlock the surface registry for reading (for external safe access)
+// Hold it while walking wl_get_all_surfaces() from outside the event thread.
 void wl_compositor_lock_surfaces(void);
 void wl_compositor_unlock_surfaces(void);
 
+// Flattened surface tree in paint order, bottom first: every root surface
+// (oldest first) with its mapped subsurfaces around it. Positions are in
+// output coordinates. The list is rebuilt on the event thread only when the
+// tree, the stacking, a position, a mapping, a size, a viewport, an opaque
+// or an input region changes, so renderers and hit-testing never walk the
+// tree per frame or event. Read it under wl_compositor_lock_surfaces(); the
+// generation changes with every rebuild.
+// Each entry is one quad: the source box of the buffer (viewport crop, in
+// buffer pixels) scaled to the surface size. Buffer transforms are not
+// applied.
+struct wl_surface_draw_entry {
+    struct wl_surface_impl *surface;
+    int32_t x, y;
+    int32_t width, height;  // Surface size (viewport destination)
+    double src_x, src_y, src_width, src_height;  // Buffer pixels shown
+    pixman_region32_t opaque;  // Copy of the surface's opaque region (surface coordinates)
+    pixman_region32_t input;   // Input region clipped to the surface (surface coordinates)
+};
+
+struct wl_surface_draw_list {
+    const struct wl_surface_draw_entry *entries;
+    int count;
+    uint32_t generation;
+};
+
+void wl_compositor_get_draw_list(struct wl_surface_draw_list *list);
+// Lock-free, to check whether a restack is needed before taking the lock
+uint32_t wl_compositor_get_draw_list_generation(void);
+// Rebuild after the tree changed outside a commit (event thread)
+void wl_compositor_update_draw_list(void);
+
 // Surface management
 struct wl_surface_impl *wl_surface_from_resource(struct wl_resource *resource);
 void wl_surface_damage(struct wl_surface_impl *surface, int32_t x, int32_t y, int32_t width, int32_t height);
 void wl_surface_commit(struct wl_surface_impl *surface);
 
+// Subsurface synchronization (wayland_subcompositor.c). A surface is
+// synchronized if it or any ancestor is a synchronized subsurface.
+bool wl_surface_is_synchronized(struct wl_surface_impl *surface);
+// Apply the cached commit of a subsurface that stopped being synchronized
+void wl_surface_apply_cached(struct wl_surface_impl *surface);
+
+// Damage accessors (buffer coordinates, clipped to the buffer size)
+// Renderers upload only these rectangles and then clear the damage.
+const pixman_region32_t *wl_surface_get_buffer_damage(struct wl_surface_impl *surface);
+void wl_surface_clear_buffer_damage(struct wl_surface_impl *surface);
+
 // Buffer handling
 void wl_surface_attach_buffer(struct wl_surface_impl *surface, struct wl_resource *buffer);
 void *wl_buffer_get_shm_data(struct wl_resource *buffer, int32_t *width, int32_t *height, int32_t *stride);
@@ -95,13 +275,31 @@ void wl_buffer_end_shm_access(struct wl_resource *buffer);
 
 // Surface iteration
 struct wl_surface_impl *wl_get_all_surfaces(void);
-
-// Send frame callbacks to all surfaces with pending callbacks
-// Called at display refresh rate to synchronize with display
-// Returns the number of callbacks sent
+// Live surface with registry id id, or NULL once it is destroyed. Hash
+// lookup; hold wl_compositor_lock_surfaces() outside the event thread.
+struct wl_surface_impl *wl_surface_from_id(uint64_t id);
+
+// Trace flow id linking a surface commit to the frame it is presented in
+uint64_t wl_surface_trace_flow_id(struct wl_surface_impl *surface, uint32_t commit_seq);
+
+// Send frame callbacks and presentation feedback to all surfaces waiting
+// for them. Called at display refresh rate to synchronize with display.
+// Frame callbacks fire once the committed content has been composited and
+// carry the timestamp of the last presented frame; presentation feedback
+// fires once the frame it was composited into has been presented.
+// Returns the number of events sent
 int wl_send_frame_callbacks(void);
 bool wl_has_pending_frame_callbacks(void);
 
+// Renderer feedback (main thread). A renderer starts every output frame with
+// wl_compositor_begin_frame(), marks each surface it draws into it, and
+// reports the frame's presentation time (CLOCK_MONOTONIC, NULL = now) with
+// wp_presentation_feedback kind flags once it is known (any thread).
+uint64_t wl_compositor_begin_frame(void);
+void wl_surface_mark_composited(struct wl_surface_impl *surface);
+void wl_compositor_frame_presented(uint64_t frame_seq, const struct timespec *when,
+                                   uint32_t flags);
+
 // Clear buffer reference from surfaces (called when buffer is destroyed)
 void wl_compositor_clear_buffer_reference(struct wl_resource *buffer_resource);
 
@@ -170,8 +368,8 @@ typedef struct WawonaCompositor WawonaCompositor;
 @property (nonatomic, assign) struct wl_display *display;
 @property (nonatomic, assign) struct wl_event_loop *eventLoop;
 @property (nonatomic, assign) int tcp_listen_fd;  // TCP listening socket (for manual accept)
-@property (nonatomic, strong) id<RenderingBackend> renderingBackend;  // Rendering backend (SurfaceRenderer or MetalRenderer)
-@property (nonatomic, assign) RenderingBackendType backendType;  // RENDERING_BACKEND_SURFACE or RENDERING_BACKEND_METAL
+@property (nonatomic, strong) id<RenderingBackend> renderingBackend;  // Rendering backend (SurfaceRenderer, MetalRenderer or SoftwareRenderer)
+@property (nonatomic, assign) RenderingBackendType backendType;  // RENDERING_BACKEND_SURFACE, RENDERING_BACKEND_METAL or RENDERING_BACKEND_SOFTWARE
 @property (nonatomic, strong) InputHandler *inputHandler;
 @property (nonatomic, strong) WawonaAppScanner *launcher;  // App scanner
 
@@ -179,6 +377,8 @@ typedef struct WawonaCompositor WawonaCompositor;
 @property (nonatomic, assign) struct wl_compositor_impl *compositor;
 @property (nonatomic, assign) struct wl_output_impl *output;
 @property (nonatomic, assign) struct wl_seat_impl *seat;
+@property (nonatomic, assign) struct input_batch *inputBatch;  // Coalesces pointer input between frames
+@property (nonatomic, assign) struct input_queue *inputQueue;  // Input from the UI thread to the event thread
 @property (nonatomic, assign) struct wl_shm_impl *shm;
 @property (nonatomic, assign) struct wl_subcompositor_impl *subcompositor;
 @property (nonatomic, assign) struct wl_data_device_manager_impl *data_device_manager;
@@ -187,6 +387,7 @@ typedef struct WawonaCompositor WawonaCompositor;
 @property (nonatomic, assign) struct wl_text_input_manager_impl *text_input_manager;
 #if !TARGET_OS_IPHONE && !TARGET_OS_SIMULATOR
 @property (nonatomic, assign) struct egl_buffer_handler *egl_buffer_handler;
+@property (nonatomic, assign) struct zwp_linux_dmabuf_v1_impl *linux_dmabuf;  // NULL when dmabuf is disabled
 #endif
 
 // Event loop integration
@@ -197,10 +398,10 @@ typedef struct WawonaCompositor WawonaCompositor;
 #endif
 @property (nonatomic, strong) NSThread *eventThread;
 @property (nonatomic, assign) BOOL shouldStopEventThread;
-@property (nonatomic, assign) struct wl_event_source *frame_callback_source;
+@property (nonatomic, assign) struct frame_scheduler *frameScheduler;
 @property (nonatomic, assign) int32_t pending_resize_width;
 @property (nonatomic, assign) int32_t pending_resize_height;
-@property (nonatomic, assign) int32_t pending_resize_scale;
+@property (nonatomic, assign) double pending_resize_scale;
 @property (nonatomic, assign) volatile BOOL needs_resize_configure;
 @property (nonatomic, assign) BOOL windowShown; // Track if window has been shown (delayed until first client)
 @property (nonatomic, assign) BOOL isFullscreen; // Track if window is in fullscreen mode
@@ -218,6 +419,7 @@ typedef struct WawonaCompositor WawonaCompositor;
 - (void)renderFrame;
 - (void)sendFrameCallbacksImmediately; // Force immediate frame callback dispatch (for input events)
 - (void)switchToMetalBackend; // Switch to Metal rendering for full compositors
+- (void)switchToSoftwareBackend; // Switch to pixman rendering (GPU fallback)
 - (void)updateWindowTitleForClient:(struct wl_client *)client; // Update window title with client name
 - (void)showAndSizeWindowForFirstClient:(int32_t)width height:(int32_t)height; // Show and size window when first client connects
 - (void)updateOutputSize:(CGSize)size; // Update output size and notify clients (called on resize)
@@ -8,9 +8,15 @@
 #import <libproc.h>
 #endif
 #endif
+#include "frame_scheduler.h"
+#include "input_batch.h"
+#include "input_queue.h"
 #include "logging.h"
+#include "trace.h"
+#include "wayland_fractional_scale.h"
 #include "wayland_fullscreen_shell.h"
 #include "wayland_linux_dmabuf.h"
+#include "wayland_viewporter.h"
 #include <arpa/inet.h>
 #include <assert.h>
 #ifdef __APPLE__
@@ -18,9 +24,13 @@
 #endif
 #include <errno.h>
 #include <fcntl.h>
+#include <mach/mach_time.h>
+#include <math.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <string.h>
-#include <sys/select.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #include <wayland-server-core.h>
@@ -28,9 +38,6 @@
 #include <wayland-server.h>
 // --- Forward Declarations ---
 
-static struct wl_surface_impl *g_surface_list = NULL;
-static struct wl_compositor_impl *g_compositor = NULL;
-
 #ifdef __APPLE__
 static WawonaCompositor *g_compositor_instance;
 #else
@@ -43,619 +50,228 @@ struct WawonaCompositor {
 static struct WawonaCompositor *g_compositor_instance;
 #endif
 
-// Timer callback to check for TCP connections
-static int tcp_accept_timer_handler(void *data) {
-#ifdef __APPLE__
-  WawonaCompositor *compositor = (__bridge WawonaCompositor *)data;
-  int listen_fd = compositor.tcp_listen_fd;
-#else
-  WawonaCompositor *compositor = (WawonaCompositor *)data;
-  int listen_fd = compositor->tcp_listen_fd;
-#endif
+// Socket buffers for accepted TCP clients: waypipe pushes whole buffers
+// through the connection, the defaults are far too small for that
+#define TCP_CLIENT_SOCKET_BUFFER_SIZE (1024 * 1024)
 
-  if (!compositor || listen_fd < 0) {
-    return 0; // Stop timer
-  }
+// Connections per remote address, so one peer cannot exhaust the compositor
+// (event thread only)
+struct tcp_peer {
+  struct wl_list link;
+  struct in_addr addr;
+  int connections;
+};
 
-  // Accept all pending connections (non-blocking socket, so this won't block)
-  // Accept multiple connections per timer tick to handle connection bursts
-  int accepted_count = 0;
-  const int max_accept_per_tick = 10; // Limit to avoid blocking the event loop
-
-  // Use select() to check if socket has pending connections (non-blocking)
-  fd_set read_fds;
-  FD_ZERO(&read_fds);
-  FD_SET(listen_fd, &read_fds);
-  struct timeval timeout = {0, 0}; // Non-blocking check
-  int ret =
-      select(listen_fd + 1, &read_fds, NULL, NULL, &timeout);
-
-  if (ret < 0) {
-    // Select error
-    static int logged_select_error = 0;
-    if (!logged_select_error) {
-      log_printf("[COMPOSITOR] ", "⚠️ TCP select() failed: %s\n",
-                 strerror(errno));
-      logged_select_error = 1;
-    }
-    return 50; // Continue timer
-  }
+struct tcp_peer_client {
+  struct wl_listener destroy_listener;
+  struct tcp_peer *peer;
+};
 
-  if (ret == 0) {
-    // No pending connections
-    return 50; // Continue timer
-  }
+static struct wl_list g_tcp_peers = {&g_tcp_peers, &g_tcp_peers};
 
-  // Socket has pending connections, accept them
-  for (int i = 0; i < max_accept_per_tick; i++) {
-    // Check again if socket is still readable
-    FD_ZERO(&read_fds);
-    FD_SET(listen_fd, &read_fds);
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 0;
-    ret = select(listen_fd + 1, &read_fds, NULL, NULL, &timeout);
+// Out of descriptors (EMFILE/ENFILE), accept() fails while the listen socket
+// stays readable: it leaves the event loop until a backoff timer puts it
+// back, doubling the delay while accepting keeps failing (event thread only)
+#define TCP_ACCEPT_BACKOFF_MIN_MS 100
+#define TCP_ACCEPT_BACKOFF_MAX_MS 3200
 
-    if (ret <= 0 || !FD_ISSET(listen_fd, &read_fds)) {
-      // No more pending connections
-      break;
-    }
-
-    // Accept one connection
-    struct sockaddr_in client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    int client_fd = accept(listen_fd,
-                           (struct sockaddr *)&client_addr, &client_len);
+static struct wl_event_source *g_tcp_accept_source = NULL;
+static struct wl_event_source *g_tcp_accept_retry_timer = NULL;
+static int g_tcp_accept_backoff_ms = 0;
 
-    if (client_fd >= 0) {
-      int flags = fcntl(client_fd, F_GETFL, 0);
-      if (flags >= 0) {
-        fcntl(client_fd, F_SETFL, flags | O_NONBLOCK);
-      }
-      BOOL allowMultiple = WawonaSettings_GetMultipleClientsEnabled();
-#ifdef __APPLE__
-      if (!allowMultiple && g_compositor_instance &&
-          g_compositor_instance.connectedClientCount > 0) {
-#else
-      if (!allowMultiple && g_compositor_instance &&
-          g_compositor_instance->connectedClientCount > 0) {
-#endif
-        log_printf("[COMPOSITOR] ",
-                   "🚫 TCP client rejected: multiple clients disabled\n");
-        close(client_fd);
-        continue;
-      }
-#ifdef __APPLE__
-      struct wl_client *client =
-          wl_client_create(compositor.display, client_fd);
-#else
-      struct wl_client *client =
-          wl_client_create(compositor->display, client_fd);
-#endif
-      if (!client) {
-        log_printf("[COMPOSITOR] ",
-                   "⚠️ Failed to create Wayland client for TCP connection "
-                   "(fd=%d): %s\n",
-                   client_fd, strerror(errno));
-        close(client_fd);
-      } else {
-        accepted_count++;
-        log_printf("[COMPOSITOR] ",
-                   "✅ Accepted TCP connection (fd=%d from %s:%d), created "
-                   "Wayland client %p\n",
-                   client_fd, inet_ntoa(client_addr.sin_addr),
-                   ntohs(client_addr.sin_port), client);
-      }
-    } else {
-      // Accept error
-      int err = errno;
-      if (err == EAGAIN || err == EWOULDBLOCK || err == EINTR) {
-        // No more connections available right now
-        break;
-      } else {
-        // Real error
-        static int logged_accept_error = 0;
-        if (!logged_accept_error || err != EINVAL) {
-          log_printf("[COMPOSITOR] ", "⚠️ TCP accept() failed: %s (errno=%d)\n",
-                     strerror(err), err);
-          if (err == EINVAL) {
-            logged_accept_error = 1;
-          }
-        }
-        break;
-      }
-    }
+static void tcp_accept_pause(void) {
+  if (!g_tcp_accept_source || !g_tcp_accept_retry_timer) {
+    return;
   }
-
-  if (accepted_count > 0) {
-    log_printf("[COMPOSITOR] ", "✅ Accepted %d TCP connection(s) this tick\n",
-               accepted_count);
+  g_tcp_accept_backoff_ms = g_tcp_accept_backoff_ms > 0
+                                ? 2 * g_tcp_accept_backoff_ms
+                                : TCP_ACCEPT_BACKOFF_MIN_MS;
+  if (g_tcp_accept_backoff_ms > TCP_ACCEPT_BACKOFF_MAX_MS) {
+    g_tcp_accept_backoff_ms = TCP_ACCEPT_BACKOFF_MAX_MS;
   }
-
-  // Reschedule timer for 50ms
-  return 50;
-}
-
-static void surface_destroy_resource(struct wl_resource *resource);
-static void region_destroy_resource(struct wl_resource *resource);
-
-// --- Region Implementation ---
-
-struct wl_region_impl {
-  struct wl_resource *resource;
-};
-
-static void region_destroy(struct wl_client *client,
-                           struct wl_resource *resource) {
-  (void)client;
-  wl_resource_destroy(resource);
-}
-
-static void region_add(struct wl_client *client, struct wl_resource *resource,
-                       int32_t x, int32_t y, int32_t width, int32_t height) {
-  (void)client;
-  (void)resource;
-  (void)x;
-  (void)y;
-  (void)width;
-  (void)height;
-}
-
-static void region_subtract(struct wl_client *client,
-                            struct wl_resource *resource, int32_t x, int32_t y,
-                            int32_t width, int32_t height) {
-  (void)client;
-  (void)resource;
-  (void)x;
-  (void)y;
-  (void)width;
-  (void)height;
+  wl_event_source_fd_update(g_tcp_accept_source, 0);
+  wl_event_source_timer_update(g_tcp_accept_retry_timer,
+                               g_tcp_accept_backoff_ms);
+  log_printf("[COMPOSITOR] ", "⚠️ TCP accept paused for %d ms\n",
+             g_tcp_accept_backoff_ms);
 }
 
-static const struct wl_region_interface region_interface = {
-    region_destroy, region_add, region_subtract};
-
-static void region_destroy_resource(struct wl_resource *resource) {
-  struct wl_region_impl *region = wl_resource_get_user_data(resource);
-  free(region);
-}
-
-static void compositor_destroy_bound_resource(struct wl_resource *resource) {
-  (void)resource;
-  macos_compositor_handle_client_disconnect();
-}
-
-// --- Surface Implementation ---
-
-static void surface_destroy(struct wl_client *client,
-                            struct wl_resource *resource) {
-  (void)client;
-  wl_resource_destroy(resource);
-}
-
-static void surface_attach(struct wl_client *client,
-                           struct wl_resource *resource,
-                           struct wl_resource *buffer, int32_t x, int32_t y) {
-  (void)client;
-  struct wl_surface_impl *surface = wl_resource_get_user_data(resource);
-
-  // CRITICAL: Release old buffer if a new one is being attached
-  // This is required by Wayland protocol - when a new buffer is attached,
-  // the old one must be released (unless it's NULL, which means detach)
-  if (surface->buffer_resource && surface->buffer_resource != buffer && !surface->buffer_release_sent) {
-    struct wl_client *old_buffer_client = wl_resource_get_client(surface->buffer_resource);
-    if (old_buffer_client) {
-      wl_buffer_send_release(surface->buffer_resource);
-      surface->buffer_release_sent = true;
-    }
-  }
-
-  // Pending state update
-  surface->buffer_resource = buffer;
-  // Reset release sent flag for the new buffer (or re-attached buffer)
-  // If buffer is NULL (detach), keep the flag as-is
-  if (buffer) {
-    surface->buffer_release_sent = false;
+static int tcp_accept_resume(void *data) {
+  (void)data;
+  if (g_tcp_accept_source) {
+    wl_event_source_fd_update(g_tcp_accept_source, WL_EVENT_READABLE);
   }
-  surface->x = x;
-  surface->y = y;
+  return 0;
 }
 
-static void surface_damage(struct wl_client *client,
-                           struct wl_resource *resource, int32_t x, int32_t y,
-                           int32_t width, int32_t height) {
-  (void)client;
-  (void)resource;
-  (void)x;
-  (void)y;
-  (void)width;
-  (void)height;
+static struct tcp_peer *tcp_peer_lookup(struct in_addr addr, bool create) {
+  struct tcp_peer *peer;
+  wl_list_for_each(peer, &g_tcp_peers, link) {
+    if (peer->addr.s_addr == addr.s_addr)
+      return peer;
+  }
+  if (!create)
+    return NULL;
+  peer = calloc(1, sizeof(struct tcp_peer));
+  if (!peer)
+    return NULL;
+  peer->addr = addr;
+  wl_list_insert(&g_tcp_peers, &peer->link);
+  return peer;
 }
 
-static void surface_frame(struct wl_client *client,
-                          struct wl_resource *resource, uint32_t callback) {
-  struct wl_surface_impl *surface = wl_resource_get_user_data(resource);
-
-  struct wl_resource *callback_resource =
-      wl_resource_create(client, &wl_callback_interface, 1, callback);
-  if (!callback_resource) {
-    wl_resource_post_no_memory(resource);
-    return;
+static void tcp_peer_client_destroyed(struct wl_listener *listener,
+                                      void *data) {
+  (void)data;
+  struct tcp_peer_client *peer_client =
+      wl_container_of(listener, peer_client, destroy_listener);
+  struct tcp_peer *peer = peer_client->peer;
+  if (--peer->connections <= 0) {
+    wl_list_remove(&peer->link);
+    free(peer);
   }
+  free(peer_client);
+}
 
-  // Store callback to be fired on next frame
-  // Simple implementation: replace existing (should be a list)
-  // For now, we just keep one.
-  // Ideally, we should append to a list.
-  // Given the header structure: struct wl_resource *frame_callback;
-  // It seems it only stores one? Or maybe it's a list head?
-  // Let's assume it's a single callback for now or I should change header to
-  // support list. But header is fixed.
-
-  if (surface->frame_callback) {
-    wl_resource_destroy(surface->frame_callback);
+static void tcp_configure_client_socket(int client_fd) {
+  int flags = fcntl(client_fd, F_GETFL, 0);
+  if (flags >= 0) {
+    fcntl(client_fd, F_SETFL, flags | O_NONBLOCK);
   }
-  surface->frame_callback = callback_resource;
+  fcntl(client_fd, F_SETFD, FD_CLOEXEC);
 
-  // Notify compositor to ensure frame callback timer is running
-  if (g_compositor && g_compositor->frame_callback_requested) {
-    g_compositor->frame_callback_requested();
+  // Wayland messages are small and latency bound - don't let Nagle batch them
+  int nodelay = 1;
+  if (setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay,
+                 sizeof(nodelay)) < 0) {
+    log_printf("[COMPOSITOR] ", "⚠️ Failed to set TCP_NODELAY: %s\n",
+               strerror(errno));
   }
+  int buffer_size = TCP_CLIENT_SOCKET_BUFFER_SIZE;
+  setsockopt(client_fd, SOL_SOCKET, SO_SNDBUF, &buffer_size,
+             sizeof(buffer_size));
+  setsockopt(client_fd, SOL_SOCKET, SO_RCVBUF, &buffer_size,
+             sizeof(buffer_size));
 }
 
-static void surface_set_opaque_region(struct wl_client *client,
-                                      struct wl_resource *resource,
-                                      struct wl_resource *region_resource) {
-  (void)client;
-  (void)resource;
-  (void)region_resource;
-}
-
-static void surface_set_input_region(struct wl_client *client,
-                                     struct wl_resource *resource,
-                                     struct wl_resource *region_resource) {
-  (void)client;
-  (void)resource;
-  (void)region_resource;
-}
+// Listen socket became readable: accept every pending connection
+static int tcp_accept_handler(int listen_fd, uint32_t mask, void *data) {
+  (void)mask;
+#ifdef __APPLE__
+  WawonaCompositor *compositor = (__bridge WawonaCompositor *)data;
+#else
+  WawonaCompositor *compositor = (WawonaCompositor *)data;
+#endif
 
-static void surface_commit(struct wl_client *client,
-                           struct wl_resource *resource) {
-  (void)client;
-  struct wl_surface_impl *surface = wl_resource_get_user_data(resource);
+  if (!compositor || listen_fd < 0) {
+    return 0;
+  }
 
-  surface->committed = true;
+  int accepted_count = 0;
+  int max_per_peer = WawonaSettings_GetTCPMaxConnectionsPerPeer();
+  for (;;) {
+    // Accept one connection
+    struct sockaddr_in client_addr;
+    socklen_t client_len = sizeof(client_addr);
+    int client_fd = accept(listen_fd,
+                           (struct sockaddr *)&client_addr, &client_len);
 
-  // Update buffer dimensions if we have a buffer
-  if (surface->buffer_resource) {
-    // Query buffer details if shm
-    struct wl_shm_buffer *shm_buffer =
-        wl_shm_buffer_get(surface->buffer_resource);
-    if (shm_buffer) {
-      surface->buffer_width = wl_shm_buffer_get_width(shm_buffer);
-      surface->buffer_height = wl_shm_buffer_get_height(shm_buffer);
-      surface->width = surface->buffer_width;
-      surface->height = surface->buffer_height;
-    } else {
-      // Check for dmabuf buffer first (before EGL)
-      // This is critical for waypipe which uses dmabuf buffers
-      if (is_dmabuf_buffer(surface->buffer_resource)) {
-        struct metal_dmabuf_buffer *dmabuf_buffer = dmabuf_buffer_get(surface->buffer_resource);
-        if (dmabuf_buffer) {
-          // Update surface dimensions from dmabuf buffer
-          surface->buffer_width = dmabuf_buffer->width;
-          surface->buffer_height = dmabuf_buffer->height;
-          surface->width = dmabuf_buffer->width;
-          surface->height = dmabuf_buffer->height;
-        }
+    if (client_fd < 0) {
+      int err = errno;
+      if (err == EINTR) {
+        continue;
       }
-      // EGL or other buffer. Width/height should be known or queried via EGL.
-#if !TARGET_OS_IPHONE && !TARGET_OS_SIMULATOR
-      else {
-        struct egl_buffer_handler *egl_handler =
-            macos_compositor_get_egl_buffer_handler();
-        if (egl_handler) {
-          int32_t width, height;
-          EGLint format;
-          if (egl_buffer_handler_query_buffer(egl_handler,
-                                              surface->buffer_resource, &width,
-                                              &height, &format) == 0) {
-            surface->buffer_width = width;
-            surface->buffer_height = height;
-            surface->width = width;
-            surface->height = height;
-          }
+      if (err != EAGAIN && err != EWOULDBLOCK) {
+        log_printf("[COMPOSITOR] ", "⚠️ TCP accept() failed: %s (errno=%d)\n",
+                   strerror(err), err);
+        if (err == EMFILE || err == ENFILE || err == ENOBUFS || err == ENOMEM) {
+          // The connection stays pending: retrying now would spin
+          tcp_accept_pause();
+          return 0;
         }
       }
-#endif
+      break;
     }
-  }
-
-  // Notify compositor to render
-  if (g_compositor && g_compositor->render_callback) {
-    g_compositor->render_callback(surface);
-  }
-}
 
-static void surface_set_buffer_transform(struct wl_client *client,
-                                         struct wl_resource *resource,
-                                         int32_t transform) {
-  (void)client;
-  (void)resource;
-  (void)transform;
-}
-
-static void surface_set_buffer_scale(struct wl_client *client,
-                                     struct wl_resource *resource,
-                                     int32_t scale) {
-  (void)client;
-  (void)resource;
-  (void)scale;
-}
-
-static void surface_damage_buffer(struct wl_client *client,
-                                  struct wl_resource *resource, int32_t x,
-                                  int32_t y, int32_t width, int32_t height) {
-  (void)client;
-  (void)resource;
-  (void)x;
-  (void)y;
-  (void)width;
-  (void)height;
-}
-
-static const struct wl_surface_interface surface_interface = {
-    surface_destroy,
-    surface_attach,
-    surface_damage,
-    surface_frame,
-    surface_set_opaque_region,
-    surface_set_input_region,
-    surface_commit,
-    surface_set_buffer_transform,
-    surface_set_buffer_scale,
-    surface_damage_buffer};
-
-static void surface_destroy_resource(struct wl_resource *resource) {
-  struct wl_surface_impl *surface = wl_resource_get_user_data(resource);
-
-  // CRITICAL: Notify renderer to remove this surface before we free it
-  // This prevents Use-After-Free crashes in the renderer loop
-  remove_surface_from_renderer(surface);
-
-  // Remove from global list
-  if (g_surface_list == surface) {
-    g_surface_list = surface->next;
-  } else {
-    struct wl_surface_impl *prev = g_surface_list;
-    while (prev && prev->next != surface) {
-      prev = prev->next;
-    }
-    if (prev) {
-      prev->next = surface->next;
+    BOOL allowMultiple = WawonaSettings_GetMultipleClientsEnabled();
+#ifdef __APPLE__
+    if (!allowMultiple && g_compositor_instance &&
+        g_compositor_instance.connectedClientCount > 0) {
+#else
+    if (!allowMultiple && g_compositor_instance &&
+        g_compositor_instance->connectedClientCount > 0) {
+#endif
+      log_printf("[COMPOSITOR] ",
+                 "🚫 TCP client rejected: multiple clients disabled\n");
+      close(client_fd);
+      continue;
     }
-  }
-
-  free(surface);
-}
-
-// --- Compositor Implementation ---
-
-static void compositor_create_surface(struct wl_client *client,
-                                      struct wl_resource *resource,
-                                      uint32_t id) {
-  (void)client;
-  (void)resource;
-  (void)id;
-
-  struct wl_surface_impl *surface = calloc(1, sizeof(struct wl_surface_impl));
-  if (!surface) {
-    wl_resource_post_no_memory(resource);
-    return;
-  }
 
-  surface->resource = wl_resource_create(client, &wl_surface_interface,
-                                         wl_resource_get_version(resource), id);
-  if (!surface->resource) {
-    free(surface);
-    wl_resource_post_no_memory(resource);
-    return;
-  }
-
-  wl_resource_set_implementation(surface->resource, &surface_interface, surface,
-                                 surface_destroy_resource);
-
-  // Add to global list
-  surface->next = g_surface_list;
-  g_surface_list = surface;
-}
-
-static void compositor_create_region(struct wl_client *client,
-                                     struct wl_resource *resource,
-                                     uint32_t id) {
-  struct wl_region_impl *region = calloc(1, sizeof(struct wl_region_impl));
-  if (!region) {
-    wl_resource_post_no_memory(resource);
-    return;
-  }
-
-  region->resource = wl_resource_create(client, &wl_region_interface,
-                                        wl_resource_get_version(resource), id);
-  if (!region->resource) {
-    free(region);
-    wl_resource_post_no_memory(resource);
-    return;
-  }
-
-  wl_resource_set_implementation(region->resource, &region_interface, region,
-                                 region_destroy_resource);
-}
+    struct tcp_peer *peer = tcp_peer_lookup(client_addr.sin_addr, false);
+    if (max_per_peer > 0 && peer && peer->connections >= max_per_peer) {
+      log_printf("[COMPOSITOR] ",
+                 "🚫 TCP client rejected: %s already has %d connection(s)\n",
+                 inet_ntoa(client_addr.sin_addr), peer->connections);
+      close(client_fd);
+      continue;
+    }
 
-static const struct wl_compositor_interface compositor_interface = {
-    compositor_create_surface, compositor_create_region};
+    tcp_configure_client_socket(client_fd);
 
-static void compositor_bind(struct wl_client *client, void *data,
-                            uint32_t version, uint32_t id) {
-  struct wl_compositor_impl *compositor = data;
-  BOOL allowMultiple = NO;
 #ifdef __APPLE__
-  @try {
-    WawonaPreferencesManager *prefsManager = [WawonaPreferencesManager sharedManager];
-    if (prefsManager) {
-      allowMultiple = [prefsManager multipleClientsEnabled];
-    }
-  } @catch (NSException *exception) {
-    NSLog(@"⚠️ Failed to read multipleClientsEnabled preference: %@", exception);
-    allowMultiple = NO;
-  }
-  if (!allowMultiple && g_compositor_instance &&
-      g_compositor_instance.connectedClientCount > 0) {
+    struct wl_client *client =
+        wl_client_create(compositor.display, client_fd);
 #else
-  allowMultiple = WawonaSettings_GetMultipleClientsEnabled();
-  if (!allowMultiple && g_compositor_instance &&
-      g_compositor_instance->connectedClientCount > 0) {
+    struct wl_client *client =
+        wl_client_create(compositor->display, client_fd);
 #endif
-    NSLog(
-        @"🚫 Additional client connection rejected: multiple clients disabled");
-    wl_client_destroy(client);
-    return;
-  }
-  struct wl_resource *resource =
-      wl_resource_create(client, &wl_compositor_interface, version, id);
-  if (!resource) {
-    wl_client_post_no_memory(client);
-    return;
-  }
-  wl_resource_set_implementation(resource, &compositor_interface, compositor,
-                                 compositor_destroy_bound_resource);
-  macos_compositor_handle_client_connect();
-}
-
-// --- Public API ---
-
-struct wl_compositor_impl *wl_compositor_create(struct wl_display *display) {
-  struct wl_compositor_impl *compositor =
-      calloc(1, sizeof(struct wl_compositor_impl));
-  if (!compositor)
-    return NULL;
-
-  compositor->display = display;
-  compositor->global = wl_global_create(display, &wl_compositor_interface, 4,
-                                        compositor, compositor_bind);
-
-  if (!compositor->global) {
-    free(compositor);
-    return NULL;
-  }
-
-  g_compositor = compositor;
-  return compositor;
-}
-
-void wl_compositor_destroy(struct wl_compositor_impl *compositor) {
-  if (!compositor)
-    return;
-  if (g_compositor == compositor)
-    g_compositor = NULL;
-  wl_global_destroy(compositor->global);
-  free(compositor);
-}
-
-void wl_compositor_set_render_callback(struct wl_compositor_impl *compositor,
-                                       wl_surface_render_callback_t callback) {
-  if (compositor)
-    compositor->render_callback = callback;
-}
-
-void wl_compositor_set_title_update_callback(
-    struct wl_compositor_impl *compositor,
-    wl_title_update_callback_t callback) {
-  if (compositor)
-    compositor->update_title_callback = callback;
-}
-
-void wl_compositor_set_frame_callback_requested(
-    struct wl_compositor_impl *compositor,
-    wl_frame_callback_requested_t callback) {
-  if (compositor)
-    compositor->frame_callback_requested = callback;
-}
+    if (!client) {
+      log_printf("[COMPOSITOR] ",
+                 "⚠️ Failed to create Wayland client for TCP connection "
+                 "(fd=%d): %s\n",
+                 client_fd, strerror(errno));
+      close(client_fd);
+      continue;
+    }
 
-void wl_compositor_set_seat(struct wl_seat_impl *seat) { (void)seat; }
+    // Count the connection against its peer until the client goes away
+    struct tcp_peer_client *peer_client =
+        calloc(1, sizeof(struct tcp_peer_client));
+    peer = tcp_peer_lookup(client_addr.sin_addr, true);
+    if (peer_client && peer) {
+      peer->connections++;
+      peer_client->peer = peer;
+      peer_client->destroy_listener.notify = tcp_peer_client_destroyed;
+      wl_client_add_destroy_listener(client, &peer_client->destroy_listener);
+    } else {
+      free(peer_client);
+    }
 
-void wl_compositor_for_each_surface(wl_surface_iterator_func_t iterator,
-                                    void *data) {
-  struct wl_surface_impl *s = g_surface_list;
-  while (s) {
-    iterator(s, data);
-    s = s->next;
+    accepted_count++;
+    log_printf("[COMPOSITOR] ",
+               "✅ Accepted TCP connection (fd=%d from %s:%d), created "
+               "Wayland client %p\n",
+               client_fd, inet_ntoa(client_addr.sin_addr),
+               ntohs(client_addr.sin_port), client);
   }
-}
-
-void wl_compositor_lock_surfaces(void) {
-  // TODO: Mutex
-}
 
-void wl_compositor_unlock_surfaces(void) {
-  // TODO: Mutex
-}
-
-struct wl_surface_impl *wl_surface_from_resource(struct wl_resource *resource) {
-  if (wl_resource_instance_of(resource, &wl_surface_interface,
-                              &surface_interface)) {
-    return wl_resource_get_user_data(resource);
+  if (accepted_count > 1) {
+    log_printf("[COMPOSITOR] ", "✅ Accepted %d TCP connection(s)\n",
+               accepted_count);
   }
-  return NULL;
-}
-
-void wl_surface_damage(struct wl_surface_impl *surface, int32_t x, int32_t y,
-                       int32_t width, int32_t height) {
-  (void)surface;
-  (void)x;
-  (void)y;
-  (void)width;
-  (void)height;
-  // Internal damage
-}
-
-void wl_surface_commit(struct wl_surface_impl *surface) {
-  // Internal commit
-  surface->committed = true;
-}
-
-void wl_surface_attach_buffer(struct wl_surface_impl *surface,
-                              struct wl_resource *buffer) {
-  surface->buffer_resource = buffer;
-}
-
-void *wl_buffer_get_shm_data(struct wl_resource *buffer, int32_t *width,
-                             int32_t *height, int32_t *stride) {
-  struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(buffer);
-  if (!shm_buffer)
-    return NULL;
-
-  if (width)
-    *width = wl_shm_buffer_get_width(shm_buffer);
-  if (height)
-    *height = wl_shm_buffer_get_height(shm_buffer);
-  if (stride)
-    *stride = wl_shm_buffer_get_stride(shm_buffer);
-
-  wl_shm_buffer_begin_access(shm_buffer);
-  return wl_shm_buffer_get_data(shm_buffer);
+  g_tcp_accept_backoff_ms = 0;
+  return 0;
 }
 
-void wl_buffer_end_shm_access(struct wl_resource *buffer) {
-  struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(buffer);
-  if (shm_buffer) {
-    wl_shm_buffer_end_access(shm_buffer);
-  }
+// Trace export requested (SIGUSR2): write the trace from the event thread
+static int trace_dump_handler(int fd, uint32_t mask, void *data) {
+  (void)fd;
+  (void)mask;
+  (void)data;
+  trace_handle_dump_request();
+  return 0;
 }
 
-struct wl_surface_impl *wl_get_all_surfaces(void) { return g_surface_list; }
-
-// Update compositor_create_surface to use g_surface_list
-// Re-implementing parts of compositor_create_surface here to ensure correct
-// linking (Code above was simplified)
 #include "metal_waypipe.h"
 #include "wayland_drm.h"
 #include "wayland_gtk_shell.h"
@@ -673,10 +289,10 @@ struct wl_surface_impl *wl_get_all_surfaces(void) { return g_surface_list; }
 #include "wayland_screencopy.h"
 #include "wayland_shell.h"
 #include "wayland_tablet.h"
-#include "wayland_viewporter.h"
 #include "xdg-shell-protocol.h"
 
 #include "metal_renderer.h"
+#include "software_renderer.h"
 #include "surface_renderer.h"
 #import <MetalKit/MetalKit.h>
 
@@ -830,7 +446,7 @@ struct wl_surface_impl *wl_get_all_surfaces(void) { return g_surface_list; }
 @property(nonatomic, assign)
     InputHandler *inputHandler; // assign for MRC compatibility
 @property(nonatomic, assign)
-    SurfaceRenderer *renderer; // assign for MRC compatibility
+    id<RenderingBackend> renderer; // assign for MRC compatibility
 @property(nonatomic, strong)
     MTKView *metalView; // Metal view for full compositor rendering
 @end
@@ -853,19 +469,16 @@ struct wl_surface_impl *wl_get_all_surfaces(void) { return g_surface_list; }
   BOOL result = [super becomeFirstResponder];
   // Send keyboard enter to focused surface when view becomes first responder
   if (result && self.inputHandler && self.inputHandler.seat) {
+    wl_compositor_lock_surfaces();
     struct wl_surface_impl *surface = wl_get_all_surfaces();
     // Find the first valid surface
-    while (surface && (!surface->resource || !self.inputHandler.seat->keyboard_resource)) {
+    while (surface && !surface->resource) {
       surface = surface->next;
     }
-    if (surface && surface->resource && self.inputHandler.seat->keyboard_resource) {
-      uint32_t serial = wl_seat_get_serial(self.inputHandler.seat);
-      struct wl_array keys;
-      wl_array_init(&keys);
-      wl_seat_send_keyboard_enter(self.inputHandler.seat, surface->resource, serial, &keys);
-      wl_array_release(&keys);
-      wl_seat_send_keyboard_modifiers(self.inputHandler.seat, serial);
+    if (surface && surface->resource) {
+      input_queue_keyboard_enter(self.inputHandler.inputQueue, surface->id);
     }
+    wl_compositor_unlock_surfaces();
   }
   return result;
 }
@@ -983,56 +596,255 @@ struct wl_surface_impl *wl_get_all_surfaces(void) { return g_surface_list; }
 // Static reference to compositor instance for C callback
 static WawonaCompositor *g_compositor_instance = NULL;
 
-// Forward declarations
-static int send_frame_callbacks_timer(void *data);
-__attribute__((unused)) static void send_frame_callbacks_timer_idle(void *data);
-static BOOL ensure_frame_callback_timer_on_event_thread(
-    WawonaCompositor *compositor, uint32_t delay_ms, const char *reason);
-static void ensure_frame_callback_timer_idle(void *data);
-static void trigger_first_frame_callback_idle(void *data);
+// Refresh period last reported by the display link (written on the display
+// link thread, applied to the scheduler on the event thread)
+static _Atomic uint64_t g_display_refresh_ns = 0;
+// Whether display link ticks are forwarded to the frame scheduler. The display
+// link keeps running for rendering; this only gates the vblank notifications.
+static atomic_bool g_vblank_forwarding = false;
 
-// C function for frame callback requested callback
-// Called from event thread when a client requests a frame callback
-static void wawona_compositor_frame_callback_requested(void) {
-  if (!g_compositor_instance)
+static void display_link_vblank_set_enabled(struct frame_vblank_source *source,
+                                            bool enabled) {
+  (void)source;
+  atomic_store(&g_vblank_forwarding, enabled);
+}
+
+static struct frame_vblank_source g_display_link_vblank = {
+    .set_enabled = display_link_vblank_set_enabled,
+    .data = NULL,
+};
+
+static uint64_t monotonic_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+// Forward a display link tick (any thread). until_present is the time left
+// until the upcoming frame reaches the display, refresh the current period
+// (both in seconds; ProMotion panels change the period at runtime).
+static void forward_display_link_vblank(WawonaCompositor *compositor,
+                                        double until_present, double refresh) {
+  if (refresh > 0) {
+    atomic_store(&g_display_refresh_ns, (uint64_t)(refresh * 1e9));
+  }
+  if (!compositor || !atomic_load(&g_vblank_forwarding)) {
     return;
+  }
+  uint64_t present_ns = monotonic_now_ns();
+  if (until_present > 0) {
+    present_ns += (uint64_t)(until_present * 1e9);
+  }
+  frame_scheduler_post_vblank(compositor.frameScheduler, present_ns);
+}
 
-  // This runs on the event thread - safe to create timer directly
-  if (g_compositor_instance.display) {
-    BOOL timer_was_missing =
-        (g_compositor_instance.frame_callback_source == NULL);
-
-    // Ensure timer exists - if it was missing, create it with delay 1ms to fire
-    // almost immediately Using 1ms instead of 0ms because Wayland timers might
-    // not fire with delay=0 Otherwise, if timer already exists, don't modify it
-    // (let it fire at its scheduled time) This prevents infinite loops where
-    // sending callbacks triggers immediate requests
-    if (timer_was_missing) {
-      log_printf("[COMPOSITOR] ", "wawona_compositor_frame_callback_requested: "
-                                  "Creating timer (first frame request)\n");
-      // Create timer with 16ms delay for continuous operation
-      if (!ensure_frame_callback_timer_on_event_thread(
-              g_compositor_instance, 16, "first frame request")) {
-        log_printf("[COMPOSITOR] ", "wawona_compositor_frame_callback_"
-                                    "requested: Failed to create timer\n");
-      } else {
-        log_printf("[COMPOSITOR] ",
-                   "wawona_compositor_frame_callback_requested: Timer created "
-                   "successfully. Scheduling immediate fire via idle.\n");
-        // Use idle callback to trigger first frame callback immediately
-        // This avoids waiting 16ms for the first frame and ensures start-up is
-        // snappy
-        struct wl_event_loop *eventLoop =
-            wl_display_get_event_loop(g_compositor_instance.display);
-        wl_event_loop_add_idle(eventLoop, trigger_first_frame_callback_idle,
-                               (__bridge void *)g_compositor_instance);
-      }
+// Repaint hook of the frame scheduler (event thread): deliver pending resize
+// configures and frame callbacks, then go idle. Callbacks of surfaces the
+// renderer has not composited yet wait for it to present them
+// (wawona_compositor_frame_presented); hidden and occluded surfaces wait for
+// a commit that shows them.
+static void wawona_compositor_repaint(void *data,
+                                      uint64_t predicted_present_ns) {
+  (void)predicted_present_ns;
+  WawonaCompositor *compositor = (__bridge WawonaCompositor *)data;
+  if (!compositor) {
+    return;
+  }
+  TRACE_SCOPE("repaint");
+
+  uint64_t refresh_ns = atomic_load(&g_display_refresh_ns);
+  if (refresh_ns > 0) {
+    frame_scheduler_set_refresh_ns(compositor.frameScheduler, refresh_ns);
+  }
+
+  BOOL needs_flush = NO;
+  if (compositor.needs_resize_configure) {
+    // Update wl_output mode/geometry (must be done on event thread to avoid
+    // races)
+    if (compositor.output) {
+      wl_output_update_size(compositor.output, compositor.pending_resize_width,
+                            compositor.pending_resize_height,
+                            compositor.pending_resize_scale);
     }
-    // If timer already exists, do nothing - it will fire at its scheduled
-    // interval
+
+    if (compositor.xdg_wm_base) {
+      // Pass actual output size for storage (clients can use as hint)
+      // But configure events send 0x0 to signal arbitrary resolution support
+      xdg_wm_base_send_configure_to_all_toplevels(
+          compositor.xdg_wm_base, compositor.pending_resize_width,
+          compositor.pending_resize_height);
+    }
+    compositor.needs_resize_configure = NO;
+    needs_flush = YES;
+  }
+
+  // Cache entries dropped by renderFrame since the last commit
+  metal_renderer_sync_buffer_listeners();
+
+  // Input queued by the UI thread and pointer input coalesced since the last
+  // frame go out before the frame callbacks
+  input_queue_drain(compositor.inputQueue);
+  input_batch_flush(compositor.inputBatch);
+
+  if (wl_send_frame_callbacks() > 0) {
+    needs_flush = YES;
+  }
+  if (needs_flush) {
+    // Wake clients waiting on wl_display_dispatch()
+    wl_display_flush_clients(compositor.display);
+  }
+}
+
+// Input batch hook (event thread): send the batch with the next frame
+static void input_batch_schedule(void *data) {
+  WawonaCompositor *compositor = (__bridge WawonaCompositor *)data;
+  if (compositor) {
+    frame_scheduler_schedule(compositor.frameScheduler);
+  }
+}
+
+// dmabuf feedback follows the rendering backend: SurfaceRenderer shows
+// IOSurfaces as CALayer contents without compositing them, so their formats
+// go into the scanout tranche; Metal and pixman composite everything.
+// Runs on the event thread, which owns the client resources.
+static void update_dmabuf_feedback_idle(void *data) {
+  WawonaCompositor *compositor = (__bridge WawonaCompositor *)data;
+  if (!compositor || !compositor.linux_dmabuf) {
+    return;
+  }
+  static const uint32_t layer_formats[] = {
+      0x34325241, // ARGB8888
+      0x34325258, // XRGB8888
+      0x3231564e, // NV12
+  };
+  if (compositor.backendType == RENDERING_BACKEND_SURFACE) {
+    zwp_linux_dmabuf_v1_set_scanout_formats(
+        compositor.linux_dmabuf, layer_formats,
+        (int)(sizeof(layer_formats) / sizeof(layer_formats[0])));
+  } else {
+    zwp_linux_dmabuf_v1_set_scanout_formats(compositor.linux_dmabuf, NULL, 0);
+  }
+}
+
+// Called by the renderers' presentation handlers (any thread) once a frame
+// with newly composited commits was presented: their frame callbacks and
+// presentation feedback go out with the next repaint
+static void wawona_compositor_frame_presented(void) {
+  WawonaCompositor *compositor = g_compositor_instance;
+  if (compositor) {
+    frame_scheduler_post_schedule(compositor.frameScheduler);
+  }
+}
+
+// Work posted to the event thread by other threads. The event loop blocks
+// until a client, a timer or this wake pipe needs it, so work queued from
+// the main thread must write to the pipe (wl_event_loop_add_idle neither
+// wakes the loop nor is safe to call off the event thread).
+enum event_thread_work {
+  EVENT_THREAD_FLUSH_INPUT = 1u << 0,     // Flush clients, send frame callbacks
+  EVENT_THREAD_DMABUF_FEEDBACK = 1u << 1, // Backend changed: update feedback
+  EVENT_THREAD_CHECK_STOP = 1u << 2,      // Re-check shouldStopEventThread
+};
+
+static void flush_input_and_send_frame_callbacks_idle(void *data);
+
+static int g_event_thread_wake_fds[2] = {-1, -1};
+static struct wl_event_source *g_event_thread_wake_source = NULL;
+static atomic_uint g_event_thread_work = 0;
+
+static void post_event_thread_work(unsigned int work) {
+  // Only the poster that finds no work pending writes: the pipe holds at
+  // most one byte per drain
+  if (atomic_fetch_or(&g_event_thread_work, work) != 0 ||
+      g_event_thread_wake_fds[1] < 0) {
+    return;
+  }
+  if (write(g_event_thread_wake_fds[1], "w", 1) < 0 && errno != EAGAIN) {
+    log_printf("[COMPOSITOR] ", "⚠️ Failed to wake the event thread: %s\n",
+               strerror(errno));
+  }
+}
+
+static int event_thread_wake_handler(int fd, uint32_t mask, void *data) {
+  (void)mask;
+  char buf[16];
+  while (read(fd, buf, sizeof(buf)) > 0) {
+  }
+  unsigned int work = atomic_exchange(&g_event_thread_work, 0);
+  if (work & EVENT_THREAD_FLUSH_INPUT) {
+    flush_input_and_send_frame_callbacks_idle(data);
+  }
+  if (work & EVENT_THREAD_DMABUF_FEEDBACK) {
+    update_dmabuf_feedback_idle(data);
+  }
+  return 0;
+}
+
+static int set_wake_fd_flags(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    return -1;
+  }
+  return fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+static bool create_event_thread_wake(struct wl_event_loop *loop, void *data) {
+  if (pipe(g_event_thread_wake_fds) < 0 ||
+      set_wake_fd_flags(g_event_thread_wake_fds[0]) < 0 ||
+      set_wake_fd_flags(g_event_thread_wake_fds[1]) < 0) {
+    log_printf("[COMPOSITOR] ",
+               "⚠️ Failed to create event thread wake pipe: %s\n",
+               strerror(errno));
+    return false;
+  }
+  g_event_thread_wake_source =
+      wl_event_loop_add_fd(loop, g_event_thread_wake_fds[0], WL_EVENT_READABLE,
+                           event_thread_wake_handler, data);
+  return g_event_thread_wake_source != NULL;
+}
+
+static void destroy_event_thread_wake(void) {
+  if (g_event_thread_wake_source) {
+    wl_event_source_remove(g_event_thread_wake_source);
+    g_event_thread_wake_source = NULL;
+  }
+  for (int i = 0; i < 2; i++) {
+    if (g_event_thread_wake_fds[i] >= 0) {
+      close(g_event_thread_wake_fds[i]);
+      g_event_thread_wake_fds[i] = -1;
+    }
+  }
+  atomic_store(&g_event_thread_work, 0);
+}
+
+// C function for frame callback requested callback
+// Called from event thread when a client requests a frame callback
+static void wawona_compositor_frame_callback_requested(void) {
+  if (g_compositor_instance) {
+    frame_scheduler_schedule(g_compositor_instance.frameScheduler);
   }
 }
 
+// Size of EGL buffers for the compositor core (shm and dmabuf it handles itself)
+static bool wawona_compositor_query_buffer_size(struct wl_resource *buffer,
+                                                int32_t *width,
+                                                int32_t *height) {
+#if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
+  (void)buffer;
+  (void)width;
+  (void)height;
+  return false;
+#else
+  struct egl_buffer_handler *egl_handler =
+      macos_compositor_get_egl_buffer_handler();
+  if (!egl_handler)
+    return false;
+  EGLint format;
+  return egl_buffer_handler_query_buffer(egl_handler, buffer, width, height,
+                                         &format) == 0;
+#endif
+}
+
 // C function to update window title when focus changes
 void wawona_compositor_update_title(struct wl_client *client) {
   if (g_compositor_instance) {
@@ -1064,10 +876,16 @@ void wawona_compositor_detect_full_compositor(struct wl_client *client) {
   // 0 = Automatic (default)
   // 1 = Metal (Vulkan)
   // 2 = Cocoa (Surface)
+  // 3 = Software (pixman)
   NSInteger backendPref =
       [[NSUserDefaults standardUserDefaults] integerForKey:@"RenderingBackend"];
 
-  if (backendPref == 1) {
+  if (backendPref == 3) {
+    // Force software
+    shouldSwitchToMetal = NO;
+    NSLog(@"ℹ️ Rendering Backend preference set to Software (pixman) - "
+          @"preventing switch");
+  } else if (backendPref == 1) {
     // Force Metal
     shouldSwitchToMetal = YES;
     NSLog(@"ℹ️ Rendering Backend preference set to Metal (Vulkan) - forcing "
@@ -1183,6 +1001,7 @@ static void render_surface_callback(struct wl_surface_impl *surface) {
   if (!client)
     return;
 
+  TRACE_SCOPE("render_surface_callback");
   if (g_compositor_instance && g_compositor_instance.renderingBackend) {
     // CRITICAL: Render SYNCHRONOUSLY on main thread for immediate updates
     // Wayland compositors MUST repaint immediately when clients commit buffers
@@ -1191,9 +1010,12 @@ static void render_surface_callback(struct wl_surface_impl *surface) {
     if ([NSThread isMainThread]) {
       renderSurfaceImmediate(surface);
     } else {
+      TRACE_SCOPE("dispatch_sync main");
       dispatch_sync(dispatch_get_main_queue(), ^{
         renderSurfaceImmediate(surface);
       });
+      // Buffers the renderer started caching are still attached here
+      metal_renderer_sync_buffer_listeners();
     }
   }
 }
@@ -1202,6 +1024,9 @@ static void render_surface_callback(struct wl_surface_impl *surface) {
 static void renderSurfaceImmediate(struct wl_surface_impl *surface) {
   if (!g_compositor_instance || !surface)
     return;
+  TRACE_SCOPE("render_surface");
+  TRACE_FLOW_STEP("commit",
+                  wl_surface_trace_flow_id(surface, surface->commit_seq));
 
   // Check if window needs to be shown and sized for first client
   if (!g_compositor_instance.windowShown && surface->buffer_resource) {
@@ -1227,6 +1052,7 @@ static void renderSurfaceImmediate(struct wl_surface_impl *surface) {
           respondsToSelector:@selector(renderSurface:)]) {
     [g_compositor_instance.renderingBackend renderSurface:surface];
   }
+  surface->rendered_seq = surface->commit_seq;
 
   // CRITICAL: Trigger IMMEDIATE redraw after rendering surface
   // This ensures nested compositors (like Weston) see updates immediately
@@ -1328,7 +1154,7 @@ void macos_compositor_check_and_hide_window_if_needed(void) {
     _window = window;
     _eventLoop = wl_display_get_event_loop(display);
     _shouldStopEventThread = NO;
-    _frame_callback_source = NULL;
+    _frameScheduler = NULL;
     _pending_resize_width = 0;
     _pending_resize_height = 0;
     _needs_resize_configure = NO;
@@ -1416,11 +1242,21 @@ void macos_compositor_check_and_hide_window_if_needed(void) {
 
     // Create surface renderer with NSView (like OWL compositor)
     // Start with Cocoa renderer, will switch to Metal if full compositor
-    // detected
-    SurfaceRenderer *renderer =
-        [[SurfaceRenderer alloc] initWithCompositorView:compositorView];
+    // detected. The software (pixman) renderer can be forced via prefs.
+    id<RenderingBackend> renderer = nil;
+    if ([[NSUserDefaults standardUserDefaults]
+            integerForKey:@"RenderingBackend"] == 3) {
+      renderer =
+          [[SoftwareRenderer alloc] initWithCompositorView:compositorView];
+    }
+    if (renderer) {
+      _backendType = RENDERING_BACKEND_SOFTWARE;
+    } else {
+      renderer =
+          [[SurfaceRenderer alloc] initWithCompositorView:compositorView];
+      _backendType = 0; // RENDERING_BACKEND_COCOA
+    }
     _renderingBackend = renderer;
-    _backendType = 0; // RENDERING_BACKEND_COCOA
 
     // Set renderer reference in view for drawRect: calls
     compositorView.renderer = renderer;
@@ -1444,53 +1280,12 @@ void macos_compositor_check_and_hide_window_if_needed(void) {
   return self;
 }
 
-// Implementation of wayland frame callback functions
-int wl_send_frame_callbacks(void) {
-  if (!g_compositor_instance || !g_surface_list) {
-    return 0;
-  }
-
-  int count = 0;
-  struct wl_surface_impl *surface = g_surface_list;
-  while (surface) {
-    if (surface->frame_callback) {
-      // Get current time in milliseconds (wayland time is in milliseconds since
-      // epoch)
-      struct timespec ts;
-      clock_gettime(CLOCK_MONOTONIC, &ts);
-      uint32_t time = (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
-
-      // Send frame callback done event
-      wl_callback_send_done(surface->frame_callback, time);
-      wl_resource_destroy(surface->frame_callback);
-      surface->frame_callback = NULL;
-      count++;
-    }
-    surface = surface->next;
-  }
-  return count;
-}
-
-bool wl_has_pending_frame_callbacks(void) {
-  if (!g_surface_list) {
-    return false;
-  }
-
-  struct wl_surface_impl *surface = g_surface_list;
-  while (surface) {
-    if (surface->frame_callback) {
-      return true;
-    }
-    surface = surface->next;
-  }
-  return false;
-}
-
 - (void)setupInputHandling {
   if (_seat && _window) {
     _inputHandler = [[InputHandler alloc] initWithSeat:_seat
                                                 window:_window
                                             compositor:self];
+    _inputHandler.inputQueue = _inputQueue;
     [_inputHandler setupInputHandling];
 
 #if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
@@ -1522,6 +1317,8 @@ bool wl_has_pending_frame_callbacks(void) {
 
 - (BOOL)start {
   init_compositor_logging();
+  trace_set_enabled(WawonaSettings_GetTraceEnabled());
+  trace_set_thread_name("main");
   NSLog(@"✅ Starting compositor backend...");
   log_printf("[COMPOSITOR] ", "Starting compositor backend...\n");
 
@@ -1548,6 +1345,17 @@ bool wl_has_pending_frame_callbacks(void) {
   // Set up frame callback requested callback to ensure timer is running
   wl_compositor_set_frame_callback_requested(
       _compositor, wawona_compositor_frame_callback_requested);
+  wl_compositor_set_frame_presented_callback(_compositor,
+                                             wawona_compositor_frame_presented);
+
+  // Renderer, client and buffer hooks of the platform independent core
+  wl_compositor_set_surface_destroyed_callback(_compositor,
+                                               remove_surface_from_renderer);
+  wl_compositor_set_client_callbacks(_compositor,
+                                     macos_compositor_handle_client_connect,
+                                     macos_compositor_handle_client_disconnect);
+  wl_compositor_set_buffer_size_query(_compositor,
+                                      wawona_compositor_query_buffer_size);
 
   // Get window size for output
   // CRITICAL: Use actual CompositorView bounds (already constrained to safe
@@ -1590,21 +1398,21 @@ bool wl_has_pending_frame_callbacks(void) {
   // Calculate pixel dimensions: points * scale = pixels
   int32_t pixelWidth = (int32_t)round(frame.size.width * scale);
   int32_t pixelHeight = (int32_t)round(frame.size.height * scale);
-  int32_t scaleInt = (int32_t)scale;
 
+  // The exact factor: wl_output rounds it up for integer-scale clients and
+  // wp_fractional_scale_v1 hands it to the others
 #if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
-  _output =
-      wl_output_create(_display, pixelWidth, pixelHeight, scaleInt, "iOS");
+  _output = wl_output_create(_display, pixelWidth, pixelHeight, scale, "iOS");
 #else
   _output =
-      wl_output_create(_display, pixelWidth, pixelHeight, scaleInt, "macOS");
+      wl_output_create(_display, pixelWidth, pixelHeight, scale, "macOS");
 #endif
   if (!_output) {
     NSLog(@"❌ Failed to create wl_output");
     return NO;
   }
   NSLog(
-      @"   ✓ wl_output created: %.0fx%.0f points @ %.0fx scale = %dx%d pixels",
+      @"   ✓ wl_output created: %.0fx%.0f points @ %.2fx scale = %dx%d pixels",
       frame.size.width, frame.size.height, scale, pixelWidth, pixelHeight);
 
 #if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
@@ -1627,6 +1435,26 @@ bool wl_has_pending_frame_callbacks(void) {
   // Set seat in compositor for focus management
   wl_compositor_set_seat(_seat);
 
+  _inputBatch =
+      input_batch_create(_seat, _display, INPUT_BATCH_DEFAULT_WINDOW_MS);
+  if (!_inputBatch) {
+    NSLog(@"❌ Failed to create input batch");
+    return NO;
+  }
+  input_batch_set_callbacks(_inputBatch, &(struct input_batch_callbacks){
+                                             .schedule = input_batch_schedule,
+                                             .data = (__bridge void *)self,
+                                         });
+
+  // The UI thread never calls into the seat: its events are queued and
+  // dispatched here on the event thread
+  _inputQueue = input_queue_create(_eventLoop, _seat, _inputBatch,
+                                   INPUT_QUEUE_DEFAULT_CAPACITY);
+  if (!_inputQueue) {
+    NSLog(@"❌ Failed to create input queue");
+    return NO;
+  }
+
   _shm = wl_shm_create(_display);
   if (!_shm) {
     NSLog(@"❌ Failed to create wl_shm");
@@ -1695,8 +1523,8 @@ bool wl_has_pending_frame_callbacks(void) {
   }
 
   // Fractional scale protocol
-  struct wl_fractional_scale_manager_impl *fractional_scale =
-      wl_fractional_scale_create(_display);
+  struct wp_fractional_scale_manager_impl *fractional_scale =
+      wp_fractional_scale_manager_create(_display, _output);
   if (fractional_scale) {
     NSLog(@"   ✓ Fractional scale protocol created");
   }
@@ -1779,6 +1607,8 @@ bool wl_has_pending_frame_callbacks(void) {
     struct zwp_linux_dmabuf_v1_impl *linux_dmabuf =
         zwp_linux_dmabuf_v1_create(_display);
     if (linux_dmabuf) {
+      _linux_dmabuf = linux_dmabuf;
+      update_dmabuf_feedback_idle((__bridge void *)self);
       NSLog(@"   ✓ Linux DMA-BUF protocol created (IOSurface-backed, nearly "
             @"zero-copy)");
     }
@@ -1860,7 +1690,8 @@ bool wl_has_pending_frame_callbacks(void) {
   }
 
   // Presentation time protocol (for accurate presentation timing feedback)
-  struct wp_presentation_impl *presentation = wp_presentation_create(_display);
+  struct wp_presentation_impl *presentation =
+      wp_presentation_create(_display, _output);
   if (presentation) {
     NSLog(@"   ✓ Presentation time protocol created");
   }
@@ -1887,6 +1718,25 @@ bool wl_has_pending_frame_callbacks(void) {
     NSLog(@"   ✗ Qt Window Manager protocol creation failed");
   }
 
+  // Frame scheduler: repaints (frame callbacks, configures) are driven by the
+  // display link's vblanks while work is pending and idle otherwise
+  _frameScheduler = frame_scheduler_create_for_event_loop(
+      _eventLoop, wawona_compositor_repaint, (__bridge void *)self);
+  if (_frameScheduler) {
+    frame_scheduler_set_vblank_source(_frameScheduler, &g_display_link_vblank);
+    wl_compositor_set_frame_scheduler(_compositor, _frameScheduler);
+    NSLog(@"   ✓ Frame scheduler created");
+  } else {
+    NSLog(@"   ✗ Frame scheduler creation failed");
+  }
+
+  // Work from other threads wakes the event thread through a pipe
+  if (create_event_thread_wake(_eventLoop, (__bridge void *)self)) {
+    NSLog(@"   ✓ Event thread wake pipe created");
+  } else {
+    NSLog(@"   ✗ Event thread wake pipe creation failed");
+  }
+
   // Start dedicated Wayland event processing thread
   NSLog(@"   ✓ Starting Wayland event processing thread");
   _shouldStopEventThread = NO;
@@ -1897,6 +1747,7 @@ bool wl_has_pending_frame_callbacks(void) {
       return;
 
     log_printf("[COMPOSITOR] ", "🚀 Wayland event thread started\n");
+    trace_set_thread_name("WaylandEventThread");
 
     // Set up proper error handling for client connections
     // wl_display_run() handles client connections internally
@@ -1924,55 +1775,36 @@ bool wl_has_pending_frame_callbacks(void) {
       struct wl_event_loop *eventLoop =
           wl_display_get_event_loop(compositor.display);
 
-      // Set up TCP accept() handling if we have a listening socket
-      // Use a timer to periodically check for new connections
-      struct wl_event_source *tcp_accept_timer = NULL;
+      // Accept TCP connections as soon as the listening socket is readable
       if (compositor.tcp_listen_fd >= 0) {
-        // Create a timer that fires every 50ms to check for new TCP connections
-        tcp_accept_timer = wl_event_loop_add_timer(
-            eventLoop, tcp_accept_timer_handler, (__bridge void *)compositor);
-
-        if (tcp_accept_timer) {
-          // Start timer immediately (0ms) - it will reschedule itself via
-          // return value
-          int ret = wl_event_source_timer_update(tcp_accept_timer, 0);
-          if (ret < 0) {
-            log_printf("[COMPOSITOR] ",
-                       "⚠️ Failed to start TCP accept() timer: %s\n",
-                       strerror(errno));
-            wl_event_source_remove(tcp_accept_timer);
-            tcp_accept_timer = NULL;
-          } else {
-            log_printf("[COMPOSITOR] ",
-                       "✅ TCP accept() timer registered and started "
-                       "(listen_fd=%d, ret=%d)\n",
-                       compositor.tcp_listen_fd, ret);
-          }
+        g_tcp_accept_source = wl_event_loop_add_fd(
+            eventLoop, compositor.tcp_listen_fd, WL_EVENT_READABLE,
+            tcp_accept_handler, (__bridge void *)compositor);
+        g_tcp_accept_retry_timer =
+            wl_event_loop_add_timer(eventLoop, tcp_accept_resume, NULL);
+        if (g_tcp_accept_source) {
+          log_printf("[COMPOSITOR] ",
+                     "✅ TCP listener registered with event loop "
+                     "(listen_fd=%d)\n",
+                     compositor.tcp_listen_fd);
         } else {
           log_printf("[COMPOSITOR] ",
-                     "⚠️ Failed to register TCP accept() timer\n");
+                     "⚠️ Failed to register TCP listener with event loop\n");
         }
       }
 
-      while (!compositor.shouldStopEventThread) {
-        // Manually check for TCP connections if timer isn't working
-        // This ensures connections are accepted even if timer has issues
-        if (compositor.tcp_listen_fd >= 0) {
-          fd_set read_fds;
-          FD_ZERO(&read_fds);
-          FD_SET(compositor.tcp_listen_fd, &read_fds);
-          struct timeval timeout = {0, 0}; // Non-blocking
-          int select_ret = select(compositor.tcp_listen_fd + 1, &read_fds, NULL,
-                                  NULL, &timeout);
-          if (select_ret > 0 && FD_ISSET(compositor.tcp_listen_fd, &read_fds)) {
-            // Call timer handler directly to accept connection
-            tcp_accept_timer_handler((__bridge void *)compositor);
-          }
-        }
+      // Export the frame trace on request
+      struct wl_event_source *trace_dump_source = NULL;
+      if (trace_get_dump_fd() >= 0) {
+        trace_dump_source =
+            wl_event_loop_add_fd(eventLoop, trace_get_dump_fd(),
+                                 WL_EVENT_READABLE, trace_dump_handler, NULL);
+      }
 
-        // Dispatch events with a timeout to allow timers to fire
-        // Use 16ms timeout (matches frame callback timer interval)
-        int ret = wl_event_loop_dispatch(eventLoop, 16);
+      while (!compositor.shouldStopEventThread) {
+        // Block until there is work: clients, timers, vblanks and work
+        // posted by other threads (post_event_thread_work) all wake the loop
+        int ret = wl_event_loop_dispatch(eventLoop, -1);
         if (ret < 0) {
           log_printf("[COMPOSITOR] ", "⚠️ Event loop dispatch failed: %d\n",
                      ret);
@@ -1982,9 +1814,18 @@ bool wl_has_pending_frame_callbacks(void) {
         wl_display_flush_clients(compositor.display);
       }
 
-      // Cleanup TCP accept timer
-      if (tcp_accept_timer) {
-        wl_event_source_remove(tcp_accept_timer);
+      // Cleanup TCP listener source
+      if (g_tcp_accept_source) {
+        wl_event_source_remove(g_tcp_accept_source);
+        g_tcp_accept_source = NULL;
+      }
+      if (g_tcp_accept_retry_timer) {
+        wl_event_source_remove(g_tcp_accept_retry_timer);
+        g_tcp_accept_retry_timer = NULL;
+      }
+      g_tcp_accept_backoff_ms = 0;
+      if (trace_dump_source) {
+        wl_event_source_remove(trace_dump_source);
       }
     } @catch (NSException *exception) {
       log_printf("[COMPOSITOR] ", "⚠️ Exception in Wayland event thread: %s\n",
@@ -2090,7 +1931,9 @@ bool wl_has_pending_frame_callbacks(void) {
 // DisplayLink callback - called at display refresh rate
 #if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
 - (void)displayLinkCallback:(CADisplayLink *)displayLink {
-  (void)displayLink;
+  forward_display_link_vblank(
+      self, displayLink.targetTimestamp - CACurrentMediaTime(),
+      displayLink.targetTimestamp - displayLink.timestamp);
   [self renderFrame];
 }
 #else
@@ -2100,11 +1943,29 @@ displayLinkCallback(CVDisplayLinkRef displayLink, const CVTimeStamp *inNow,
                     CVOptionFlags *flagsOut, void *displayLinkContext) {
   (void)displayLink;
   (void)inNow;
-  (void)inOutputTime;
   (void)flagsIn;
   (void)flagsOut;
   WawonaCompositor *compositor =
       (__bridge WawonaCompositor *)displayLinkContext;
+
+  // Host time is in mach_absolute_time units
+  static mach_timebase_info_data_t timebase;
+  if (timebase.denom == 0) {
+    mach_timebase_info(&timebase);
+  }
+  uint64_t host_now = mach_absolute_time();
+  double until_present = 0;
+  if (inOutputTime->hostTime > host_now) {
+    until_present = (double)(inOutputTime->hostTime - host_now) *
+                    timebase.numer / timebase.denom / 1e9;
+  }
+  double refresh = 0;
+  if (inOutputTime->videoTimeScale > 0) {
+    refresh = (double)inOutputTime->videoRefreshPeriod /
+              inOutputTime->videoTimeScale;
+  }
+  forward_display_link_vblank(compositor, until_present, refresh);
+
   if (compositor) {
     // Render on main thread
     dispatch_async(dispatch_get_main_queue(), ^{
@@ -2331,17 +2192,18 @@ displayLinkCallback(CVDisplayLinkRef displayLink, const CVTimeStamp *inNow,
   // Example: 375 points * 3 scale = 1125 pixels (iPhone 14 Pro)
   int32_t pixelWidth = (int32_t)round(outputRect.size.width * scale);
   int32_t pixelHeight = (int32_t)round(outputRect.size.height * scale);
-  int32_t scaleInt = (int32_t)scale;
 
-  NSLog(@"🔵 Output scaling: %.0fx%.0f points @ %.0fx scale = %dx%d pixels",
+  NSLog(@"🔵 Output scaling: %.0fx%.0f points @ %.2fx scale = %dx%d pixels",
         outputRect.size.width, outputRect.size.height, scale, pixelWidth,
         pixelHeight);
 
   // Store for resize handling on event thread to avoid race conditions
   _pending_resize_width = pixelWidth;
   _pending_resize_height = pixelHeight;
-  _pending_resize_scale = scaleInt;
+  _pending_resize_scale = scale;
   _needs_resize_configure = YES;
+
+  frame_scheduler_post_schedule(_frameScheduler);
 }
 
 #if !TARGET_OS_IPHONE && !TARGET_OS_SIMULATOR
@@ -2522,11 +2384,11 @@ displayLinkCallback(CVDisplayLinkRef displayLink, const CVTimeStamp *inNow,
 #endif
 
   if (_output) {
-    int32_t scale = 1;
+    CGFloat scale = 1.0;
 #if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
-    scale = (int32_t)[UIScreen mainScreen].scale;
+    scale = [UIScreen mainScreen].scale;
 #else
-    scale = (int32_t)_window.backingScaleFactor;
+    scale = _window.backingScaleFactor;
 #endif
     wl_output_update_size(_output, width, height, scale);
   }
@@ -2542,111 +2404,11 @@ displayLinkCallback(CVDisplayLinkRef displayLink, const CVTimeStamp *inNow,
   _pending_resize_height = height;
   _needs_resize_configure = YES;
 
-  // Trigger the idle callback immediately to send configure events
-  if (_eventLoop) {
-    // Kick the timer from the event loop thread to send configure + frame
-    // callbacks quickly
-    wl_event_loop_add_idle(_eventLoop, ensure_frame_callback_timer_idle,
-                           (__bridge void *)self);
-  }
-}
-
-// DEPRECATED: This function is no longer used - it caused infinite loops
-// Frame callbacks are now handled entirely by the timer mechanism
-static void send_frame_callbacks_timer_idle(void *data) {
-  // Do nothing - this function should never be called
-  // If it is called, it means there's a bug somewhere adding idle callbacks
-  (void)data;
-  log_printf("[COMPOSITOR] ", "ERROR: send_frame_callbacks_timer_idle called - "
-                              "this should not happen!\n");
-}
-
-// Ensure the frame callback timer exists and is scheduled (must run on event
-// thread)
-static BOOL ensure_frame_callback_timer_on_event_thread(
-    WawonaCompositor *compositor, uint32_t delay_ms, const char *reason) {
-  if (!compositor || !compositor.display) {
-    return NO;
-  }
-
-  struct wl_event_loop *eventLoop =
-      wl_display_get_event_loop(compositor.display);
-  if (!eventLoop) {
-    log_printf("[COMPOSITOR] ", "ensure_frame_callback_timer_on_event_thread: "
-                                "event loop unavailable\n");
-    return NO;
-  }
-
-  if (!compositor.frame_callback_source) {
-    compositor.frame_callback_source = wl_event_loop_add_timer(
-        eventLoop, send_frame_callbacks_timer, (__bridge void *)compositor);
-    if (!compositor.frame_callback_source) {
-      log_printf("[COMPOSITOR] ",
-                 "ensure_frame_callback_timer_on_event_thread: Failed to "
-                 "create timer (%s)\n",
-                 reason ? reason : "no reason");
-      return NO;
-    }
-    log_printf("[COMPOSITOR] ",
-               "ensure_frame_callback_timer_on_event_thread: Created timer "
-               "(%s, delay=%ums)\n",
-               reason ? reason : "no reason", delay_ms);
-  }
-
-  // CRITICAL: Always update timer delay to schedule it
-  // If delay is 0, we want immediate execution - but Wayland timers might not
-  // fire immediately So use a small delay (1ms) to ensure it fires in the next
-  // event loop iteration
-  uint32_t actual_delay = (delay_ms == 0) ? 1 : delay_ms;
-  int ret = wl_event_source_timer_update(compositor.frame_callback_source,
-                                         actual_delay);
-  if (ret < 0) {
-    int err = errno;
-    log_printf("[COMPOSITOR] ",
-               "ensure_frame_callback_timer_on_event_thread: timer update "
-               "failed (%s, delay=%ums) - recreating\n",
-               strerror(err), delay_ms);
-    wl_event_source_remove(compositor.frame_callback_source);
-    compositor.frame_callback_source = NULL;
-
-    compositor.frame_callback_source = wl_event_loop_add_timer(
-        eventLoop, send_frame_callbacks_timer, (__bridge void *)compositor);
-    if (!compositor.frame_callback_source) {
-      log_printf("[COMPOSITOR] ", "ensure_frame_callback_timer_on_event_thread:"
-                                  " Failed to recreate timer after error\n");
-      return NO;
-    }
-
-    ret = wl_event_source_timer_update(compositor.frame_callback_source,
-                                       delay_ms);
-    if (ret < 0) {
-      err = errno;
-      log_printf("[COMPOSITOR] ",
-                 "ensure_frame_callback_timer_on_event_thread: Second timer "
-                 "update failed (%s)\n",
-                 strerror(err));
-      wl_event_source_remove(compositor.frame_callback_source);
-      compositor.frame_callback_source = NULL;
-      return NO;
-    }
-
-    log_printf("[COMPOSITOR] ", "ensure_frame_callback_timer_on_event_thread: "
-                                "Timer recreated successfully\n");
-  } else {
-    // Timer update succeeded - verify timer is actually scheduled
-    // Log for verification - this confirms the timer should fire
-    log_printf("[COMPOSITOR] ",
-               "ensure_frame_callback_timer_on_event_thread: Timer updated "
-               "successfully (delay=%ums, will fire in %ums, timer=%p)\n",
-               delay_ms, actual_delay,
-               (void *)compositor.frame_callback_source);
-    // Force flush to ensure log is visible immediately
-    fflush(stdout);
-  }
-  return YES;
+  // Request a repaint so the configure events go out on the next vblank
+  frame_scheduler_post_schedule(_frameScheduler);
 }
 
-// Idle helper to flush input events and trigger frame callback immediately
+// Idle helper to flush input events and request a repaint
 // This is safe because it runs on the event thread
 static void flush_input_and_send_frame_callbacks_idle(void *data) {
   WawonaCompositor *compositor = (__bridge WawonaCompositor *)data;
@@ -2654,147 +2416,13 @@ static void flush_input_and_send_frame_callbacks_idle(void *data) {
     // CRITICAL: Flush clients immediately so they receive keyboard/input events
     // This wakes up clients waiting on wl_display_dispatch() so they can process input
     wl_display_flush_clients(compositor.display);
-    
-    // Send frame callbacks immediately if any are pending
-    // This allows clients to render immediately after processing input
-    if (wl_has_pending_frame_callbacks()) {
-      log_printf("[COMPOSITOR] ", "flush_input_and_send_frame_callbacks_idle: "
-                                  "Flushing input and sending frame callbacks immediately\n");
-      send_frame_callbacks_timer(data);
-    } else {
-      log_printf("[COMPOSITOR] ", "flush_input_and_send_frame_callbacks_idle: "
-                                  "Flushed input events (no pending frame callbacks)\n");
-    }
-  }
-}
-
-// Idle helper to trigger first frame callback immediately
-// This is safe because it runs on the event thread and only fires once
-static void trigger_first_frame_callback_idle(void *data) {
-  WawonaCompositor *compositor = (__bridge WawonaCompositor *)data;
-  if (compositor) {
-    log_printf("[COMPOSITOR] ", "trigger_first_frame_callback_idle: Manually "
-                                "triggering first frame callback via idle\n");
-    // Manually call the timer function
-    // This will send callbacks and re-arm the timer for the next frame (16ms
-    // later)
-    send_frame_callbacks_timer(data);
-  }
-}
-
-// Idle helper to (re)arm the timer from threads other than the event thread
-static void ensure_frame_callback_timer_idle(void *data) {
-  WawonaCompositor *compositor = (__bridge WawonaCompositor *)data;
-  if (compositor) {
-    ensure_frame_callback_timer_on_event_thread(compositor, 16, "idle kick");
-  }
-}
-
-// Timer callback to send frame callbacks from Wayland event thread
-// This fires every ~16ms (60Hz) to match display refresh rate
-static int send_frame_callbacks_timer(void *data) {
-  WawonaCompositor *compositor = (__bridge WawonaCompositor *)data;
-  if (!compositor) {
-    log_printf(
-        "[COMPOSITOR] ",
-        "ERROR: send_frame_callbacks_timer called with NULL compositor!\n");
-    return 0;
-  }
-
-  // This runs on the Wayland event thread - safe to call Wayland server
-  // functions
-
-  // Timer fires every 16ms - log calls to verify operation
-  static int timer_call_count = 0;
-  timer_call_count++;
-
-  // Always log first call to verify timer fired
-  if (timer_call_count == 1) {
-    log_printf("[COMPOSITOR] ",
-               "✅ send_frame_callbacks_timer() FIRED! (call #%d) - Timer is "
-               "working!\n",
-               timer_call_count);
-    fflush(stdout);
-  }
-
-  // Log every 60 calls (approx every 1 second) to keep liveliness check
-  if (timer_call_count <= 30 || timer_call_count % 60 == 0) {
-    log_printf("[COMPOSITOR] ",
-               "send_frame_callbacks_timer() called (call #%d)\n",
-               timer_call_count);
-    fflush(stdout); // Force flush to ensure log is visible
-  }
-
-  // Handle pending resize configure events first
-  if (compositor.needs_resize_configure) {
-    // Update wl_output mode/geometry (must be done on event thread to avoid
-    // races)
-    if (compositor.output) {
-      wl_output_update_size(compositor.output, compositor.pending_resize_width,
-                            compositor.pending_resize_height,
-                            compositor.pending_resize_scale);
-    }
-
-    if (compositor.xdg_wm_base) {
-      // Pass actual output size for storage (clients can use as hint)
-      // But configure events send 0x0 to signal arbitrary resolution support
-      xdg_wm_base_send_configure_to_all_toplevels(
-          compositor.xdg_wm_base, compositor.pending_resize_width,
-          compositor.pending_resize_height);
-    }
-    compositor.needs_resize_configure = NO;
-  }
 
-  // Send frame callbacks
-  int sent_count = wl_send_frame_callbacks();
-  if (sent_count > 0) {
-    log_printf("[COMPOSITOR] ",
-               "send_frame_callbacks_timer: Sent %d frame callback(s)\n",
-               sent_count);
-    fflush(stdout);
-  }
-
-  // CRITICAL: Flush clients to ensure frame callbacks are sent immediately
-  // This wakes up clients waiting on wl_display_dispatch()
-  wl_display_flush_clients(compositor.display);
-
-  // CRITICAL: Re-arm timer for next frame (16ms = 60Hz)
-  // Always re-arm to keep timer firing continuously
-  if (compositor.frame_callback_source) {
-    int ret =
-        wl_event_source_timer_update(compositor.frame_callback_source, 16);
-    if (ret < 0) {
-      int err = errno;
-      log_printf("[COMPOSITOR] ",
-                 "send_frame_callbacks_timer: Failed to re-arm timer: %s\n",
-                 strerror(err));
-      // Timer update failed - recreate it
-      wl_event_source_remove(compositor.frame_callback_source);
-      compositor.frame_callback_source = NULL;
-      ensure_frame_callback_timer_on_event_thread(
-          compositor, 16, "recreate after update failure");
-    } else {
-      // Log first 10 re-arms to verify timer is working continuously
-      static int rearm_count = 0;
-      rearm_count++;
-      if (rearm_count <= 10) {
-        log_printf("[COMPOSITOR] ",
-                   "send_frame_callbacks_timer: Re-armed timer successfully "
-                   "(rearm #%d, next fire in 16ms)\n",
-                   rearm_count);
-      }
+    // Pending frame callbacks go out on the next vblank so clients can render
+    // right after processing input
+    if (wl_has_pending_frame_callbacks()) {
+      frame_scheduler_schedule(compositor.frameScheduler);
     }
-  } else {
-    // Timer was removed - recreate it immediately
-    log_printf("[COMPOSITOR] ",
-               "send_frame_callbacks_timer: Timer was removed, recreating\n");
-    ensure_frame_callback_timer_on_event_thread(compositor, 16,
-                                                "recreate after removal");
   }
-
-  // Return 0 to indicate timer callback completed
-  // We manually re-arm above, so timer will continue firing
-  return 0;
 }
 
 - (void)sendFrameCallbacksImmediately {
@@ -2802,12 +2430,12 @@ static int send_frame_callbacks_timer(void *data) {
   // This allows clients to receive keyboard events and render immediately
   // NOTE: Must be called from main thread, but the callback will run on event thread
   if (_eventLoop) {
-    // Flush input events AND send frame callbacks immediately via idle callback
+    // Flush input events AND send frame callbacks immediately on the event
+    // thread
     // This ensures:
     // 1. Clients receive keyboard/input events immediately (via flush)
     // 2. Clients can render immediately if they have pending frame callbacks
-    wl_event_loop_add_idle(_eventLoop, flush_input_and_send_frame_callbacks_idle,
-                           (__bridge void *)self);
+    post_event_thread_work(EVENT_THREAD_FLUSH_INPUT);
   }
 }
 
@@ -2823,8 +2451,9 @@ static void render_surface_iterator(struct wl_surface_impl *surface,
   struct RenderContext *ctx = (struct RenderContext *)data;
   WawonaCompositor *self = ctx->compositor;
 
-  // Only render if surface is still valid and has committed buffer
-  if (surface->committed && surface->buffer_resource && surface->resource) {
+  // Only render if surface is still valid and has a commit not yet rendered
+  if (surface->commit_seq != surface->rendered_seq &&
+      surface->buffer_resource && surface->resource) {
     // Verify resource is still valid before rendering
     struct wl_client *client = wl_resource_get_client(surface->resource);
     if (client) {
@@ -2842,7 +2471,7 @@ static void render_surface_iterator(struct wl_surface_impl *surface,
         }
       }
     }
-    surface->committed = false;
+    surface->rendered_seq = surface->commit_seq;
   }
 }
 
@@ -2853,11 +2482,9 @@ static void render_surface_iterator(struct wl_surface_impl *surface,
   // NOTE: This continues to run even when the window loses focus, ensuring
   // Wayland clients continue to receive frame callbacks and can render updates
 
-  // Note: Frame callback timer is now created automatically when clients
-  // request frame callbacks via the macos_compositor_frame_callback_requested
-  // callback. This ensures the timer is created on the event thread and starts
-  // firing immediately. We don't need to check here anymore - the timer will be
-  // created when needed.
+  // Note: Frame callbacks are delivered by the frame scheduler on the event
+  // thread, which is scheduled when clients request them and woken by the
+  // display link's vblanks.
 
   // Check for any committed surfaces and render them
   // Note: The event thread also triggers rendering, but this ensures
@@ -2978,6 +2605,11 @@ static void disconnect_all_clients(struct wl_display *display) {
 - (void)stop {
   NSLog(@"🛑 Stopping compositor backend...");
 
+  // Keep the recorded frame trace (the only way to get one on iOS)
+  if (trace_enabled()) {
+    trace_handle_dump_request();
+  }
+
   // Clear global reference
   if (g_compositor_instance == self) {
     g_compositor_instance = NULL;
@@ -2992,6 +2624,7 @@ static void disconnect_all_clients(struct wl_display *display) {
 
   // Now signal event thread to stop (after clients are disconnected)
   _shouldStopEventThread = YES;
+  post_event_thread_work(EVENT_THREAD_CHECK_STOP);
 
   // Wait for event thread to finish (with timeout)
   if (_eventThread && [_eventThread isExecuting]) {
@@ -3018,10 +2651,13 @@ static void disconnect_all_clients(struct wl_display *display) {
     _displayLink = NULL;
   }
 
-  // Stop frame callback timer
-  if (_frame_callback_source) {
-    wl_event_source_remove(_frame_callback_source);
-    _frame_callback_source = NULL;
+  destroy_event_thread_wake();
+
+  // Stop frame scheduler (event thread and display link are gone)
+  if (_frameScheduler) {
+    wl_compositor_set_frame_scheduler(_compositor, NULL);
+    frame_scheduler_destroy(_frameScheduler);
+    _frameScheduler = NULL;
   }
 
   // Clean up Wayland resources
@@ -3035,6 +2671,17 @@ static void disconnect_all_clients(struct wl_display *display) {
     _shm = NULL;
   }
 
+  if (_inputQueue) {
+    _inputHandler.inputQueue = NULL;
+    input_queue_destroy(_inputQueue);
+    _inputQueue = NULL;
+  }
+
+  if (_inputBatch) {
+    input_batch_destroy(_inputBatch);
+    _inputBatch = NULL;
+  }
+
   if (_seat) {
     wl_seat_destroy(_seat);
     _seat = NULL;
@@ -3228,7 +2875,9 @@ static void disconnect_all_clients(struct wl_display *display) {
   MetalRenderer *metalRenderer =
       [[MetalRenderer alloc] initWithMetalView:metalView];
   if (!metalRenderer) {
-    NSLog(@"❌ Failed to create Metal renderer");
+    NSLog(@"❌ Failed to create Metal renderer - falling back to software "
+          @"rendering");
+    [self switchToSoftwareBackend];
     return;
   }
 
@@ -3279,6 +2928,9 @@ static void disconnect_all_clients(struct wl_display *display) {
   // Switch rendering backend
   _renderingBackend = metalRenderer;
   _backendType = 1; // RENDERING_BACKEND_METAL
+  if (_eventLoop && _linux_dmabuf) {
+    post_event_thread_work(EVENT_THREAD_DMABUF_FEEDBACK);
+  }
 
   // Update render callback to use Metal backend
   // The render_surface_callback will now use the Metal backend
@@ -3291,6 +2943,47 @@ static void disconnect_all_clients(struct wl_display *display) {
   NSLog(@"   Metal renderer: %@", metalRenderer);
 }
 
+- (void)switchToSoftwareBackend {
+  // Switch to the pixman renderer, e.g. when Metal is unavailable
+  if (_backendType == RENDERING_BACKEND_SOFTWARE) {
+    return;
+  }
+
+#if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
+  UIView *contentView = _window.rootViewController.view;
+#else
+  NSView *contentView = _window.contentView;
+#endif
+  if (![contentView isKindOfClass:[CompositorView class]]) {
+    NSLog(@"⚠️ Content view is not CompositorView, cannot switch to software "
+          @"rendering");
+    return;
+  }
+  CompositorView *compositorView = (CompositorView *)contentView;
+
+  SoftwareRenderer *softwareRenderer =
+      [[SoftwareRenderer alloc] initWithCompositorView:compositorView];
+  if (!softwareRenderer) {
+    NSLog(@"❌ Failed to create software renderer");
+    return;
+  }
+
+  // Surfaces are picked up again on their next commit
+  _renderingBackend = softwareRenderer;
+  _backendType = RENDERING_BACKEND_SOFTWARE;
+  compositorView.renderer = softwareRenderer;
+  if (_eventLoop && _linux_dmabuf) {
+    post_event_thread_work(EVENT_THREAD_DMABUF_FEEDBACK);
+  }
+#if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
+  [compositorView setNeedsDisplay];
+#else
+  [compositorView setNeedsDisplay:YES];
+#endif
+
+  NSLog(@"✅ Switched to software rendering backend");
+}
+
 - (void)updateWindowTitleForClient:(struct wl_client *)client {
   if (!_window || !client)
     return;
@@ -15,9 +15,12 @@ static WawonaSettingsConfig g_config = {
     .waypipeRSSupport = true,
     .enableTCPListener = false,
     .tcpPort = 0,
+    .tcpAcceptBacklog = 128,
+    .tcpMaxConnectionsPerPeer = 8,
     .renderingBackend = 0,
     .vulkanDrivers = false,
-    .eglDrivers = false
+    .eglDrivers = false,
+    .traceEnabled = false
 };
 
 void WawonaSettings_UpdateConfig(const WawonaSettingsConfig *config) {
@@ -87,6 +90,14 @@ int WawonaSettings_GetTCPListenerPort(void) {
     return g_config.tcpPort;
 }
 
+int WawonaSettings_GetTCPAcceptBacklog(void) {
+    return g_config.tcpAcceptBacklog > 0 ? g_config.tcpAcceptBacklog : 128;
+}
+
+int WawonaSettings_GetTCPMaxConnectionsPerPeer(void) {
+    return g_config.tcpMaxConnectionsPerPeer > 0 ? g_config.tcpMaxConnectionsPerPeer : 0;
+}
+
 // Rendering Backend Flags
 int WawonaSettings_GetRenderingBackend(void) {
     return g_config.renderingBackend;
@@ -106,4 +117,9 @@ bool WawonaSettings_GetDmabufEnabled(void) {
     return true; 
 }
 
+// Diagnostics
+bool WawonaSettings_GetTraceEnabled(void) {
+    return g_config.traceEnabled;
+}
+
 #endif
@@ -35,6 +35,8 @@ bool WawonaSettings_GetWaypipeRSSupportEnabled(void);
 // Network / Remote Access
 bool WawonaSettings_GetEnableTCPListener(void);
 int WawonaSettings_GetTCPListenerPort(void);
+int WawonaSettings_GetTCPAcceptBacklog(void);
+int WawonaSettings_GetTCPMaxConnectionsPerPeer(void);  // 0 = unlimited
 
 // Rendering Backend Flags
 int WawonaSettings_GetRenderingBackend(void);
@@ -44,6 +46,9 @@ bool WawonaSettings_GetEGLDriversEnabled(void);
 // Dmabuf Support
 bool WawonaSettings_GetDmabufEnabled(void);
 
+// Diagnostics
+bool WawonaSettings_GetTraceEnabled(void);  // Record the frame trace (see trace.h)
+
 // Configuration update (mainly for Android/Linux where settings are pushed from platform layer)
 #ifndef __APPLE__
 typedef struct {
@@ -60,10 +65,13 @@ typedef struct {
     bool waypipeRSSupport;
     bool enableTCPListener;
     int tcpPort;
+    int tcpAcceptBacklog;
+    int tcpMaxConnectionsPerPeer;
     // Rendering backend is handled separately or via separate flags
-    int renderingBackend; // 0=Automatic, 1=Metal(Vulkan), 2=Cocoa(Surface)
+    int renderingBackend; // 0=Automatic, 1=Metal(Vulkan), 2=Cocoa(Surface), 3=Software(pixman)
     bool vulkanDrivers; // derived from backend choice
     bool eglDrivers;    // derived from backend choice
+    bool traceEnabled;
 } WawonaSettingsConfig;
 
 void WawonaSettings_UpdateConfig(const WawonaSettingsConfig *config);
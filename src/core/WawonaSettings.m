@@ -58,6 +58,16 @@ int WawonaSettings_GetTCPListenerPort(void) {
     return (int)[[WawonaPreferencesManager sharedManager] tcpListenerPort];
 }
 
+int WawonaSettings_GetTCPAcceptBacklog(void) {
+    NSInteger backlog = [[WawonaPreferencesManager sharedManager] tcpAcceptBacklog];
+    return backlog > 0 ? (int)backlog : 128;
+}
+
+int WawonaSettings_GetTCPMaxConnectionsPerPeer(void) {
+    NSInteger limit = [[WawonaPreferencesManager sharedManager] tcpMaxConnectionsPerPeer];
+    return limit > 0 ? (int)limit : 0;
+}
+
 bool WawonaSettings_GetVulkanDriversEnabled(void) {
     return [[WawonaPreferencesManager sharedManager] vulkanDriversEnabled];
 }
@@ -70,4 +80,8 @@ bool WawonaSettings_GetDmabufEnabled(void) {
     return [[WawonaPreferencesManager sharedManager] dmabufEnabled];
 }
 
+bool WawonaSettings_GetTraceEnabled(void) {
+    return [[WawonaPreferencesManager sharedManager] traceEnabled];
+}
+
 #endif
@@ -0,0 +1,461 @@
+#include "frame_scheduler.h"
+#include "logging.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
+
+#define FRAME_SCHEDULER_DEFAULT_REFRESH_NS 16666667ull  // 60 Hz until the output tells us
+#define FRAME_SCHEDULER_DEFAULT_BUDGET_NS 4000000ull    // 4ms reserved for the repaint
+
+enum frame_scheduler_state {
+    FRAME_SCHEDULER_IDLE,
+    FRAME_SCHEDULER_SCHEDULED,
+    FRAME_SCHEDULER_REPAINTING,
+};
+
+struct frame_scheduler {
+    frame_scheduler_clock_t clock;
+    frame_scheduler_repaint_t repaint;
+    void *data;
+    struct frame_scheduler_timer *timer;
+    struct frame_vblank_source *vblank;
+
+    enum frame_scheduler_state state;
+    bool repaint_requested;  // schedule() called during the repaint hook
+    uint64_t refresh_ns;
+    uint64_t budget_ns;
+    uint64_t last_present_ns;  // Last known presentation time (0 = unknown)
+    uint64_t predicted_present_ns;
+    uint64_t repaint_deadline_ns;
+
+    // Event loop integration (frame_scheduler_create_for_event_loop only)
+    struct frame_scheduler_timer loop_timer;
+    struct wl_event_source *timer_source;
+    int timer_fd;
+    struct wl_event_source *wake_source;
+    int wake_fds[2];
+    _Atomic uint64_t posted_vblank_ns;
+    _Atomic bool posted_schedule;
+};
+
+static uint64_t
+monotonic_now(void *data)
+{
+    (void)data;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t
+scheduler_now(struct frame_scheduler *scheduler)
+{
+    return scheduler->clock(scheduler->data);
+}
+
+static void
+scheduler_arm_timer(struct frame_scheduler *scheduler, uint64_t deadline_ns)
+{
+    if (scheduler->timer && scheduler->timer->arm) {
+        scheduler->timer->arm(scheduler->timer, deadline_ns);
+    }
+}
+
+static void
+scheduler_set_vblank_enabled(struct frame_scheduler *scheduler, bool enabled)
+{
+    if (scheduler->vblank && scheduler->vblank->set_enabled) {
+        scheduler->vblank->set_enabled(scheduler->vblank, enabled);
+    }
+}
+
+// First presentation slot after the last one that still leaves the repaint
+// budget, on the vblank grid anchored at the last known presentation time
+static void
+scheduler_update_prediction(struct frame_scheduler *scheduler, uint64_t now)
+{
+    uint64_t earliest = now + scheduler->budget_ns;
+    uint64_t present = earliest;
+
+    if (scheduler->last_present_ns != 0) {
+        if (scheduler->last_present_ns >= earliest) {
+            present = scheduler->last_present_ns + scheduler->refresh_ns;
+        } else {
+            uint64_t periods = (earliest - scheduler->last_present_ns + scheduler->refresh_ns - 1) /
+                               scheduler->refresh_ns;
+            present = scheduler->last_present_ns + periods * scheduler->refresh_ns;
+        }
+    }
+
+    scheduler->predicted_present_ns = present;
+    scheduler->repaint_deadline_ns = present - scheduler->budget_ns;
+}
+
+static void
+scheduler_repaint(struct frame_scheduler *scheduler)
+{
+    scheduler->state = FRAME_SCHEDULER_REPAINTING;
+    scheduler->repaint_requested = false;
+    scheduler_arm_timer(scheduler, 0);
+
+    if (scheduler->repaint) {
+        scheduler->repaint(scheduler->data, scheduler->predicted_present_ns);
+    }
+
+    scheduler->state = FRAME_SCHEDULER_IDLE;
+    if (scheduler->repaint_requested) {
+        scheduler->repaint_requested = false;
+        frame_scheduler_schedule(scheduler);
+    } else {
+        // Nothing pending - stop vblank delivery and stay idle
+        scheduler_set_vblank_enabled(scheduler, false);
+    }
+}
+
+struct frame_scheduler *
+frame_scheduler_create(frame_scheduler_clock_t clock,
+                       struct frame_scheduler_timer *timer,
+                       frame_scheduler_repaint_t repaint,
+                       void *data)
+{
+    struct frame_scheduler *scheduler = calloc(1, sizeof(struct frame_scheduler));
+    if (!scheduler) {
+        return NULL;
+    }
+
+    scheduler->clock = clock ? clock : monotonic_now;
+    scheduler->timer = timer;
+    scheduler->repaint = repaint;
+    scheduler->data = data;
+    scheduler->state = FRAME_SCHEDULER_IDLE;
+    scheduler->refresh_ns = FRAME_SCHEDULER_DEFAULT_REFRESH_NS;
+    scheduler->budget_ns = FRAME_SCHEDULER_DEFAULT_BUDGET_NS;
+    scheduler->timer_fd = -1;
+    scheduler->wake_fds[0] = -1;
+    scheduler->wake_fds[1] = -1;
+    atomic_init(&scheduler->posted_vblank_ns, 0);
+    atomic_init(&scheduler->posted_schedule, false);
+    return scheduler;
+}
+
+// --- Event loop integration ---
+
+#ifdef __linux__
+static void
+loop_timer_arm(struct frame_scheduler_timer *timer, uint64_t deadline_ns)
+{
+    struct frame_scheduler *scheduler = timer->data;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = (time_t)(deadline_ns / 1000000000ull);
+    its.it_value.tv_nsec = (long)(deadline_ns % 1000000000ull);
+    if (timerfd_settime(scheduler->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        log_error("[FRAME] ", "timerfd_settime failed: %s\n", strerror(errno));
+    }
+}
+
+static int
+loop_timer_dispatch(int fd, uint32_t mask, void *data)
+{
+    (void)mask;
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        log_error("[FRAME] ", "timerfd read failed: %s\n", strerror(errno));
+    }
+    frame_scheduler_handle_timer(data);
+    return 0;
+}
+#else
+// No timerfd: wl_event_loop timers have millisecond resolution, round up
+static void
+loop_timer_arm(struct frame_scheduler_timer *timer, uint64_t deadline_ns)
+{
+    struct frame_scheduler *scheduler = timer->data;
+    int delay_ms = 0;
+    if (deadline_ns != 0) {
+        uint64_t now = scheduler_now(scheduler);
+        uint64_t delta = deadline_ns > now ? deadline_ns - now : 0;
+        delay_ms = (int)((delta + 999999ull) / 1000000ull);
+        if (delay_ms < 1) {
+            delay_ms = 1;  // 0 would disarm
+        }
+    }
+    wl_event_source_timer_update(scheduler->timer_source, delay_ms);
+}
+
+static int
+loop_timer_dispatch(void *data)
+{
+    frame_scheduler_handle_timer(data);
+    return 0;
+}
+#endif
+
+static int
+loop_wake_dispatch(int fd, uint32_t mask, void *data)
+{
+    (void)mask;
+    struct frame_scheduler *scheduler = data;
+    char buf[64];
+    while (read(fd, buf, sizeof(buf)) > 0) {
+        // Drain - only the latest vblank matters
+    }
+    if (atomic_exchange(&scheduler->posted_schedule, false)) {
+        frame_scheduler_schedule(scheduler);
+    }
+    uint64_t present_ns = atomic_exchange(&scheduler->posted_vblank_ns, 0);
+    if (present_ns != 0) {
+        frame_scheduler_handle_vblank(scheduler, present_ns);
+    }
+    return 0;
+}
+
+static int
+set_fd_flags(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return -1;
+    }
+    return fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+struct frame_scheduler *
+frame_scheduler_create_for_event_loop(struct wl_event_loop *loop,
+                                      frame_scheduler_repaint_t repaint,
+                                      void *data)
+{
+    struct frame_scheduler *scheduler = frame_scheduler_create(NULL, NULL, repaint, data);
+    if (!scheduler) {
+        return NULL;
+    }
+
+    scheduler->loop_timer.arm = loop_timer_arm;
+    scheduler->loop_timer.data = scheduler;
+#ifdef __linux__
+    scheduler->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (scheduler->timer_fd < 0) {
+        log_error("[FRAME] ", "timerfd_create failed: %s\n", strerror(errno));
+        frame_scheduler_destroy(scheduler);
+        return NULL;
+    }
+    scheduler->timer_source = wl_event_loop_add_fd(loop, scheduler->timer_fd, WL_EVENT_READABLE,
+                                                   loop_timer_dispatch, scheduler);
+#else
+    scheduler->timer_source = wl_event_loop_add_timer(loop, loop_timer_dispatch, scheduler);
+#endif
+    if (!scheduler->timer_source) {
+        log_error("[FRAME] ", "Failed to add repaint timer to event loop\n");
+        frame_scheduler_destroy(scheduler);
+        return NULL;
+    }
+    scheduler->timer = &scheduler->loop_timer;
+
+    if (pipe(scheduler->wake_fds) < 0 ||
+        set_fd_flags(scheduler->wake_fds[0]) < 0 ||
+        set_fd_flags(scheduler->wake_fds[1]) < 0) {
+        log_error("[FRAME] ", "Failed to create vblank wake pipe: %s\n", strerror(errno));
+        frame_scheduler_destroy(scheduler);
+        return NULL;
+    }
+    scheduler->wake_source = wl_event_loop_add_fd(loop, scheduler->wake_fds[0], WL_EVENT_READABLE,
+                                                  loop_wake_dispatch, scheduler);
+    if (!scheduler->wake_source) {
+        log_error("[FRAME] ", "Failed to add vblank wake pipe to event loop\n");
+        frame_scheduler_destroy(scheduler);
+        return NULL;
+    }
+
+    return scheduler;
+}
+
+void
+frame_scheduler_destroy(struct frame_scheduler *scheduler)
+{
+    if (!scheduler) {
+        return;
+    }
+
+    scheduler_set_vblank_enabled(scheduler, false);
+    if (scheduler->timer_source) {
+        wl_event_source_remove(scheduler->timer_source);
+    }
+    if (scheduler->wake_source) {
+        wl_event_source_remove(scheduler->wake_source);
+    }
+    if (scheduler->timer_fd >= 0) {
+        close(scheduler->timer_fd);
+    }
+    if (scheduler->wake_fds[0] >= 0) {
+        close(scheduler->wake_fds[0]);
+    }
+    if (scheduler->wake_fds[1] >= 0) {
+        close(scheduler->wake_fds[1]);
+    }
+    free(scheduler);
+}
+
+// --- Configuration ---
+
+void
+frame_scheduler_set_vblank_source(struct frame_scheduler *scheduler,
+                                  struct frame_vblank_source *source)
+{
+    if (!scheduler) {
+        return;
+    }
+    scheduler_set_vblank_enabled(scheduler, false);
+    scheduler->vblank = source;
+    if (scheduler->state == FRAME_SCHEDULER_SCHEDULED) {
+        scheduler_set_vblank_enabled(scheduler, true);
+    }
+}
+
+void
+frame_scheduler_set_refresh_ns(struct frame_scheduler *scheduler, uint64_t refresh_ns)
+{
+    if (scheduler && refresh_ns > 0) {
+        scheduler->refresh_ns = refresh_ns;
+    }
+}
+
+void
+frame_scheduler_set_repaint_budget_ns(struct frame_scheduler *scheduler, uint64_t budget_ns)
+{
+    if (scheduler) {
+        scheduler->budget_ns = budget_ns;
+    }
+}
+
+// --- Scheduling ---
+
+void
+frame_scheduler_schedule(struct frame_scheduler *scheduler)
+{
+    if (!scheduler) {
+        return;
+    }
+
+    if (scheduler->state == FRAME_SCHEDULER_REPAINTING) {
+        // Picked up again as soon as the current repaint returns
+        scheduler->repaint_requested = true;
+        return;
+    }
+    if (scheduler->state == FRAME_SCHEDULER_SCHEDULED) {
+        return;
+    }
+
+    scheduler->state = FRAME_SCHEDULER_SCHEDULED;
+    scheduler_update_prediction(scheduler, scheduler_now(scheduler));
+
+    if (scheduler->vblank) {
+        // Repaint on the next vblank; the timer only guards against a source
+        // that stops delivering (hidden window, backgrounded app)
+        scheduler_set_vblank_enabled(scheduler, true);
+        scheduler_arm_timer(scheduler, scheduler->predicted_present_ns + scheduler->refresh_ns);
+    } else {
+        scheduler_arm_timer(scheduler, scheduler->repaint_deadline_ns);
+    }
+}
+
+void
+frame_scheduler_handle_vblank(struct frame_scheduler *scheduler, uint64_t present_ns)
+{
+    if (!scheduler) {
+        return;
+    }
+
+    if (present_ns != 0) {
+        scheduler->last_present_ns = present_ns;
+    }
+    if (scheduler->state != FRAME_SCHEDULER_SCHEDULED) {
+        return;
+    }
+
+    uint64_t now = scheduler_now(scheduler);
+    scheduler->predicted_present_ns = present_ns != 0 ? present_ns : now + scheduler->refresh_ns;
+    scheduler->repaint_deadline_ns = now;
+    scheduler_repaint(scheduler);
+}
+
+void
+frame_scheduler_post_vblank(struct frame_scheduler *scheduler, uint64_t present_ns)
+{
+    if (!scheduler || scheduler->wake_fds[1] < 0) {
+        return;
+    }
+
+    atomic_store(&scheduler->posted_vblank_ns, present_ns != 0 ? present_ns : 1);
+    if (write(scheduler->wake_fds[1], "v", 1) < 0 && errno != EAGAIN) {
+        log_error("[FRAME] ", "Failed to post vblank: %s\n", strerror(errno));
+    }
+}
+
+void
+frame_scheduler_post_schedule(struct frame_scheduler *scheduler)
+{
+    if (!scheduler || scheduler->wake_fds[1] < 0) {
+        return;
+    }
+
+    atomic_store(&scheduler->posted_schedule, true);
+    if (write(scheduler->wake_fds[1], "s", 1) < 0 && errno != EAGAIN) {
+        log_error("[FRAME] ", "Failed to post repaint request: %s\n", strerror(errno));
+    }
+}
+
+void
+frame_scheduler_handle_timer(struct frame_scheduler *scheduler)
+{
+    if (!scheduler || scheduler->state != FRAME_SCHEDULER_SCHEDULED) {
+        return;
+    }
+
+    uint64_t now = scheduler_now(scheduler);
+    if (!scheduler->vblank && now < scheduler->repaint_deadline_ns) {
+        // Fired early (coarse timer) - wait for the real deadline
+        scheduler_arm_timer(scheduler, scheduler->repaint_deadline_ns);
+        return;
+    }
+
+    if (scheduler->vblank) {
+        // Vblank source stalled - repaint for the next predicted slot
+        scheduler_update_prediction(scheduler, now);
+    }
+    // Assume the frame makes its slot; keeps later predictions on the vblank grid
+    scheduler->last_present_ns = scheduler->predicted_present_ns;
+    scheduler_repaint(scheduler);
+}
+
+// --- Queries ---
+
+bool
+frame_scheduler_is_idle(const struct frame_scheduler *scheduler)
+{
+    return !scheduler || scheduler->state == FRAME_SCHEDULER_IDLE;
+}
+
+uint64_t
+frame_scheduler_get_refresh_ns(const struct frame_scheduler *scheduler)
+{
+    return scheduler ? scheduler->refresh_ns : 0;
+}
+
+uint64_t
+frame_scheduler_get_predicted_present(const struct frame_scheduler *scheduler)
+{
+    return scheduler ? scheduler->predicted_present_ns : 0;
+}
+
+uint64_t
+frame_scheduler_get_repaint_deadline(const struct frame_scheduler *scheduler)
+{
+    return scheduler ? scheduler->repaint_deadline_ns : 0;
+}
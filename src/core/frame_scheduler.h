@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-server-core.h>
+
+// Frame scheduler
+// Decides when the compositor repaints (sends frame callbacks, configures and
+// flushes clients). One scheduler drives one output.
+//
+// The scheduler is idle until frame_scheduler_schedule() is called because a
+// commit or frame callback is pending. It then waits for the next vblank from
+// the output's vblank source, or - without one - for a fallback timer armed at
+// the repaint deadline, calls the repaint hook once and goes idle again.
+//
+// All times are CLOCK_MONOTONIC nanoseconds. The clock is injectable so the
+// scheduling logic can be exercised headless against a fake clock.
+
+struct frame_scheduler;
+
+// Abstract vblank source (CVDisplayLink, CADisplayLink, Choreographer, ...).
+// While enabled the source reports every vblank with
+// frame_scheduler_post_vblank() (any thread) or frame_scheduler_handle_vblank()
+// (event thread).
+struct frame_vblank_source {
+    void (*set_enabled)(struct frame_vblank_source *source, bool enabled);
+    void *data;
+};
+
+// Fallback timer. deadline_ns == 0 disarms it.
+struct frame_scheduler_timer {
+    void (*arm)(struct frame_scheduler_timer *timer, uint64_t deadline_ns);
+    void *data;
+};
+
+typedef uint64_t (*frame_scheduler_clock_t)(void *data);
+// Called on the event thread when it is time to repaint. predicted_present_ns
+// is when the frame being prepared is expected to reach the display.
+typedef void (*frame_scheduler_repaint_t)(void *data, uint64_t predicted_present_ns);
+
+// Create a scheduler with explicit clock and timer (clock/timer may be NULL for
+// CLOCK_MONOTONIC and no fallback timer)
+struct frame_scheduler *frame_scheduler_create(frame_scheduler_clock_t clock,
+                                               struct frame_scheduler_timer *timer,
+                                               frame_scheduler_repaint_t repaint,
+                                               void *data);
+// Create a scheduler on a Wayland event loop: CLOCK_MONOTONIC, a timerfd
+// fallback timer (wl_event_loop timer where timerfd is unavailable) and a wake
+// pipe so vblanks can be posted from other threads
+struct frame_scheduler *frame_scheduler_create_for_event_loop(struct wl_event_loop *loop,
+                                                              frame_scheduler_repaint_t repaint,
+                                                              void *data);
+void frame_scheduler_destroy(struct frame_scheduler *scheduler);
+
+void frame_scheduler_set_vblank_source(struct frame_scheduler *scheduler,
+                                       struct frame_vblank_source *source);
+// Output refresh period (e.g. 8333333 for 120 Hz). Variable-rate displays
+// update this as the period changes.
+void frame_scheduler_set_refresh_ns(struct frame_scheduler *scheduler, uint64_t refresh_ns);
+// Time reserved before presentation for the repaint itself
+void frame_scheduler_set_repaint_budget_ns(struct frame_scheduler *scheduler, uint64_t budget_ns);
+
+// Request a repaint (event thread). Cheap when one is already scheduled.
+void frame_scheduler_schedule(struct frame_scheduler *scheduler);
+
+// Vblank notification carrying the presentation time of the upcoming frame
+void frame_scheduler_handle_vblank(struct frame_scheduler *scheduler, uint64_t present_ns);
+// Thread-safe variant for display link threads (needs an event-loop scheduler)
+void frame_scheduler_post_vblank(struct frame_scheduler *scheduler, uint64_t present_ns);
+// Thread-safe frame_scheduler_schedule() (needs an event-loop scheduler)
+void frame_scheduler_post_schedule(struct frame_scheduler *scheduler);
+// Fallback timer expiry (event thread)
+void frame_scheduler_handle_timer(struct frame_scheduler *scheduler);
+
+bool frame_scheduler_is_idle(const struct frame_scheduler *scheduler);
+uint64_t frame_scheduler_get_refresh_ns(const struct frame_scheduler *scheduler);
+uint64_t frame_scheduler_get_predicted_present(const struct frame_scheduler *scheduler);
+uint64_t frame_scheduler_get_repaint_deadline(const struct frame_scheduler *scheduler);
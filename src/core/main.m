@@ -11,6 +11,8 @@
 #import "../ui/Helpers/WawonaUIHelpers.h"
 #import "../ui/About/WawonaAboutPanel.h"
 #import "logging.h"
+#import "trace.h"
+#import "WawonaSettings.h"
 #include <wayland-server-core.h>
 #include <signal.h>
 #include <stdlib.h>
@@ -56,6 +58,12 @@ static void signal_handler(int sig) {
 #endif
 }
 
+// SIGUSR2 exports the frame trace; the event thread writes the file
+static void trace_signal_handler(int sig) {
+    (void)sig;
+    trace_request_dump();
+}
+
 #if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
 
 //
@@ -227,7 +235,7 @@ static void signal_handler(int sig) {
         }
         
         // Listen on socket
-        if (listen(tcp_listen_fd, 128) < 0) {
+        if (listen(tcp_listen_fd, WawonaSettings_GetTCPAcceptBacklog()) < 0) {
             NSLog(@"❌ Failed to listen on TCP socket: %s", strerror(errno));
             close(tcp_listen_fd);
             wl_display_destroy(display);
@@ -366,6 +374,7 @@ static void signal_handler(int sig) {
     // Signal handlers
     signal(SIGTERM, signal_handler);
     signal(SIGINT, signal_handler);
+    signal(SIGUSR2, trace_signal_handler);
     
     @try {
         if (![compositor start]) {
@@ -670,6 +679,7 @@ int main(int argc, char *argv[]) {
         
         signal(SIGTERM, signal_handler);
         signal(SIGINT, signal_handler);
+        signal(SIGUSR2, trace_signal_handler);
         
         if (![compositor start]) {
             NSLog(@"❌ Failed to start compositor backend");
@@ -0,0 +1,570 @@
+#include "headless_backend.h"
+#include "WawonaCompositor.h"
+#include "WawonaSettings.h"
+#include "frame_scheduler.h"
+#include "input_batch.h"
+#include "logging.h"
+#include "pixman_renderer.h"
+#include "presentation-time-protocol.h"
+#include "texture_pool.h"
+#include "trace.h"
+#include "wayland_data_device_manager.h"
+#include "wayland_fractional_scale.h"
+#include "wayland_linux_dmabuf.h"
+#include "wayland_output.h"
+#include "wayland_presentation.h"
+#include "wayland_seat.h"
+#include "wayland_shm.h"
+#include "wayland_subcompositor.h"
+#include "wayland_viewporter.h"
+#include "xdg_shell.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct headless_backend {
+    struct headless_options options;
+    struct wl_display *display;
+    struct wl_event_loop *loop;
+    const char *socket;
+
+    struct wl_compositor_impl *compositor;
+    struct wl_output_impl *output;
+    struct wl_seat_impl *seat;
+    struct input_batch *input;
+    struct wl_shm_impl *shm;
+    struct wl_subcompositor_impl *subcompositor;
+    struct xdg_wm_base_impl *xdg_wm_base;
+    struct wl_event_source *signal_sources[3];
+
+    // Frame scheduling on the virtual clock. The vblank source is a flag the
+    // run loop polls: while it is set, every tick is a vblank.
+    struct frame_scheduler *scheduler;
+    struct frame_vblank_source vblank;
+    bool vblank_enabled;
+    uint64_t clock_base_ns;   // CLOCK_MONOTONIC when the backend was created
+    uint64_t virtual_now_ns;  // Virtual clock, always on the vblank grid
+    uint64_t next_tick_ns;    // Real time of the next vblank (paced mode)
+
+    struct pixman_renderer *renderer;
+    struct wl_surface_impl *input_focus;  // Surface given synthetic input focus
+    bool running;
+    struct headless_stats stats;
+};
+
+// The compositor hooks carry no user data; there is one backend per process
+static struct headless_backend *g_headless = NULL;
+
+static uint64_t
+monotonic_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Virtual clock of the frame scheduler. Paced: real time snapped to the
+// vblank grid. Free running: advanced only by vblanks.
+static uint64_t
+headless_clock(void *data)
+{
+    struct headless_backend *backend = data;
+    if (!backend->options.free_run) {
+        uint64_t elapsed = monotonic_now_ns() - backend->clock_base_ns;
+        backend->virtual_now_ns =
+            backend->clock_base_ns + elapsed - elapsed % backend->options.refresh_ns;
+    }
+    return backend->virtual_now_ns;
+}
+
+static void
+headless_vblank_set_enabled(struct frame_vblank_source *source, bool enabled)
+{
+    struct headless_backend *backend = source->data;
+    if (enabled && !backend->vblank_enabled && !backend->options.free_run) {
+        backend->next_tick_ns = headless_clock(backend) + backend->options.refresh_ns;
+    }
+    backend->vblank_enabled = enabled;
+}
+
+static void
+headless_vblank(struct headless_backend *backend)
+{
+    uint64_t now;
+    if (backend->options.free_run) {
+        backend->virtual_now_ns += backend->options.refresh_ns;
+        now = backend->virtual_now_ns;
+    } else {
+        now = headless_clock(backend);
+        backend->next_tick_ns = now + backend->options.refresh_ns;
+    }
+    // The frame prepared on this vblank is scanned out on the next one
+    frame_scheduler_handle_vblank(backend->scheduler, now + backend->options.refresh_ns);
+}
+
+// --- Compositing ---
+
+static void
+headless_composite(struct headless_backend *backend)
+{
+    TRACE_SCOPE("composite");
+
+    // Stacking and positions come from the flattened surface tree. Contents
+    // are uploaded for every changed surface, shown or not, so a subsurface
+    // is up to date when its parent maps.
+    wl_compositor_lock_surfaces();
+    struct wl_surface_draw_list list;
+    wl_compositor_get_draw_list(&list);
+    pixman_renderer_update_stacking(backend->renderer, &list);
+    for (struct wl_surface_impl *surface = wl_get_all_surfaces(); surface;
+         surface = surface->next) {
+        if (surface->rendered_seq == surface->commit_seq) {
+            continue;
+        }
+        pixman_renderer_render_surface(backend->renderer, surface);
+        surface->rendered_seq = surface->commit_seq;
+        backend->stats.surface_updates++;
+    }
+    wl_compositor_unlock_surfaces();
+
+    pixman_region32_t repainted;
+    pixman_region32_init(&repainted);
+    if (pixman_renderer_repaint(backend->renderer, &repainted)) {
+        int n_rects = 0;
+        const pixman_box32_t *rects = pixman_region32_rectangles(&repainted, &n_rects);
+        for (int i = 0; i < n_rects; i++) {
+            backend->stats.pixels +=
+                (uint64_t)(rects[i].x2 - rects[i].x1) * (uint64_t)(rects[i].y2 - rects[i].y1);
+        }
+    }
+    pixman_region32_fini(&repainted);
+    pixman_renderer_mark_composited(backend->renderer);
+
+    struct pixman_renderer_stats render;
+    pixman_renderer_get_stats(backend->renderer, &render);
+    backend->stats.uploads = render.uploads;
+    backend->stats.upload_bytes = render.upload_bytes;
+
+    struct texture_pool_stats pool;
+    pixman_renderer_get_pool_stats(backend->renderer, &pool);
+    backend->stats.pool_hits = pool.hits;
+    backend->stats.pool_misses = pool.misses;
+    backend->stats.pool_resident_bytes = pool.resident_bytes;
+}
+
+// --- Synthetic input ---
+
+static void
+headless_input_schedule(void *data)
+{
+    struct headless_backend *backend = data;
+    frame_scheduler_schedule(backend->scheduler);
+}
+
+// Move pointer and keyboard focus to the next surface of the draw list and
+// queue options.input_events motion events for it, timestamped evenly across
+// the coming refresh period as a high rate mouse would deliver them
+static void
+headless_inject_input(struct headless_backend *backend)
+{
+    TRACE_SCOPE("input_inject");
+
+    wl_compositor_lock_surfaces();
+    struct wl_surface_draw_list list;
+    wl_compositor_get_draw_list(&list);
+    if (list.count == 0) {
+        wl_compositor_unlock_surfaces();
+        return;
+    }
+
+    const struct wl_surface_draw_entry *entry =
+        &list.entries[backend->stats.frames % (uint64_t)list.count];
+    struct wl_seat_impl *seat = backend->seat;
+    uint32_t time = (uint32_t)((backend->virtual_now_ns - backend->clock_base_ns) / 1000000ull);
+    if (entry->surface != backend->input_focus && entry->surface->resource) {
+        if (backend->input_focus && backend->input_focus->resource) {
+            input_batch_pointer_leave(backend->input, backend->input_focus->resource,
+                                      wl_seat_get_serial(seat));
+            wl_seat_send_keyboard_leave(seat, backend->input_focus->resource, wl_seat_get_serial(seat));
+        }
+        struct wl_array keys;
+        wl_array_init(&keys);
+        input_batch_pointer_enter(backend->input, entry->surface->resource,
+                                  wl_seat_get_serial(seat), 0.0, 0.0);
+        wl_seat_send_keyboard_enter(seat, entry->surface->resource, wl_seat_get_serial(seat), &keys);
+        wl_array_release(&keys);
+        backend->input_focus = entry->surface;
+    }
+
+    uint32_t count = backend->options.input_events;
+    uint64_t period_ms = backend->options.refresh_ns / 1000000ull;
+    int32_t width = entry->width > 0 ? entry->width : 1;
+    int32_t height = entry->height > 0 ? entry->height : 1;
+    for (uint32_t i = 0; i < count; i++) {
+        input_batch_pointer_motion(backend->input, time + (uint32_t)(i * period_ms / count),
+                                   (double)(i % (uint32_t)width), (double)(i % (uint32_t)height));
+    }
+    backend->stats.seat_clients = wl_seat_get_client_count(seat);
+    wl_compositor_unlock_surfaces();
+}
+
+// Repaint hook of the frame scheduler: composite, present on the virtual
+// clock and deliver frame callbacks. Callbacks left pending belong to
+// hidden or occluded surfaces: only a commit or new input schedules the
+// next frame, so the compositor idles otherwise.
+static void
+headless_repaint(void *data, uint64_t predicted_present_ns)
+{
+    struct headless_backend *backend = data;
+    TRACE_SCOPE("repaint");
+
+    // Input queued since the last frame goes out before its frame callbacks
+    input_batch_flush(backend->input);
+    uint64_t frame_seq = wl_compositor_begin_frame();
+    headless_composite(backend);
+
+    struct timespec when = {
+        .tv_sec = (time_t)(predicted_present_ns / 1000000000ull),
+        .tv_nsec = (long)(predicted_present_ns % 1000000000ull),
+    };
+    wl_compositor_frame_presented(frame_seq, &when, WP_PRESENTATION_FEEDBACK_KIND_VSYNC);
+    backend->stats.frames++;
+
+    int sent = wl_send_frame_callbacks();
+    if (sent > 0) {
+        backend->stats.frame_events += (uint64_t)sent;
+        wl_display_flush_clients(backend->display);
+    }
+    if (backend->options.input_events > 0) {
+        headless_inject_input(backend);
+        struct input_batch_stats input;
+        input_batch_get_stats(backend->input, &input);
+        backend->stats.input_events = input.events;
+        backend->stats.input_batches = input.batches;
+        backend->stats.input_flushes = input.flushes;
+    }
+    if (backend->options.max_frames != 0 && backend->stats.frames >= backend->options.max_frames) {
+        backend->running = false;
+    }
+}
+
+// --- Compositor hooks ---
+
+static void
+headless_surface_committed(struct wl_surface_impl *surface)
+{
+    (void)surface;
+    if (g_headless) {
+        frame_scheduler_schedule(g_headless->scheduler);
+    }
+}
+
+static void
+headless_surface_destroyed(struct wl_surface_impl *surface)
+{
+    if (g_headless) {
+        if (g_headless->input_focus == surface) {
+            g_headless->input_focus = NULL;
+        }
+        pixman_renderer_remove_surface(g_headless->renderer, surface);
+        frame_scheduler_schedule(g_headless->scheduler);
+    }
+}
+
+static void
+headless_frame_callback_requested(void)
+{
+    if (g_headless) {
+        frame_scheduler_schedule(g_headless->scheduler);
+    }
+}
+
+static void
+headless_client_connected(void)
+{
+    if (g_headless) {
+        g_headless->stats.clients++;
+        if (g_headless->stats.clients > g_headless->stats.peak_clients) {
+            g_headless->stats.peak_clients = g_headless->stats.clients;
+        }
+    }
+}
+
+static void
+headless_client_disconnected(void)
+{
+    if (g_headless && g_headless->stats.clients > 0) {
+        g_headless->stats.clients--;
+    }
+}
+
+static int
+headless_handle_signal(int signal_number, void *data)
+{
+    struct headless_backend *backend = data;
+    if (signal_number == SIGUSR2) {
+        trace_handle_dump_request();
+    } else {
+        backend->running = false;
+    }
+    return 0;
+}
+
+// --- Public API ---
+
+struct headless_backend *
+headless_backend_create(const struct headless_options *options)
+{
+    if (g_headless) {
+        log_error("[HEADLESS] ", "Only one headless backend per process\n");
+        return NULL;
+    }
+    if (!options || options->width <= 0 || options->height <= 0 || options->refresh_ns == 0) {
+        log_error("[HEADLESS] ", "Invalid output mode\n");
+        return NULL;
+    }
+
+    struct headless_backend *backend = calloc(1, sizeof(struct headless_backend));
+    if (!backend) {
+        return NULL;
+    }
+    backend->options = *options;
+    backend->clock_base_ns = monotonic_now_ns();
+    backend->virtual_now_ns = backend->clock_base_ns;
+
+    backend->display = wl_display_create();
+    if (!backend->display) {
+        log_error("[HEADLESS] ", "Failed to create wl_display\n");
+        free(backend);
+        return NULL;
+    }
+    backend->loop = wl_display_get_event_loop(backend->display);
+    g_headless = backend;
+
+    backend->renderer = pixman_renderer_create(options->width, options->height);
+    if (!backend->renderer) {
+        goto err;
+    }
+
+    backend->vblank.set_enabled = headless_vblank_set_enabled;
+    backend->vblank.data = backend;
+    backend->scheduler = frame_scheduler_create(headless_clock, NULL, headless_repaint, backend);
+    if (!backend->scheduler) {
+        goto err;
+    }
+    frame_scheduler_set_refresh_ns(backend->scheduler, options->refresh_ns);
+    frame_scheduler_set_vblank_source(backend->scheduler, &backend->vblank);
+
+    backend->compositor = wl_compositor_create(backend->display);
+    if (!backend->compositor) {
+        log_error("[HEADLESS] ", "Failed to create wl_compositor\n");
+        goto err;
+    }
+    wl_compositor_set_render_callback(backend->compositor, headless_surface_committed);
+    wl_compositor_set_frame_callback_requested(backend->compositor,
+                                               headless_frame_callback_requested);
+    wl_compositor_set_surface_destroyed_callback(backend->compositor,
+                                                 headless_surface_destroyed);
+    wl_compositor_set_client_callbacks(backend->compositor, headless_client_connected,
+                                       headless_client_disconnected);
+    wl_compositor_set_frame_scheduler(backend->compositor, backend->scheduler);
+
+    backend->output = wl_output_create(backend->display, options->width, options->height, 1.0,
+                                       "headless");
+    backend->seat = wl_seat_create(backend->display);
+    if (backend->seat) {
+        backend->input = input_batch_create(backend->seat, backend->display, options->input_batch_ms);
+    }
+    backend->shm = wl_shm_create(backend->display);
+    backend->subcompositor = wl_subcompositor_create(backend->display);
+    backend->xdg_wm_base = xdg_wm_base_create(backend->display);
+    if (!backend->output || !backend->seat || !backend->input || !backend->shm ||
+        !backend->subcompositor || !backend->xdg_wm_base) {
+        log_error("[HEADLESS] ", "Failed to create core globals\n");
+        goto err;
+    }
+    wl_compositor_set_seat(backend->seat);
+    input_batch_set_callbacks(backend->input, &(struct input_batch_callbacks){
+                                                  .schedule = headless_input_schedule,
+                                                  .data = backend,
+                                              });
+    xdg_wm_base_set_output_size(backend->xdg_wm_base, options->width, options->height);
+    wl_data_device_manager_create(backend->display);
+    wp_presentation_create(backend->display, backend->output);
+    wp_viewporter_create(backend->display);
+    wp_fractional_scale_manager_create(backend->display, backend->output);
+    if (WawonaSettings_GetDmabufEnabled()) {
+        zwp_linux_dmabuf_v1_create(backend->display);
+    }
+
+    if (options->socket_name) {
+        if (wl_display_add_socket(backend->display, options->socket_name) == 0) {
+            backend->socket = options->socket_name;
+        }
+    } else {
+        backend->socket = wl_display_add_socket_auto(backend->display);
+    }
+    if (!backend->socket) {
+        log_error("[HEADLESS] ", "Failed to add Wayland socket: %s\n", strerror(errno));
+        goto err;
+    }
+
+    backend->signal_sources[0] =
+        wl_event_loop_add_signal(backend->loop, SIGINT, headless_handle_signal, backend);
+    backend->signal_sources[1] =
+        wl_event_loop_add_signal(backend->loop, SIGTERM, headless_handle_signal, backend);
+    backend->signal_sources[2] =
+        wl_event_loop_add_signal(backend->loop, SIGUSR2, headless_handle_signal, backend);
+
+    log_printf("[HEADLESS] ", "Listening on %s: %dx%d @ %.2f Hz (%s)\n", backend->socket,
+               options->width, options->height, 1e9 / (double)options->refresh_ns,
+               options->free_run ? "free running" : "paced");
+    return backend;
+
+err:
+    headless_backend_destroy(backend);
+    return NULL;
+}
+
+void
+headless_backend_destroy(struct headless_backend *backend)
+{
+    if (!backend) {
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(backend->signal_sources) / sizeof(backend->signal_sources[0]);
+         i++) {
+        if (backend->signal_sources[i]) {
+            wl_event_source_remove(backend->signal_sources[i]);
+        }
+    }
+    wl_display_destroy_clients(backend->display);
+
+    if (backend->compositor) {
+        wl_compositor_set_frame_scheduler(backend->compositor, NULL);
+    }
+    if (backend->scheduler) {
+        frame_scheduler_destroy(backend->scheduler);
+    }
+    if (backend->xdg_wm_base) {
+        xdg_wm_base_destroy(backend->xdg_wm_base);
+    }
+    if (backend->subcompositor) {
+        wl_subcompositor_destroy(backend->subcompositor);
+    }
+    if (backend->shm) {
+        wl_shm_destroy(backend->shm);
+    }
+    input_batch_destroy(backend->input);
+    if (backend->seat) {
+        wl_seat_destroy(backend->seat);
+    }
+    if (backend->output) {
+        wl_output_destroy(backend->output);
+    }
+    if (backend->compositor) {
+        wl_compositor_destroy(backend->compositor);
+    }
+    wl_display_destroy(backend->display);
+
+    pixman_renderer_destroy(backend->renderer);
+    if (g_headless == backend) {
+        g_headless = NULL;
+    }
+    free(backend);
+}
+
+int
+headless_backend_run(struct headless_backend *backend)
+{
+    backend->running = true;
+    while (backend->running) {
+        // Idle until a client talks to us unless a repaint is scheduled
+        int timeout = -1;
+        if (backend->vblank_enabled) {
+            timeout = 0;
+            if (!backend->options.free_run) {
+                uint64_t now = monotonic_now_ns();
+                if (backend->next_tick_ns > now) {
+                    timeout = (int)((backend->next_tick_ns - now + 999999ull) / 1000000ull);
+                }
+            }
+        }
+
+        wl_display_flush_clients(backend->display);
+        if (wl_event_loop_dispatch(backend->loop, timeout) < 0 && errno != EINTR) {
+            log_error("[HEADLESS] ", "Event loop failed: %s\n", strerror(errno));
+            return -1;
+        }
+
+        if (backend->vblank_enabled &&
+            (backend->options.free_run || monotonic_now_ns() >= backend->next_tick_ns)) {
+            headless_vblank(backend);
+        }
+    }
+    wl_display_flush_clients(backend->display);
+    return 0;
+}
+
+void
+headless_backend_stop(struct headless_backend *backend)
+{
+    if (backend) {
+        backend->running = false;
+    }
+}
+
+const char *
+headless_backend_get_socket(const struct headless_backend *backend)
+{
+    return backend ? backend->socket : NULL;
+}
+
+const struct headless_stats *
+headless_backend_get_stats(const struct headless_backend *backend)
+{
+    return backend ? &backend->stats : NULL;
+}
+
+uint64_t
+headless_backend_get_virtual_time_ns(const struct headless_backend *backend)
+{
+    return backend ? backend->virtual_now_ns - backend->clock_base_ns : 0;
+}
+
+int
+headless_backend_write_ppm(const struct headless_backend *backend, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        log_error("[HEADLESS] ", "Failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    pixman_image_t *framebuffer = pixman_renderer_get_image(backend->renderer);
+    int width = pixman_image_get_width(framebuffer);
+    int height = pixman_image_get_height(framebuffer);
+    int stride = pixman_image_get_stride(framebuffer);
+    const uint8_t *pixels = (const uint8_t *)pixman_image_get_data(framebuffer);
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (int y = 0; y < height; y++) {
+        const uint32_t *row = (const uint32_t *)(const void *)(pixels + (size_t)y * (size_t)stride);
+        for (int x = 0; x < width; x++) {
+            uint8_t rgb[3] = {
+                (uint8_t)(row[x] >> 16),
+                (uint8_t)(row[x] >> 8),
+                (uint8_t)row[x],
+            };
+            fwrite(rgb, 1, sizeof(rgb), file);
+        }
+    }
+
+    int result = ferror(file) ? -1 : 0;
+    fclose(file);
+    return result;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Headless backend
+// Runs the compositor core on a plain Wayland event loop without a window
+// system: surfaces are composited by the pixman renderer and frame
+// callbacks and presentation feedback are driven by a virtual clock. Used on
+// Linux build machines to load test the protocol layer with real clients.
+//
+// Everything runs on the calling thread.
+
+struct headless_options {
+    const char *socket_name;  // NULL = first free wayland-N
+    int32_t width;
+    int32_t height;
+    uint64_t refresh_ns;  // Virtual output refresh period
+    // Advance the virtual clock by one refresh period per repaint instead of
+    // pacing vblanks in real time (benchmarks run as fast as clients commit)
+    bool free_run;
+    uint64_t max_frames;  // Stop after this many output frames (0 = until stopped)
+    // Synthetic pointer motion events per output frame (0 = none). Pointer
+    // and keyboard focus move to the next mapped surface every frame, so the
+    // cost of routing input with many clients bound to the seat is measured.
+    uint32_t input_events;
+    uint32_t input_batch_ms;  // Input batching window (0 = send every event)
+};
+
+struct headless_stats {
+    uint64_t frames;           // Output frames composited
+    uint64_t surface_updates;  // Surface commits composited into a frame
+    uint64_t pixels;           // Output pixels repainted (damage only)
+    uint64_t uploads;          // Surface commits copied into the renderer
+    uint64_t upload_bytes;     // ... and the bytes they copied (damaged rectangles only)
+    uint64_t frame_events;     // Frame callbacks and presentation feedback sent
+    int clients;               // Clients bound to wl_compositor
+    int peak_clients;
+    int seat_clients;          // Clients bound to wl_seat
+    uint64_t input_events;     // Synthetic input events sent (enter and leave included)
+    uint64_t input_batches;    // ... grouped in this many wl_pointer.frame batches
+    uint64_t input_flushes;    // Client socket flushes for input (focused client wakeups)
+    uint64_t pool_hits;        // Renderer texture pool acquires served from idle storage
+    uint64_t pool_misses;      // ... and those that allocated
+    size_t pool_resident_bytes;
+};
+
+struct headless_backend;
+
+struct headless_backend *headless_backend_create(const struct headless_options *options);
+void headless_backend_destroy(struct headless_backend *backend);
+
+// Dispatch clients until headless_backend_stop(), SIGINT/SIGTERM or
+// max_frames. Returns 0 on a clean stop, -1 on an event loop error.
+int headless_backend_run(struct headless_backend *backend);
+void headless_backend_stop(struct headless_backend *backend);
+
+const char *headless_backend_get_socket(const struct headless_backend *backend);
+const struct headless_stats *headless_backend_get_stats(const struct headless_backend *backend);
+// Virtual time elapsed since the backend was created
+uint64_t headless_backend_get_virtual_time_ns(const struct headless_backend *backend);
+
+// Write the framebuffer as a binary PPM. Returns 0 on success.
+int headless_backend_write_ppm(const struct headless_backend *backend, const char *path);
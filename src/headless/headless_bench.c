@@ -0,0 +1,637 @@
+#include "headless_bench.h"
+#include "frame_scheduler.h"
+#include "input_batch.h"
+#include "input_queue.h"
+#include "logging.h"
+#include "pixel_convert.h"
+#include "wayland_seat.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t
+bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// --- Frame scheduler test ---
+
+#define SCHEDULER_TEST_REFRESH_NS 16666667ull
+#define SCHEDULER_TEST_BUDGET_NS 4000000ull
+
+struct scheduler_test {
+    struct frame_scheduler *scheduler;
+    struct frame_scheduler_timer timer;
+    struct frame_vblank_source vblank;
+
+    uint64_t now_ns;              // Fake clock
+    uint64_t timer_deadline_ns;   // Armed fallback timer (0 = disarmed)
+    bool vblank_enabled;
+    int repaints;
+    uint64_t repaint_present_ns;  // predicted_present_ns of the last repaint
+    bool reschedule;              // The repaint hook requests another frame
+
+    int checks;
+    int failures;
+};
+
+static void
+scheduler_check(struct scheduler_test *test, bool ok, const char *what, int line)
+{
+    test->checks++;
+    if (!ok) {
+        test->failures++;
+        log_error("[HEADLESS] ", "Frame scheduler test, line %d: %s\n", line, what);
+    }
+}
+
+#define SCHEDULER_CHECK(test, cond) scheduler_check(test, cond, #cond, __LINE__)
+
+static uint64_t
+scheduler_test_clock(void *data)
+{
+    struct scheduler_test *test = data;
+    return test->now_ns;
+}
+
+static void
+scheduler_test_arm(struct frame_scheduler_timer *timer, uint64_t deadline_ns)
+{
+    struct scheduler_test *test = timer->data;
+    test->timer_deadline_ns = deadline_ns;
+}
+
+static void
+scheduler_test_set_vblank(struct frame_vblank_source *source, bool enabled)
+{
+    struct scheduler_test *test = source->data;
+    test->vblank_enabled = enabled;
+}
+
+static void
+scheduler_test_repaint(void *data, uint64_t predicted_present_ns)
+{
+    struct scheduler_test *test = data;
+    test->repaints++;
+    test->repaint_present_ns = predicted_present_ns;
+    if (test->reschedule) {
+        frame_scheduler_schedule(test->scheduler);
+    }
+}
+
+// First presentation slot on the vblank grid through last_present_ns that
+// leaves the repaint budget after now_ns
+static uint64_t
+scheduler_test_expected_present(uint64_t last_present_ns, uint64_t now_ns)
+{
+    uint64_t present = last_present_ns;
+    while (present < now_ns + SCHEDULER_TEST_BUDGET_NS) {
+        present += SCHEDULER_TEST_REFRESH_NS;
+    }
+    return present;
+}
+
+// Without a vblank source: the timer fires at the repaint deadline
+static void
+scheduler_test_timer(struct scheduler_test *test)
+{
+    struct frame_scheduler *scheduler = test->scheduler;
+    SCHEDULER_CHECK(test, frame_scheduler_is_idle(scheduler));
+
+    // Nothing presented yet: repaint right away for now + budget
+    frame_scheduler_schedule(scheduler);
+    SCHEDULER_CHECK(test, !frame_scheduler_is_idle(scheduler));
+    SCHEDULER_CHECK(test, frame_scheduler_get_predicted_present(scheduler) ==
+                              test->now_ns + SCHEDULER_TEST_BUDGET_NS);
+    SCHEDULER_CHECK(test, frame_scheduler_get_repaint_deadline(scheduler) == test->now_ns);
+    SCHEDULER_CHECK(test, test->timer_deadline_ns == test->now_ns);
+    SCHEDULER_CHECK(test, test->repaints == 0);
+
+    frame_scheduler_handle_timer(scheduler);
+    SCHEDULER_CHECK(test, test->repaints == 1);
+    SCHEDULER_CHECK(test, test->repaint_present_ns == test->now_ns + SCHEDULER_TEST_BUDGET_NS);
+    SCHEDULER_CHECK(test, test->timer_deadline_ns == 0);
+    SCHEDULER_CHECK(test, frame_scheduler_is_idle(scheduler));
+
+    // Later frames stay on the grid of the first one, also after missed
+    // slots; a timer firing early waits for the deadline
+    static const uint64_t delays_ns[] = {5000000ull, 13000000ull, 70000000ull, 1000ull};
+    for (size_t i = 0; i < sizeof(delays_ns) / sizeof(delays_ns[0]); i++) {
+        uint64_t last_present_ns = test->repaint_present_ns;
+        test->now_ns = last_present_ns + delays_ns[i];
+        uint64_t present_ns = scheduler_test_expected_present(last_present_ns, test->now_ns);
+        uint64_t deadline_ns = present_ns - SCHEDULER_TEST_BUDGET_NS;
+
+        frame_scheduler_schedule(scheduler);
+        SCHEDULER_CHECK(test, frame_scheduler_get_predicted_present(scheduler) == present_ns);
+        SCHEDULER_CHECK(test, frame_scheduler_get_repaint_deadline(scheduler) == deadline_ns);
+        SCHEDULER_CHECK(test, test->timer_deadline_ns == deadline_ns);
+
+        // Scheduling again is a no-op
+        frame_scheduler_schedule(scheduler);
+        SCHEDULER_CHECK(test, frame_scheduler_get_repaint_deadline(scheduler) == deadline_ns);
+
+        int repaints = test->repaints;
+        if (deadline_ns > test->now_ns) {
+            frame_scheduler_handle_timer(scheduler);
+            SCHEDULER_CHECK(test, test->repaints == repaints);
+            SCHEDULER_CHECK(test, test->timer_deadline_ns == deadline_ns);
+        }
+        test->now_ns = deadline_ns;
+        frame_scheduler_handle_timer(scheduler);
+        SCHEDULER_CHECK(test, test->repaints == repaints + 1);
+        SCHEDULER_CHECK(test, test->repaint_present_ns == present_ns);
+        SCHEDULER_CHECK(test, frame_scheduler_is_idle(scheduler));
+    }
+
+    // A repaint that schedules again gets the next slot
+    test->reschedule = true;
+    test->now_ns += SCHEDULER_TEST_REFRESH_NS;
+    frame_scheduler_schedule(scheduler);
+    test->now_ns = test->timer_deadline_ns;
+    frame_scheduler_handle_timer(scheduler);
+    SCHEDULER_CHECK(test, !frame_scheduler_is_idle(scheduler));
+    SCHEDULER_CHECK(test, frame_scheduler_get_predicted_present(scheduler) ==
+                              test->repaint_present_ns + SCHEDULER_TEST_REFRESH_NS);
+    test->reschedule = false;
+    test->now_ns = test->timer_deadline_ns;
+    frame_scheduler_handle_timer(scheduler);
+    SCHEDULER_CHECK(test, frame_scheduler_is_idle(scheduler));
+    SCHEDULER_CHECK(test, test->timer_deadline_ns == 0);
+}
+
+// With a vblank source: repaint on the vblank, the timer only as a fallback
+static void
+scheduler_test_vblank(struct scheduler_test *test)
+{
+    struct frame_scheduler *scheduler = test->scheduler;
+    frame_scheduler_set_vblank_source(scheduler, &test->vblank);
+    SCHEDULER_CHECK(test, !test->vblank_enabled);
+
+    test->now_ns += 3 * SCHEDULER_TEST_REFRESH_NS;
+    frame_scheduler_schedule(scheduler);
+    SCHEDULER_CHECK(test, test->vblank_enabled);
+    uint64_t predicted_ns = frame_scheduler_get_predicted_present(scheduler);
+    SCHEDULER_CHECK(test, test->timer_deadline_ns == predicted_ns + SCHEDULER_TEST_REFRESH_NS);
+
+    int repaints = test->repaints;
+    test->now_ns = predicted_ns - SCHEDULER_TEST_REFRESH_NS / 2;
+    uint64_t vblank_present_ns = predicted_ns + 250000ull;
+    frame_scheduler_handle_vblank(scheduler, vblank_present_ns);
+    SCHEDULER_CHECK(test, test->repaints == repaints + 1);
+    SCHEDULER_CHECK(test, test->repaint_present_ns == vblank_present_ns);
+    SCHEDULER_CHECK(test, !test->vblank_enabled);
+    SCHEDULER_CHECK(test, test->timer_deadline_ns == 0);
+    SCHEDULER_CHECK(test, frame_scheduler_is_idle(scheduler));
+
+    // Idle: vblanks and stray timer expiries repaint nothing
+    for (int i = 0; i < 10; i++) {
+        test->now_ns += SCHEDULER_TEST_REFRESH_NS;
+        frame_scheduler_handle_vblank(scheduler, test->now_ns + SCHEDULER_TEST_REFRESH_NS);
+        frame_scheduler_handle_timer(scheduler);
+    }
+    SCHEDULER_CHECK(test, test->repaints == repaints + 1);
+    SCHEDULER_CHECK(test, frame_scheduler_is_idle(scheduler));
+    SCHEDULER_CHECK(test, !test->vblank_enabled);
+
+    // A stalled source (hidden window): the timer repaints a refresh late,
+    // for the next slot on the grid of the last vblank
+    uint64_t last_present_ns = test->now_ns + SCHEDULER_TEST_REFRESH_NS;
+    frame_scheduler_schedule(scheduler);
+    SCHEDULER_CHECK(test, test->vblank_enabled);
+    test->now_ns = test->timer_deadline_ns;
+    frame_scheduler_handle_timer(scheduler);
+    SCHEDULER_CHECK(test, test->repaints == repaints + 2);
+    SCHEDULER_CHECK(test, test->repaint_present_ns ==
+                              scheduler_test_expected_present(last_present_ns, test->now_ns));
+    SCHEDULER_CHECK(test, !test->vblank_enabled);
+    SCHEDULER_CHECK(test, frame_scheduler_is_idle(scheduler));
+
+    frame_scheduler_set_vblank_source(scheduler, NULL);
+}
+
+int
+headless_scheduler_test(void)
+{
+    struct scheduler_test test = {.now_ns = 1000000000ull};
+    test.timer.arm = scheduler_test_arm;
+    test.timer.data = &test;
+    test.vblank.set_enabled = scheduler_test_set_vblank;
+    test.vblank.data = &test;
+    test.scheduler = frame_scheduler_create(scheduler_test_clock, &test.timer,
+                                            scheduler_test_repaint, &test);
+    if (!test.scheduler) {
+        log_error("[HEADLESS] ", "Failed to create the frame scheduler\n");
+        return -1;
+    }
+    frame_scheduler_set_refresh_ns(test.scheduler, SCHEDULER_TEST_REFRESH_NS);
+    frame_scheduler_set_repaint_budget_ns(test.scheduler, SCHEDULER_TEST_BUDGET_NS);
+
+    scheduler_test_timer(&test);
+    scheduler_test_vblank(&test);
+    frame_scheduler_destroy(test.scheduler);
+
+    log_printf("[HEADLESS] ", "Frame scheduler: %d of %d checks passed (%d repaints)\n",
+               test.checks - test.failures, test.checks, test.repaints);
+    return test.failures == 0 ? 0 : -1;
+}
+
+// --- Input queue test ---
+
+#define INPUT_QUEUE_TEST_PRODUCERS 4
+#define INPUT_QUEUE_TEST_RECORDS 50000  // Per producer; every fourth is motion
+#define INPUT_QUEUE_TEST_CAPACITY 64    // Small, so the ring overflows
+
+struct input_queue_test {
+    struct input_queue *queue;
+    atomic_int producers_done;
+    atomic_uint_fast64_t push_failures;
+
+    // Dispatch side (this thread)
+    int64_t last[INPUT_QUEUE_TEST_PRODUCERS];  // Sequence number dispatched last
+    uint64_t keys[INPUT_QUEUE_TEST_PRODUCERS];
+    uint64_t motions;
+    uint64_t out_of_order;
+    uint64_t foreign;
+};
+
+struct input_queue_test_producer {
+    struct input_queue_test *test;
+    uint32_t index;
+};
+
+static void *
+input_queue_test_produce(void *data)
+{
+    struct input_queue_test_producer *producer = data;
+    struct input_queue_test *test = producer->test;
+    for (uint32_t i = 0; i < INPUT_QUEUE_TEST_RECORDS; i++) {
+        struct input_record record = {
+            .type = i % 4 == 3 ? INPUT_RECORD_POINTER_MOTION : INPUT_RECORD_KEYBOARD_KEY,
+            .time = i,
+            .code = producer->index,
+        };
+        if (!input_queue_push(test->queue, &record)) {
+            atomic_fetch_add(&test->push_failures, 1);
+        }
+    }
+    atomic_fetch_add(&test->producers_done, 1);
+    return NULL;
+}
+
+// Records of one producer must arrive in the order it pushed them; motion
+// may be replaced by later motion of any producer, keys never go missing
+static void
+input_queue_test_dispatch(void *data, const struct input_record *record)
+{
+    struct input_queue_test *test = data;
+    if (record->code >= INPUT_QUEUE_TEST_PRODUCERS) {
+        test->foreign++;
+        return;
+    }
+    if ((int64_t)record->time <= test->last[record->code]) {
+        test->out_of_order++;
+    }
+    test->last[record->code] = record->time;
+    if (record->type == INPUT_RECORD_KEYBOARD_KEY) {
+        test->keys[record->code]++;
+    } else {
+        test->motions++;
+    }
+}
+
+int
+headless_input_queue_test(void)
+{
+    struct wl_display *display = wl_display_create();
+    struct wl_seat_impl *seat = display ? wl_seat_create(display) : NULL;
+    struct input_batch *batch = seat ? input_batch_create(seat, display, 0) : NULL;
+    struct input_queue_test test = {0};
+    test.queue = batch ? input_queue_create(wl_display_get_event_loop(display), seat, batch,
+                                            INPUT_QUEUE_TEST_CAPACITY)
+                       : NULL;
+    if (!test.queue) {
+        log_error("[HEADLESS] ", "Failed to create the input queue\n");
+        input_batch_destroy(batch);
+        wl_seat_destroy(seat);
+        if (display) {
+            wl_display_destroy(display);
+        }
+        return -1;
+    }
+    for (int i = 0; i < INPUT_QUEUE_TEST_PRODUCERS; i++) {
+        test.last[i] = -1;
+    }
+    input_queue_set_callbacks(test.queue, &(struct input_queue_callbacks){
+                                              .dispatch = input_queue_test_dispatch,
+                                              .data = &test,
+                                          });
+
+    struct input_queue_test_producer producers[INPUT_QUEUE_TEST_PRODUCERS];
+    pthread_t threads[INPUT_QUEUE_TEST_PRODUCERS];
+    int started = 0;
+    for (int i = 0; i < INPUT_QUEUE_TEST_PRODUCERS; i++) {
+        producers[i] = (struct input_queue_test_producer){.test = &test, .index = (uint32_t)i};
+        if (pthread_create(&threads[i], NULL, input_queue_test_produce, &producers[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    // Leave the ring full for a while, as a busy event thread would, then
+    // drain alongside the producers
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = 5 * 1000 * 1000};
+    nanosleep(&pause, NULL);
+    while (atomic_load(&test.producers_done) < started) {
+        input_queue_drain(test.queue);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    input_queue_drain(test.queue);
+
+    struct input_queue_stats stats;
+    input_queue_get_stats(test.queue, &stats);
+    input_queue_destroy(test.queue);
+    input_batch_destroy(batch);
+    wl_seat_destroy(seat);
+    wl_display_destroy(display);
+
+    uint64_t expected_keys = INPUT_QUEUE_TEST_RECORDS - INPUT_QUEUE_TEST_RECORDS / 4;
+    int failures = 0;
+    if (started != INPUT_QUEUE_TEST_PRODUCERS) {
+        log_error("[HEADLESS] ", "Input queue test: started %d of %d producers\n", started,
+                  INPUT_QUEUE_TEST_PRODUCERS);
+        failures++;
+    }
+    for (int i = 0; i < started; i++) {
+        if (test.keys[i] != expected_keys) {
+            log_error("[HEADLESS] ", "Input queue test: producer %d, %llu of %llu keys\n", i,
+                      (unsigned long long)test.keys[i], (unsigned long long)expected_keys);
+            failures++;
+        }
+    }
+    if (test.out_of_order > 0 || test.foreign > 0) {
+        log_error("[HEADLESS] ", "Input queue test: %llu records out of order, %llu unknown\n",
+                  (unsigned long long)test.out_of_order, (unsigned long long)test.foreign);
+        failures++;
+    }
+    uint64_t failed_pushes = atomic_load(&test.push_failures);
+    if (failed_pushes > 0 || stats.dropped > 0) {
+        log_error("[HEADLESS] ", "Input queue test: %llu pushes failed, %llu records dropped\n",
+                  (unsigned long long)failed_pushes, (unsigned long long)stats.dropped);
+        failures++;
+    }
+    if (stats.overflowed == 0) {
+        log_error("[HEADLESS] ", "Input queue test: the ring never overflowed\n");
+        failures++;
+    }
+
+    log_printf("[HEADLESS] ",
+               "Input queue: %d producers, %llu records pushed, %llu overflowed, "
+               "%llu motions dispatched (%llu coalesced)%s\n",
+               started, (unsigned long long)stats.pushed, (unsigned long long)stats.overflowed,
+               (unsigned long long)test.motions, (unsigned long long)stats.coalesced,
+               failures == 0 ? "" : ", FAILED");
+    return failures == 0 ? 0 : -1;
+}
+
+// --- Logger benchmark ---
+
+#define LOG_BENCH_FILTERED_CALLS 10000000
+#define LOG_BENCH_LIMITED_CALLS 1000000
+#define LOG_BENCH_SITE_BURST 20  // Messages per call site and second let through
+
+// Distinct call sites: the rate limit is per format string
+static const char *const log_bench_formats[] = {
+    "bench site 0: record %d of %s\n",  "bench site 1: record %d of %s\n",
+    "bench site 2: record %d of %s\n",  "bench site 3: record %d of %s\n",
+    "bench site 4: record %d of %s\n",  "bench site 5: record %d of %s\n",
+    "bench site 6: record %d of %s\n",  "bench site 7: record %d of %s\n",
+    "bench site 8: record %d of %s\n",  "bench site 9: record %d of %s\n",
+    "bench site 10: record %d of %s\n", "bench site 11: record %d of %s\n",
+};
+
+#define LOG_BENCH_SITES ((int)(sizeof(log_bench_formats) / sizeof(log_bench_formats[0])))
+
+// Wait for the start of a second, so a burst is not split by the per-second
+// rate limit
+static void
+log_bench_wait_second(void)
+{
+    time_t second = time(NULL);
+    while (time(NULL) == second) {
+        usleep(1000);
+    }
+}
+
+int
+headless_log_bench(void)
+{
+    // The records go to the log file; stdout would only be flooded
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (saved_stdout < 0 || null_fd < 0 || dup2(null_fd, STDOUT_FILENO) < 0) {
+        log_error("[HEADLESS] ", "Logger benchmark: failed to silence stdout\n");
+        if (saved_stdout >= 0) {
+            close(saved_stdout);
+        }
+        if (null_fd >= 0) {
+            close(null_fd);
+        }
+        return -1;
+    }
+    close(null_fd);
+
+    // Below the runtime threshold: the level check alone
+    log_set_level(WAWONA_LOG_ERROR);
+    uint64_t start_ns = bench_now_ns();
+    for (int i = 0; i < LOG_BENCH_FILTERED_CALLS; i++) {
+        log_write(WAWONA_LOG_INFO, "[BENCH] ", "filtered record %d of %s\n", i, "bench");
+    }
+    uint64_t filtered_ns = bench_now_ns() - start_ns;
+    log_set_level(WAWONA_LOG_LEVEL);
+
+    // Every call site once up to its burst: formatted into the ring
+    log_fflush();
+    log_bench_wait_second();
+    int enqueued = 0;
+    start_ns = bench_now_ns();
+    for (int i = 0; i < LOG_BENCH_SITE_BURST; i++) {
+        for (int site = 0; site < LOG_BENCH_SITES; site++) {
+            log_write(WAWONA_LOG_INFO, "[BENCH] ", log_bench_formats[site], i, "bench");
+            enqueued++;
+        }
+    }
+    uint64_t enqueue_ns = bench_now_ns() - start_ns;
+    log_fflush();
+    uint64_t drain_ns = bench_now_ns() - start_ns;
+
+    // One hot call site: all but its burst are rate limited
+    log_bench_wait_second();
+    start_ns = bench_now_ns();
+    for (int i = 0; i < LOG_BENCH_LIMITED_CALLS; i++) {
+        log_write(WAWONA_LOG_INFO, "[BENCH] ", "rate limited record %d of %s\n", i, "bench");
+    }
+    uint64_t limited_ns = bench_now_ns() - start_ns;
+    log_fflush();
+
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    log_printf("[HEADLESS] ", "Logger: cost per call\n");
+    log_printf("[HEADLESS] ", "  below the level threshold: %.1f ns\n",
+               (double)filtered_ns / LOG_BENCH_FILTERED_CALLS);
+    log_printf("[HEADLESS] ", "  rate limited: %.1f ns\n",
+               (double)limited_ns / LOG_BENCH_LIMITED_CALLS);
+    log_printf("[HEADLESS] ",
+               "  formatted and queued: %.1f ns (%d records, written out in %.1f us)\n",
+               (double)enqueue_ns / enqueued, enqueued, (double)drain_ns / 1e3);
+    return 0;
+}
+
+// --- Pixel conversion benchmark ---
+
+#define CONVERT_BENCH_MIN_NS 100000000ull  // Time each kernel for at least this long
+
+static const struct {
+    uint32_t format;
+    const char *name;
+} convert_bench_formats[] = {
+    {PIXEL_FORMAT_ARGB8888, "ARGB8888"},         {PIXEL_FORMAT_XRGB8888, "XRGB8888"},
+    {PIXEL_FORMAT_ABGR8888, "ABGR8888"},         {PIXEL_FORMAT_XBGR8888, "XBGR8888"},
+    {PIXEL_FORMAT_RGBA8888, "RGBA8888"},         {PIXEL_FORMAT_RGBX8888, "RGBX8888"},
+    {PIXEL_FORMAT_BGRA8888, "BGRA8888"},         {PIXEL_FORMAT_BGRX8888, "BGRX8888"},
+    {PIXEL_FORMAT_RGB565, "RGB565"},             {PIXEL_FORMAT_ARGB2101010, "ARGB2101010"},
+    {PIXEL_FORMAT_XRGB2101010, "XRGB2101010"},   {PIXEL_FORMAT_ABGR2101010, "ABGR2101010"},
+    {PIXEL_FORMAT_XBGR2101010, "XBGR2101010"},   {PIXEL_FORMAT_ARGB16161616, "ARGB16161616"},
+    {PIXEL_FORMAT_XRGB16161616, "XRGB16161616"}, {PIXEL_FORMAT_ABGR16161616, "ABGR16161616"},
+    {PIXEL_FORMAT_XBGR16161616, "XBGR16161616"}, {PIXEL_FORMAT_NV12, "NV12"},
+    {PIXEL_FORMAT_P010, "P010"},                 {PIXEL_FORMAT_YUV420, "YUV420"},
+    {PIXEL_FORMAT_YUYV, "YUYV"},
+};
+
+static const struct {
+    enum pixel_convert_isa isa;
+    const char *name;
+} convert_bench_isas[] = {
+    {PIXEL_CONVERT_ISA_SCALAR, "scalar"},  // Reference, first
+    {PIXEL_CONVERT_ISA_SSE41, "sse4.1"},
+    {PIXEL_CONVERT_ISA_AVX2, "avx2"},
+    {PIXEL_CONVERT_ISA_NEON, "neon"},
+};
+
+#define CONVERT_BENCH_FORMATS \
+    ((int)(sizeof(convert_bench_formats) / sizeof(convert_bench_formats[0])))
+#define CONVERT_BENCH_ISAS ((int)(sizeof(convert_bench_isas) / sizeof(convert_bench_isas[0])))
+
+// Nanoseconds per conversion of the whole source with the selected kernels
+static double
+convert_bench_time(const struct pixel_convert_source *source, void *dst, int32_t dst_stride)
+{
+    int runs = 0;
+    uint64_t start_ns = bench_now_ns();
+    uint64_t elapsed_ns;
+    do {
+        pixel_convert_rect(source, 0, 0, source->width, source->height, dst, dst_stride, 0);
+        runs++;
+        elapsed_ns = bench_now_ns() - start_ns;
+    } while (elapsed_ns < CONVERT_BENCH_MIN_NS);
+    return (double)elapsed_ns / runs;
+}
+
+int
+headless_convert_bench(int32_t width, int32_t height)
+{
+    // Random source data, large enough for every format at 8 bytes per
+    // pixel and two planes' worth of rows
+    int32_t stride = width * 8;
+    int32_t dst_stride = width * 4;
+    size_t source_size = (size_t)stride * (size_t)height * 2;
+    size_t dst_size = (size_t)dst_stride * (size_t)height;
+    uint32_t *data = malloc(source_size);
+    uint8_t *expected = malloc(2 * dst_size);  // Premultiplied, then straight alpha
+    uint8_t *dst = malloc(dst_size);
+    if (!data || !expected || !dst) {
+        log_error("[HEADLESS] ", "Out of memory for the conversion benchmark\n");
+        free(data);
+        free(expected);
+        free(dst);
+        return -1;
+    }
+    uint32_t seed = 0x6d2b79f5u;
+    for (size_t i = 0; i < source_size / sizeof(uint32_t); i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        data[i] = seed;
+    }
+
+    log_printf("[HEADLESS] ", "Pixel conversion: %dx%d, ms per frame (speedup over scalar)\n",
+               width, height);
+    int mismatches = 0;
+    for (int f = 0; f < CONVERT_BENCH_FORMATS; f++) {
+        struct pixel_convert_source source;
+        if (!pixel_convert_source_init(&source, convert_bench_formats[f].format, data, width,
+                                       height, stride, source_size)) {
+            log_error("[HEADLESS] ", "  %s: not supported\n", convert_bench_formats[f].name);
+            mismatches++;
+            continue;
+        }
+
+        // Premultiplied and straight alpha output of every ISA must match
+        // the scalar reference
+        pixel_convert_set_isa(PIXEL_CONVERT_ISA_SCALAR);
+        for (uint32_t flags = 0; flags <= PIXEL_CONVERT_STRAIGHT_ALPHA; flags++) {
+            pixel_convert_rect(&source, 0, 0, width, height, expected + flags * dst_size,
+                               dst_stride, flags);
+        }
+
+        char line[256];
+        int length = snprintf(line, sizeof(line), "  %-13s", convert_bench_formats[f].name);
+        double scalar_ns = 0.0;
+        for (int i = 0; i < CONVERT_BENCH_ISAS; i++) {
+            if (!pixel_convert_set_isa(convert_bench_isas[i].isa)) {
+                continue;
+            }
+            bool same = true;
+            for (uint32_t flags = 0; i > 0 && flags <= PIXEL_CONVERT_STRAIGHT_ALPHA; flags++) {
+                memset(dst, 0, dst_size);
+                pixel_convert_rect(&source, 0, 0, width, height, dst, dst_stride, flags);
+                same = same && memcmp(dst, expected + flags * dst_size, dst_size) == 0;
+            }
+            if (!same) {
+                log_error("[HEADLESS] ", "  %s: %s output differs from scalar\n",
+                          convert_bench_formats[f].name, convert_bench_isas[i].name);
+                mismatches++;
+            }
+
+            double frame_ns = convert_bench_time(&source, dst, dst_stride);
+            if (i == 0) {
+                scalar_ns = frame_ns;
+            }
+            if (length > 0 && (size_t)length < sizeof(line)) {
+                length += snprintf(line + length, sizeof(line) - (size_t)length,
+                                   "  %s %.2f (%.1fx)", convert_bench_isas[i].name,
+                                   frame_ns / 1e6, scalar_ns / frame_ns);
+            }
+        }
+        log_printf("[HEADLESS] ", "%s\n", line);
+    }
+
+    pixel_convert_set_isa(PIXEL_CONVERT_ISA_AUTO);
+    free(data);
+    free(expected);
+    free(dst);
+    return mismatches == 0 ? 0 : -1;
+}
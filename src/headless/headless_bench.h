@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+// Self-contained test and benchmark modes of wawona-headless. They log
+// their results and return 0 on success.
+
+struct headless_options;
+
+// Drive a frame scheduler with a fake clock, timer and vblank source and
+// check its repaint deadlines, presentation predictions and that it goes
+// idle once nothing is scheduled
+int headless_scheduler_test(void);
+
+// Push keys and pointer motion into an input queue from several threads
+// while the ring is left full, and check that each thread's records are
+// dispatched in order, that no key is lost and that the overflow list was
+// used
+int headless_input_queue_test(void);
+
+// Time log calls that the level threshold drops, that the per-call-site rate
+// limit drops, and that are formatted into the ring, and how long the writer
+// thread takes to write a burst out. Records go to the log file only.
+int headless_log_bench(void);
+
+// Time converting a width x height buffer of every supported format with
+// each pixel_convert ISA available, checking that every ISA produces the
+// same pixels as the scalar reference
+int headless_convert_bench(int32_t width, int32_t height);
+
+// Serve a paced headless output to an in-process wl_shm client that commits
+// frames one presentation feedback after another, and report the commit to
+// presentation latency. Fails on discarded or missing feedback and on
+// presentation times off the vblank grid.
+int headless_latency_test(const struct headless_options *options, int frames);
+
+// Connect an in-process client to a headless backend connections times and
+// report the time from wl_display_connect() to the first wl_registry global
+int headless_connect_bench(const struct headless_options *options, int connections);
@@ -0,0 +1,524 @@
+#include "headless_backend.h"
+#include "headless_bench.h"
+#include "logging.h"
+#include "presentation-time-client-protocol.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-client.h>
+
+// Modes that serve a headless backend to a Wayland client on a thread of
+// the same process. The client thread is started after the backend, so it
+// inherits the blocked signals the backend reads through its event loop,
+// and stops the backend with SIGTERM when done.
+
+#define CLIENT_TIMEOUT_NS 2000000000ull
+
+static uint64_t
+client_now_ns(clockid_t clock_id)
+{
+    struct timespec ts;
+    clock_gettime(clock_id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Dispatch events until *pending is cleared by a listener. Returns -1 on a
+// connection error or if CLIENT_TIMEOUT_NS passes first.
+static int
+client_dispatch_until(struct wl_display *display, const bool *pending)
+{
+    uint64_t deadline_ns = client_now_ns(CLOCK_MONOTONIC) + CLIENT_TIMEOUT_NS;
+    while (*pending) {
+        uint64_t now_ns = client_now_ns(CLOCK_MONOTONIC);
+        if (now_ns >= deadline_ns) {
+            return -1;
+        }
+        while (wl_display_prepare_read(display) != 0) {
+            if (wl_display_dispatch_pending(display) < 0) {
+                return -1;
+            }
+        }
+        if (wl_display_flush(display) < 0 && errno != EAGAIN) {
+            wl_display_cancel_read(display);
+            return -1;
+        }
+        struct pollfd pfd = {.fd = wl_display_get_fd(display), .events = POLLIN};
+        int timeout_ms = (int)((deadline_ns - now_ns + 999999ull) / 1000000ull);
+        if (poll(&pfd, 1, timeout_ms) <= 0) {
+            wl_display_cancel_read(display);
+            continue;
+        }
+        if (wl_display_read_events(display) < 0 || wl_display_dispatch_pending(display) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+struct client_thread {
+    void (*run)(void *data);
+    void *data;
+};
+
+static void *
+client_thread_main(void *data)
+{
+    struct client_thread *thread = data;
+    thread->run(thread->data);
+
+    // Stop the compositor: SIGTERM is blocked in every thread and read by
+    // its event loop
+    kill(getpid(), SIGTERM);
+    return NULL;
+}
+
+// Run backend until run(data) returns on a client thread; *socket is set to
+// the backend's socket name before the thread starts
+static int
+run_with_client(struct headless_backend *backend, const char **socket, void (*run)(void *data),
+                void *data)
+{
+    struct client_thread client = {.run = run, .data = data};
+    *socket = headless_backend_get_socket(backend);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, client_thread_main, &client) != 0) {
+        log_error("[HEADLESS] ", "Failed to start the client thread\n");
+        return -1;
+    }
+    int result = headless_backend_run(backend);
+    pthread_join(thread, NULL);
+    return result;
+}
+
+// --- Presentation latency test ---
+
+// A wl_shm client commits a frame, waits for its presentation feedback and
+// commits the next one. The compositor runs paced, so the presentation
+// clock is the virtual vblank clock snapped to the real one and commit
+// times are comparable.
+
+#define LATENCY_TEST_WIDTH 256
+#define LATENCY_TEST_HEIGHT 256
+
+struct latency_client {
+    const char *socket;
+    int frames;
+    uint64_t refresh_ns;
+
+    struct wl_display *display;
+    struct wl_registry *registry;
+    struct wl_compositor *compositor;
+    struct wl_shm *shm;
+    struct wp_presentation *presentation;
+    struct wl_surface *surface;
+    struct wl_buffer *buffers[2];
+    void *pixels;
+    size_t pixels_size;
+    clockid_t clock_id;
+    bool have_clock;
+
+    // Feedback of the frame in flight
+    bool pending;
+    uint64_t commit_ns;
+
+    int presented;
+    int discarded;
+    int early;        // Presented before they were committed
+    int off_grid;     // Presentation time off the vblank grid
+    int bad_refresh;  // refresh other than the output's period
+    uint64_t first_present_ns;
+    uint64_t last_present_ns;
+    uint64_t latency_min_ns;
+    uint64_t latency_max_ns;
+    uint64_t latency_sum_ns;
+    int result;
+};
+
+static void
+latency_presentation_clock_id(void *data, struct wp_presentation *presentation, uint32_t clk_id)
+{
+    (void)presentation;
+    struct latency_client *client = data;
+    client->clock_id = (clockid_t)clk_id;
+    client->have_clock = true;
+}
+
+static const struct wp_presentation_listener latency_presentation_listener = {
+    .clock_id = latency_presentation_clock_id,
+};
+
+static void
+latency_feedback_sync_output(void *data, struct wp_presentation_feedback *feedback,
+                             struct wl_output *output)
+{
+    (void)data;
+    (void)feedback;
+    (void)output;
+}
+
+static void
+latency_feedback_presented(void *data, struct wp_presentation_feedback *feedback,
+                           uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec,
+                           uint32_t refresh, uint32_t seq_hi, uint32_t seq_lo, uint32_t flags)
+{
+    (void)seq_hi;
+    (void)seq_lo;
+    (void)flags;
+    struct latency_client *client = data;
+    wp_presentation_feedback_destroy(feedback);
+    client->pending = false;
+
+    uint64_t present_ns = ((((uint64_t)tv_sec_hi << 32) | tv_sec_lo) * 1000000000ull) + tv_nsec;
+    if (client->presented == 0) {
+        client->first_present_ns = present_ns;
+    }
+    client->presented++;
+    client->last_present_ns = present_ns;
+    client->bad_refresh += refresh != client->refresh_ns;
+    client->off_grid += present_ns < client->first_present_ns ||
+                        (present_ns - client->first_present_ns) % client->refresh_ns != 0;
+    if (present_ns < client->commit_ns) {
+        client->early++;
+        return;
+    }
+
+    uint64_t latency_ns = present_ns - client->commit_ns;
+    client->latency_sum_ns += latency_ns;
+    client->latency_min_ns = latency_ns < client->latency_min_ns ? latency_ns
+                                                                 : client->latency_min_ns;
+    client->latency_max_ns = latency_ns > client->latency_max_ns ? latency_ns
+                                                                 : client->latency_max_ns;
+}
+
+static void
+latency_feedback_discarded(void *data, struct wp_presentation_feedback *feedback)
+{
+    struct latency_client *client = data;
+    wp_presentation_feedback_destroy(feedback);
+    client->pending = false;
+    client->discarded++;
+}
+
+static const struct wp_presentation_feedback_listener latency_feedback_listener = {
+    .sync_output = latency_feedback_sync_output,
+    .presented = latency_feedback_presented,
+    .discarded = latency_feedback_discarded,
+};
+
+static void
+latency_registry_global(void *data, struct wl_registry *registry, uint32_t name,
+                        const char *interface, uint32_t version)
+{
+    struct latency_client *client = data;
+    if (strcmp(interface, wl_compositor_interface.name) == 0 && version >= 4) {
+        client->compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 4);
+    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
+        client->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+    } else if (strcmp(interface, wp_presentation_interface.name) == 0) {
+        client->presentation = wl_registry_bind(registry, name, &wp_presentation_interface, 1);
+        wp_presentation_add_listener(client->presentation, &latency_presentation_listener,
+                                     client);
+    }
+}
+
+static void
+latency_registry_global_remove(void *data, struct wl_registry *registry, uint32_t name)
+{
+    (void)data;
+    (void)registry;
+    (void)name;
+}
+
+static const struct wl_registry_listener latency_registry_listener = {
+    .global = latency_registry_global,
+    .global_remove = latency_registry_global_remove,
+};
+
+// Two XRGB8888 buffers in one shm pool
+static int
+latency_client_create_buffers(struct latency_client *client)
+{
+    int32_t stride = LATENCY_TEST_WIDTH * 4;
+    size_t buffer_size = (size_t)stride * LATENCY_TEST_HEIGHT;
+    client->pixels_size = 2 * buffer_size;
+
+    int fd = memfd_create("wawona-latency", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, (off_t)client->pixels_size) != 0) {
+        log_error("[HEADLESS] ", "Latency client: no shm file: %s\n", strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    client->pixels = mmap(NULL, client->pixels_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (client->pixels == MAP_FAILED) {
+        client->pixels = NULL;
+        close(fd);
+        return -1;
+    }
+    memset(client->pixels, 0x40, buffer_size);
+    memset((char *)client->pixels + buffer_size, 0xc0, buffer_size);
+
+    struct wl_shm_pool *pool = wl_shm_create_pool(client->shm, fd, (int32_t)client->pixels_size);
+    for (int i = 0; i < 2; i++) {
+        client->buffers[i] =
+            wl_shm_pool_create_buffer(pool, (int32_t)buffer_size * i, LATENCY_TEST_WIDTH,
+                                      LATENCY_TEST_HEIGHT, stride, WL_SHM_FORMAT_XRGB8888);
+    }
+    wl_shm_pool_destroy(pool);
+    close(fd);
+    return 0;
+}
+
+static int
+latency_client_connect(struct latency_client *client)
+{
+    client->display = wl_display_connect(client->socket);
+    if (!client->display) {
+        log_error("[HEADLESS] ", "Latency client: failed to connect to %s\n", client->socket);
+        return -1;
+    }
+    client->registry = wl_display_get_registry(client->display);
+    wl_registry_add_listener(client->registry, &latency_registry_listener, client);
+    // Globals, then the events of the objects bound
+    if (wl_display_roundtrip(client->display) < 0 || wl_display_roundtrip(client->display) < 0) {
+        return -1;
+    }
+    if (!client->compositor || !client->shm || !client->presentation) {
+        log_error("[HEADLESS] ", "Latency client: wl_compositor, wl_shm or wp_presentation "
+                                 "missing\n");
+        return -1;
+    }
+    if (!client->have_clock) {
+        log_error("[HEADLESS] ", "Latency client: no presentation clock\n");
+        return -1;
+    }
+
+    client->surface = wl_compositor_create_surface(client->compositor);
+    return latency_client_create_buffers(client);
+}
+
+static int
+latency_client_frames(struct latency_client *client)
+{
+    for (int i = 0; i < client->frames; i++) {
+        wl_surface_attach(client->surface, client->buffers[i % 2], 0, 0);
+        wl_surface_damage_buffer(client->surface, 0, 0, LATENCY_TEST_WIDTH, LATENCY_TEST_HEIGHT);
+        struct wp_presentation_feedback *feedback =
+            wp_presentation_feedback(client->presentation, client->surface);
+        wp_presentation_feedback_add_listener(feedback, &latency_feedback_listener, client);
+        client->pending = true;
+        client->commit_ns = client_now_ns(client->clock_id);
+        wl_surface_commit(client->surface);
+        if (client_dispatch_until(client->display, &client->pending) != 0) {
+            log_error("[HEADLESS] ", "Latency client: no feedback for frame %d\n", i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void
+latency_client_disconnect(struct latency_client *client)
+{
+    for (int i = 0; i < 2; i++) {
+        if (client->buffers[i]) {
+            wl_buffer_destroy(client->buffers[i]);
+        }
+    }
+    if (client->surface) {
+        wl_surface_destroy(client->surface);
+    }
+    if (client->presentation) {
+        wp_presentation_destroy(client->presentation);
+    }
+    if (client->shm) {
+        wl_shm_destroy(client->shm);
+    }
+    if (client->compositor) {
+        wl_compositor_destroy(client->compositor);
+    }
+    if (client->registry) {
+        wl_registry_destroy(client->registry);
+    }
+    if (client->display) {
+        wl_display_disconnect(client->display);
+    }
+    if (client->pixels) {
+        munmap(client->pixels, client->pixels_size);
+    }
+}
+
+static void
+latency_client_run(void *data)
+{
+    struct latency_client *client = data;
+    client->result = latency_client_connect(client) == 0 ? latency_client_frames(client) : -1;
+    latency_client_disconnect(client);
+}
+
+int
+headless_latency_test(const struct headless_options *options, int frames)
+{
+    struct headless_options paced = *options;
+    paced.free_run = false;
+    paced.max_frames = 0;
+    struct headless_backend *backend = headless_backend_create(&paced);
+    if (!backend) {
+        return -1;
+    }
+
+    struct latency_client client = {
+        .frames = frames,
+        .refresh_ns = paced.refresh_ns,
+        .latency_min_ns = UINT64_MAX,
+        .result = -1,
+    };
+    int result = run_with_client(backend, &client.socket, latency_client_run, &client);
+    headless_backend_destroy(backend);
+
+    int measured = client.presented - client.early;
+    double refresh_ms = (double)paced.refresh_ns / 1e6;
+    log_printf("[HEADLESS] ", "Latency: %d of %d frames presented (%d discarded) at %.2f Hz\n",
+               client.presented, frames, client.discarded, 1e9 / (double)paced.refresh_ns);
+    if (measured > 0) {
+        double average_ms = (double)client.latency_sum_ns / measured / 1e6;
+        log_printf("[HEADLESS] ",
+                   "  commit to present: %.2f / %.2f / %.2f ms min/avg/max "
+                   "(%.2f refresh periods on average)\n",
+                   (double)client.latency_min_ns / 1e6, average_ms,
+                   (double)client.latency_max_ns / 1e6, average_ms / refresh_ms);
+    }
+    if (client.presented > 1) {
+        log_printf("[HEADLESS] ", "  one frame every %.2f refresh periods\n",
+                   (double)(client.last_present_ns - client.first_present_ns) /
+                       (double)paced.refresh_ns / (client.presented - 1));
+    }
+    if (client.early > 0 || client.off_grid > 0 || client.bad_refresh > 0) {
+        log_error("[HEADLESS] ",
+                  "Latency: %d frames presented before their commit, %d off the vblank grid, "
+                  "%d with a wrong refresh period\n",
+                  client.early, client.off_grid, client.bad_refresh);
+    }
+
+    bool passed = result == 0 && client.result == 0 && client.presented == frames &&
+                  client.early == 0 && client.off_grid == 0 && client.bad_refresh == 0;
+    return passed ? 0 : -1;
+}
+
+// --- Connection benchmark ---
+
+// Time from wl_display_connect() to the first wl_registry.global event:
+// accepting the connection, creating the wl_client and advertising globals
+
+struct connect_bench {
+    const char *socket;
+    int connections;
+    uint64_t *samples_ns;
+    int measured;
+};
+
+static void
+connect_bench_global(void *data, struct wl_registry *registry, uint32_t name,
+                     const char *interface, uint32_t version)
+{
+    (void)registry;
+    (void)name;
+    (void)interface;
+    (void)version;
+    bool *pending = data;
+    *pending = false;
+}
+
+static void
+connect_bench_global_remove(void *data, struct wl_registry *registry, uint32_t name)
+{
+    (void)data;
+    (void)registry;
+    (void)name;
+}
+
+static const struct wl_registry_listener connect_bench_registry_listener = {
+    .global = connect_bench_global,
+    .global_remove = connect_bench_global_remove,
+};
+
+static void
+connect_bench_run(void *data)
+{
+    struct connect_bench *bench = data;
+    for (int i = 0; i < bench->connections; i++) {
+        bool pending = true;
+        uint64_t start_ns = client_now_ns(CLOCK_MONOTONIC);
+        struct wl_display *display = wl_display_connect(bench->socket);
+        if (!display) {
+            log_error("[HEADLESS] ", "Connection benchmark: failed to connect to %s\n",
+                      bench->socket);
+            return;
+        }
+        struct wl_registry *registry = wl_display_get_registry(display);
+        wl_registry_add_listener(registry, &connect_bench_registry_listener, &pending);
+        int result = client_dispatch_until(display, &pending);
+        uint64_t elapsed_ns = client_now_ns(CLOCK_MONOTONIC) - start_ns;
+        wl_registry_destroy(registry);
+        wl_display_disconnect(display);
+        if (result != 0) {
+            log_error("[HEADLESS] ", "Connection benchmark: no globals on connection %d\n", i);
+            return;
+        }
+        bench->samples_ns[bench->measured++] = elapsed_ns;
+    }
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+int
+headless_connect_bench(const struct headless_options *options, int connections)
+{
+    struct connect_bench bench = {
+        .connections = connections,
+        .samples_ns = calloc((size_t)connections, sizeof(uint64_t)),
+    };
+    struct headless_options served = *options;
+    served.max_frames = 0;
+    struct headless_backend *backend = bench.samples_ns ? headless_backend_create(&served) : NULL;
+    if (!backend) {
+        free(bench.samples_ns);
+        return -1;
+    }
+    int result = run_with_client(backend, &bench.socket, connect_bench_run, &bench);
+    headless_backend_destroy(backend);
+
+    if (bench.measured > 0) {
+        qsort(bench.samples_ns, (size_t)bench.measured, sizeof(uint64_t), compare_u64);
+        uint64_t total_ns = 0;
+        for (int i = 0; i < bench.measured; i++) {
+            total_ns += bench.samples_ns[i];
+        }
+        log_printf("[HEADLESS] ",
+                   "Connect to first wl_registry global: %d connections, "
+                   "%.1f / %.1f / %.1f / %.1f us min/median/p99/max, %.1f us average\n",
+                   bench.measured, (double)bench.samples_ns[0] / 1e3,
+                   (double)bench.samples_ns[bench.measured / 2] / 1e3,
+                   (double)bench.samples_ns[(bench.measured * 99) / 100] / 1e3,
+                   (double)bench.samples_ns[bench.measured - 1] / 1e3,
+                   (double)total_ns / bench.measured / 1e3);
+    }
+    bool passed = result == 0 && bench.measured == connections;
+    free(bench.samples_ns);
+    return passed ? 0 : -1;
+}
@@ -0,0 +1,102 @@
+#include "metal_dmabuf.h"
+#include "logging.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// DMA-BUF buffers for the headless backend
+// Linear dmabufs are mapped read-only, one mapping per plane, and composited
+// on the CPU like wl_shm buffers (multi-planar YUV through pixel_convert).
+// There is no GPU, so iosurface and texture stay NULL.
+
+struct metal_dmabuf_buffer *
+metal_dmabuf_create_buffer(uint32_t width, uint32_t height, uint32_t format)
+{
+    // Only imported buffers are used headless
+    (void)width;
+    (void)height;
+    (void)format;
+    return NULL;
+}
+
+void
+metal_dmabuf_destroy_buffer(struct metal_dmabuf_buffer *buffer)
+{
+    if (!buffer) {
+        return;
+    }
+    for (uint32_t i = 0; i < buffer->n_planes; i++) {
+        if (buffer->plane_maps[i]) {
+            munmap(buffer->plane_maps[i], buffer->plane_map_sizes[i]);
+        }
+    }
+    free(buffer);
+}
+
+// Takes ownership of the plane fds
+struct metal_dmabuf_buffer *
+metal_dmabuf_import(const struct metal_dmabuf_plane *planes, uint32_t n_planes, uint32_t width,
+                    uint32_t height, uint32_t format)
+{
+    struct metal_dmabuf_buffer *buffer = calloc(1, sizeof(struct metal_dmabuf_buffer));
+    bool failed = (buffer == NULL);
+
+    for (uint32_t i = 0; i < n_planes; i++) {
+        // mmap offsets must be page aligned, so map from the start of the fd
+        size_t size = (size_t)planes[i].offset + (size_t)planes[i].stride * planes[i].height;
+        if (!failed) {
+            void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, planes[i].fd, 0);
+            if (map == MAP_FAILED) {
+                log_error("[DMABUF] ", "Failed to map dmabuf plane %u: %s\n", i, strerror(errno));
+                failed = true;
+            } else {
+                buffer->plane_maps[i] = map;
+                buffer->plane_map_sizes[i] = size;
+                buffer->offsets[i] = planes[i].offset;
+                buffer->strides[i] = planes[i].stride;
+                buffer->n_planes = i + 1;
+            }
+        }
+        close(planes[i].fd);
+    }
+    if (failed) {
+        metal_dmabuf_destroy_buffer(buffer);
+        return NULL;
+    }
+
+    buffer->width = width;
+    buffer->height = height;
+    buffer->format = format;
+    buffer->stride = planes[0].stride;
+    return buffer;
+}
+
+int
+metal_dmabuf_get_fd(struct metal_dmabuf_buffer *buffer)
+{
+    (void)buffer;
+    return -1;
+}
+
+id
+metal_dmabuf_get_texture(struct metal_dmabuf_buffer *buffer, id device)
+{
+    (void)buffer;
+    (void)device;
+    return NULL;
+}
+
+IOSurfaceRef
+metal_dmabuf_create_iosurface_from_data(void *data, uint32_t width, uint32_t height,
+                                        uint32_t stride, uint32_t format)
+{
+    (void)data;
+    (void)width;
+    (void)height;
+    (void)stride;
+    (void)format;
+    return NULL;
+}
@@ -0,0 +1,478 @@
+#include "headless_backend.h"
+#include "headless_bench.h"
+#include "WawonaCompositor.h"
+#include "WawonaSettings.h"
+#include "hit_test.h"
+#include "input_batch.h"
+#include "logging.h"
+#include "trace.h"
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// wawona-headless: the compositor core on a virtual output, for CI.
+// Prints the socket name on startup and frame statistics on exit.
+
+static void
+usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -s, --socket NAME     Wayland socket name (default: first free wayland-N)\n"
+            "  -W, --width PIXELS    Output width (default: 1920)\n"
+            "  -H, --height PIXELS   Output height (default: 1080)\n"
+            "  -r, --refresh HZ      Virtual refresh rate (default: 60)\n"
+            "  -f, --free-run        Repaint as soon as clients commit instead of in real time\n"
+            "  -n, --frames COUNT    Exit after COUNT output frames\n"
+            "  -i, --input COUNT     Send COUNT pointer motion events per frame, moving focus\n"
+            "                        to the next surface every frame\n"
+            "  -b, --input-batch MS  Input batching window (default: %d, 0 = off)\n"
+            "  -x, --hit-test-bench SURFACES\n"
+            "                        Time pointer hit-testing over SURFACES stacked surfaces\n"
+            "                        (grid index against a linear scan) and exit\n"
+            "  -S, --scheduler-test  Check frame scheduler deadlines, predictions and idling\n"
+            "                        against a fake clock and exit\n"
+            "  -Q, --input-queue-test\n"
+            "                        Check input queue ordering and overflow with several\n"
+            "                        producer threads and exit\n"
+            "  -L, --latency-test FRAMES\n"
+            "                        Present FRAMES frames of an in-process client on the\n"
+            "                        paced output, report commit to presentation latency\n"
+            "                        and exit\n"
+            "  -C, --connect-bench CONNECTIONS\n"
+            "                        Time CONNECTIONS in-process client connections up to\n"
+            "                        their first wl_registry global and exit\n"
+            "  -l, --log-bench       Time the cost of a log call and exit\n"
+            "  -c, --convert-bench   Time pixel format conversion per format and ISA at the\n"
+            "                        output size, check the ISAs agree and exit\n"
+            "  -o, --output FILE     Write the final framebuffer to FILE (PPM)\n"
+            "  -t, --trace FILE      Record a frame trace and write it to FILE on exit\n"
+            "  -h, --help            Show this help\n",
+            program, INPUT_BATCH_DEFAULT_WINDOW_MS);
+}
+
+static bool
+parse_positive(const char *arg, long max, long *out)
+{
+    char *end = NULL;
+    long value = strtol(arg, &end, 10);
+    if (!end || *end != '\0' || value <= 0 || value > max) {
+        return false;
+    }
+    *out = value;
+    return true;
+}
+
+static uint64_t
+monotonic_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// --- Hit-test benchmark ---
+
+#define HIT_TEST_BENCH_EVENTS 1000000
+#define HIT_TEST_BENCH_MOVES 1000
+
+static uint32_t
+bench_random(uint32_t *state)
+{
+    // xorshift32: the same layout and pointer path on every run
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// A draw list of count windows scattered over the output, stacked in
+// creation order. Every third window has an input region inset from its
+// edges (client-side shadows), every fourth an L-shaped one.
+static struct wl_surface_draw_entry *
+bench_create_windows(int count, int32_t width, int32_t height, struct wl_surface_impl **surfaces)
+{
+    struct wl_surface_draw_entry *entries = calloc((size_t)count, sizeof(*entries));
+    *surfaces = calloc((size_t)count, sizeof(struct wl_surface_impl));
+    if (!entries || !*surfaces) {
+        free(entries);
+        free(*surfaces);
+        return NULL;
+    }
+
+    uint32_t seed = 0x9e3779b9u;
+    for (int i = 0; i < count; i++) {
+        struct wl_surface_draw_entry *entry = &entries[i];
+        entry->surface = &(*surfaces)[i];
+        entry->width = 200 + (int32_t)(bench_random(&seed) % 600u);
+        entry->height = 150 + (int32_t)(bench_random(&seed) % 450u);
+        int32_t span_x = width > entry->width ? width - entry->width : 1;
+        int32_t span_y = height > entry->height ? height - entry->height : 1;
+        entry->x = (int32_t)(bench_random(&seed) % (uint32_t)span_x);
+        entry->y = (int32_t)(bench_random(&seed) % (uint32_t)span_y);
+        pixman_region32_init(&entry->opaque);
+        uint32_t w = (uint32_t)entry->width;
+        uint32_t h = (uint32_t)entry->height;
+        if (i % 4 == 3) {
+            pixman_region32_init_rect(&entry->input, 0, 0, w, h / 2);
+            pixman_region32_union_rect(&entry->input, &entry->input, 0, (int)(h / 2), w / 2,
+                                       h - h / 2);
+        } else if (i % 3 == 2) {
+            pixman_region32_init_rect(&entry->input, 16, 16, w - 32, h - 32);
+        } else {
+            pixman_region32_init_rect(&entry->input, 0, 0, w, h);
+        }
+    }
+    return entries;
+}
+
+// Route HIT_TEST_BENCH_EVENTS pointer positions through the index and
+// through a linear scan of the draw list, check both agree, and time the
+// rebuilds that follow moving one window. Returns 0 if the answers agree.
+static int
+run_hit_test_bench(int count, int32_t width, int32_t height)
+{
+    struct hit_test *index = hit_test_create();
+    double *points = malloc(2 * HIT_TEST_BENCH_EVENTS * sizeof(double));
+    struct wl_surface_impl **expected = malloc(HIT_TEST_BENCH_EVENTS * sizeof(*expected));
+    struct wl_surface_impl *surfaces = NULL;
+    struct wl_surface_draw_entry *entries =
+        index && points && expected ? bench_create_windows(count, width, height, &surfaces) : NULL;
+    if (!entries) {
+        log_error("[HEADLESS] ", "Out of memory for the hit-test benchmark\n");
+        free(points);
+        free(expected);
+        hit_test_destroy(index);
+        return -1;
+    }
+    struct wl_surface_draw_list list = {.entries = entries, .count = count, .generation = 1};
+
+    // Pointer motion: a random walk in small steps, as a mouse moves
+    uint32_t seed = 0x2545f491u;
+    double x = width / 2.0;
+    double y = height / 2.0;
+    for (int i = 0; i < HIT_TEST_BENCH_EVENTS; i++) {
+        x += (double)(bench_random(&seed) % 33u) - 16.0;
+        y += (double)(bench_random(&seed) % 33u) - 16.0;
+        x = x < 0.0 ? -x : (x >= width ? 2.0 * (width - 1) - x : x);
+        y = y < 0.0 ? -y : (y >= height ? 2.0 * (height - 1) - y : y);
+        points[2 * i] = x;
+        points[2 * i + 1] = y;
+    }
+
+    struct hit_test_result result;
+    int hits = 0;
+    uint64_t start_ns = monotonic_now_ns();
+    for (int i = 0; i < HIT_TEST_BENCH_EVENTS; i++) {
+        expected[i] = hit_test_pick_list(&list, points[2 * i], points[2 * i + 1], &result)
+                          ? result.surface
+                          : NULL;
+    }
+    uint64_t linear_ns = monotonic_now_ns() - start_ns;
+
+    start_ns = monotonic_now_ns();
+    hit_test_update(index, &list);
+    uint64_t build_ns = monotonic_now_ns() - start_ns;
+
+    int mismatches = 0;
+    start_ns = monotonic_now_ns();
+    for (int i = 0; i < HIT_TEST_BENCH_EVENTS; i++) {
+        struct wl_surface_impl *surface =
+            hit_test_pick(index, points[2 * i], points[2 * i + 1], &result) ? result.surface : NULL;
+        hits += surface != NULL;
+        mismatches += surface != expected[i];
+    }
+    uint64_t index_ns = monotonic_now_ns() - start_ns;
+
+    // One window moves per draw list generation, as while dragging it
+    start_ns = monotonic_now_ns();
+    for (int i = 0; i < HIT_TEST_BENCH_MOVES; i++) {
+        struct wl_surface_draw_entry *entry = &entries[i % count];
+        entry->x = (entry->x + 7) % (width > entry->width ? width - entry->width : 1);
+        list.generation++;
+        hit_test_update(index, &list);
+    }
+    uint64_t moves_ns = monotonic_now_ns() - start_ns;
+
+    struct hit_test_stats stats;
+    hit_test_get_stats(index, &stats);
+    log_printf("[HEADLESS] ",
+               "Hit test: %d surfaces on %dx%d, %d motion events (%.1f%% on a surface)\n", count,
+               width, height, HIT_TEST_BENCH_EVENTS,
+               100.0 * (double)hits / (double)HIT_TEST_BENCH_EVENTS);
+    log_printf("[HEADLESS] ",
+               "  grid index: %.1f ns/event, %.2f surfaces tested/event, "
+               "built in %.1f us, %.1f us per rebuild after a move\n",
+               (double)index_ns / HIT_TEST_BENCH_EVENTS,
+               (double)stats.candidates / (double)stats.queries, (double)build_ns / 1e3,
+               (double)moves_ns / 1e3 / HIT_TEST_BENCH_MOVES);
+    log_printf("[HEADLESS] ", "  linear scan: %.1f ns/event\n",
+               (double)linear_ns / HIT_TEST_BENCH_EVENTS);
+    if (mismatches > 0) {
+        log_error("[HEADLESS] ", "Hit test: %d events picked a different surface than the scan\n",
+                  mismatches);
+    }
+
+    for (int i = 0; i < count; i++) {
+        pixman_region32_fini(&entries[i].opaque);
+        pixman_region32_fini(&entries[i].input);
+    }
+    free(entries);
+    free(surfaces);
+    free(points);
+    free(expected);
+    hit_test_destroy(index);
+    return mismatches == 0 ? 0 : -1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct headless_options options = {
+        .socket_name = NULL,
+        .width = 1920,
+        .height = 1080,
+        .refresh_ns = 16666667ull,
+        .free_run = false,
+        .max_frames = 0,
+        .input_events = 0,
+        .input_batch_ms = INPUT_BATCH_DEFAULT_WINDOW_MS,
+    };
+    const char *output_path = NULL;
+    const char *trace_path = NULL;
+    long hit_test_surfaces = 0;
+    bool scheduler_test = false;
+    bool input_queue_test = false;
+    long latency_frames = 0;
+    long connect_connections = 0;
+    bool log_bench = false;
+    bool convert_bench = false;
+
+    static const struct option long_options[] = {
+        {"socket", required_argument, NULL, 's'},
+        {"width", required_argument, NULL, 'W'},
+        {"height", required_argument, NULL, 'H'},
+        {"refresh", required_argument, NULL, 'r'},
+        {"free-run", no_argument, NULL, 'f'},
+        {"frames", required_argument, NULL, 'n'},
+        {"input", required_argument, NULL, 'i'},
+        {"input-batch", required_argument, NULL, 'b'},
+        {"hit-test-bench", required_argument, NULL, 'x'},
+        {"scheduler-test", no_argument, NULL, 'S'},
+        {"input-queue-test", no_argument, NULL, 'Q'},
+        {"latency-test", required_argument, NULL, 'L'},
+        {"connect-bench", required_argument, NULL, 'C'},
+        {"log-bench", no_argument, NULL, 'l'},
+        {"convert-bench", no_argument, NULL, 'c'},
+        {"output", required_argument, NULL, 'o'},
+        {"trace", required_argument, NULL, 't'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    long value;
+    while ((opt = getopt_long(argc, argv, "s:W:H:r:fn:i:b:x:SQL:C:lco:t:h", long_options, NULL)) !=
+           -1) {
+        switch (opt) {
+        case 's':
+            options.socket_name = optarg;
+            break;
+        case 'W':
+        case 'H':
+            if (!parse_positive(optarg, 16384, &value)) {
+                fprintf(stderr, "Invalid size: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            if (opt == 'W') {
+                options.width = (int32_t)value;
+            } else {
+                options.height = (int32_t)value;
+            }
+            break;
+        case 'r':
+            if (!parse_positive(optarg, 1000, &value)) {
+                fprintf(stderr, "Invalid refresh rate: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            options.refresh_ns = 1000000000ull / (uint64_t)value;
+            break;
+        case 'f':
+            options.free_run = true;
+            break;
+        case 'n':
+            if (!parse_positive(optarg, LONG_MAX, &value)) {
+                fprintf(stderr, "Invalid frame count: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            options.max_frames = (uint64_t)value;
+            break;
+        case 'i':
+            if (!parse_positive(optarg, 1000000, &value)) {
+                fprintf(stderr, "Invalid input event count: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            options.input_events = (uint32_t)value;
+            break;
+        case 'b':
+            // 0 is valid here: it turns batching off
+            if (strcmp(optarg, "0") == 0) {
+                options.input_batch_ms = 0;
+            } else if (parse_positive(optarg, 1000, &value)) {
+                options.input_batch_ms = (uint32_t)value;
+            } else {
+                fprintf(stderr, "Invalid input batching window: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'x':
+            if (!parse_positive(optarg, 100000, &hit_test_surfaces)) {
+                fprintf(stderr, "Invalid surface count: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'S':
+            scheduler_test = true;
+            break;
+        case 'Q':
+            input_queue_test = true;
+            break;
+        case 'L':
+            if (!parse_positive(optarg, 1000000, &latency_frames)) {
+                fprintf(stderr, "Invalid frame count: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'C':
+            if (!parse_positive(optarg, 1000000, &connect_connections)) {
+                fprintf(stderr, "Invalid connection count: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'l':
+            log_bench = true;
+            break;
+        case 'c':
+            convert_bench = true;
+            break;
+        case 'o':
+            output_path = optarg;
+            break;
+        case 't':
+            trace_path = optarg;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return EXIT_SUCCESS;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    init_compositor_logging();
+    if (hit_test_surfaces > 0) {
+        int bench = run_hit_test_bench((int)hit_test_surfaces, options.width, options.height);
+        cleanup_logging();
+        return bench == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (scheduler_test) {
+        int test = headless_scheduler_test();
+        cleanup_logging();
+        return test == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (input_queue_test) {
+        int test = headless_input_queue_test();
+        cleanup_logging();
+        return test == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (latency_frames > 0) {
+        int test = headless_latency_test(&options, (int)latency_frames);
+        cleanup_logging();
+        return test == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (log_bench) {
+        int bench = headless_log_bench();
+        cleanup_logging();
+        return bench == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (convert_bench) {
+        int bench = headless_convert_bench(options.width, options.height);
+        cleanup_logging();
+        return bench == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (connect_connections > 0) {
+        int bench = headless_connect_bench(&options, (int)connect_connections);
+        cleanup_logging();
+        return bench == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    trace_set_enabled(trace_path != NULL || WawonaSettings_GetTraceEnabled());
+    trace_set_thread_name("headless");
+
+    struct headless_backend *backend = headless_backend_create(&options);
+    if (!backend) {
+        cleanup_logging();
+        return EXIT_FAILURE;
+    }
+
+    // First line on stdout, for scripts that start clients against us
+    printf("WAYLAND_DISPLAY=%s\n", headless_backend_get_socket(backend));
+    fflush(stdout);
+
+    uint64_t start_ns = monotonic_now_ns();
+    int result = headless_backend_run(backend);
+    uint64_t elapsed_ns = monotonic_now_ns() - start_ns;
+
+    const struct headless_stats *stats = headless_backend_get_stats(backend);
+    double elapsed_s = (double)elapsed_ns / 1e9;
+    log_printf("[HEADLESS] ",
+               "%llu frames in %.3f s (%.1f fps, %.3f s virtual), %llu surface updates, "
+               "%llu Mpixels, %llu frame events, peak %d clients\n",
+               (unsigned long long)stats->frames, elapsed_s,
+               elapsed_s > 0.0 ? (double)stats->frames / elapsed_s : 0.0,
+               (double)headless_backend_get_virtual_time_ns(backend) / 1e9,
+               (unsigned long long)stats->surface_updates,
+               (unsigned long long)(stats->pixels / 1000000ull),
+               (unsigned long long)stats->frame_events, stats->peak_clients);
+    log_printf("[HEADLESS] ",
+               "Uploads: %llu surface commits, %.1f KiB per commit (%llu KiB total)\n",
+               (unsigned long long)stats->uploads,
+               stats->uploads > 0
+                   ? (double)stats->upload_bytes / (double)stats->uploads / 1024.0
+                   : 0.0,
+               (unsigned long long)(stats->upload_bytes / 1024ull));
+    uint64_t pool_acquires = stats->pool_hits + stats->pool_misses;
+    log_printf("[HEADLESS] ", "Texture pool: %.1f%% hit rate (%llu acquires), %.1f MiB resident\n",
+               pool_acquires > 0 ? 100.0 * (double)stats->pool_hits / (double)pool_acquires : 0.0,
+               (unsigned long long)pool_acquires,
+               (double)stats->pool_resident_bytes / (1024.0 * 1024.0));
+    if (options.input_events > 0) {
+        // Rates are per virtual second: with --free-run the output is not paced
+        double virtual_s = (double)headless_backend_get_virtual_time_ns(backend) / 1e9;
+        log_printf("[HEADLESS] ",
+                   "Input: %llu events to %d seat clients in %llu pointer frames, "
+                   "%llu flushes (%.0f client wakeups/s, %u ms batching)\n",
+                   (unsigned long long)stats->input_events, stats->seat_clients,
+                   (unsigned long long)stats->input_batches,
+                   (unsigned long long)stats->input_flushes,
+                   virtual_s > 0.0 ? (double)stats->input_flushes / virtual_s : 0.0,
+                   options.input_batch_ms);
+    }
+
+    if (output_path && headless_backend_write_ppm(backend, output_path) != 0) {
+        result = -1;
+    }
+    if (trace_path) {
+        int written = trace_export_chrome_json(trace_path);
+        if (written >= 0) {
+            log_printf("[TRACE] ", "Wrote %d trace events to %s\n", written, trace_path);
+        }
+    }
+
+    headless_backend_destroy(backend);
+    cleanup_logging();
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
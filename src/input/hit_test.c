@@ -0,0 +1,288 @@
+#include "hit_test.h"
+#include "WawonaCompositor.h"
+#include "logging.h"
+#include "trace.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct hit_test_entry {
+    struct wl_surface_impl *surface;
+    int32_t x, y;             // Surface origin, output coordinates
+    pixman_box32_t box;       // Input region extents, output coordinates
+    pixman_region32_t input;  // Surface coordinates
+    bool rectangular;         // The input region is box
+};
+
+struct hit_test {
+    struct hit_test_entry *entries;  // Top first
+    int count;
+    int capacity;
+
+    // Grid over the union of the entry boxes
+    int32_t origin_x, origin_y;
+    int32_t cell_size;
+    int columns, rows;
+    int *cell_start;    // columns * rows + 1 offsets into cell_entries
+    int *cell_entries;  // Entry indices of each cell, top first
+    size_t cell_start_capacity;
+    size_t cell_entries_capacity;
+
+    uint32_t generation;
+    bool indexed;  // generation is meaningful
+    struct hit_test_stats stats;
+};
+
+static bool
+hit_test_reserve(int **array, size_t *capacity, size_t needed)
+{
+    if (needed <= *capacity) {
+        return true;
+    }
+    size_t grown = *capacity > 0 ? *capacity : 64;
+    while (grown < needed) {
+        grown *= 2;
+    }
+    int *data = realloc(*array, grown * sizeof(int));
+    if (!data) {
+        return false;
+    }
+    *array = data;
+    *capacity = grown;
+    return true;
+}
+
+static bool
+hit_test_reserve_entries(struct hit_test *index, int needed)
+{
+    if (needed <= index->capacity) {
+        return true;
+    }
+    int capacity = index->capacity > 0 ? index->capacity : 32;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    struct hit_test_entry *entries =
+        realloc(index->entries, (size_t)capacity * sizeof(struct hit_test_entry));
+    if (!entries) {
+        return false;
+    }
+    for (int i = index->capacity; i < capacity; i++) {
+        pixman_region32_init(&entries[i].input);
+    }
+    index->entries = entries;
+    index->capacity = capacity;
+    return true;
+}
+
+// Copy the surfaces accepting input, top first
+static bool
+hit_test_copy_entries(struct hit_test *index, const struct wl_surface_draw_list *list)
+{
+    index->count = 0;
+    if (!hit_test_reserve_entries(index, list->count)) {
+        return false;
+    }
+    for (int i = list->count - 1; i >= 0; i--) {
+        const struct wl_surface_draw_entry *draw = &list->entries[i];
+        if (!pixman_region32_not_empty(&draw->input)) {
+            continue;
+        }
+        struct hit_test_entry *entry = &index->entries[index->count++];
+        entry->surface = draw->surface;
+        entry->x = draw->x;
+        entry->y = draw->y;
+        pixman_region32_copy(&entry->input, &draw->input);
+        const pixman_box32_t *extents = pixman_region32_extents(&entry->input);
+        entry->box.x1 = draw->x + extents->x1;
+        entry->box.y1 = draw->y + extents->y1;
+        entry->box.x2 = draw->x + extents->x2;
+        entry->box.y2 = draw->y + extents->y2;
+        entry->rectangular = pixman_region32_n_rects(&entry->input) == 1;
+    }
+    return true;
+}
+
+static void
+hit_test_cell_range(const struct hit_test *index, const pixman_box32_t *box, int *c0, int *r0,
+                    int *c1, int *r1)
+{
+    *c0 = (box->x1 - index->origin_x) / index->cell_size;
+    *r0 = (box->y1 - index->origin_y) / index->cell_size;
+    *c1 = (box->x2 - 1 - index->origin_x) / index->cell_size;
+    *r1 = (box->y2 - 1 - index->origin_y) / index->cell_size;
+}
+
+// Size the grid to cover every entry box and bucket the entries
+static bool
+hit_test_build_grid(struct hit_test *index)
+{
+    index->columns = 0;
+    index->rows = 0;
+    if (index->count == 0) {
+        return true;
+    }
+
+    pixman_box32_t bounds = index->entries[0].box;
+    for (int i = 1; i < index->count; i++) {
+        const pixman_box32_t *box = &index->entries[i].box;
+        bounds.x1 = box->x1 < bounds.x1 ? box->x1 : bounds.x1;
+        bounds.y1 = box->y1 < bounds.y1 ? box->y1 : bounds.y1;
+        bounds.x2 = box->x2 > bounds.x2 ? box->x2 : bounds.x2;
+        bounds.y2 = box->y2 > bounds.y2 ? box->y2 : bounds.y2;
+    }
+    int64_t width = (int64_t)bounds.x2 - bounds.x1;
+    int64_t height = (int64_t)bounds.y2 - bounds.y1;
+    int64_t cell_size = HIT_TEST_CELL_SIZE;
+    while (((width + cell_size - 1) / cell_size) * ((height + cell_size - 1) / cell_size) >
+           HIT_TEST_MAX_CELLS) {
+        cell_size *= 2;
+    }
+    index->origin_x = bounds.x1;
+    index->origin_y = bounds.y1;
+    index->cell_size = (int32_t)cell_size;
+    index->columns = (int)((width + cell_size - 1) / cell_size);
+    index->rows = (int)((height + cell_size - 1) / cell_size);
+
+    // Count the entries of each cell, then turn the counts into the end
+    // offsets and fill bottom entry first, moving each end down: the cell
+    // lists come out top first and cell_start ends up at their starts
+    size_t cells = (size_t)index->columns * (size_t)index->rows;
+    if (!hit_test_reserve(&index->cell_start, &index->cell_start_capacity, cells + 1)) {
+        return false;
+    }
+    memset(index->cell_start, 0, (cells + 1) * sizeof(int));
+    for (int i = 0; i < index->count; i++) {
+        int c0, r0, c1, r1;
+        hit_test_cell_range(index, &index->entries[i].box, &c0, &r0, &c1, &r1);
+        for (int row = r0; row <= r1; row++) {
+            for (int column = c0; column <= c1; column++) {
+                index->cell_start[row * index->columns + column]++;
+            }
+        }
+    }
+    int total = 0;
+    for (size_t cell = 0; cell < cells; cell++) {
+        total += index->cell_start[cell];
+        index->cell_start[cell] = total;
+    }
+    index->cell_start[cells] = total;
+    if (!hit_test_reserve(&index->cell_entries, &index->cell_entries_capacity, (size_t)total)) {
+        return false;
+    }
+    for (int i = index->count - 1; i >= 0; i--) {
+        int c0, r0, c1, r1;
+        hit_test_cell_range(index, &index->entries[i].box, &c0, &r0, &c1, &r1);
+        for (int row = r0; row <= r1; row++) {
+            for (int column = c0; column <= c1; column++) {
+                index->cell_entries[--index->cell_start[row * index->columns + column]] = i;
+            }
+        }
+    }
+    return true;
+}
+
+struct hit_test *
+hit_test_create(void)
+{
+    return calloc(1, sizeof(struct hit_test));
+}
+
+void
+hit_test_destroy(struct hit_test *index)
+{
+    if (!index) {
+        return;
+    }
+    for (int i = 0; i < index->capacity; i++) {
+        pixman_region32_fini(&index->entries[i].input);
+    }
+    free(index->entries);
+    free(index->cell_start);
+    free(index->cell_entries);
+    free(index);
+}
+
+void
+hit_test_update(struct hit_test *index, const struct wl_surface_draw_list *list)
+{
+    if (index->indexed && index->generation == list->generation) {
+        return;
+    }
+    TRACE_SCOPE("hit_test_rebuild");
+    index->generation = list->generation;
+    index->indexed = true;
+    index->stats.rebuilds++;
+    if (!hit_test_copy_entries(index, list) || !hit_test_build_grid(index)) {
+        // Nothing is hit until the next rebuild
+        log_error("[INPUT] ", "Failed to index %d surfaces for hit-testing\n", list->count);
+        index->count = 0;
+        index->columns = 0;
+        index->rows = 0;
+    }
+    TRACE_COUNTER("hit_test_entries", index->count);
+}
+
+bool
+hit_test_pick(struct hit_test *index, double x, double y, struct hit_test_result *result)
+{
+    index->stats.queries++;
+    if (index->columns == 0) {
+        return false;
+    }
+    double fx = floor(x - index->origin_x);
+    double fy = floor(y - index->origin_y);
+    if (fx < 0.0 || fy < 0.0 || fx >= (double)index->columns * index->cell_size ||
+        fy >= (double)index->rows * index->cell_size) {
+        return false;
+    }
+    int32_t px = index->origin_x + (int32_t)fx;
+    int32_t py = index->origin_y + (int32_t)fy;
+    int cell = ((int)fy / index->cell_size) * index->columns + (int)fx / index->cell_size;
+
+    for (int i = index->cell_start[cell]; i < index->cell_start[cell + 1]; i++) {
+        const struct hit_test_entry *entry = &index->entries[index->cell_entries[i]];
+        index->stats.candidates++;
+        if (px < entry->box.x1 || px >= entry->box.x2 || py < entry->box.y1 ||
+            py >= entry->box.y2) {
+            continue;
+        }
+        if (!entry->rectangular &&
+            !pixman_region32_contains_point(&entry->input, px - entry->x, py - entry->y, NULL)) {
+            continue;
+        }
+        result->surface = entry->surface;
+        result->x = x - entry->x;
+        result->y = y - entry->y;
+        return true;
+    }
+    return false;
+}
+
+bool
+hit_test_pick_list(const struct wl_surface_draw_list *list, double x, double y,
+                   struct hit_test_result *result)
+{
+    double fx = floor(x);
+    double fy = floor(y);
+    if (fx < INT32_MIN || fx > INT32_MAX || fy < INT32_MIN || fy > INT32_MAX) {
+        return false;
+    }
+    for (int i = list->count - 1; i >= 0; i--) {
+        const struct wl_surface_draw_entry *entry = &list->entries[i];
+        if (pixman_region32_contains_point(&entry->input, (int32_t)fx - entry->x,
+                                           (int32_t)fy - entry->y, NULL)) {
+            result->surface = entry->surface;
+            result->x = x - entry->x;
+            result->y = y - entry->y;
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+hit_test_get_stats(const struct hit_test *index, struct hit_test_stats *stats)
+{
+    *stats = index->stats;
+}
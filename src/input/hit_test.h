@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct wl_surface_draw_list;
+struct wl_surface_impl;
+
+// Hit-test index
+// Pointer and touch input goes to the topmost surface whose input region
+// contains the point. Instead of scanning every surface per event, the
+// index buckets the draw list into a uniform grid over the area the
+// surfaces cover: each cell lists, top first, the surfaces whose input
+// region overlaps it, so a query only tests the few surfaces stacked under
+// one cell. Input regions are copied from the draw list (clipped to the
+// surface); a single rectangle is tested against its bounds alone.
+//
+// The grid is rebuilt from the draw list only when the draw list generation
+// changed, that is after a commit changed the geometry or input region of a
+// surface, or the stacking; storage is reused across rebuilds.
+//
+// Not thread-safe: update and query from one thread, with
+// wl_compositor_lock_surfaces() held. The surface returned is only valid
+// while the lock is held.
+
+#define HIT_TEST_CELL_SIZE 64    // Pixels; doubled while the grid exceeds...
+#define HIT_TEST_MAX_CELLS 4096  // ... this many cells
+
+struct hit_test_result {
+    struct wl_surface_impl *surface;
+    double x, y;  // Surface coordinates of the point
+};
+
+struct hit_test_stats {
+    uint64_t queries;
+    uint64_t candidates;  // Surfaces tested by queries
+    uint64_t rebuilds;
+};
+
+struct hit_test;
+
+struct hit_test *hit_test_create(void);
+void hit_test_destroy(struct hit_test *index);
+
+// Rebuild from list if its generation differs from the last one indexed
+void hit_test_update(struct hit_test *index, const struct wl_surface_draw_list *list);
+
+// Topmost surface accepting input at (x, y), output coordinates. Returns
+// false if there is none.
+bool hit_test_pick(struct hit_test *index, double x, double y, struct hit_test_result *result);
+
+// The same answer by scanning list top to bottom, without an index
+bool hit_test_pick_list(const struct wl_surface_draw_list *list, double x, double y,
+                        struct hit_test_result *result);
+
+void hit_test_get_stats(const struct hit_test *index, struct hit_test_stats *stats);
@@ -0,0 +1,233 @@
+#include "input_batch.h"
+#include "trace.h"
+#include "wayland_seat.h"
+#include <stdlib.h>
+#include <wayland-server-protocol.h>
+
+#define INPUT_BATCH_AXES 2  // wl_pointer.axis: vertical and horizontal scroll
+
+struct input_batch {
+    struct wl_seat_impl *seat;
+    struct wl_display *display;
+    struct input_batch_callbacks callbacks;
+    uint32_t window_ms;
+
+    // Open batch
+    bool open;
+    uint32_t open_time;  // Timestamp of its first event
+    bool has_motion;
+    uint32_t motion_time;
+    double motion_x, motion_y;
+    bool has_axis[INPUT_BATCH_AXES];
+    uint32_t axis_time[INPUT_BATCH_AXES];
+    double axis_value[INPUT_BATCH_AXES];
+
+    struct input_batch_stats stats;
+};
+
+// Send the coalesced events of the open batch without ending it
+static void
+batch_send_events(struct input_batch *batch)
+{
+    if (batch->has_motion) {
+        wl_seat_send_pointer_motion(batch->seat, batch->motion_time, batch->motion_x,
+                                    batch->motion_y);
+        batch->has_motion = false;
+    }
+    for (uint32_t axis = 0; axis < INPUT_BATCH_AXES; axis++) {
+        if (batch->has_axis[axis]) {
+            wl_seat_send_pointer_axis(batch->seat, batch->axis_time[axis], axis,
+                                      batch->axis_value[axis]);
+            batch->has_axis[axis] = false;
+            batch->axis_value[axis] = 0.0;
+        }
+    }
+}
+
+// End the group of pointer events sent since the last frame
+static void
+batch_send_frame(struct input_batch *batch)
+{
+    wl_seat_send_pointer_frame(batch->seat);
+    batch->open = false;
+    batch->stats.batches++;
+}
+
+static void
+batch_flush_clients(struct input_batch *batch)
+{
+    wl_display_flush_clients(batch->display);
+    batch->stats.flushes++;
+}
+
+// Send the open batch, if any, as one frame group. Returns true if it was open.
+static bool
+batch_close(struct input_batch *batch)
+{
+    if (!batch->open) {
+        return false;
+    }
+    batch_send_events(batch);
+    batch_send_frame(batch);
+    return true;
+}
+
+// Open a batch for a coalesced event. Returns true if a new batch was opened.
+static bool
+batch_open(struct input_batch *batch, uint32_t time)
+{
+    batch->stats.events++;
+    if (batch->open) {
+        return false;
+    }
+    batch->open = true;
+    batch->open_time = time;
+    return true;
+}
+
+// After a coalesced event: send the batch if its window has run out
+static void
+batch_check_window(struct input_batch *batch, uint32_t time)
+{
+    if (batch->window_ms == 0 || time - batch->open_time >= batch->window_ms) {
+        batch_close(batch);
+        batch_flush_clients(batch);
+    }
+}
+
+static void
+batch_schedule(struct input_batch *batch, bool opened)
+{
+    if (opened && batch->callbacks.schedule) {
+        batch->callbacks.schedule(batch->callbacks.data);
+    }
+}
+
+struct input_batch *
+input_batch_create(struct wl_seat_impl *seat, struct wl_display *display, uint32_t window_ms)
+{
+    struct input_batch *batch = calloc(1, sizeof(struct input_batch));
+    if (!batch) {
+        return NULL;
+    }
+    batch->seat = seat;
+    batch->display = display;
+    batch->window_ms = window_ms;
+    return batch;
+}
+
+void
+input_batch_destroy(struct input_batch *batch)
+{
+    if (!batch) {
+        return;
+    }
+    free(batch);
+}
+
+void
+input_batch_set_callbacks(struct input_batch *batch, const struct input_batch_callbacks *callbacks)
+{
+    if (callbacks) {
+        batch->callbacks = *callbacks;
+    } else {
+        batch->callbacks = (struct input_batch_callbacks){0};
+    }
+}
+
+void
+input_batch_set_window(struct input_batch *batch, uint32_t window_ms)
+{
+    batch->window_ms = window_ms;
+}
+
+void
+input_batch_pointer_motion(struct input_batch *batch, uint32_t time, double x, double y)
+{
+    bool opened = batch_open(batch, time);
+    batch->has_motion = true;
+    batch->motion_time = time;
+    batch->motion_x = x;
+    batch->motion_y = y;
+    batch_check_window(batch, time);
+    batch_schedule(batch, opened);
+}
+
+void
+input_batch_pointer_axis(struct input_batch *batch, uint32_t time, uint32_t axis, double value)
+{
+    if (axis >= INPUT_BATCH_AXES) {
+        return;
+    }
+    bool opened = batch_open(batch, time);
+    batch->has_axis[axis] = true;
+    batch->axis_time[axis] = time;
+    batch->axis_value[axis] += value;
+    batch_check_window(batch, time);
+    batch_schedule(batch, opened);
+}
+
+void
+input_batch_pointer_enter(struct input_batch *batch, struct wl_resource *surface, uint32_t serial,
+                          double x, double y)
+{
+    batch->stats.events++;
+    batch_close(batch);
+    wl_seat_send_pointer_enter(batch->seat, surface, serial, x, y);
+    batch_send_frame(batch);
+    batch_flush_clients(batch);
+}
+
+void
+input_batch_pointer_leave(struct input_batch *batch, struct wl_resource *surface, uint32_t serial)
+{
+    batch->stats.events++;
+    // Coalesced motion belongs to the surface being left. The leave comes
+    // with its own frame: the client has no pointer focus after it.
+    batch_close(batch);
+    wl_seat_send_pointer_leave(batch->seat, surface, serial);
+    batch->stats.batches++;
+    batch_flush_clients(batch);
+}
+
+void
+input_batch_pointer_button(struct input_batch *batch, uint32_t serial, uint32_t time,
+                           uint32_t button, uint32_t state)
+{
+    batch->stats.events++;
+    // Motion up to the button press shares its frame
+    batch_send_events(batch);
+    wl_seat_send_pointer_button(batch->seat, serial, time, button, state);
+    batch_send_frame(batch);
+    batch_flush_clients(batch);
+}
+
+void
+input_batch_keyboard_key(struct input_batch *batch, uint32_t serial, uint32_t time, uint32_t key,
+                         uint32_t state)
+{
+    batch->stats.events++;
+    batch_close(batch);
+    wl_seat_send_keyboard_key(batch->seat, serial, time, key, state);
+    batch_flush_clients(batch);
+}
+
+bool
+input_batch_flush(struct input_batch *batch)
+{
+    if (!batch) {
+        return false;
+    }
+    TRACE_SCOPE("input_flush");
+    bool sent = batch_close(batch);
+    if (sent) {
+        batch_flush_clients(batch);
+    }
+    return sent;
+}
+
+void
+input_batch_get_stats(struct input_batch *batch, struct input_batch_stats *stats)
+{
+    *stats = batch->stats;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-server.h>
+
+struct wl_seat_impl;
+
+// Input batching
+// Sits between the platform input handlers and wayland_seat.c. Pointer
+// motion and axis events are coalesced into a batch: motion keeps the latest
+// position and axis values add up. A batch goes out as one wl_pointer.frame
+// group followed by a single flush of the client sockets when
+//  - an event arrives window_ms or more after the batch was opened,
+//  - the next frame is due (input_batch_flush from the repaint hook), or
+//  - an event that must keep its order arrives (enter, leave, button, key).
+//    The batch is sent first, so ordering across events is exact; a button
+//    ends the batch it is sent with.
+// A window of 0 turns batching off: every event is sent and flushed at once.
+//
+// Event thread only, like wayland_seat.c: platform threads go through
+// input_queue.h.
+
+#define INPUT_BATCH_DEFAULT_WINDOW_MS 8
+
+struct input_batch_stats {
+    uint64_t events;   // Events received from the platform
+    uint64_t batches;  // wl_pointer.frame groups sent
+    uint64_t flushes;  // Client socket flushes, each one wakes the focused client
+};
+
+// Platform hook, optional: asks for input_batch_flush at the next frame
+// deadline. Called when a batch opens.
+struct input_batch_callbacks {
+    void (*schedule)(void *data);
+    void *data;
+};
+
+struct input_batch;
+
+struct input_batch *input_batch_create(struct wl_seat_impl *seat, struct wl_display *display,
+                                       uint32_t window_ms);
+void input_batch_destroy(struct input_batch *batch);
+
+void input_batch_set_callbacks(struct input_batch *batch,
+                               const struct input_batch_callbacks *callbacks);
+void input_batch_set_window(struct input_batch *batch, uint32_t window_ms);
+
+// Coalesced (times are the event timestamps in milliseconds)
+void input_batch_pointer_motion(struct input_batch *batch, uint32_t time, double x, double y);
+void input_batch_pointer_axis(struct input_batch *batch, uint32_t time, uint32_t axis,
+                              double value);
+
+// Ordered: the open batch is sent first, then the event, then one flush
+void input_batch_pointer_enter(struct input_batch *batch, struct wl_resource *surface,
+                               uint32_t serial, double x, double y);
+void input_batch_pointer_leave(struct input_batch *batch, struct wl_resource *surface,
+                               uint32_t serial);
+void input_batch_pointer_button(struct input_batch *batch, uint32_t serial, uint32_t time,
+                                uint32_t button, uint32_t state);
+void input_batch_keyboard_key(struct input_batch *batch, uint32_t serial, uint32_t time,
+                              uint32_t key, uint32_t state);
+
+// Send the open batch, if any. Returns true if something was sent.
+bool input_batch_flush(struct input_batch *batch);
+
+void input_batch_get_stats(struct input_batch *batch, struct input_batch_stats *stats);
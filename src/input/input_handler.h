@@ -7,10 +7,22 @@
 #endif
 #include "wayland_seat.h"
 
+struct input_queue;
+
+// The surface under a point as input needs it, copied with the surface
+// registry locked: the surface may be freed as soon as the lock is dropped
+struct input_surface_hit {
+    uint64_t surface_id;            // Registry id (wl_surface_impl::id)
+    double x, y;                    // The point in surface coordinates
+    int32_t width, height;          // Surface size
+    int32_t surface_x, surface_y;   // Surface position
+};
+
 // Input Handler - Converts NSEvent/UIEvent to Wayland events
 @interface InputHandler : NSObject
 
 @property (nonatomic, assign) struct wl_seat_impl *seat;
+@property (nonatomic, assign) struct input_queue *inputQueue; // Events are pushed here for the event thread (see input_queue.h)
 #if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
 @property (nonatomic, assign) UIWindow *window;
 @property (nonatomic, weak) UIView *targetView; // Optional: View to convert coordinates relative to (e.g. safe area view)
@@ -27,8 +39,10 @@
 - (void)handleMouseEvent:(NSEvent *)event;
 - (void)handleKeyboardEvent:(NSEvent *)event;
 - (void)setupInputHandling;
-- (struct wl_surface_impl *)pickSurfaceAt:(CGPoint)location;
 #endif
 
+// Topmost surface accepting input at location (output pixels); NO if none
+- (BOOL)hitSurfaceAt:(CGPoint)location hit:(struct input_surface_hit *)hit;
+
 @end
 
@@ -1,5 +1,7 @@
 #import "input_handler.h"
 #import "wayland_seat.h"
+#import "input_queue.h"
+#import "hit_test.h"
 #import "WawonaCompositor.h" // For wl_get_all_surfaces and wl_surface_impl
 #include <wayland-server-protocol.h>
 #include <wayland-server.h>
@@ -152,7 +154,12 @@ static uint32_t macButtonToWaylandButton(NSEventType eventType, NSEvent *event)
 }
 #endif
 
-@implementation InputHandler
+@implementation InputHandler {
+    // Modifier state as last queued (the seat's copy belongs to the event thread)
+    uint32_t _modsDepressed;
+    uint32_t _modsLocked;
+    struct hit_test *_hitTest;  // Main thread, over the compositor draw list
+}
 
 #if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
 - (instancetype)initWithSeat:(struct wl_seat_impl *)seat window:(UIWindow *)window compositor:(id)compositor {
@@ -168,12 +175,47 @@ static uint32_t macButtonToWaylandButton(NSEventType eventType, NSEvent *event)
     return self;
 }
 
+- (void)dealloc {
+    hit_test_destroy(_hitTest);
+}
+
 static uint32_t getWaylandTime(void) {
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
     return (uint32_t)((ts.tv_sec * 1000) + (ts.tv_nsec / 1000000));
 }
 
+// Topmost surface whose input region contains location (output pixels).
+// The index follows the draw list, so it is only rebuilt after a commit
+// changed the surfaces. What callers need of the surface is copied before
+// the registry is unlocked; they never see the surface itself.
+- (BOOL)hitSurfaceAt:(CGPoint)location hit:(struct input_surface_hit *)hit {
+    if (!_hitTest) {
+        _hitTest = hit_test_create();
+        if (!_hitTest) {
+            return NO;
+        }
+    }
+    
+    struct hit_test_result result;
+    wl_compositor_lock_surfaces();
+    struct wl_surface_draw_list list;
+    wl_compositor_get_draw_list(&list);
+    hit_test_update(_hitTest, &list);
+    BOOL found = hit_test_pick(_hitTest, location.x, location.y, &result) && result.surface->resource;
+    if (found) {
+        hit->surface_id = result.surface->id;
+        hit->x = result.x;
+        hit->y = result.y;
+        hit->width = result.surface->width;
+        hit->height = result.surface->height;
+        hit->surface_x = result.surface->x;
+        hit->surface_y = result.surface->y;
+    }
+    wl_compositor_unlock_surfaces();
+    return found;
+}
+
 - (void)setupInputHandling {
 #if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
     if (_seat) {
@@ -234,36 +276,8 @@ static uint32_t getWaylandTime(void) {
     }
 }
 
-- (struct wl_surface_impl *)pickSurfaceAt:(CGPoint)location {
-    // Simple hit testing: return the first surface that contains the point
-    // For fullscreen shell, this usually returns the main surface
-    // TODO: Handle z-order and subsurfaces correctly
-    
-    struct wl_surface_impl *surface = wl_get_all_surfaces();
-    while (surface) {
-        // In fullscreen mode, the surface covers the screen, so we just check if it has a resource
-        // Also check if the location is within the surface bounds
-        if (surface->resource) {
-            // For now, if there's any surface with a resource, return it
-            // TODO: Proper hit testing based on surface->x, surface->y, surface->width, surface->height
-            return surface;
-        }
-        surface = surface->next;
-    }
-    return NULL;
-}
-
 - (void)sendTouchDown:(CGPoint)location touch:(UITouch *)touch {
-    if (_seat) {
-        struct wl_seat_impl *seat_impl = _seat;
-        struct wl_surface_impl *surface = [self pickSurfaceAt:location];
-        
-        if (!surface || !surface->resource) {
-            // No surface found - can't send event
-            NSLog(@"⚠️ No surface found at touch location (%.1f, %.1f)", location.x, location.y);
-            return;
-        }
-        
+    if (_inputQueue) {
         // Convert view points to surface-local coordinates (pixels)
         // Location is already relative to targetView (CompositorView's metalView)
         // We need to convert from points to pixels using the screen scale
@@ -279,39 +293,40 @@ static uint32_t getWaylandTime(void) {
         
         // Location is in points relative to targetView
         // Convert to pixels for Wayland (which uses pixel coordinates)
-        wl_fixed_t x = wl_fixed_from_double(location.x * scale);
-        wl_fixed_t y = wl_fixed_from_double(location.y * scale);
+        double x = location.x * scale;
+        double y = location.y * scale;
+        
+        struct input_surface_hit hit;
+        if (![self hitSurfaceAt:CGPointMake(x, y) hit:&hit]) {
+            // No surface found - can't send event
+            NSLog(@"⚠️ No surface found at touch location (%.1f, %.1f)", location.x, location.y);
+            return;
+        }
+        x = hit.x;
+        y = hit.y;
         
         NSLog(@"📱 Touch down: view coords (%.1f, %.1f) points, scale %.0fx = Wayland (%.1f, %.1f) pixels",
-              location.x, location.y, scale, wl_fixed_to_double(x), wl_fixed_to_double(y));
+              location.x, location.y, scale, x, y);
         
-        wl_seat_send_touch_down(seat_impl, 
-                               wl_seat_get_serial(seat_impl),
-                               getWaylandTime(), // timestamp
-                               surface->resource, // Valid surface!
-                               (int32_t)(intptr_t)touch, 
-                               x, y);
-        wl_seat_send_touch_frame(seat_impl); // REQUIRED: Group events
+        input_queue_touch_down(_inputQueue, hit.surface_id, getWaylandTime(), (int32_t)(intptr_t)touch, x, y);
+        input_queue_touch_frame(_inputQueue); // REQUIRED: Group events
         
         // Also send pointer events for desktop apps compatibility (emulate mouse click)
-        wl_seat_send_pointer_enter(seat_impl, surface->resource, wl_seat_get_serial(seat_impl), x, y);
-        wl_seat_send_pointer_frame(seat_impl);
+        input_queue_pointer_enter(_inputQueue, hit.surface_id, x, y);
         
         // Send explicit motion to ensure client updates cursor position before click
-        wl_seat_send_pointer_motion(seat_impl, getWaylandTime(), x, y);
-        wl_seat_send_pointer_frame(seat_impl);
-        
-        wl_seat_send_pointer_button(seat_impl, wl_seat_get_serial(seat_impl), getWaylandTime(), 272, 1); // BTN_LEFT down
-        wl_seat_send_pointer_frame(seat_impl);
+        // (it shares the frame of the button)
+        input_queue_pointer_motion(_inputQueue, getWaylandTime(), x, y);
+        input_queue_pointer_button(_inputQueue, getWaylandTime(), 272, 1); // BTN_LEFT down
         
-        NSLog(@"📱 Touch down at (%.1f, %.1f) on surface %p", location.x, location.y, (void *)surface);
+        NSLog(@"📱 Touch down at (%.1f, %.1f) on surface %llu", location.x, location.y,
+              (unsigned long long)hit.surface_id);
     }
 }
 
 - (void)sendTouchMotion:(CGPoint)location touch:(UITouch *)touch {
-    if (_seat) {
-        struct wl_seat_impl *seat_impl = _seat;
-        
+    if (_inputQueue) {
+
         // Convert to pixels (location is already relative to targetView)
         UIView *targetView = self.targetView ? self.targetView : _window;
 #if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
@@ -322,18 +337,14 @@ static uint32_t getWaylandTime(void) {
 #else
         CGFloat scale = _window.backingScaleFactor;
 #endif
-        wl_fixed_t x = wl_fixed_from_double(location.x * scale);
-        wl_fixed_t y = wl_fixed_from_double(location.y * scale);
+        double x = location.x * scale;
+        double y = location.y * scale;
         
-        wl_seat_send_touch_motion(seat_impl,
-                                getWaylandTime(), // timestamp
-                                (int32_t)(intptr_t)touch,
-                                x, y);
-        wl_seat_send_touch_frame(seat_impl); // REQUIRED
+        input_queue_touch_motion(_inputQueue, getWaylandTime(), (int32_t)(intptr_t)touch, x, y);
+        input_queue_touch_frame(_inputQueue); // REQUIRED
         
-        // Send pointer motion
-        wl_seat_send_pointer_motion(seat_impl, getWaylandTime(), x, y);
-        wl_seat_send_pointer_frame(seat_impl);
+        // Send pointer motion (coalesced by the input batch)
+        input_queue_pointer_motion(_inputQueue, getWaylandTime(), x, y);
         
         // Reduce log spam for motion
         // NSLog(@"📱 Touch motion at (%.1f, %.1f)", location.x, location.y);
@@ -341,27 +352,21 @@ static uint32_t getWaylandTime(void) {
 }
 
 - (void)sendTouchUp:(CGPoint)location touch:(UITouch *)touch {
-    if (_seat) {
-        struct wl_seat_impl *seat_impl = _seat;
-        wl_seat_send_touch_up(seat_impl,
-                             wl_seat_get_serial(seat_impl),
-                             getWaylandTime(), // timestamp
-                             (int32_t)(intptr_t)touch);
-        wl_seat_send_touch_frame(seat_impl); // REQUIRED
+    if (_inputQueue) {
+        input_queue_touch_up(_inputQueue, getWaylandTime(), (int32_t)(intptr_t)touch);
+        input_queue_touch_frame(_inputQueue); // REQUIRED
                              
         // Send pointer button up
-        wl_seat_send_pointer_button(seat_impl, wl_seat_get_serial(seat_impl), getWaylandTime(), 272, 0); // BTN_LEFT up
-        wl_seat_send_pointer_frame(seat_impl);
+        input_queue_pointer_button(_inputQueue, getWaylandTime(), 272, 0); // BTN_LEFT up
         
         NSLog(@"📱 Touch up at (%.1f, %.1f)", location.x, location.y);
     }
 }
 
 - (void)sendTouchCancel:(UITouch *)touch {
-    if (_seat) {
-        struct wl_seat_impl *seat_impl = _seat;
-        wl_seat_send_touch_cancel(seat_impl);
-        wl_seat_send_touch_frame(seat_impl); // REQUIRED
+    if (_inputQueue) {
+        input_queue_touch_cancel(_inputQueue);
+        input_queue_touch_frame(_inputQueue); // REQUIRED
         NSLog(@"📱 Touch cancelled");
     }
 }
@@ -396,28 +401,13 @@ static uint32_t getWaylandTime(void) {
     NSLog(@"[INPUT] handleMouseEvent called: type=%lu, locationInWindow=(%.1f, %.1f)", 
           (unsigned long)[event type], [event locationInWindow].x, [event locationInWindow].y);
     
-    if (!_seat) {
+    // The seat belongs to the event thread: events are queued for it and
+    // dropped there if no client has the focus
+    if (!_inputQueue) {
         NSLog(@"[INPUT] ⚠️ No seat available for mouse event");
         return;
     }
     
-    if (!_seat->pointer_resource) {
-        // Log warning but don't return - the send functions will safely handle NULL pointer_resource
-        // This allows us to see if events are being generated even if pointer isn't requested yet
-        static BOOL logged_warning = NO;
-        if (!logged_warning) {
-            NSLog(@"[INPUT] ⚠️ No pointer resource available (client hasn't requested pointer yet)");
-            NSLog(@"[INPUT]   Seat capabilities: 0x%x (KEYBOARD=0x%x, POINTER=0x%x, TOUCH=0x%x)", 
-                  _seat->capabilities, 
-                  WL_SEAT_CAPABILITY_KEYBOARD,
-                  WL_SEAT_CAPABILITY_POINTER,
-                  WL_SEAT_CAPABILITY_TOUCH);
-            NSLog(@"[INPUT]   Mouse events will be sent but may be ignored until client requests pointer");
-            logged_warning = YES;
-        }
-        // Continue - the send functions check for pointer_resource internally
-    }
-    
     NSPoint locationInWindow = [event locationInWindow];
     NSPoint locationInView = [_window.contentView convertPoint:locationInWindow fromView:nil];
     
@@ -432,93 +422,67 @@ static uint32_t getWaylandTime(void) {
     uint32_t time = (uint32_t)((ts.tv_sec * 1000) + (ts.tv_nsec / 1000000));
     
     // Find the surface under the cursor
-    struct wl_surface_impl *surface = [self pickSurfaceAt:locationInView];
-    
-    if (!surface || !surface->resource) {
+    struct input_surface_hit hit;
+    if (![self hitSurfaceAt:CGPointMake(window_x, window_y) hit:&hit]) {
         NSLog(@"[INPUT] ⚠️ No surface found at (%.1f, %.1f) - cannot send mouse events", locationInView.x, locationInView.y);
         return;
     }
     
-    NSLog(@"[INPUT] Found surface %p at window (%.1f, %.1f), surface pos=(%d, %d), size=(%d, %d)", 
-          (void *)surface, locationInView.x, locationInView.y, surface->x, surface->y, surface->width, surface->height);
+    NSLog(@"[INPUT] Found surface %llu at window (%.1f, %.1f), surface pos=(%d, %d), size=(%d, %d)", 
+          (unsigned long long)hit.surface_id, locationInView.x, locationInView.y, hit.surface_x, hit.surface_y,
+          hit.width, hit.height);
     
-    // CRITICAL: Convert window coordinates to surface-local coordinates
-    // Wayland protocol requires motion/enter events to use surface-local coordinates
-    // Surface position is in pixels, so we subtract surface position from window position
-    double surface_x = window_x - surface->x;
-    double surface_y = window_y - surface->y;
+    // Wayland protocol requires motion/enter events to use surface-local
+    // coordinates: the hit test gives them, subsurface offsets included
+    double surface_x = hit.x;
+    double surface_y = hit.y;
     
     // Ensure coordinates are non-negative (clamp to surface bounds)
     if (surface_x < 0) surface_x = 0;
     if (surface_y < 0) surface_y = 0;
-    if (surface->width > 0 && surface_x > surface->width) surface_x = surface->width;
-    if (surface->height > 0 && surface_y > surface->height) surface_y = surface->height;
+    if (hit.width > 0 && surface_x > hit.width) surface_x = hit.width;
+    if (hit.height > 0 && surface_y > hit.height) surface_y = hit.height;
     
     // Handle pointer enter/leave
-    static struct wl_surface_impl *last_pointer_surface = NULL;
+    // Surfaces are remembered by registry id: the pointers may be freed
+    static uint64_t last_pointer_surface = 0;
     static BOOL pointer_has_entered = NO;
     
-    // Send initial enter event if pointer hasn't entered any surface yet
-    if (!pointer_has_entered && surface && surface->resource && _seat->pointer_resource) {
-        uint32_t serial = wl_seat_get_serial(_seat);
-        wl_seat_send_pointer_enter(_seat, surface->resource, serial, surface_x, surface_y);
-        wl_seat_send_pointer_frame(_seat);
-        NSLog(@"[INPUT] Pointer entered surface %p at surface-local (%.1f, %.1f) [window: (%.1f, %.1f), surface pos: (%d, %d)]", 
-              (void *)surface, surface_x, surface_y, window_x, window_y, surface->x, surface->y);
-        last_pointer_surface = surface;
+    // Send initial enter event if pointer hasn't entered any surface yet.
+    // Enter and leave go out (and are flushed) right away through the batch.
+    if (!pointer_has_entered) {
+        input_queue_pointer_enter(_inputQueue, hit.surface_id, surface_x, surface_y);
+        NSLog(@"[INPUT] Pointer entered surface %llu at surface-local (%.1f, %.1f) [window: (%.1f, %.1f), surface pos: (%d, %d)]", 
+              (unsigned long long)hit.surface_id, surface_x, surface_y, window_x, window_y, hit.surface_x, hit.surface_y);
+        last_pointer_surface = hit.surface_id;
         pointer_has_entered = YES;
-        
-        // Flush enter event immediately
-        if (_compositor && [_compositor respondsToSelector:@selector(sendFrameCallbacksImmediately)]) {
-            [_compositor sendFrameCallbacksImmediately];
-        }
-    } else if (surface != last_pointer_surface) {
-        // Leave old surface
-        if (last_pointer_surface && last_pointer_surface->resource && _seat->pointer_resource) {
-            uint32_t serial = wl_seat_get_serial(_seat);
-            wl_seat_send_pointer_leave(_seat, last_pointer_surface->resource, serial);
-            wl_seat_send_pointer_frame(_seat);
-            NSLog(@"[INPUT] Pointer left surface %p", (void *)last_pointer_surface);
+    } else if (hit.surface_id != last_pointer_surface) {
+        // Leave old surface (a no-op once it is destroyed)
+        if (last_pointer_surface) {
+            input_queue_pointer_leave(_inputQueue, last_pointer_surface);
+            NSLog(@"[INPUT] Pointer left surface %llu", (unsigned long long)last_pointer_surface);
         }
         // Enter new surface
-        if (surface && surface->resource && _seat->pointer_resource) {
-            uint32_t serial = wl_seat_get_serial(_seat);
-            wl_seat_send_pointer_enter(_seat, surface->resource, serial, surface_x, surface_y);
-            wl_seat_send_pointer_frame(_seat);
-            NSLog(@"[INPUT] Pointer entered surface %p at surface-local (%.1f, %.1f) [window: (%.1f, %.1f)]", 
-                  (void *)surface, surface_x, surface_y, window_x, window_y);
-        }
-        last_pointer_surface = surface;
-        
-        // Flush enter/leave events immediately so clients receive them right away
-        if (_compositor && [_compositor respondsToSelector:@selector(sendFrameCallbacksImmediately)]) {
-            [_compositor sendFrameCallbacksImmediately];
-        }
+        input_queue_pointer_enter(_inputQueue, hit.surface_id, surface_x, surface_y);
+        NSLog(@"[INPUT] Pointer entered surface %llu at surface-local (%.1f, %.1f) [window: (%.1f, %.1f)]", 
+              (unsigned long long)hit.surface_id, surface_x, surface_y, window_x, window_y);
+        last_pointer_surface = hit.surface_id;
     }
     
     // Handle keyboard enter/leave when pointer enters/leaves surface
     // Keyboard focus follows pointer on macOS
-    static struct wl_surface_impl *last_keyboard_surface = NULL;
-    if (surface != last_keyboard_surface) {
+    static uint64_t last_keyboard_surface = 0;
+    if (hit.surface_id != last_keyboard_surface) {
         // Leave old surface
-        if (last_keyboard_surface && last_keyboard_surface->resource && _seat->keyboard_resource) {
-            uint32_t serial = wl_seat_get_serial(_seat);
-            wl_seat_send_keyboard_leave(_seat, last_keyboard_surface->resource, serial);
-            NSLog(@"[INPUT] Keyboard left surface %p", (void *)last_keyboard_surface);
+        if (last_keyboard_surface) {
+            input_queue_keyboard_leave(_inputQueue, last_keyboard_surface);
+            NSLog(@"[INPUT] Keyboard left surface %llu", (unsigned long long)last_keyboard_surface);
         }
         // Enter new surface
-        if (surface && surface->resource && _seat->keyboard_resource) {
-            uint32_t serial = wl_seat_get_serial(_seat);
-            // Create empty keys array for keyboard enter (no pressed keys initially)
-            struct wl_array keys;
-            wl_array_init(&keys);
-            wl_seat_send_keyboard_enter(_seat, surface->resource, serial, &keys);
-            wl_array_release(&keys);
-            // Send current modifiers after enter
-            wl_seat_send_keyboard_modifiers(_seat, serial);
-            NSLog(@"[INPUT] Keyboard entered surface %p", (void *)surface);
-        }
-        last_keyboard_surface = surface;
+        // No pressed keys initially; the current modifiers follow the enter
+        input_queue_keyboard_enter(_inputQueue, hit.surface_id);
+        NSLog(@"[INPUT] Keyboard entered surface %llu", (unsigned long long)hit.surface_id);
+        last_keyboard_surface = hit.surface_id;
     }
     
     switch (eventType) {
@@ -527,70 +491,37 @@ static uint32_t getWaylandTime(void) {
         case NSEventTypeRightMouseDragged:
         case NSEventTypeOtherMouseDragged: {
             // Use surface-local coordinates for motion events
-            NSLog(@"[INPUT] Mouse moved to surface-local (%.1f, %.1f) [window: (%.1f, %.1f)] - pointer_resource=%p", 
-                  surface_x, surface_y, window_x, window_y, (void *)_seat->pointer_resource);
-            wl_seat_send_pointer_motion(_seat, time, surface_x, surface_y);
-            wl_seat_send_pointer_frame(_seat);
-            
-            // Flush mouse events immediately so clients receive them right away
-            if (_compositor && [_compositor respondsToSelector:@selector(sendFrameCallbacksImmediately)]) {
-                [_compositor sendFrameCallbacksImmediately];
-            }
-            
-            [self triggerFrameCallback];
+            NSLog(@"[INPUT] Mouse moved to surface-local (%.1f, %.1f) [window: (%.1f, %.1f)]", 
+                  surface_x, surface_y, window_x, window_y);
+            // Coalesced: sent with the next frame or when the batch window ends
+            input_queue_pointer_motion(_inputQueue, time, surface_x, surface_y);
             break;
         }
         case NSEventTypeLeftMouseDown:
         case NSEventTypeRightMouseDown:
         case NSEventTypeOtherMouseDown: {
-            uint32_t serial = wl_seat_get_serial(_seat);
             uint32_t button = macButtonToWaylandButton(eventType, event);
-            NSLog(@"[INPUT] Mouse button down: button=%u at surface-local (%.1f, %.1f) [window: (%.1f, %.1f)] - pointer_resource=%p", 
-                  button, surface_x, surface_y, window_x, window_y, (void *)_seat->pointer_resource);
-            wl_seat_send_pointer_button(_seat, serial, time, button, WL_POINTER_BUTTON_STATE_PRESSED);
-            wl_seat_send_pointer_frame(_seat);
-            
-            // Flush mouse events immediately so clients receive them right away
-            if (_compositor && [_compositor respondsToSelector:@selector(sendFrameCallbacksImmediately)]) {
-                [_compositor sendFrameCallbacksImmediately];
-            }
-            
+            NSLog(@"[INPUT] Mouse button down: button=%u at surface-local (%.1f, %.1f) [window: (%.1f, %.1f)]", 
+                  button, surface_x, surface_y, window_x, window_y);
+            input_queue_pointer_button(_inputQueue, time, button, WL_POINTER_BUTTON_STATE_PRESSED);
             [self triggerFrameCallback];
             break;
         }
         case NSEventTypeLeftMouseUp:
         case NSEventTypeRightMouseUp:
         case NSEventTypeOtherMouseUp: {
-            uint32_t serial = wl_seat_get_serial(_seat);
             uint32_t button = macButtonToWaylandButton(eventType, event);
             NSLog(@"[INPUT] Mouse button up: button=%u at surface-local (%.1f, %.1f) [window: (%.1f, %.1f)]", 
                   button, surface_x, surface_y, window_x, window_y);
-            wl_seat_send_pointer_button(_seat, serial, time, button, WL_POINTER_BUTTON_STATE_RELEASED);
-            wl_seat_send_pointer_frame(_seat);
-            
-            // Flush mouse events immediately so clients receive them right away
-            if (_compositor && [_compositor respondsToSelector:@selector(sendFrameCallbacksImmediately)]) {
-                [_compositor sendFrameCallbacksImmediately];
-            }
-            
+            input_queue_pointer_button(_inputQueue, time, button, WL_POINTER_BUTTON_STATE_RELEASED);
             [self triggerFrameCallback];
             break;
         }
         case NSEventTypeScrollWheel: {
             double deltaY = [event scrollingDeltaY];
             if (deltaY != 0) {
-                // Send scroll event (axis event)
-                if (wl_resource_get_version(_seat->pointer_resource) >= WL_POINTER_AXIS_SINCE_VERSION) {
-                    wl_pointer_send_axis(_seat->pointer_resource, time, WL_POINTER_AXIS_VERTICAL_SCROLL, wl_fixed_from_double(deltaY * 10));
-                    wl_seat_send_pointer_frame(_seat);
-                }
-                
-                // Flush scroll events immediately so clients receive them right away
-                if (_compositor && [_compositor respondsToSelector:@selector(sendFrameCallbacksImmediately)]) {
-                    [_compositor sendFrameCallbacksImmediately];
-                }
-                
-                [self triggerFrameCallback];
+                // Send scroll event (axis event), coalesced like motion
+                input_queue_pointer_axis(_inputQueue, time, WL_POINTER_AXIS_VERTICAL_SCROLL, deltaY * 10);
             }
             break;
         }
@@ -616,33 +547,25 @@ static uint32_t getWaylandTime(void) {
 - (void)scrollWheel:(NSEvent *)event { [self handleMouseEvent:event]; }
 
 - (void)handleKeyboardEvent:(NSEvent *)event {
-    if (!_seat) {
+    if (!_inputQueue) {
         NSLog(@"[INPUT] ⚠️ No seat available for keyboard event");
         return;
     }
     
-    if (!_seat->keyboard_resource) {
-        NSLog(@"[INPUT] ⚠️ No keyboard resource available (client hasn't requested keyboard)");
-        return;
-    }
-    
     // Ensure keyboard enter has been sent to a surface
     // Keyboard focus follows pointer, but if user types before moving mouse, send enter now
-    static struct wl_surface_impl *last_keyboard_surface_entered = NULL;
+    static uint64_t last_keyboard_surface_entered = 0;
+    wl_compositor_lock_surfaces();
     struct wl_surface_impl *surface = wl_get_all_surfaces();
     while (surface && (!surface->resource)) {
         surface = surface->next;
     }
-    if (surface && surface->resource && surface != last_keyboard_surface_entered) {
-        uint32_t serial = wl_seat_get_serial(_seat);
-        struct wl_array keys;
-        wl_array_init(&keys);
+    if (surface && surface->resource && surface->id != last_keyboard_surface_entered) {
         NSLog(@"[INPUT] Sending keyboard enter to surface %p (first keyboard event)", (void *)surface);
-        wl_seat_send_keyboard_enter(_seat, surface->resource, serial, &keys);
-        wl_array_release(&keys);
-        wl_seat_send_keyboard_modifiers(_seat, serial);
-        last_keyboard_surface_entered = surface;
+        input_queue_keyboard_enter(_inputQueue, surface->id);
+        last_keyboard_surface_entered = surface->id;
     }
+    wl_compositor_unlock_surfaces();
 
     NSEventType eventType = [event type];
     struct timespec ts;
@@ -705,7 +628,7 @@ static uint32_t getWaylandTime(void) {
     }
     
     NSEventModifierFlags modifierFlags = [event modifierFlags];
-    uint32_t old_mods_depressed = _seat->mods_depressed;
+    uint32_t old_mods_depressed = _modsDepressed;
     uint32_t shift_mask = 1 << 0;
     uint32_t lock_mask = 1 << 1;
     uint32_t control_mask = 1 << 2;
@@ -716,21 +639,20 @@ static uint32_t getWaylandTime(void) {
     if (modifierFlags & NSEventModifierFlagShift) new_mods_depressed |= shift_mask;
     if (modifierFlags & NSEventModifierFlagCapsLock) {
         new_mods_depressed |= lock_mask;
-        _seat->mods_locked |= lock_mask;
+        _modsLocked |= lock_mask;
     }
     if (modifierFlags & NSEventModifierFlagControl) new_mods_depressed |= control_mask;
     if (modifierFlags & NSEventModifierFlagOption) new_mods_depressed |= mod1_mask;
     if (modifierFlags & NSEventModifierFlagCommand) new_mods_depressed |= mod4_mask;
     
     if (old_mods_depressed != new_mods_depressed) {
-        _seat->mods_depressed = new_mods_depressed;
+        _modsDepressed = new_mods_depressed;
         // Send modifiers update
-        uint32_t serial = wl_seat_get_serial(_seat);
-        wl_seat_send_keyboard_modifiers(_seat, serial);
+        input_queue_keyboard_modifiers(_inputQueue, _modsDepressed, 0, _modsLocked, 0);
     }
     
     if (!(modifierFlags & NSEventModifierFlagCapsLock)) {
-        _seat->mods_locked &= ~lock_mask;
+        _modsLocked &= ~lock_mask;
     }
 
     if (linuxKeyCode == 0) return;
@@ -742,14 +664,9 @@ static uint32_t getWaylandTime(void) {
         default: return;
     }
     
-    uint32_t serial = wl_seat_get_serial(_seat);
-    NSLog(@"[INPUT] Sending keyboard key: keyCode=%u, state=%u, serial=%u", linuxKeyCode, state, serial);
-    wl_seat_send_keyboard_key(_seat, serial, time, linuxKeyCode, state);
-    
-    // Trigger immediate frame callback so client can redraw in response to keyboard input
-    if (_compositor && [_compositor respondsToSelector:@selector(sendFrameCallbacksImmediately)]) {
-        [_compositor sendFrameCallbacksImmediately];
-    }
+    NSLog(@"[INPUT] Sending keyboard key: keyCode=%u, state=%u", linuxKeyCode, state);
+    // Sent after any pointer events still in the batch, then flushed
+    input_queue_keyboard_key(_inputQueue, time, linuxKeyCode, state);
     
     [self triggerRedraw];
 }
@@ -0,0 +1,697 @@
+#include "input_queue.h"
+#include "WawonaCompositor.h"
+#include "input_batch.h"
+#include "logging.h"
+#include "trace.h"
+#include "wayland_seat.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Bounded MPSC ring (Vyukov). Each slot carries a sequence number: a slot
+// is free for the producer that claims position pos when its sequence is
+// pos, and holds a record for the consumer when it is pos + 1. Producers
+// claim positions with a CAS on head; the single consumer owns tail and
+// publishes it so producers can tell how full the ring is.
+struct input_queue_slot {
+    atomic_size_t sequence;
+    struct input_record record;
+};
+
+struct input_queue {
+    struct input_queue_slot *slots;
+    size_t mask;  // capacity - 1
+    size_t motion_limit;  // Records in the ring past which motion is held back
+    atomic_size_t head;
+    atomic_size_t tail;
+
+    // Pointer motion held back from a filling ring. Producers hold the lock
+    // while they queue it ahead of their own record, so it keeps its place.
+    pthread_mutex_t motion_lock;
+    struct input_record held_motion;
+    atomic_bool motion_held;
+
+    // Records that found the ring full, in order. While the list is not
+    // empty every record goes to it, so a thread's records never overtake
+    // each other. The event thread swaps it with spare to dispatch it.
+    pthread_mutex_t overflow_lock;
+    struct input_record *overflow;
+    size_t overflow_count;
+    size_t overflow_capacity;
+    atomic_bool overflowing;
+    struct input_record *spare;  // Event thread
+    size_t spare_capacity;
+
+    struct input_queue_callbacks callbacks;
+
+    struct wl_seat_impl *seat;
+    struct input_batch *batch;
+
+    // Wakeup pipe. wake_pending is set by the producer that writes the byte
+    // and cleared by the consumer before it drains, so a drain never misses
+    // a record and the pipe holds at most one byte per drain.
+    int wake_fds[2];
+    struct wl_event_source *wake_source;
+    atomic_bool wake_pending;
+
+    atomic_uint_fast64_t pushed;
+    atomic_uint_fast64_t coalesced;
+    atomic_uint_fast64_t overflowed;
+    atomic_uint_fast64_t dropped;
+    uint64_t drained;
+    uint64_t wakeups;
+};
+
+// --- Producer side (any thread) ---
+
+static void
+queue_wake(struct input_queue *queue)
+{
+    if (atomic_exchange_explicit(&queue->wake_pending, true, memory_order_acq_rel)) {
+        return;
+    }
+    uint8_t byte = 1;
+    ssize_t written;
+    do {
+        written = write(queue->wake_fds[1], &byte, 1);
+    } while (written < 0 && errno == EINTR);
+}
+
+// Claim a slot and publish record, or return false if the ring is full
+static bool
+queue_try_push(struct input_queue *queue, const struct input_record *record)
+{
+    size_t pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    struct input_queue_slot *slot;
+    for (;;) {
+        slot = &queue->slots[pos & queue->mask];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;  // The consumer has not freed this slot yet: full
+        } else {
+            pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+
+    slot->record = *record;
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    atomic_fetch_add_explicit(&queue->pushed, 1, memory_order_relaxed);
+    return true;
+}
+
+// Append record to the overflow list. Producers never wait for the event
+// thread: the list grows instead, and only an allocation failure drops.
+static bool
+queue_push_overflow(struct input_queue *queue, const struct input_record *record)
+{
+    pthread_mutex_lock(&queue->overflow_lock);
+    if (queue->overflow_count == queue->overflow_capacity) {
+        size_t capacity = queue->overflow_capacity ? queue->overflow_capacity * 2 : 64;
+        struct input_record *grown = realloc(queue->overflow, capacity * sizeof(*grown));
+        if (!grown) {
+            pthread_mutex_unlock(&queue->overflow_lock);
+            if (atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed) == 0) {
+                log_error("[INPUT_QUEUE] ", "Out of memory, dropping input events\n");
+            }
+            return false;
+        }
+        queue->overflow = grown;
+        queue->overflow_capacity = capacity;
+    }
+    queue->overflow[queue->overflow_count++] = *record;
+    atomic_store_explicit(&queue->overflowing, true, memory_order_relaxed);
+    pthread_mutex_unlock(&queue->overflow_lock);
+
+    atomic_fetch_add_explicit(&queue->pushed, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&queue->overflowed, 1, memory_order_relaxed);
+    queue_wake(queue);
+    return true;
+}
+
+// Push record behind everything queued so far, into the ring while it has
+// room and nothing is waiting in the overflow list
+static bool
+queue_push_ordered(struct input_queue *queue, const struct input_record *record)
+{
+    if (!atomic_load_explicit(&queue->overflowing, memory_order_acquire) &&
+        queue_try_push(queue, record)) {
+        queue_wake(queue);
+        return true;
+    }
+    return queue_push_overflow(queue, record);
+}
+
+// Queue the held back motion, if any, ahead of a record about to be pushed
+static bool
+queue_release_motion(struct input_queue *queue)
+{
+    if (!atomic_load_explicit(&queue->motion_held, memory_order_acquire)) {
+        return true;
+    }
+    bool queued = true;
+    pthread_mutex_lock(&queue->motion_lock);
+    if (atomic_load_explicit(&queue->motion_held, memory_order_relaxed)) {
+        queued = queue_push_ordered(queue, &queue->held_motion);
+        atomic_store_explicit(&queue->motion_held, false, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&queue->motion_lock);
+    return queued;
+}
+
+// Motion carries an absolute position, so later motion stands in for
+// earlier motion that did not fit
+static bool
+queue_push_motion(struct input_queue *queue, const struct input_record *record)
+{
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (!atomic_load_explicit(&queue->motion_held, memory_order_acquire) &&
+        !atomic_load_explicit(&queue->overflowing, memory_order_acquire) &&
+        head - tail < queue->motion_limit && queue_try_push(queue, record)) {
+        queue_wake(queue);
+        return true;
+    }
+    pthread_mutex_lock(&queue->motion_lock);
+    if (atomic_load_explicit(&queue->motion_held, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&queue->coalesced, 1, memory_order_relaxed);
+    }
+    queue->held_motion = *record;
+    atomic_store_explicit(&queue->motion_held, true, memory_order_release);
+    pthread_mutex_unlock(&queue->motion_lock);
+    queue_wake(queue);
+    return true;
+}
+
+bool
+input_queue_push(struct input_queue *queue, const struct input_record *record)
+{
+    if (!queue) {
+        return false;
+    }
+    if (record->type == INPUT_RECORD_POINTER_MOTION) {
+        return queue_push_motion(queue, record);
+    }
+    return queue_release_motion(queue) && queue_push_ordered(queue, record);
+}
+
+bool
+input_queue_pointer_enter(struct input_queue *queue, uint64_t surface_id, double x, double y)
+{
+    return input_queue_push(queue, &(struct input_record){
+                                       .type = INPUT_RECORD_POINTER_ENTER,
+                                       .surface_id = surface_id,
+                                       .x = x,
+                                       .y = y,
+                                   });
+}
+
+bool
+input_queue_pointer_leave(struct input_queue *queue, uint64_t surface_id)
+{
+    return input_queue_push(queue, &(struct input_record){
+                                       .type = INPUT_RECORD_POINTER_LEAVE,
+                                       .surface_id = surface_id,
+                                   });
+}
+
+bool
+input_queue_pointer_motion(struct input_queue *queue, uint32_t time, double x, double y)
+{
+    return input_queue_push(queue, &(struct input_record){
+                                       .type = INPUT_RECORD_POINTER_MOTION,
+                                       .time = time,
+                                       .x = x,
+                                       .y = y,
+                                   });
+}
+
+bool
+input_queue_pointer_axis(struct input_queue *queue, uint32_t time, uint32_t axis, double value)
+{
+    return input_queue_push(queue, &(struct input_record){
+                                       .type = INPUT_RECORD_POINTER_AXIS,
+                                       .time = time,
+                                       .code = axis,
+                                       .x = value,
+                                   });
+}
+
+bool
+input_queue_pointer_button(struct input_queue *queue, uint32_t time, uint32_t button,
+                           uint32_t state)
+{
+    return input_queue_push(queue, &(struct input_record){
+                                       .type = INPUT_RECORD_POINTER_BUTTON,
+                                       .time = time,
+                                       .code = button,
+                                       .state = state,
+                                   });
+}
+
+bool
+input_queue_keyboard_enter(struct input_queue *queue, uint64_t surface_id)
+{
+    return input_queue_push(queue, &(struct input_record){
+                                       .type = INPUT_RECORD_KEYBOARD_ENTER,
+                                       .surface_id = surface_id,
+                                   });
+}
+
+bool
+input_queue_keyboard_leave(struct input_queue *queue, uint64_t surface_id)
+{
+    return input_queue_push(queue, &(struct input_record){
+                                       .type = INPUT_RECORD_KEYBOARD_LEAVE,
+                                       .surface_id = surface_id,
+                                   });
+}
+
+bool
+input_queue_keyboard_key(struct input_queue *queue, uint32_t time, uint32_t key, uint32_t state)
+{
+    return input_queue_push(queue, &(struct input_record){
+                                       .type = INPUT_RECORD_KEYBOARD_KEY,
+                                       .time = time,
+                                       .code = key,
+                                       .state = state,
+                                   });
+}
+
+bool
+input_queue_keyboard_modifiers(struct input_queue *queue, uint32_t depressed, uint32_t latched,
+                               uint32_t locked, uint32_t group)
+{
+    return input_queue_push(queue, &(struct input_record){
+                                       .type = INPUT_RECORD_KEYBOARD_MODIFIERS,
+                                       .mods_depressed = depressed,
+                                       .mods_latched = latched,
+                                       .mods_locked = locked,
+                                       .group = group,
+                                   });
+}
+
+bool
+input_queue_touch_down(struct input_queue *queue, uint64_t surface_id, uint32_t time, int32_t id,
+                       double x, double y)
+{
+    return input_queue_push(queue, &(struct input_record){
+                                       .type = INPUT_RECORD_TOUCH_DOWN,
+                                       .surface_id = surface_id,
+                                       .time = time,
+                                       .code = (uint32_t)id,
+                                       .x = x,
+                                       .y = y,
+                                   });
+}
+
+bool
+input_queue_touch_up(struct input_queue *queue, uint32_t time, int32_t id)
+{
+    return input_queue_push(queue, &(struct input_record){
+                                       .type = INPUT_RECORD_TOUCH_UP,
+                                       .time = time,
+                                       .code = (uint32_t)id,
+                                   });
+}
+
+bool
+input_queue_touch_motion(struct input_queue *queue, uint32_t time, int32_t id, double x, double y)
+{
+    return input_queue_push(queue, &(struct input_record){
+                                       .type = INPUT_RECORD_TOUCH_MOTION,
+                                       .time = time,
+                                       .code = (uint32_t)id,
+                                       .x = x,
+                                       .y = y,
+                                   });
+}
+
+bool
+input_queue_touch_frame(struct input_queue *queue)
+{
+    return input_queue_push(queue, &(struct input_record){.type = INPUT_RECORD_TOUCH_FRAME});
+}
+
+bool
+input_queue_touch_cancel(struct input_queue *queue)
+{
+    return input_queue_push(queue, &(struct input_record){.type = INPUT_RECORD_TOUCH_CANCEL});
+}
+
+// --- Consumer side (event thread) ---
+
+// The resource of a surface named by a record, or NULL if the surface has
+// been destroyed since (ids are never reused)
+static struct wl_resource *
+queue_surface_resource(uint64_t surface_id)
+{
+    struct wl_surface_impl *surface = wl_surface_from_id(surface_id);
+    return surface ? surface->resource : NULL;
+}
+
+static void
+queue_dispatch(struct input_queue *queue, const struct input_record *record)
+{
+    struct wl_seat_impl *seat = queue->seat;
+    struct wl_resource *surface = NULL;
+
+    switch (record->type) {
+    case INPUT_RECORD_POINTER_ENTER:
+        if ((surface = queue_surface_resource(record->surface_id))) {
+            input_batch_pointer_enter(queue->batch, surface, wl_seat_get_serial(seat), record->x,
+                                      record->y);
+        }
+        break;
+    case INPUT_RECORD_POINTER_LEAVE:
+        if ((surface = queue_surface_resource(record->surface_id))) {
+            input_batch_pointer_leave(queue->batch, surface, wl_seat_get_serial(seat));
+        }
+        break;
+    case INPUT_RECORD_POINTER_MOTION:
+        input_batch_pointer_motion(queue->batch, record->time, record->x, record->y);
+        break;
+    case INPUT_RECORD_POINTER_AXIS:
+        input_batch_pointer_axis(queue->batch, record->time, record->code, record->x);
+        break;
+    case INPUT_RECORD_POINTER_BUTTON:
+        input_batch_pointer_button(queue->batch, wl_seat_get_serial(seat), record->time,
+                                   record->code, record->state);
+        break;
+    case INPUT_RECORD_KEYBOARD_ENTER:
+        if ((surface = queue_surface_resource(record->surface_id))) {
+            uint32_t serial = wl_seat_get_serial(seat);
+            struct wl_array keys;
+            wl_array_init(&keys);
+            wl_seat_send_keyboard_enter(seat, surface, serial, &keys);
+            wl_array_release(&keys);
+            wl_seat_send_keyboard_modifiers(seat, serial);
+        }
+        break;
+    case INPUT_RECORD_KEYBOARD_LEAVE:
+        if ((surface = queue_surface_resource(record->surface_id))) {
+            wl_seat_send_keyboard_leave(seat, surface, wl_seat_get_serial(seat));
+        }
+        break;
+    case INPUT_RECORD_KEYBOARD_KEY:
+        input_batch_keyboard_key(queue->batch, wl_seat_get_serial(seat), record->time,
+                                 record->code, record->state);
+        break;
+    case INPUT_RECORD_KEYBOARD_MODIFIERS:
+        seat->mods_depressed = record->mods_depressed;
+        seat->mods_latched = record->mods_latched;
+        seat->mods_locked = record->mods_locked;
+        seat->group = record->group;
+        wl_seat_send_keyboard_modifiers(seat, wl_seat_get_serial(seat));
+        break;
+    case INPUT_RECORD_TOUCH_DOWN:
+        if ((surface = queue_surface_resource(record->surface_id))) {
+            wl_seat_send_touch_down(seat, wl_seat_get_serial(seat), record->time, surface,
+                                    (int32_t)record->code, wl_fixed_from_double(record->x),
+                                    wl_fixed_from_double(record->y));
+        }
+        break;
+    case INPUT_RECORD_TOUCH_UP:
+        wl_seat_send_touch_up(seat, wl_seat_get_serial(seat), record->time,
+                              (int32_t)record->code);
+        break;
+    case INPUT_RECORD_TOUCH_MOTION:
+        wl_seat_send_touch_motion(seat, record->time, (int32_t)record->code,
+                                  wl_fixed_from_double(record->x), wl_fixed_from_double(record->y));
+        break;
+    case INPUT_RECORD_TOUCH_FRAME:
+        wl_seat_send_touch_frame(seat);
+        break;
+    case INPUT_RECORD_TOUCH_CANCEL:
+        wl_seat_send_touch_cancel(seat);
+        break;
+    default:
+        break;
+    }
+}
+
+// Whether the next record in the ring has been published
+static bool
+queue_ring_ready(struct input_queue *queue)
+{
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    struct input_queue_slot *slot = &queue->slots[tail & queue->mask];
+    return atomic_load_explicit(&slot->sequence, memory_order_acquire) == tail + 1;
+}
+
+// Take the next record from the ring, or return false if it is empty (or
+// the next producer has not finished writing)
+static bool
+queue_pop(struct input_queue *queue, struct input_record *record)
+{
+    if (!queue_ring_ready(queue)) {
+        return false;
+    }
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    struct input_queue_slot *slot = &queue->slots[tail & queue->mask];
+    *record = slot->record;
+    atomic_store_explicit(&slot->sequence, tail + queue->mask + 1, memory_order_release);
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+// Swap the overflow list into spare, setting *count, once the ring is
+// empty. A record that reached the ring before the list was taken may be
+// older than the list, so the ring is checked again under the lock,
+// including slots claimed but not yet written; records pushed after the
+// swap are newer.
+static bool
+queue_take_overflow(struct input_queue *queue, size_t *count)
+{
+    pthread_mutex_lock(&queue->overflow_lock);
+    if (atomic_load_explicit(&queue->head, memory_order_relaxed) !=
+        atomic_load_explicit(&queue->tail, memory_order_relaxed)) {
+        pthread_mutex_unlock(&queue->overflow_lock);
+        return false;
+    }
+    struct input_record *records = queue->overflow;
+    size_t capacity = queue->overflow_capacity;
+    *count = queue->overflow_count;
+    queue->overflow = queue->spare;
+    queue->overflow_capacity = queue->spare_capacity;
+    queue->overflow_count = 0;
+    atomic_store_explicit(&queue->overflowing, false, memory_order_relaxed);
+    pthread_mutex_unlock(&queue->overflow_lock);
+
+    queue->spare = records;
+    queue->spare_capacity = capacity;
+    return true;
+}
+
+// Take the held back motion: it is newer than anything in the ring and the
+// overflow list, so only once both are empty (no slot claimed either)
+static bool
+queue_take_motion(struct input_queue *queue, struct input_record *record)
+{
+    pthread_mutex_lock(&queue->motion_lock);
+    bool held = atomic_load_explicit(&queue->motion_held, memory_order_relaxed) &&
+                !atomic_load_explicit(&queue->overflowing, memory_order_relaxed) &&
+                atomic_load_explicit(&queue->head, memory_order_relaxed) ==
+                    atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (held) {
+        *record = queue->held_motion;
+        atomic_store_explicit(&queue->motion_held, false, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&queue->motion_lock);
+    return held;
+}
+
+static void
+queue_dispatch_counted(struct input_queue *queue, const struct input_record *record, int *count)
+{
+    if (queue->callbacks.dispatch) {
+        queue->callbacks.dispatch(queue->callbacks.data, record);
+    } else {
+        if (*count == 0) {
+            // Surface ids are looked up in the registry index
+            wl_compositor_lock_surfaces();
+        }
+        queue_dispatch(queue, record);
+    }
+    (*count)++;
+}
+
+int
+input_queue_drain(struct input_queue *queue)
+{
+    if (!queue) {
+        return 0;
+    }
+
+    int count = 0;
+    struct input_record record;
+    for (;;) {
+        if (queue_pop(queue, &record)) {
+            queue_dispatch_counted(queue, &record, &count);
+        } else if (atomic_load_explicit(&queue->overflowing, memory_order_acquire)) {
+            size_t taken = 0;
+            if (!queue_take_overflow(queue, &taken)) {
+                if (queue_ring_ready(queue)) {
+                    continue;
+                }
+                // A producer is still writing its slot; it wakes this
+                // thread once it has
+                break;
+            }
+            for (size_t i = 0; i < taken; i++) {
+                queue_dispatch_counted(queue, &queue->spare[i], &count);
+            }
+        } else if (atomic_load_explicit(&queue->motion_held, memory_order_acquire)) {
+            if (queue_take_motion(queue, &record)) {
+                queue_dispatch_counted(queue, &record, &count);
+            } else if (!queue_ring_ready(queue) &&
+                       !atomic_load_explicit(&queue->overflowing, memory_order_acquire)) {
+                break;  // As above, or a producer queued the motion meanwhile
+            }
+        } else {
+            break;
+        }
+    }
+    if (count > 0) {
+        if (!queue->callbacks.dispatch) {
+            wl_compositor_unlock_surfaces();
+        }
+        queue->drained += (uint64_t)count;
+        TRACE_COUNTER("input_drained", count);
+    }
+    return count;
+}
+
+static int
+queue_handle_wake(int fd, uint32_t mask, void *data)
+{
+    (void)mask;
+    struct input_queue *queue = data;
+    uint8_t buffer[64];
+    while (read(fd, buffer, sizeof(buffer)) > 0) {
+    }
+    queue->wakeups++;
+
+    // Pushes from here on write a new byte, so nothing is left behind
+    atomic_store_explicit(&queue->wake_pending, false, memory_order_release);
+    TRACE_SCOPE("input_drain");
+    input_queue_drain(queue);
+    return 0;
+}
+
+static bool
+queue_set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0 &&
+           fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+struct input_queue *
+input_queue_create(struct wl_event_loop *loop, struct wl_seat_impl *seat,
+                   struct input_batch *batch, uint32_t capacity)
+{
+    if (!loop || !seat || !batch) {
+        return NULL;
+    }
+    struct input_queue *queue = calloc(1, sizeof(struct input_queue));
+    if (!queue) {
+        return NULL;
+    }
+    queue->wake_fds[0] = queue->wake_fds[1] = -1;
+
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    queue->slots = calloc(size, sizeof(struct input_queue_slot));
+    if (!queue->slots) {
+        free(queue);
+        return NULL;
+    }
+    queue->mask = size - 1;
+    queue->motion_limit = size - size / INPUT_QUEUE_MOTION_RESERVE;
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&queue->slots[i].sequence, i);
+    }
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    pthread_mutex_init(&queue->motion_lock, NULL);
+    atomic_init(&queue->motion_held, false);
+    pthread_mutex_init(&queue->overflow_lock, NULL);
+    atomic_init(&queue->overflowing, false);
+    atomic_init(&queue->wake_pending, false);
+    atomic_init(&queue->pushed, 0);
+    atomic_init(&queue->coalesced, 0);
+    atomic_init(&queue->overflowed, 0);
+    atomic_init(&queue->dropped, 0);
+    queue->seat = seat;
+    queue->batch = batch;
+
+    if (pipe(queue->wake_fds) != 0 || !queue_set_nonblocking(queue->wake_fds[0]) ||
+        !queue_set_nonblocking(queue->wake_fds[1])) {
+        log_error("[INPUT_QUEUE] ", "Failed to create wakeup pipe: %s\n", strerror(errno));
+        input_queue_destroy(queue);
+        return NULL;
+    }
+    queue->wake_source = wl_event_loop_add_fd(loop, queue->wake_fds[0], WL_EVENT_READABLE,
+                                              queue_handle_wake, queue);
+    if (!queue->wake_source) {
+        input_queue_destroy(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+void
+input_queue_destroy(struct input_queue *queue)
+{
+    if (!queue) {
+        return;
+    }
+    if (queue->wake_source) {
+        wl_event_source_remove(queue->wake_source);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (queue->wake_fds[i] >= 0) {
+            close(queue->wake_fds[i]);
+        }
+    }
+    pthread_mutex_destroy(&queue->motion_lock);
+    pthread_mutex_destroy(&queue->overflow_lock);
+    free(queue->overflow);
+    free(queue->spare);
+    free(queue->slots);
+    free(queue);
+}
+
+void
+input_queue_set_callbacks(struct input_queue *queue, const struct input_queue_callbacks *callbacks)
+{
+    if (callbacks) {
+        queue->callbacks = *callbacks;
+    } else {
+        memset(&queue->callbacks, 0, sizeof(queue->callbacks));
+    }
+}
+
+void
+input_queue_get_stats(struct input_queue *queue, struct input_queue_stats *stats)
+{
+    stats->pushed = atomic_load_explicit(&queue->pushed, memory_order_relaxed);
+    stats->coalesced = atomic_load_explicit(&queue->coalesced, memory_order_relaxed);
+    stats->overflowed = atomic_load_explicit(&queue->overflowed, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&queue->dropped, memory_order_relaxed);
+    stats->drained = queue->drained;
+    stats->wakeups = queue->wakeups;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-server.h>
+
+struct input_batch;
+struct wl_seat_impl;
+
+// Input queue
+// libwayland-server is not thread-safe, so the platform input handlers
+// (Cocoa/UIKit main thread) do not touch the seat. They push fixed-size
+// records into a bounded lock-free MPSC ring; the Wayland event thread is
+// woken through a pipe, drains the ring in order and feeds the records to
+// the input batch and wayland_seat.c, which only run on that thread.
+// Producers never wait for the event thread, which may itself be waiting
+// on the main thread.
+// Serials are taken when a record is dispatched.
+//
+// Records name surfaces by registry id (wl_surface_impl::id), looked up
+// when the record is dispatched: one destroyed in the meantime turns the
+// record into a no-op.
+//
+// Push functions are safe from any thread. Pointer motion only fills the
+// ring up to a fraction (1/INPUT_QUEUE_MOTION_RESERVE) short of full; past
+// that the latest motion is held back (each one replacing the last) and
+// queued ahead of the next other record, or dispatched once the queue
+// drains. Every other record that finds the ring full goes to an unbounded
+// overflow list, dispatched after the ring, and so do the records after it
+// until the list is drained: buttons, keys and touch ups keep their order
+// and return false only if memory runs out.
+
+#define INPUT_QUEUE_DEFAULT_CAPACITY 1024  // Records; rounded up to a power of two
+#define INPUT_QUEUE_MOTION_RESERVE 4       // Fraction of the ring (1/4) kept from motion
+
+enum input_record_type {
+    INPUT_RECORD_POINTER_ENTER,
+    INPUT_RECORD_POINTER_LEAVE,
+    INPUT_RECORD_POINTER_MOTION,
+    INPUT_RECORD_POINTER_AXIS,
+    INPUT_RECORD_POINTER_BUTTON,
+    INPUT_RECORD_KEYBOARD_ENTER,  // Followed by the current modifiers
+    INPUT_RECORD_KEYBOARD_LEAVE,
+    INPUT_RECORD_KEYBOARD_KEY,
+    INPUT_RECORD_KEYBOARD_MODIFIERS,
+    INPUT_RECORD_TOUCH_DOWN,
+    INPUT_RECORD_TOUCH_UP,
+    INPUT_RECORD_TOUCH_MOTION,
+    INPUT_RECORD_TOUCH_FRAME,
+    INPUT_RECORD_TOUCH_CANCEL,
+};
+
+struct input_record {
+    enum input_record_type type;
+    uint32_t time;                    // Event timestamp in milliseconds
+    uint64_t surface_id;              // Enter, leave, touch down
+    double x, y;                      // Surface coordinates; axis: x is the value
+    uint32_t code;                    // Button, key, axis or touch id
+    uint32_t state;                   // Button or key state
+    uint32_t mods_depressed, mods_latched, mods_locked, group;  // Modifiers
+};
+
+struct input_queue_stats {
+    uint64_t pushed;
+    uint64_t coalesced;   // Motion replaced by later motion while held back
+    uint64_t overflowed;  // Records that went to the overflow list
+    uint64_t dropped;     // Records lost to a failed overflow allocation
+    uint64_t drained;
+    uint64_t wakeups;     // Pipe wakeups of the event thread
+};
+
+// Test hook, optional: dispatch receives every record, in order, on the
+// event thread instead of the seat
+struct input_queue_callbacks {
+    void (*dispatch)(void *data, const struct input_record *record);
+    void *data;
+};
+
+struct input_queue;
+
+// The queue dispatches to seat through batch. Create and destroy it on the
+// event thread of loop, or before that thread runs; returns NULL on failure.
+struct input_queue *input_queue_create(struct wl_event_loop *loop, struct wl_seat_impl *seat,
+                                       struct input_batch *batch, uint32_t capacity);
+void input_queue_destroy(struct input_queue *queue);
+
+void input_queue_set_callbacks(struct input_queue *queue,
+                               const struct input_queue_callbacks *callbacks);
+
+// Any thread
+bool input_queue_push(struct input_queue *queue, const struct input_record *record);
+
+bool input_queue_pointer_enter(struct input_queue *queue, uint64_t surface_id, double x, double y);
+bool input_queue_pointer_leave(struct input_queue *queue, uint64_t surface_id);
+bool input_queue_pointer_motion(struct input_queue *queue, uint32_t time, double x, double y);
+bool input_queue_pointer_axis(struct input_queue *queue, uint32_t time, uint32_t axis,
+                              double value);
+bool input_queue_pointer_button(struct input_queue *queue, uint32_t time, uint32_t button,
+                                uint32_t state);
+bool input_queue_keyboard_enter(struct input_queue *queue, uint64_t surface_id);
+bool input_queue_keyboard_leave(struct input_queue *queue, uint64_t surface_id);
+bool input_queue_keyboard_key(struct input_queue *queue, uint32_t time, uint32_t key,
+                              uint32_t state);
+bool input_queue_keyboard_modifiers(struct input_queue *queue, uint32_t depressed,
+                                    uint32_t latched, uint32_t locked, uint32_t group);
+bool input_queue_touch_down(struct input_queue *queue, uint64_t surface_id, uint32_t time,
+                            int32_t id, double x, double y);
+bool input_queue_touch_up(struct input_queue *queue, uint32_t time, int32_t id);
+bool input_queue_touch_motion(struct input_queue *queue, uint32_t time, int32_t id, double x,
+                              double y);
+bool input_queue_touch_frame(struct input_queue *queue);
+bool input_queue_touch_cancel(struct input_queue *queue);
+
+// Event thread: dispatch every queued record (the repaint hook calls this
+// before input_batch_flush so input lands ahead of frame callbacks).
+// Returns the number of records dispatched.
+int input_queue_drain(struct input_queue *queue);
+
+void input_queue_get_stats(struct input_queue *queue, struct input_queue_stats *stats);
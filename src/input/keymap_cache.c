@@ -0,0 +1,417 @@
+#include "keymap_cache.h"
+#include "logging.h"
+#include "trace.h"
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "compat/macos/stubs/libinput-macos/posix-compat.h"
+
+// Cache files are "<header>\n<keymap text>": the header repeats the key
+// so a file name hash collision (or a file of another xkbcommon or XKB data
+// set) reads as a miss
+#define KEYMAP_CACHE_HEADER "# wawona keymap v2 "
+#define KEYMAP_CACHE_MAX_SIZE (4u * 1024u * 1024u)
+
+// Version of the xkbcommon the keymaps are compiled with, when the build
+// passes it; the loaded library is identified at run time either way
+#ifndef WAWONA_XKBCOMMON_VERSION
+#define WAWONA_XKBCOMMON_VERSION "unknown"
+#endif
+
+static long long
+keymap_path_mtime(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (long long)st.st_mtime : 0;
+}
+
+// Latest modification time of an XKB data directory and of the rules file
+// the names select, so data updated in place changes the key too
+static long long
+keymap_data_mtime(const char *root, const char *rules)
+{
+    long long mtime = keymap_path_mtime(root);
+    size_t length = strlen(root) + strlen(rules) + sizeof("/rules/");
+    char *path = malloc(length);
+    if (path) {
+        snprintf(path, length, "%s/rules/%s", root, rules);
+        long long rules_mtime = keymap_path_mtime(path);
+        if (rules_mtime > mtime) {
+            mtime = rules_mtime;
+        }
+        free(path);
+    }
+    return mtime;
+}
+
+static bool
+keymap_key_append(char **key, size_t *length, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (needed < 0) {
+        return false;
+    }
+    char *grown = realloc(*key, *length + (size_t)needed + 1);
+    if (!grown) {
+        return false;
+    }
+    va_start(args, format);
+    vsnprintf(grown + *length, (size_t)needed + 1, format, args);
+    va_end(args);
+    *key = grown;
+    *length += (size_t)needed;
+    return true;
+}
+
+// "rules:model:layout:variant:options xkbcommon <version> <library>@<mtime>
+// <include dir>@<mtime>...". The library file stands in for the version on
+// builds that do not pass it, and the include directories are the ones the
+// context searches (user directories first, then the data root xkbcommon
+// was built with or $XKB_CONFIG_ROOT).
+static char *
+keymap_key(struct xkb_context *context, const struct xkb_rule_names *names)
+{
+    const char *rules = names->rules && names->rules[0] ? names->rules : "evdev";
+    char *key = NULL;
+    size_t length = 0;
+    bool ok = keymap_key_append(&key, &length, "%s:%s:%s:%s:%s xkbcommon %s",
+                                names->rules ? names->rules : "",
+                                names->model ? names->model : "",
+                                names->layout ? names->layout : "",
+                                names->variant ? names->variant : "",
+                                names->options ? names->options : "", WAWONA_XKBCOMMON_VERSION);
+
+    Dl_info info;
+    if (ok && dladdr((const void *)xkb_keymap_new_from_names, &info) && info.dli_fname) {
+        ok = keymap_key_append(&key, &length, " %s@%lld", info.dli_fname,
+                               keymap_path_mtime(info.dli_fname));
+    }
+
+    unsigned int count = xkb_context_num_include_paths(context);
+    for (unsigned int i = 0; ok && i < count; i++) {
+        const char *root = xkb_context_include_path_get(context, i);
+        if (root) {
+            ok = keymap_key_append(&key, &length, " %s@%lld", root,
+                                   keymap_data_mtime(root, rules));
+        }
+    }
+    if (!ok) {
+        free(key);
+        return NULL;
+    }
+    return key;
+}
+
+// FNV-1a, for the file name
+static uint64_t
+keymap_key_hash(const char *key)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        hash = (hash ^ *p) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static char *
+keymap_cache_path(const struct keymap_cache *cache, const char *key, const char *suffix)
+{
+    size_t length = strlen(cache->dir) + 64;
+    char *path = malloc(length);
+    if (path) {
+        snprintf(path, length, "%s/keymap-%016llx.xkb%s", cache->dir,
+                 (unsigned long long)keymap_key_hash(key), suffix);
+    }
+    return path;
+}
+
+// Create path and its missing parents
+static int
+keymap_mkdirs(const char *path)
+{
+    char *copy = strdup(path);
+    if (!copy) {
+        return -1;
+    }
+    for (char *p = copy + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(copy, 0700) != 0 && errno != EEXIST) {
+                free(copy);
+                return -1;
+            }
+            *p = '/';
+        }
+    }
+    int result = (mkdir(copy, 0700) == 0 || errno == EEXIST) ? 0 : -1;
+    free(copy);
+    return result;
+}
+
+static char *
+keymap_default_dir(void)
+{
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *suffix = "/wawona/keymaps";
+    char *dir = NULL;
+    if (base && base[0] == '/') {
+        size_t length = strlen(base) + strlen(suffix) + 1;
+        if ((dir = malloc(length))) {
+            snprintf(dir, length, "%s%s", base, suffix);
+        }
+        return dir;
+    }
+
+    const char *home = getenv("HOME");
+    if (!home || home[0] != '/') {
+        return NULL;
+    }
+#ifdef __APPLE__
+    const char *caches = "/Library/Caches";
+#else
+    const char *caches = "/.cache";
+#endif
+    size_t length = strlen(home) + strlen(caches) + strlen(suffix) + 1;
+    if ((dir = malloc(length))) {
+        snprintf(dir, length, "%s%s%s", home, caches, suffix);
+    }
+    return dir;
+}
+
+// A memfd holding text (size bytes, NUL included), sealed where supported
+static int
+keymap_create_fd(const char *text, uint32_t size)
+{
+    int fd = memfd_create("wawona-keymap", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        log_error("[KEYMAP] ", "Failed to create keymap fd: %s\n", strerror(errno));
+        return -1;
+    }
+
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = write(fd, text + written, size - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            log_error("[KEYMAP] ", "Failed to write keymap fd: %s\n", strerror(errno));
+            close(fd);
+            return -1;
+        }
+        written += (size_t)n;
+    }
+
+#ifdef F_ADD_SEALS
+    // Clients map the very same file: nobody may change it from now on
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+        log_error("[KEYMAP] ", "Failed to seal keymap fd: %s\n", strerror(errno));
+    }
+#endif
+    return fd;
+}
+
+static const struct keymap_layout *
+keymap_cache_add(struct keymap_cache *cache, char *key, const char *text, uint32_t size)
+{
+    struct keymap_layout *layout = calloc(1, sizeof(struct keymap_layout));
+    if (!layout) {
+        free(key);
+        return NULL;
+    }
+    layout->fd = keymap_create_fd(text, size);
+    if (layout->fd < 0) {
+        free(key);
+        free(layout);
+        return NULL;
+    }
+    layout->key = key;
+    layout->size = size;
+    wl_list_insert(&cache->layouts, &layout->link);
+    return layout;
+}
+
+// The cached keymap text of key (NUL terminated), or NULL on a miss
+static char *
+keymap_cache_read(const struct keymap_cache *cache, const char *key, uint32_t *size)
+{
+    char *path = keymap_cache_path(cache, key, "");
+    if (!path) {
+        return NULL;
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    free(path);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    char *data = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && (uint64_t)st.st_size < KEYMAP_CACHE_MAX_SIZE) {
+        size_t length = (size_t)st.st_size;
+        data = malloc(length + 1);
+        size_t done = 0;
+        while (data && done < length) {
+            ssize_t n = read(fd, data + done, length - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                free(data);
+                data = NULL;
+                break;
+            }
+            done += (size_t)n;
+        }
+        if (data) {
+            data[length] = '\0';
+        }
+    }
+    close(fd);
+    if (!data) {
+        return NULL;
+    }
+
+    // Header with the same key, then a keymap
+    size_t header_length = strlen(KEYMAP_CACHE_HEADER);
+    char *newline = strchr(data, '\n');
+    if (strncmp(data, KEYMAP_CACHE_HEADER, header_length) != 0 || !newline ||
+        (size_t)(newline - data) != header_length + strlen(key) ||
+        strncmp(data + header_length, key, strlen(key)) != 0 ||
+        strncmp(newline + 1, "xkb_keymap", strlen("xkb_keymap")) != 0) {
+        free(data);
+        return NULL;
+    }
+
+    size_t text_length = strlen(newline + 1);
+    memmove(data, newline + 1, text_length + 1);
+    *size = (uint32_t)(text_length + 1);
+    return data;
+}
+
+static void
+keymap_cache_write(const struct keymap_cache *cache, const char *key, const char *text)
+{
+    if (keymap_mkdirs(cache->dir) != 0) {
+        log_error("[KEYMAP] ", "Failed to create %s: %s\n", cache->dir, strerror(errno));
+        return;
+    }
+    char *path = keymap_cache_path(cache, key, "");
+    char *tmp_path = keymap_cache_path(cache, key, ".tmp");
+    if (!path || !tmp_path) {
+        free(path);
+        free(tmp_path);
+        return;
+    }
+
+    // Written aside and renamed, so a reader never sees a partial file
+    FILE *file = fopen(tmp_path, "w");
+    if (file) {
+        fprintf(file, "%s%s\n%s", KEYMAP_CACHE_HEADER, key, text);
+        bool failed = ferror(file) != 0;
+        if (fclose(file) != 0 || failed || rename(tmp_path, path) != 0) {
+            log_error("[KEYMAP] ", "Failed to write %s: %s\n", path, strerror(errno));
+            unlink(tmp_path);
+        }
+    }
+    free(path);
+    free(tmp_path);
+}
+
+struct keymap_cache *
+keymap_cache_create(const char *dir)
+{
+    struct keymap_cache *cache = calloc(1, sizeof(struct keymap_cache));
+    if (!cache) {
+        return NULL;
+    }
+    cache->dir = dir ? strdup(dir) : keymap_default_dir();
+    wl_list_init(&cache->layouts);
+    return cache;
+}
+
+void
+keymap_cache_destroy(struct keymap_cache *cache)
+{
+    if (!cache) {
+        return;
+    }
+    struct keymap_layout *layout, *tmp;
+    wl_list_for_each_safe(layout, tmp, &cache->layouts, link) {
+        wl_list_remove(&layout->link);
+        close(layout->fd);
+        free(layout->key);
+        free(layout);
+    }
+    if (cache->context) {
+        xkb_context_unref(cache->context);
+    }
+    free(cache->dir);
+    free(cache);
+}
+
+const struct keymap_layout *
+keymap_cache_get(struct keymap_cache *cache, const struct xkb_rule_names *names)
+{
+    // The context's include paths are part of the key
+    if (!cache->context) {
+        cache->context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+        if (!cache->context) {
+            return NULL;
+        }
+    }
+    char *key = keymap_key(cache->context, names);
+    if (!key) {
+        return NULL;
+    }
+
+    struct keymap_layout *layout;
+    wl_list_for_each(layout, &cache->layouts, link) {
+        if (strcmp(layout->key, key) == 0) {
+            free(key);
+            return layout;
+        }
+    }
+
+    TRACE_SCOPE("keymap_load");
+    uint32_t size = 0;
+    char *text = cache->dir ? keymap_cache_read(cache, key, &size) : NULL;
+    if (text) {
+        log_debug("[KEYMAP] ", "Loaded cached keymap %s (%u bytes)\n", key, size);
+        const struct keymap_layout *cached = keymap_cache_add(cache, key, text, size);
+        free(text);
+        return cached;
+    }
+
+    // Miss: compile, then keep the text for the next launch
+    struct xkb_keymap *keymap =
+        xkb_keymap_new_from_names(cache->context, names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    text = keymap ? xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1) : NULL;
+    if (keymap) {
+        xkb_keymap_unref(keymap);
+    }
+    if (!text) {
+        log_error("[KEYMAP] ", "Failed to compile keymap %s\n", key);
+        free(key);
+        return NULL;
+    }
+    log_debug("[KEYMAP] ", "Compiled keymap %s\n", key);
+    if (cache->dir) {
+        keymap_cache_write(cache, key, text);
+    }
+    const struct keymap_layout *compiled =
+        keymap_cache_add(cache, key, text, (uint32_t)(strlen(text) + 1));
+    free(text);
+    return compiled;
+}
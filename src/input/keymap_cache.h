@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <wayland-server.h>
+#include <xkbcommon/xkbcommon.h>
+
+// Keymap cache
+// Compiling a keymap from RMLVO names (xkb_keymap_new_from_names) costs
+// tens of milliseconds, on iOS more. The keymap text clients receive is
+// cached on disk, keyed by the RMLVO names, the xkbcommon library (build
+// version, file and modification time) and the XKB include directories the
+// context searches with their modification times, so later launches load it
+// without compiling anything;
+// layouts already loaded stay in memory so the seat can switch between them
+// for free.
+//
+// Each layout is kept in one memfd holding the NUL-terminated keymap text.
+// Where the platform supports it (Linux memfd) the file is sealed against
+// writes and resizing, so the same fd can be sent to every client.
+// Elsewhere the file is private to the compositor and clients map it
+// MAP_PRIVATE as wl_keyboard v7 requires.
+//
+// An xkbcommon or keyboard data update misses the cache and compiles anew.
+// Changes to files the rules only include are not noticed: delete the cache
+// directory after editing XKB data by hand.
+
+struct keymap_layout {
+    struct wl_list link;  // keymap_cache::layouts
+    char *key;            // "<rmlvo> xkbcommon <version> <library>@<mtime> <dir>@<mtime>..."
+    int fd;
+    uint32_t size;        // Text size, NUL included (wl_keyboard.keymap size)
+};
+
+struct keymap_cache {
+    struct xkb_context *context;  // Created by the first compile
+    char *dir;                    // NULL: no disk cache
+    struct wl_list layouts;       // struct keymap_layout::link
+};
+
+// dir NULL selects the per-user cache directory
+// ($XDG_CACHE_HOME/wawona/keymaps, ~/Library/Caches/wawona/keymaps on Apple)
+struct keymap_cache *keymap_cache_create(const char *dir);
+void keymap_cache_destroy(struct keymap_cache *cache);
+
+// The layout for names: from memory, else from the disk cache, else
+// compiled (and written to the disk cache). NULL if it cannot be compiled.
+const struct keymap_layout *keymap_cache_get(struct keymap_cache *cache,
+                                             const struct xkb_rule_names *names);
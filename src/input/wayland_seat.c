@@ -1,4 +1,5 @@
 #include "wayland_seat.h"
+#include "keymap_cache.h"
 #include <wayland-server-protocol.h>
 #include <xkbcommon/xkbcommon.h>
 #include <xkbcommon/xkbcommon-names.h>
@@ -11,30 +12,125 @@
 #include <errno.h>
 #include "compat/macos/stubs/libinput-macos/posix-compat.h"
 
-// Pointer implementation
+// Per-client resources
+// The entry of a client is found through its destroy listener, which
+// libwayland keeps on the client: no search over the clients of the seat.
+static void seat_client_handle_destroy(struct wl_listener *listener, void *data);
+
+static struct wl_seat_client *
+seat_client_find(struct wl_seat_impl *seat, struct wl_client *client)
+{
+    struct wl_listener *listener = wl_client_get_destroy_listener(client, seat_client_handle_destroy);
+    if (!listener) {
+        return NULL;
+    }
+    struct wl_seat_client *seat_client = wl_container_of(listener, seat_client, client_destroy);
+    if (seat_client->seat == seat) {
+        return seat_client;
+    }
+    // Only the first seat's listener is found that way
+    wl_list_for_each(seat_client, &seat->clients, link) {
+        if (seat_client->client == client) {
+            return seat_client;
+        }
+    }
+    return NULL;
+}
+
+static struct wl_seat_client *
+seat_client_get(struct wl_seat_impl *seat, struct wl_client *client)
+{
+    struct wl_seat_client *seat_client = seat_client_find(seat, client);
+    if (seat_client) {
+        return seat_client;
+    }
+    seat_client = calloc(1, sizeof(struct wl_seat_client));
+    if (!seat_client) {
+        return NULL;
+    }
+    seat_client->seat = seat;
+    seat_client->client = client;
+    wl_list_init(&seat_client->seat_resources);
+    wl_list_init(&seat_client->pointer_resources);
+    wl_list_init(&seat_client->keyboard_resources);
+    wl_list_init(&seat_client->touch_resources);
+    seat_client->client_destroy.notify = seat_client_handle_destroy;
+    wl_client_add_destroy_listener(client, &seat_client->client_destroy);
+    wl_list_insert(&seat->clients, &seat_client->link);
+    return seat_client;
+}
+
+// The entry of the client owning a resource, NULL if it never bound the seat
+static struct wl_seat_client *
+seat_client_from_resource(struct wl_seat_impl *seat, struct wl_resource *resource)
+{
+    return resource ? seat_client_find(seat, wl_resource_get_client(resource)) : NULL;
+}
+
 static void
-pointer_set_cursor(struct wl_client *client, struct wl_resource *resource,
-                   uint32_t serial, struct wl_resource *surface,
-                   int32_t hotspot_x, int32_t hotspot_y)
+seat_client_unlink_resources(struct wl_list *resources)
 {
-    (void)client; (void)resource; (void)serial; (void)surface; (void)hotspot_x; (void)hotspot_y;
+    struct wl_resource *resource, *tmp;
+    wl_resource_for_each_safe(resource, tmp, resources) {
+        struct wl_list *link = wl_resource_get_link(resource);
+        wl_list_remove(link);
+        wl_list_init(link);
+    }
 }
 
 static void
-pointer_destroy_handler(struct wl_resource *resource)
+seat_client_destroy(struct wl_seat_client *seat_client)
 {
-    struct wl_seat_impl *seat = wl_resource_get_user_data(resource);
-    if (seat && seat->pointer_resource == resource) {
-        fprintf(stderr, "[SEAT] Pointer resource destroyed (clearing seat->pointer_resource)\n");
-        seat->pointer_resource = NULL;
+    struct wl_seat_impl *seat = seat_client->seat;
+    if (seat->pointer_client == seat_client) {
+        seat->pointer_client = NULL;
+    }
+    if (seat->keyboard_client == seat_client) {
+        seat->keyboard_client = NULL;
     }
+    if (seat->touch_client == seat_client) {
+        seat->touch_client = NULL;
+    }
+
+    // The client's resources are destroyed after its destroy listeners run;
+    // their destructors then unlink from themselves
+    seat_client_unlink_resources(&seat_client->seat_resources);
+    seat_client_unlink_resources(&seat_client->pointer_resources);
+    seat_client_unlink_resources(&seat_client->keyboard_resources);
+    seat_client_unlink_resources(&seat_client->touch_resources);
+    wl_list_remove(&seat_client->client_destroy.link);
+    wl_list_remove(&seat_client->link);
+    free(seat_client);
+}
+
+static void
+seat_client_handle_destroy(struct wl_listener *listener, void *data)
+{
+    (void)data;
+    struct wl_seat_client *seat_client = wl_container_of(listener, seat_client, client_destroy);
+    seat_client_destroy(seat_client);
+}
+
+// Destructor of every seat, pointer, keyboard and touch resource
+static void
+seat_resource_unlink(struct wl_resource *resource)
+{
+    wl_list_remove(wl_resource_get_link(resource));
+}
+
+// Pointer implementation
+static void
+pointer_set_cursor(struct wl_client *client, struct wl_resource *resource,
+                   uint32_t serial, struct wl_resource *surface,
+                   int32_t hotspot_x, int32_t hotspot_y)
+{
+    (void)client; (void)resource; (void)serial; (void)surface; (void)hotspot_x; (void)hotspot_y;
 }
 
 static void
 pointer_release(struct wl_client *client, struct wl_resource *resource)
 {
     (void)client;
-    // Resource will be destroyed, destroy handler will clear pointer_resource
     wl_resource_destroy(resource);
 }
 
@@ -67,67 +163,78 @@ static const struct wl_touch_interface touch_implementation = {
     .release = touch_release,
 };
 
+// Create a pointer, keyboard or touch resource. Returns NULL after posting
+// no_memory; otherwise the caller adds it to the list of *seat_client.
+static struct wl_resource *
+seat_create_device(struct wl_client *client, struct wl_resource *seat_resource, uint32_t id,
+                   const struct wl_interface *interface, const void *implementation,
+                   struct wl_seat_client **seat_client)
+{
+    struct wl_seat_impl *seat = wl_resource_get_user_data(seat_resource);
+    struct wl_resource *resource =
+        wl_resource_create(client, interface, wl_resource_get_version(seat_resource), id);
+    *seat_client = seat_client_get(seat, client);
+    if (!*seat_client || !resource) {
+        if (resource) {
+            wl_resource_destroy(resource);
+        }
+        wl_client_post_no_memory(client);
+        return NULL;
+    }
+    wl_resource_set_implementation(resource, implementation, seat, seat_resource_unlink);
+    return resource;
+}
+
 static void
 seat_get_pointer(struct wl_client *client, struct wl_resource *resource, uint32_t id)
 {
-    struct wl_seat_impl *seat = wl_resource_get_user_data(resource);
-    struct wl_resource *pointer = wl_resource_create(client, &wl_pointer_interface, wl_resource_get_version(resource), id);
+    struct wl_seat_client *seat_client;
+    struct wl_resource *pointer = seat_create_device(client, resource, id, &wl_pointer_interface,
+                                                     &pointer_implementation, &seat_client);
     if (!pointer) {
-        wl_client_post_no_memory(client);
         return;
     }
-    
-    wl_resource_set_implementation(pointer, &pointer_implementation, seat, pointer_destroy_handler);
-    seat->pointer_resource = pointer; // Simple tracking (last one wins)
+    wl_list_insert(&seat_client->pointer_resources, wl_resource_get_link(pointer));
     fprintf(stderr, "[SEAT] Client requested pointer (resource=%p, id=%u)\n", (void *)pointer, id);
 }
 
+// libwayland sends a duplicate of the fd, so the layout fd is shared by all
+// keyboards: sealed read-only where the platform allows it
+static void
+seat_send_keymap(struct wl_seat_impl *seat, struct wl_resource *keyboard)
+{
+    if (!seat->keymap) {
+        fprintf(stderr, "[SEAT] Warning: No keymap available\n");
+        return;
+    }
+    wl_keyboard_send_keymap(keyboard, WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1, seat->keymap->fd,
+                            seat->keymap->size);
+}
+
 static void
 seat_get_keyboard(struct wl_client *client, struct wl_resource *resource, uint32_t id)
 {
     struct wl_seat_impl *seat = wl_resource_get_user_data(resource);
-    struct wl_resource *keyboard = wl_resource_create(client, &wl_keyboard_interface, wl_resource_get_version(resource), id);
+    struct wl_seat_client *seat_client;
+    struct wl_resource *keyboard = seat_create_device(client, resource, id, &wl_keyboard_interface,
+                                                      &keyboard_implementation, &seat_client);
     if (!keyboard) {
-        wl_client_post_no_memory(client);
         return;
     }
+    wl_list_insert(&seat_client->keyboard_resources, wl_resource_get_link(keyboard));
     
-    wl_resource_set_implementation(keyboard, &keyboard_implementation, seat, NULL);
-    seat->keyboard_resource = keyboard;
-    
-    // Send keymap using xkbcommon
-    // Each client needs its own fd (Wayland takes ownership of the fd we pass)
-    if (seat->keymap_fd >= 0 && seat->keymap_size > 0) {
-        // Duplicate fd for this client - Wayland will take ownership and close it
-        int client_fd = dup(seat->keymap_fd);
-        if (client_fd >= 0) {
-            // Ensure fd is at offset 0 (clients will mmap from start)
-            lseek(client_fd, 0, SEEK_SET);
-            // Clear CLOEXEC on the duplicate so it can be transferred
-            fcntl(client_fd, F_SETFD, 0);
-            wl_keyboard_send_keymap(keyboard, WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1, client_fd, seat->keymap_size);
-            // Note: Wayland takes ownership of client_fd, so we don't close it here
-            fprintf(stderr, "[SEAT] Sent keymap to keyboard client (fd=%d, size=%u)\n", client_fd, seat->keymap_size);
-        } else {
-            fprintf(stderr, "[SEAT] Failed to duplicate keymap fd: %s\n", strerror(errno));
-        }
-    } else {
-        fprintf(stderr, "[SEAT] Warning: No keymap available (fd=%d, size=%u)\n", seat->keymap_fd, seat->keymap_size);
-    }
+    seat_send_keymap(seat, keyboard);
 }
 
 static void
 seat_get_touch(struct wl_client *client, struct wl_resource *resource, uint32_t id)
 {
-    struct wl_seat_impl *seat = wl_resource_get_user_data(resource);
-    struct wl_resource *touch = wl_resource_create(client, &wl_touch_interface, wl_resource_get_version(resource), id);
-    if (!touch) {
-        wl_client_post_no_memory(client);
-        return;
+    struct wl_seat_client *seat_client;
+    struct wl_resource *touch = seat_create_device(client, resource, id, &wl_touch_interface,
+                                                   &touch_implementation, &seat_client);
+    if (touch) {
+        wl_list_insert(&seat_client->touch_resources, wl_resource_get_link(touch));
     }
-    
-    wl_resource_set_implementation(touch, &touch_implementation, seat, NULL);
-    seat->touch_resource = touch;
 }
 
 static void
@@ -147,15 +254,20 @@ static void
 bind_seat(struct wl_client *client, void *data, uint32_t version, uint32_t id)
 {
     struct wl_seat_impl *seat = data;
+    struct wl_seat_client *seat_client = seat_client_get(seat, client);
     struct wl_resource *resource;
 
     resource = wl_resource_create(client, &wl_seat_interface, (int)version, id);
-    if (!resource) {
+    if (!seat_client || !resource) {
+        if (resource) {
+            wl_resource_destroy(resource);
+        }
         wl_client_post_no_memory(client);
         return;
     }
 
-    wl_resource_set_implementation(resource, &seat_interface, seat, NULL);
+    wl_resource_set_implementation(resource, &seat_interface, seat, seat_resource_unlink);
+    wl_list_insert(&seat_client->seat_resources, wl_resource_get_link(resource));
     
     if (version >= WL_SEAT_CAPABILITIES_SINCE_VERSION) {
         wl_seat_send_capabilities(resource, seat->capabilities);
@@ -164,8 +276,6 @@ bind_seat(struct wl_client *client, void *data, uint32_t version, uint32_t id)
     if (version >= WL_SEAT_NAME_SINCE_VERSION) {
         wl_seat_send_name(resource, "seat0");
     }
-    
-    seat->seat_resource = resource; // Track last bound resource (should be list)
 }
 
 struct wl_seat_impl *
@@ -177,12 +287,11 @@ wl_seat_create(struct wl_display *display)
     seat->display = display;
     seat->capabilities = WL_SEAT_CAPABILITY_POINTER | WL_SEAT_CAPABILITY_KEYBOARD | WL_SEAT_CAPABILITY_TOUCH;
     seat->serial = 1;
-    seat->keymap_fd = -1;
+    wl_list_init(&seat->clients);
     
-    // Initialize xkbcommon context
-    seat->xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-    if (seat->xkb_context) {
-        // Create a keymap for macOS (US layout)
+    // Loaded from the on-disk keymap cache after the first launch
+    seat->keymaps = keymap_cache_create(NULL);
+    if (seat->keymaps) {
         struct xkb_rule_names names = {
             .rules = NULL,
             .model = "pc105",
@@ -190,58 +299,17 @@ wl_seat_create(struct wl_display *display)
             .variant = NULL,
             .options = NULL
         };
-        seat->xkb_keymap = xkb_keymap_new_from_names(seat->xkb_context, &names, XKB_KEYMAP_COMPILE_NO_FLAGS);
-        if (seat->xkb_keymap) {
-            seat->xkb_state = xkb_state_new(seat->xkb_keymap);
-            // Serialize keymap to string and create shared memory fd
-                char *keymap_string = xkb_keymap_get_as_string(seat->xkb_keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
-                if (keymap_string) {
-                    size_t keymap_len = strlen(keymap_string) + 1;
-                    seat->keymap_size = (uint32_t)keymap_len;
-                    
-                    // Use memfd_create (uses shm_open on macOS, native on Linux)
-                    // Don't set CLOEXEC - we'll handle it per-client
-                    seat->keymap_fd = memfd_create("wayland-keymap", 0);
-                    if (seat->keymap_fd >= 0) {
-                        // Set size first (required for mmap to work)
-                        if (ftruncate(seat->keymap_fd, seat->keymap_size) == 0) {
-                            // Use mmap to write to shared memory (works on both macOS and Linux)
-                            void *map = mmap(NULL, seat->keymap_size, PROT_READ | PROT_WRITE, MAP_SHARED, seat->keymap_fd, 0);
-                            if (map != MAP_FAILED) {
-                                memcpy(map, keymap_string, seat->keymap_size);
-                                munmap(map, seat->keymap_size);
-                                // Ensure fd is at offset 0
-                                lseek(seat->keymap_fd, 0, SEEK_SET);
-                                fprintf(stderr, "[SEAT] Created keymap fd=%d, size=%u\n", seat->keymap_fd, seat->keymap_size);
-                            } else {
-                                fprintf(stderr, "[SEAT] Failed to mmap keymap fd: %s\n", strerror(errno));
-                                close(seat->keymap_fd);
-                                seat->keymap_fd = -1;
-                            }
-                        } else {
-                            fprintf(stderr, "[SEAT] Failed to ftruncate keymap fd: %s\n", strerror(errno));
-                            close(seat->keymap_fd);
-                            seat->keymap_fd = -1;
-                        }
-                    } else {
-                        fprintf(stderr, "[SEAT] Failed to create keymap fd: %s\n", strerror(errno));
-                    }
-                    free(keymap_string);
-                }
-        }
+        seat->keymap = keymap_cache_get(seat->keymaps, &names);
     }
     
     seat->global = wl_global_create(display, &wl_seat_interface, 7, seat, bind_seat);
     if (!seat->global) {
-        if (seat->xkb_state) xkb_state_unref(seat->xkb_state);
-        if (seat->xkb_keymap) xkb_keymap_unref(seat->xkb_keymap);
-        if (seat->xkb_context) xkb_context_unref(seat->xkb_context);
-        if (seat->keymap_fd >= 0) close(seat->keymap_fd);
+        keymap_cache_destroy(seat->keymaps);
         free(seat);
         return NULL;
     }
     
-    fprintf(stderr, "[SEAT] Created seat with keymap (fd=%d, size=%u)\n", seat->keymap_fd, seat->keymap_size);
+    fprintf(stderr, "[SEAT] Created seat with keymap (size=%u)\n", seat->keymap ? seat->keymap->size : 0);
 
     return seat;
 }
@@ -251,24 +319,15 @@ wl_seat_destroy(struct wl_seat_impl *seat)
 {
     if (!seat) return;
     
-    // Cleanup XKB resources
-    if (seat->keymap_fd >= 0) {
-        close(seat->keymap_fd);
-        seat->keymap_fd = -1;
-    }
-    if (seat->xkb_state) {
-        xkb_state_unref(seat->xkb_state);
-        seat->xkb_state = NULL;
-    }
-    if (seat->xkb_keymap) {
-        xkb_keymap_unref(seat->xkb_keymap);
-        seat->xkb_keymap = NULL;
-    }
-    if (seat->xkb_context) {
-        xkb_context_unref(seat->xkb_context);
-        seat->xkb_context = NULL;
+    struct wl_seat_client *seat_client, *tmp;
+    wl_list_for_each_safe(seat_client, tmp, &seat->clients, link) {
+        seat_client_destroy(seat_client);
     }
     
+    keymap_cache_destroy(seat->keymaps);
+    seat->keymaps = NULL;
+    seat->keymap = NULL;
+    
     if (seat->global) wl_global_destroy(seat->global);
     free(seat);
 }
@@ -278,8 +337,12 @@ wl_seat_set_capabilities(struct wl_seat_impl *seat, uint32_t capabilities)
 {
     if (!seat) return;
     seat->capabilities = capabilities;
-    if (seat->seat_resource) {
-        wl_seat_send_capabilities(seat->seat_resource, capabilities);
+    struct wl_seat_client *seat_client;
+    struct wl_resource *resource;
+    wl_list_for_each(seat_client, &seat->clients, link) {
+        wl_resource_for_each(resource, &seat_client->seat_resources) {
+            wl_seat_send_capabilities(resource, capabilities);
+        }
     }
 }
 
@@ -295,77 +358,173 @@ wl_seat_set_focused_surface(struct wl_seat_impl *seat, void *surface)
     if (seat) seat->focused_surface = surface;
 }
 
+int
+wl_seat_set_keymap(struct wl_seat_impl *seat, const struct xkb_rule_names *names)
+{
+    if (!seat || !seat->keymaps) return -1;
+
+    const struct keymap_layout *layout = keymap_cache_get(seat->keymaps, names);
+    if (!layout) {
+        fprintf(stderr, "[SEAT] Failed to load keymap (layout=%s)\n", names->layout ? names->layout : "");
+        return -1;
+    }
+    if (layout == seat->keymap) return 0;
+    seat->keymap = layout;
+
+    struct wl_seat_client *seat_client;
+    wl_list_for_each(seat_client, &seat->clients, link) {
+        struct wl_resource *keyboard;
+        wl_resource_for_each(keyboard, &seat_client->keyboard_resources) {
+            seat_send_keymap(seat, keyboard);
+        }
+    }
+    return 0;
+}
+
+int
+wl_seat_get_client_count(const struct wl_seat_impl *seat)
+{
+    return seat ? wl_list_length(&seat->clients) : 0;
+}
+
 // Input event handlers
+// Each sends to every resource of the focused client (normally one)
 void wl_seat_send_pointer_enter(struct wl_seat_impl *seat, struct wl_resource *surface, uint32_t serial, double x, double y) {
-    if (seat && seat->pointer_resource) {
-        wl_pointer_send_enter(seat->pointer_resource, serial, surface, wl_fixed_from_double(x), wl_fixed_from_double(y));
+    if (!seat) return;
+    seat->pointer_client = seat_client_from_resource(seat, surface);
+    if (!seat->pointer_client) return;
+    struct wl_resource *resource;
+    wl_resource_for_each(resource, &seat->pointer_client->pointer_resources) {
+        wl_pointer_send_enter(resource, serial, surface, wl_fixed_from_double(x), wl_fixed_from_double(y));
     }
 }
 void wl_seat_send_pointer_leave(struct wl_seat_impl *seat, struct wl_resource *surface, uint32_t serial) {
-    if (seat && seat->pointer_resource) {
-        wl_pointer_send_leave(seat->pointer_resource, serial, surface);
+    if (!seat) return;
+    struct wl_seat_client *seat_client = seat_client_from_resource(seat, surface);
+    if (!seat_client) return;
+    struct wl_resource *resource;
+    wl_resource_for_each(resource, &seat_client->pointer_resources) {
+        wl_pointer_send_leave(resource, serial, surface);
+        // Frame it here: once focus is cleared wl_seat_send_pointer_frame()
+        // no longer reaches this client
+        if (wl_resource_get_version(resource) >= WL_POINTER_FRAME_SINCE_VERSION) {
+            wl_pointer_send_frame(resource);
+        }
+    }
+    if (seat->pointer_client == seat_client) {
+        seat->pointer_client = NULL;
     }
 }
 void wl_seat_send_pointer_motion(struct wl_seat_impl *seat, uint32_t time, double x, double y) {
-    if (seat && seat->pointer_resource) {
-        wl_pointer_send_motion(seat->pointer_resource, time, wl_fixed_from_double(x), wl_fixed_from_double(y));
+    if (seat && seat->pointer_client) {
+        struct wl_resource *resource;
+        wl_resource_for_each(resource, &seat->pointer_client->pointer_resources) {
+            wl_pointer_send_motion(resource, time, wl_fixed_from_double(x), wl_fixed_from_double(y));
+        }
     }
 }
 void wl_seat_send_pointer_button(struct wl_seat_impl *seat, uint32_t serial, uint32_t time, uint32_t button, uint32_t state) {
-    if (seat && seat->pointer_resource) {
-        wl_pointer_send_button(seat->pointer_resource, serial, time, button, state);
+    if (seat && seat->pointer_client) {
+        struct wl_resource *resource;
+        wl_resource_for_each(resource, &seat->pointer_client->pointer_resources) {
+            wl_pointer_send_button(resource, serial, time, button, state);
+        }
+    }
+}
+void wl_seat_send_pointer_axis(struct wl_seat_impl *seat, uint32_t time, uint32_t axis, double value) {
+    if (seat && seat->pointer_client) {
+        struct wl_resource *resource;
+        wl_resource_for_each(resource, &seat->pointer_client->pointer_resources) {
+            wl_pointer_send_axis(resource, time, axis, wl_fixed_from_double(value));
+        }
     }
 }
 void wl_seat_send_pointer_frame(struct wl_seat_impl *seat) {
-    if (seat && seat->pointer_resource) {
-        if (wl_resource_get_version(seat->pointer_resource) >= WL_POINTER_FRAME_SINCE_VERSION) {
-            wl_pointer_send_frame(seat->pointer_resource);
+    if (seat && seat->pointer_client) {
+        struct wl_resource *resource;
+        wl_resource_for_each(resource, &seat->pointer_client->pointer_resources) {
+            if (wl_resource_get_version(resource) >= WL_POINTER_FRAME_SINCE_VERSION) {
+                wl_pointer_send_frame(resource);
+            }
         }
     }
 }
 void wl_seat_send_keyboard_enter(struct wl_seat_impl *seat, struct wl_resource *surface, uint32_t serial, struct wl_array *keys) {
-    if (seat && seat->keyboard_resource) {
-        wl_keyboard_send_enter(seat->keyboard_resource, serial, surface, keys);
+    if (!seat) return;
+    seat->keyboard_client = seat_client_from_resource(seat, surface);
+    if (!seat->keyboard_client) return;
+    struct wl_resource *resource;
+    wl_resource_for_each(resource, &seat->keyboard_client->keyboard_resources) {
+        wl_keyboard_send_enter(resource, serial, surface, keys);
     }
 }
 void wl_seat_send_keyboard_leave(struct wl_seat_impl *seat, struct wl_resource *surface, uint32_t serial) {
-    if (seat && seat->keyboard_resource) {
-        wl_keyboard_send_leave(seat->keyboard_resource, serial, surface);
+    if (!seat) return;
+    struct wl_seat_client *seat_client = seat_client_from_resource(seat, surface);
+    if (!seat_client) return;
+    struct wl_resource *resource;
+    wl_resource_for_each(resource, &seat_client->keyboard_resources) {
+        wl_keyboard_send_leave(resource, serial, surface);
+    }
+    if (seat->keyboard_client == seat_client) {
+        seat->keyboard_client = NULL;
     }
 }
 void wl_seat_send_keyboard_key(struct wl_seat_impl *seat, uint32_t serial, uint32_t time, uint32_t key, uint32_t state) {
-    if (seat && seat->keyboard_resource) {
-        wl_keyboard_send_key(seat->keyboard_resource, serial, time, key, state);
+    if (seat && seat->keyboard_client) {
+        struct wl_resource *resource;
+        wl_resource_for_each(resource, &seat->keyboard_client->keyboard_resources) {
+            wl_keyboard_send_key(resource, serial, time, key, state);
+        }
     }
 }
 void wl_seat_send_keyboard_modifiers(struct wl_seat_impl *seat, uint32_t serial) {
-    if (seat && seat->keyboard_resource) {
-        wl_keyboard_send_modifiers(seat->keyboard_resource, serial, 
-                                   seat->mods_depressed, seat->mods_latched, seat->mods_locked, seat->group);
+    if (seat && seat->keyboard_client) {
+        struct wl_resource *resource;
+        wl_resource_for_each(resource, &seat->keyboard_client->keyboard_resources) {
+            wl_keyboard_send_modifiers(resource, serial,
+                                       seat->mods_depressed, seat->mods_latched, seat->mods_locked, seat->group);
+        }
     }
 }
 void wl_seat_send_touch_down(struct wl_seat_impl *seat, uint32_t serial, uint32_t time, struct wl_resource *surface, int32_t id, wl_fixed_t x, wl_fixed_t y) {
-    if (seat && seat->touch_resource) {
-        wl_touch_send_down(seat->touch_resource, serial, time, surface, id, x, y);
+    if (!seat) return;
+    seat->touch_client = seat_client_from_resource(seat, surface);
+    if (!seat->touch_client) return;
+    struct wl_resource *resource;
+    wl_resource_for_each(resource, &seat->touch_client->touch_resources) {
+        wl_touch_send_down(resource, serial, time, surface, id, x, y);
     }
 }
 void wl_seat_send_touch_up(struct wl_seat_impl *seat, uint32_t serial, uint32_t time, int32_t id) {
-    if (seat && seat->touch_resource) {
-        wl_touch_send_up(seat->touch_resource, serial, time, id);
+    if (seat && seat->touch_client) {
+        struct wl_resource *resource;
+        wl_resource_for_each(resource, &seat->touch_client->touch_resources) {
+            wl_touch_send_up(resource, serial, time, id);
+        }
     }
 }
 void wl_seat_send_touch_motion(struct wl_seat_impl *seat, uint32_t time, int32_t id, wl_fixed_t x, wl_fixed_t y) {
-    if (seat && seat->touch_resource) {
-        wl_touch_send_motion(seat->touch_resource, time, id, x, y);
+    if (seat && seat->touch_client) {
+        struct wl_resource *resource;
+        wl_resource_for_each(resource, &seat->touch_client->touch_resources) {
+            wl_touch_send_motion(resource, time, id, x, y);
+        }
     }
 }
 void wl_seat_send_touch_frame(struct wl_seat_impl *seat) {
-    if (seat && seat->touch_resource) {
-        wl_touch_send_frame(seat->touch_resource);
+    if (seat && seat->touch_client) {
+        struct wl_resource *resource;
+        wl_resource_for_each(resource, &seat->touch_client->touch_resources) {
+            wl_touch_send_frame(resource);
+        }
     }
 }
 void wl_seat_send_touch_cancel(struct wl_seat_impl *seat) {
-    if (seat && seat->touch_resource) {
-        wl_touch_send_cancel(seat->touch_resource);
+    if (seat && seat->touch_client) {
+        struct wl_resource *resource;
+        wl_resource_for_each(resource, &seat->touch_client->touch_resources) {
+            wl_touch_send_cancel(resource);
+        }
     }
 }
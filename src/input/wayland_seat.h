@@ -4,6 +4,25 @@
 #include <wayland-server.h>
 #include <xkbcommon/xkbcommon.h>
 
+struct keymap_cache;
+struct keymap_layout;
+
+struct wl_seat_impl;
+
+// Seat resources of one client. A client may bind wl_seat and request
+// pointers, keyboards and touch objects several times; every one of them
+// receives the events meant for that client.
+struct wl_seat_client {
+    struct wl_list link;  // wl_seat_impl::clients
+    struct wl_seat_impl *seat;
+    struct wl_client *client;
+    struct wl_listener client_destroy;  // Also finds the entry from the client
+    struct wl_list seat_resources;      // wl_resource links
+    struct wl_list pointer_resources;
+    struct wl_list keyboard_resources;
+    struct wl_list touch_resources;
+};
+
 struct wl_seat_impl {
     struct wl_global *global;
     struct wl_display *display;
@@ -11,10 +30,15 @@ struct wl_seat_impl {
     uint32_t capabilities;
     uint32_t serial;
     
-    struct wl_resource *seat_resource;
-    struct wl_resource *pointer_resource;
-    struct wl_resource *keyboard_resource;
-    struct wl_resource *touch_resource;
+    // Every client bound to the seat (struct wl_seat_client)
+    struct wl_list clients;
+    
+    // Owners of the pointer, keyboard and touch focus, resolved when the
+    // focus changes (enter, touch down) so events are sent straight to
+    // their resources. NULL while nothing has focus.
+    struct wl_seat_client *pointer_client;
+    struct wl_seat_client *keyboard_client;
+    struct wl_seat_client *touch_client;
     
     // Focus tracking
     void *focused_surface;
@@ -30,29 +54,14 @@ struct wl_seat_impl {
     uint32_t mods_locked;     // Locked modifier keys (e.g., Caps Lock)
     uint32_t group;            // Keyboard group
     
-    // Deferred keyboard enter event (to avoid calling variadic function from FFI callback)
-    struct wl_event_source *pending_keyboard_enter_idle;
-    struct wl_resource *pending_keyboard_enter_surface;
-    struct wl_resource *pending_keyboard_enter_keyboard_resource;
-    uint32_t pending_keyboard_enter_serial;
-    struct wl_array *pending_keyboard_enter_keys; // Points to keys array (must be valid until callback runs)
-    
-    // Deferred modifiers event (sent after keyboard enter)
-    struct wl_event_source *pending_modifiers_idle;
-    bool pending_modifiers_needed;
-    uint32_t pending_modifiers_serial;
-    
     // Cursor surface tracking
     struct wl_resource *cursor_surface;  // Current cursor surface (if any)
     int32_t cursor_hotspot_x;
     int32_t cursor_hotspot_y;
     
-    // xkbcommon for keymap handling
-    struct xkb_context *xkb_context;
-    struct xkb_keymap *xkb_keymap;
-    struct xkb_state *xkb_state;
-    int keymap_fd;
-    uint32_t keymap_size;
+    // Keymap sent to keyboards, loaded through the keymap cache
+    struct keymap_cache *keymaps;
+    const struct keymap_layout *keymap;  // Owned by keymaps; NULL if none loaded
 };
 
 struct wl_seat_impl *wl_seat_create(struct wl_display *display);
@@ -61,11 +70,26 @@ void wl_seat_set_capabilities(struct wl_seat_impl *seat, uint32_t capabilities);
 uint32_t wl_seat_get_serial(struct wl_seat_impl *seat);
 void wl_seat_set_focused_surface(struct wl_seat_impl *seat, void *surface);
 
-// Input event handlers (to be called from NSEvent handlers)
+// Switch the keymap to the layout named by names and send it to every bound
+// keyboard. Layouts used before are switched to without compiling.
+// Event thread only. Returns 0, or -1 if the keymap cannot be loaded (the
+// current one stays).
+int wl_seat_set_keymap(struct wl_seat_impl *seat, const struct xkb_rule_names *names);
+
+// Number of clients bound to the seat
+int wl_seat_get_client_count(const struct wl_seat_impl *seat);
+
+// Input event handlers. Event thread only: platform handlers go through
+// input_queue.h (and pointer events through input_batch.h).
+// Enter and touch down move the focus to the client owning the surface;
+// the other events go to the client that has the focus. Clients without
+// the matching resource get nothing. Pointer leave carries its own
+// wl_pointer.frame, since the leaving client loses the focus frames follow.
 void wl_seat_send_pointer_enter(struct wl_seat_impl *seat, struct wl_resource *surface, uint32_t serial, double x, double y);
 void wl_seat_send_pointer_leave(struct wl_seat_impl *seat, struct wl_resource *surface, uint32_t serial);
 void wl_seat_send_pointer_motion(struct wl_seat_impl *seat, uint32_t time, double x, double y);
 void wl_seat_send_pointer_button(struct wl_seat_impl *seat, uint32_t serial, uint32_t time, uint32_t button, uint32_t state);
+void wl_seat_send_pointer_axis(struct wl_seat_impl *seat, uint32_t time, uint32_t axis, double value);
 void wl_seat_send_pointer_frame(struct wl_seat_impl *seat);
 void wl_seat_send_keyboard_enter(struct wl_seat_impl *seat, struct wl_resource *surface, uint32_t serial, struct wl_array *keys);
 void wl_seat_send_keyboard_leave(struct wl_seat_impl *seat, struct wl_resource *surface, uint32_t serial);
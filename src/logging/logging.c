@@ -2,8 +2,13 @@
 #include <time.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <unistd.h>
 
 #ifdef __ANDROID__
 #include <android/log.h>
@@ -12,6 +17,342 @@
 FILE *compositor_log_file = NULL;
 FILE *client_log_file = NULL;
 
+// --- Per-thread rings ---
+//
+// Each logging thread owns a single-producer/single-consumer ring of
+// fixed-size records. The producer only touches `head`, the writer thread
+// only `tail`, so the hot path takes no lock. Rings are registered once per
+// thread (the only locked step) and reclaimed by the writer after the thread
+// exits.
+
+#define LOG_RING_SLOTS 256        // Power of two
+#define LOG_PREFIX_MAX 32
+#define LOG_MESSAGE_MAX 448
+
+// Rate limit: messages per call site (format string) and second
+#define LOG_RATE_LIMIT_BURST 20
+#define LOG_RATE_LIMIT_SITES 32   // Power of two
+
+struct log_record {
+    time_t time;
+    int level;
+    char prefix[LOG_PREFIX_MAX];
+    char message[LOG_MESSAGE_MAX];
+};
+
+struct log_rate_site {
+    const char *format;
+    time_t second;
+    uint32_t count;
+    uint32_t suppressed;
+};
+
+struct log_ring {
+    struct log_ring *next;            // Registry link (g_ring_lock)
+    _Atomic uint32_t head;            // Next slot to write (producer)
+    _Atomic uint32_t tail;            // Next slot to read (writer thread)
+    _Atomic uint32_t dropped;         // Records lost to a full ring
+    _Atomic bool orphaned;            // Owning thread exited
+    struct log_rate_site sites[LOG_RATE_LIMIT_SITES];  // Producer only
+    struct log_record records[LOG_RING_SLOTS];
+};
+
+static struct log_ring *g_rings = NULL;
+static pthread_mutex_t g_ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t g_ring_key;
+static pthread_once_t g_logging_once = PTHREAD_ONCE_INIT;
+static _Thread_local struct log_ring *t_ring = NULL;
+
+static _Atomic int g_log_level = WAWONA_LOG_LEVEL;
+
+// Writer thread
+static pthread_t g_writer_thread;
+static bool g_writer_running = false;
+static _Atomic bool g_writer_stop = false;
+static _Atomic bool g_writer_sleeping = false;
+static pthread_mutex_t g_writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_writer_cond = PTHREAD_COND_INITIALIZER;
+// Bumped after every drain pass, so log_fflush can wait for one
+static _Atomic uint64_t g_drain_generation = 0;
+
+static const char *const g_level_names[] = {"ERROR", "WARN", "INFO", "DEBUG"};
+
+// The writer frees the ring once it is orphaned and drained, so the thread
+// must not touch it again. Clearing t_ring makes logging from a later
+// destructor register a fresh ring, whose pthread_setspecific has pthread
+// run this destructor again for it.
+static void log_ring_thread_exit(void *data)
+{
+    struct log_ring *ring = data;
+    if (t_ring == ring) {
+        t_ring = NULL;
+    }
+    atomic_store(&ring->orphaned, true);
+}
+
+static void *log_writer_main(void *data);
+
+static void log_init_once(void)
+{
+    pthread_key_create(&g_ring_key, log_ring_thread_exit);
+    g_writer_running = pthread_create(&g_writer_thread, NULL, log_writer_main, NULL) == 0;
+}
+
+static struct log_ring *log_thread_ring(void)
+{
+    if (t_ring) {
+        return t_ring;
+    }
+
+    pthread_once(&g_logging_once, log_init_once);
+    struct log_ring *ring = calloc(1, sizeof(struct log_ring));
+    if (!ring) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_ring_lock);
+    ring->next = g_rings;
+    g_rings = ring;
+    pthread_mutex_unlock(&g_ring_lock);
+
+    pthread_setspecific(g_ring_key, ring);
+    t_ring = ring;
+    return ring;
+}
+
+static void log_wake_writer(void)
+{
+    if (atomic_exchange(&g_writer_sleeping, false)) {
+        pthread_cond_signal(&g_writer_cond);
+    }
+}
+
+// Per-call-site rate limit; returns false if the message should be dropped.
+// Reports how many were suppressed in the previous second through *suppressed.
+static bool log_rate_limit(struct log_ring *ring, const char *format, time_t now,
+                           uint32_t *suppressed)
+{
+    uintptr_t hash = ((uintptr_t)format >> 3) ^ ((uintptr_t)format >> 11);
+    struct log_rate_site *site = &ring->sites[hash & (LOG_RATE_LIMIT_SITES - 1)];
+
+    *suppressed = 0;
+    if (site->format != format || site->second != now) {
+        if (site->format == format) {
+            *suppressed = site->suppressed;
+        }
+        site->format = format;
+        site->second = now;
+        site->count = 0;
+        site->suppressed = 0;
+    }
+    if (++site->count > LOG_RATE_LIMIT_BURST) {
+        site->suppressed++;
+        return false;
+    }
+    return true;
+}
+
+// Claim the next free slot of the calling thread's ring (NULL when full)
+static struct log_record *log_ring_reserve(struct log_ring *ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= LOG_RING_SLOTS) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return NULL;
+    }
+    return &ring->records[head & (LOG_RING_SLOTS - 1)];
+}
+
+// Publish the slot returned by log_ring_reserve to the writer thread
+static void log_ring_commit(struct log_ring *ring)
+{
+    atomic_fetch_add_explicit(&ring->head, 1, memory_order_release);
+    log_wake_writer();
+}
+
+static void log_record_init(struct log_record *record, int level, const char *prefix, time_t now)
+{
+    record->time = now;
+    record->level = level;
+    snprintf(record->prefix, sizeof(record->prefix), "%s", prefix ? prefix : "");
+}
+
+void log_vwrite(int level, const char *prefix, const char *format, va_list args)
+{
+    if (level > atomic_load_explicit(&g_log_level, memory_order_relaxed)) {
+        return;
+    }
+
+    struct log_ring *ring = log_thread_ring();
+    time_t now = time(NULL);
+    if (!ring) {
+        // Out of memory: fall back to unbuffered stderr
+        vfprintf(stderr, format, args);
+        return;
+    }
+
+    uint32_t suppressed;
+    bool allowed = log_rate_limit(ring, format, now, &suppressed);
+    struct log_record *record;
+    if (suppressed > 0 && (record = log_ring_reserve(ring)) != NULL) {
+        log_record_init(record, level, prefix, now);
+        snprintf(record->message, sizeof(record->message),
+                 "(%u similar messages suppressed)", suppressed);
+        log_ring_commit(ring);
+    }
+    if (!allowed || (record = log_ring_reserve(ring)) == NULL) {
+        return;
+    }
+
+    log_record_init(record, level, prefix, now);
+    vsnprintf(record->message, sizeof(record->message), format, args);
+    log_ring_commit(ring);
+}
+
+void log_write(int level, const char *prefix, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    log_vwrite(level, prefix, format, args);
+    va_end(args);
+}
+
+void log_printf(const char *prefix, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    log_vwrite(WAWONA_LOG_INFO, prefix, format, args);
+    va_end(args);
+}
+
+void log_set_level(int level)
+{
+    atomic_store(&g_log_level, level);
+}
+
+// --- Writer thread ---
+
+// Formatted timestamp, refreshed at most once per second
+static time_t g_cached_second = 0;
+static char g_cached_time_str[32];
+
+static const char *log_format_time(time_t t)
+{
+    if (t != g_cached_second) {
+        struct tm tm_info;
+        localtime_r(&t, &tm_info);
+        strftime(g_cached_time_str, sizeof(g_cached_time_str), "%Y-%m-%d %H:%M:%S", &tm_info);
+        g_cached_second = t;
+    }
+    return g_cached_time_str;
+}
+
+static void log_emit(const struct log_record *record)
+{
+    const char *time_str = log_format_time(record->time);
+
+    // Callers traditionally end messages with \n; the record gets exactly one
+    size_t len = strnlen(record->message, sizeof(record->message));
+    int message_len = (int)len;
+    if (message_len > 0 && record->message[message_len - 1] == '\n') {
+        message_len--;
+    }
+
+    if (record->level <= WAWONA_LOG_WARN) {
+        printf("[%s] [%s] [%s] %.*s\n", time_str, record->prefix,
+               g_level_names[record->level], message_len, record->message);
+    } else {
+        printf("[%s] [%s] %.*s\n", time_str, record->prefix, message_len, record->message);
+    }
+
+#ifdef __ANDROID__
+    int priority = ANDROID_LOG_INFO;
+    if (record->level == WAWONA_LOG_ERROR) priority = ANDROID_LOG_ERROR;
+    else if (record->level == WAWONA_LOG_WARN) priority = ANDROID_LOG_WARN;
+    else if (record->level == WAWONA_LOG_DEBUG) priority = ANDROID_LOG_DEBUG;
+    __android_log_print(priority, "Wawona", "%s %.*s", record->prefix, message_len, record->message);
+#endif
+
+    if (compositor_log_file) {
+        fprintf(compositor_log_file, "[%s] [%s] %.*s\n", time_str, record->prefix,
+                message_len, record->message);
+    }
+}
+
+// Write out everything queued so far; returns the number of records written
+static int log_drain(void)
+{
+    int written = 0;
+
+    pthread_mutex_lock(&g_ring_lock);
+    struct log_ring **link = &g_rings;
+    while (*link) {
+        struct log_ring *ring = *link;
+        bool orphaned = atomic_load(&ring->orphaned);
+
+        uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        while (tail != head) {
+            log_emit(&ring->records[tail & (LOG_RING_SLOTS - 1)]);
+            tail++;
+            written++;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+        uint32_t dropped = atomic_exchange(&ring->dropped, 0);
+        if (dropped > 0) {
+            printf("[logging] %u message(s) dropped (ring full)\n", dropped);
+        }
+
+        if (orphaned) {
+            *link = ring->next;
+            free(ring);
+        } else {
+            link = &ring->next;
+        }
+    }
+    pthread_mutex_unlock(&g_ring_lock);
+
+    if (written > 0) {
+        fflush(stdout);
+        if (compositor_log_file) {
+            fflush(compositor_log_file);
+        }
+    }
+    atomic_fetch_add(&g_drain_generation, 1);
+    return written;
+}
+
+static void *log_writer_main(void *data)
+{
+    (void)data;
+    while (!atomic_load(&g_writer_stop)) {
+        if (log_drain() > 0) {
+            continue;
+        }
+
+        // Nothing queued: sleep until a producer wakes us. The timeout covers
+        // the lost-wakeup window of the lock-free signal.
+        pthread_mutex_lock(&g_writer_lock);
+        atomic_store(&g_writer_sleeping, true);
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += 50 * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&g_writer_cond, &g_writer_lock, &deadline);
+        atomic_store(&g_writer_sleeping, false);
+        pthread_mutex_unlock(&g_writer_lock);
+    }
+    log_drain();
+    return NULL;
+}
+
+// --- Setup ---
+
 void init_compositor_logging(void)
 {
     // Ensure logs directory exists
@@ -26,6 +367,7 @@ void init_compositor_logging(void)
     if (!compositor_log_file) {
         perror("Failed to open compositor log file");
     }
+    pthread_once(&g_logging_once, log_init_once);
 }
 
 void init_client_logging(void)
@@ -44,51 +386,17 @@ void init_client_logging(void)
     }
 }
 
-void log_printf(const char *prefix, const char *format, ...)
-{
-    va_list args;
-    time_t now;
-    char time_str[64];
-    
-    struct tm *tm_info;
-    
-    time(&now);
-    tm_info = localtime(&now);
-    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
-    
-    // Print to stdout
-    printf("[%s] [%s] ", time_str, prefix);
-    va_start(args, format);
-    vprintf(format, args);
-    va_end(args);
-    printf("\n");
-
-#ifdef __ANDROID__
-    // Print to Android logcat
-    va_start(args, format);
-    // Determine priority based on prefix content (heuristic)
-    int priority = ANDROID_LOG_INFO;
-    if (strstr(prefix, "ERROR") || strstr(prefix, "❌")) priority = ANDROID_LOG_ERROR;
-    else if (strstr(prefix, "WARN") || strstr(prefix, "⚠️")) priority = ANDROID_LOG_WARN;
-    else if (strstr(prefix, "DEBUG")) priority = ANDROID_LOG_DEBUG;
-    
-    __android_log_vprint(priority, "Wawona", format, args);
-    va_end(args);
-#endif
-    
-    // Print to log file if open
-    if (compositor_log_file) {
-        fprintf(compositor_log_file, "[%s] [%s] ", time_str, prefix);
-        va_start(args, format);
-        vfprintf(compositor_log_file, format, args);
-        va_end(args);
-        fprintf(compositor_log_file, "\n");
-        fflush(compositor_log_file);
-    }
-}
-
 void log_fflush(void)
 {
+    if (g_writer_running) {
+        // Two completed drain passes guarantee one started after this call
+        uint64_t target = atomic_load(&g_drain_generation) + 2;
+        for (int i = 0; i < 200 && atomic_load(&g_drain_generation) < target; i++) {
+            atomic_store(&g_writer_sleeping, true);
+            log_wake_writer();
+            usleep(500);
+        }
+    }
     fflush(stdout);
     if (compositor_log_file) fflush(compositor_log_file);
     if (client_log_file) fflush(client_log_file);
@@ -96,6 +404,13 @@ void log_fflush(void)
 
 void cleanup_logging(void)
 {
+    if (g_writer_running) {
+        atomic_store(&g_writer_stop, true);
+        atomic_store(&g_writer_sleeping, true);
+        log_wake_writer();
+        pthread_join(g_writer_thread, NULL);
+        g_writer_running = false;
+    }
     if (compositor_log_file) {
         fclose(compositor_log_file);
         compositor_log_file = NULL;
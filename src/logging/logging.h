@@ -3,6 +3,22 @@
 #include <stdio.h>
 #include <stdarg.h>
 
+// Log levels (lower is more severe)
+#define WAWONA_LOG_ERROR 0
+#define WAWONA_LOG_WARN 1
+#define WAWONA_LOG_INFO 2
+#define WAWONA_LOG_DEBUG 3
+
+// Most verbose level compiled in. Calls above it are elided entirely (the
+// arguments are still type-checked but never evaluated).
+#ifndef WAWONA_LOG_LEVEL
+#ifdef NDEBUG
+#define WAWONA_LOG_LEVEL WAWONA_LOG_INFO
+#else
+#define WAWONA_LOG_LEVEL WAWONA_LOG_DEBUG
+#endif
+#endif
+
 // Log file handles
 extern FILE *compositor_log_file;
 extern FILE *client_log_file;
@@ -11,10 +27,39 @@ extern FILE *client_log_file;
 void init_compositor_logging(void);
 void init_client_logging(void);
 
-// Logging function that writes to both stdout and file
-void log_printf(const char *prefix, const char *format, ...);
+// Leveled logging. Messages are formatted into a per-thread ring and written
+// to stdout, the log file (and logcat on Android) by a background writer
+// thread, so callers never block on I/O. Bursts of messages from the same
+// call site are rate limited.
+void log_write(int level, const char *prefix, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+void log_vwrite(int level, const char *prefix, const char *format, va_list args)
+    __attribute__((format(printf, 3, 0)));
+
+// Runtime threshold on top of WAWONA_LOG_LEVEL
+void log_set_level(int level);
+
+#define WAWONA_LOG_ELIDED(level, prefix, ...) \
+    do { if (0) log_write(level, prefix, __VA_ARGS__); } while (0)
+
+#define log_error(prefix, ...) log_write(WAWONA_LOG_ERROR, prefix, __VA_ARGS__)
+#define log_warn(prefix, ...) log_write(WAWONA_LOG_WARN, prefix, __VA_ARGS__)
+#if WAWONA_LOG_LEVEL >= WAWONA_LOG_INFO
+#define log_info(prefix, ...) log_write(WAWONA_LOG_INFO, prefix, __VA_ARGS__)
+#else
+#define log_info(prefix, ...) WAWONA_LOG_ELIDED(WAWONA_LOG_INFO, prefix, __VA_ARGS__)
+#endif
+#if WAWONA_LOG_LEVEL >= WAWONA_LOG_DEBUG
+#define log_debug(prefix, ...) log_write(WAWONA_LOG_DEBUG, prefix, __VA_ARGS__)
+#else
+#define log_debug(prefix, ...) WAWONA_LOG_ELIDED(WAWONA_LOG_DEBUG, prefix, __VA_ARGS__)
+#endif
+
+// Logging function that writes to both stdout and file (info level)
+void log_printf(const char *prefix, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+// Wait until everything logged so far has been written out
 void log_fflush(void);
 
 // Cleanup
 void cleanup_logging(void);
-
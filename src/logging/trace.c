@@ -0,0 +1,396 @@
+#include "trace.h"
+#include "logging.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// --- Per-thread rings ---
+//
+// Each thread records into its own ring of fixed-size events. Only the owning
+// thread writes; it overwrites the oldest event when the ring is full, so the
+// ring always holds the newest TRACE_RING_EVENTS events (flight recorder).
+// The exporter copies events without stopping the producers and drops any
+// slot the producer may have overwritten while it was being copied.
+
+#define TRACE_RING_EVENTS 16384   // Power of two
+#define TRACE_THREAD_NAME_MAX 32
+
+enum trace_event_type {
+    TRACE_EVENT_BEGIN,
+    TRACE_EVENT_END,
+    TRACE_EVENT_COUNTER,
+    TRACE_EVENT_FLOW_BEGIN,
+    TRACE_EVENT_FLOW_STEP,
+    TRACE_EVENT_FLOW_END,
+};
+
+struct trace_event {
+    uint64_t ts_ns;        // CLOCK_MONOTONIC
+    const char *name;      // String literal
+    uint64_t arg;          // Counter value or flow id
+    uint32_t type;         // enum trace_event_type
+};
+
+struct trace_ring {
+    struct trace_ring *next;              // Registry link (g_trace_lock)
+    uint32_t tid;
+    char thread_name[TRACE_THREAD_NAME_MAX];
+    _Atomic uint64_t head;                // Events ever written
+    _Atomic bool orphaned;                // Owning thread exited, ring reusable
+    struct trace_event events[TRACE_RING_EVENTS];
+};
+
+_Atomic bool trace_enabled_flag = false;
+
+static struct trace_ring *g_trace_rings = NULL;
+static pthread_mutex_t g_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t g_trace_key;
+static pthread_once_t g_trace_once = PTHREAD_ONCE_INIT;
+static _Thread_local struct trace_ring *t_trace_ring = NULL;
+// Name set before the thread recorded anything (no ring yet)
+static _Thread_local char t_trace_thread_name[TRACE_THREAD_NAME_MAX];
+static uint32_t g_trace_next_tid = 1;     // g_trace_lock
+
+// Signal-triggered export
+static int g_dump_fds[2] = {-1, -1};
+static _Atomic uint32_t g_dump_count = 0;
+
+// An orphaned ring is handed to the next new thread, so this thread must not
+// record into it again: a later destructor that traces gets a fresh ring
+// (and this destructor runs again for it)
+static void trace_ring_thread_exit(void *data)
+{
+    struct trace_ring *ring = data;
+    if (t_trace_ring == ring) {
+        t_trace_ring = NULL;
+    }
+    atomic_store(&ring->orphaned, true);
+}
+
+static void trace_set_cloexec_nonblock(int fd)
+{
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static void trace_init_once(void)
+{
+    pthread_key_create(&g_trace_key, trace_ring_thread_exit);
+    if (pipe(g_dump_fds) == 0) {
+        trace_set_cloexec_nonblock(g_dump_fds[0]);
+        trace_set_cloexec_nonblock(g_dump_fds[1]);
+    } else {
+        g_dump_fds[0] = g_dump_fds[1] = -1;
+    }
+}
+
+static struct trace_ring *trace_thread_ring(void)
+{
+    if (t_trace_ring) {
+        return t_trace_ring;
+    }
+
+    pthread_once(&g_trace_once, trace_init_once);
+
+    // Reuse the ring of a thread that has exited before allocating a new one
+    pthread_mutex_lock(&g_trace_lock);
+    struct trace_ring *ring;
+    for (ring = g_trace_rings; ring; ring = ring->next) {
+        if (atomic_load(&ring->orphaned)) {
+            break;
+        }
+    }
+    if (!ring) {
+        ring = calloc(1, sizeof(struct trace_ring));
+        if (!ring) {
+            pthread_mutex_unlock(&g_trace_lock);
+            return NULL;
+        }
+        ring->next = g_trace_rings;
+        g_trace_rings = ring;
+    }
+    ring->tid = g_trace_next_tid++;
+    if (t_trace_thread_name[0]) {
+        memcpy(ring->thread_name, t_trace_thread_name, sizeof(ring->thread_name));
+    } else {
+        snprintf(ring->thread_name, sizeof(ring->thread_name), "thread %u", ring->tid);
+    }
+    atomic_store(&ring->head, 0);
+    atomic_store(&ring->orphaned, false);
+    pthread_mutex_unlock(&g_trace_lock);
+
+    pthread_setspecific(g_trace_key, ring);
+    t_trace_ring = ring;
+    return ring;
+}
+
+static uint64_t trace_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void trace_record(uint32_t type, const char *name, uint64_t arg)
+{
+    struct trace_ring *ring = trace_thread_ring();
+    if (!ring) {
+        return;
+    }
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    struct trace_event *event = &ring->events[head & (TRACE_RING_EVENTS - 1)];
+    event->ts_ns = trace_now_ns();
+    event->name = name;
+    event->arg = arg;
+    event->type = type;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void trace_set_enabled(bool enabled)
+{
+    pthread_once(&g_trace_once, trace_init_once);
+    atomic_store(&trace_enabled_flag, enabled);
+}
+
+void trace_set_thread_name(const char *name)
+{
+    snprintf(t_trace_thread_name, sizeof(t_trace_thread_name), "%s", name ? name : "");
+    struct trace_ring *ring = t_trace_ring;
+    if (!ring) {
+        return;  // Applied when the thread records its first event
+    }
+    pthread_mutex_lock(&g_trace_lock);
+    snprintf(ring->thread_name, sizeof(ring->thread_name), "%s", name ? name : "");
+    pthread_mutex_unlock(&g_trace_lock);
+}
+
+void trace_record_begin(const char *name)
+{
+    trace_record(TRACE_EVENT_BEGIN, name, 0);
+}
+
+void trace_record_end(const char *name)
+{
+    trace_record(TRACE_EVENT_END, name, 0);
+}
+
+void trace_record_counter(const char *name, int64_t value)
+{
+    trace_record(TRACE_EVENT_COUNTER, name, (uint64_t)value);
+}
+
+void trace_record_flow_begin(const char *name, uint64_t id)
+{
+    trace_record(TRACE_EVENT_FLOW_BEGIN, name, id);
+}
+
+void trace_record_flow_step(const char *name, uint64_t id)
+{
+    trace_record(TRACE_EVENT_FLOW_STEP, name, id);
+}
+
+void trace_record_flow_end(const char *name, uint64_t id)
+{
+    trace_record(TRACE_EVENT_FLOW_END, name, id);
+}
+
+// --- Chrome trace JSON export ---
+
+static void trace_write_json_string(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; s && *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fputc('\\', out);
+            fputc(c, out);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", (unsigned)c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// Copy the events still held by a ring, oldest first. Returns the count.
+static size_t trace_ring_snapshot(struct trace_ring *ring, struct trace_event *events)
+{
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t first = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+    for (uint64_t i = first; i < head; i++) {
+        events[i - first] = ring->events[i & (TRACE_RING_EVENTS - 1)];
+    }
+
+    // Slots the producer lapped during the copy may be torn, as may the one
+    // it is writing right now
+    uint64_t head_after = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t valid_from = head_after + 1 > TRACE_RING_EVENTS ? head_after + 1 - TRACE_RING_EVENTS : 0;
+    if (head_after < head || valid_from >= head) {
+        return 0;  // Ring was reused or lapped entirely
+    }
+    size_t skip = valid_from > first ? (size_t)(valid_from - first) : 0;
+    size_t count = (size_t)(head - first) - skip;
+    if (skip > 0) {
+        memmove(events, events + skip, count * sizeof(struct trace_event));
+    }
+    return count;
+}
+
+static int trace_write_ring(FILE *out, struct trace_ring *ring, const char *thread_name,
+                            struct trace_event *events, int pid, bool *first_record)
+{
+    size_t count = trace_ring_snapshot(ring, events);
+
+    fprintf(out, "%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":",
+            *first_record ? "" : ",", pid, ring->tid);
+    trace_write_json_string(out, thread_name);
+    fputs("}}", out);
+    *first_record = false;
+
+    int written = 0;
+    int depth = 0;
+    for (size_t i = 0; i < count; i++) {
+        const struct trace_event *event = &events[i];
+        const char *phase;
+        switch ((enum trace_event_type)event->type) {
+        case TRACE_EVENT_BEGIN:
+            phase = "B";
+            depth++;
+            break;
+        case TRACE_EVENT_END:
+            // The matching begin was overwritten
+            if (depth == 0) {
+                continue;
+            }
+            phase = "E";
+            depth--;
+            break;
+        case TRACE_EVENT_COUNTER:
+            phase = "C";
+            break;
+        case TRACE_EVENT_FLOW_BEGIN:
+            phase = "s";
+            break;
+        case TRACE_EVENT_FLOW_STEP:
+            phase = "t";
+            break;
+        case TRACE_EVENT_FLOW_END:
+            phase = "f";
+            break;
+        default:
+            continue;
+        }
+
+        fprintf(out, ",\n{\"ph\":\"%s\",\"name\":", phase);
+        trace_write_json_string(out, event->name);
+        fprintf(out, ",\"cat\":\"wawona\",\"pid\":%d,\"tid\":%u,\"ts\":%" PRIu64 ".%03u",
+                pid, ring->tid, event->ts_ns / 1000u, (unsigned)(event->ts_ns % 1000u));
+        if (event->type == TRACE_EVENT_COUNTER) {
+            fprintf(out, ",\"args\":{\"value\":%" PRId64 "}", (int64_t)event->arg);
+        } else if (event->type == TRACE_EVENT_FLOW_BEGIN ||
+                   event->type == TRACE_EVENT_FLOW_STEP ||
+                   event->type == TRACE_EVENT_FLOW_END) {
+            // Bind to the enclosing slice rather than the next one
+            fprintf(out, ",\"id\":\"0x%" PRIx64 "\",\"bp\":\"e\"", event->arg);
+        }
+        fputc('}', out);
+        written++;
+    }
+    return written;
+}
+
+int trace_export_chrome_json(const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        log_printf("[TRACE] ", "Failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    struct trace_event *events = malloc(TRACE_RING_EVENTS * sizeof(struct trace_event));
+    if (!events) {
+        fclose(out);
+        return -1;
+    }
+
+    int pid = (int)getpid();
+    int written = 0;
+    bool first_record = true;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", out);
+
+    // Rings are never freed, so the list can be walked after unlocking; only
+    // the names are copied under the lock
+    pthread_mutex_lock(&g_trace_lock);
+    struct trace_ring *rings = g_trace_rings;
+    pthread_mutex_unlock(&g_trace_lock);
+    for (struct trace_ring *ring = rings; ring; ring = ring->next) {
+        char thread_name[TRACE_THREAD_NAME_MAX];
+        pthread_mutex_lock(&g_trace_lock);
+        memcpy(thread_name, ring->thread_name, sizeof(thread_name));
+        pthread_mutex_unlock(&g_trace_lock);
+        written += trace_write_ring(out, ring, thread_name, events, pid, &first_record);
+    }
+
+    fputs("\n]}\n", out);
+    free(events);
+    if (fclose(out) != 0) {
+        log_printf("[TRACE] ", "Failed to write %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return written;
+}
+
+// --- Export on demand ---
+
+int trace_get_dump_fd(void)
+{
+    pthread_once(&g_trace_once, trace_init_once);
+    return g_dump_fds[0];
+}
+
+void trace_request_dump(void)
+{
+    int saved_errno = errno;
+    if (g_dump_fds[1] >= 0) {
+        char byte = 1;
+        ssize_t ret = write(g_dump_fds[1], &byte, 1);
+        (void)ret;
+    }
+    errno = saved_errno;
+}
+
+void trace_default_path(char *path, unsigned long size)
+{
+    const char *dir = getenv("TMPDIR");
+    if (!dir || !*dir) {
+        dir = "/tmp";
+    }
+    size_t len = strlen(dir);
+    const char *sep = (len > 0 && dir[len - 1] == '/') ? "" : "/";
+    unsigned n = atomic_fetch_add(&g_dump_count, 1);
+    snprintf(path, size, "%s%swawona-trace-%d-%u.json", dir, sep, (int)getpid(), n);
+}
+
+int trace_handle_dump_request(void)
+{
+    char buf[64];
+    while (g_dump_fds[0] >= 0 && read(g_dump_fds[0], buf, sizeof(buf)) > 0) {
+    }
+
+    char path[1024];
+    trace_default_path(path, sizeof(path));
+    int written = trace_export_chrome_json(path);
+    if (written >= 0) {
+        log_printf("[TRACE] ", "Wrote %d trace events to %s%s\n", written, path,
+                   trace_enabled() ? "" : " (recording is disabled)");
+    }
+    return written;
+}
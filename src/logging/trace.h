@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Trace recorder
+// Records scoped slices, counters and flows (e.g. a client's commit through to
+// its presentation) from the compositor hot path into per-thread ring buffers
+// and exports the most recent events as Chrome trace JSON, which loads in
+// chrome://tracing and ui.perfetto.dev.
+//
+// Recording is off by default. While disabled every trace call is a single
+// relaxed atomic load. Event names must be string literals (only the pointer
+// is stored). Each thread keeps its newest TRACE_RING_EVENTS events.
+
+extern _Atomic bool trace_enabled_flag;
+
+static inline bool
+trace_enabled(void)
+{
+    return atomic_load_explicit(&trace_enabled_flag, memory_order_relaxed);
+}
+
+void trace_set_enabled(bool enabled);
+// Thread name shown in the exported trace (defaults to "thread N")
+void trace_set_thread_name(const char *name);
+
+void trace_record_begin(const char *name);
+void trace_record_end(const char *name);
+void trace_record_counter(const char *name, int64_t value);
+// Flow arrows link slices across threads. A flow is started inside one slice,
+// may pass through others (step) and ends inside the last one.
+void trace_record_flow_begin(const char *name, uint64_t id);
+void trace_record_flow_step(const char *name, uint64_t id);
+void trace_record_flow_end(const char *name, uint64_t id);
+
+#define TRACE_BEGIN(name) \
+    do { if (trace_enabled()) trace_record_begin(name); } while (0)
+#define TRACE_END(name) \
+    do { if (trace_enabled()) trace_record_end(name); } while (0)
+#define TRACE_COUNTER(name, value) \
+    do { if (trace_enabled()) trace_record_counter(name, (int64_t)(value)); } while (0)
+#define TRACE_FLOW_BEGIN(name, id) \
+    do { if (trace_enabled()) trace_record_flow_begin(name, id); } while (0)
+#define TRACE_FLOW_STEP(name, id) \
+    do { if (trace_enabled()) trace_record_flow_step(name, id); } while (0)
+#define TRACE_FLOW_END(name, id) \
+    do { if (trace_enabled()) trace_record_flow_end(name, id); } while (0)
+
+// Slice covering the rest of the enclosing block
+struct trace_scope {
+    const char *name;
+};
+
+static inline void
+trace_scope_end(struct trace_scope *scope)
+{
+    if (scope->name) {
+        trace_record_end(scope->name);
+    }
+}
+
+static inline const char *
+trace_scope_begin(const char *name)
+{
+    if (!trace_enabled()) {
+        return NULL;
+    }
+    trace_record_begin(name);
+    return name;
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) \
+    struct trace_scope TRACE_CONCAT(trace_scope_, __LINE__) \
+        __attribute__((cleanup(trace_scope_end))) = { trace_scope_begin(name) }
+
+// Write the recorded events to path as Chrome trace JSON. Returns the number
+// of events written or -1 on error.
+int trace_export_chrome_json(const char *path);
+
+// Export on demand from a signal handler: trace_request_dump() only writes to
+// a pipe, so it is async-signal-safe. The owner of an event loop watches
+// trace_get_dump_fd() and calls trace_handle_dump_request() when it becomes
+// readable, which exports to the default path.
+int trace_get_dump_fd(void);
+void trace_request_dump(void);
+int trace_handle_dump_request(void);
+// $TMPDIR/wawona-trace-<pid>-<n>.json
+void trace_default_path(char *path, unsigned long size);
@@ -39,6 +39,19 @@ static VkFormat map_format(uint32_t format) {
         case 0x34324241: // ABGR8888 -> RGBA
         case 0x34324258: // XBGR8888 -> RGBA
             return VK_FORMAT_R8G8B8A8_UNORM;
+        case 0x30335241: // ARGB2101010
+        case 0x30335258: // XRGB2101010
+            return VK_FORMAT_A2R10G10B10_UNORM_PACK32;
+        case 0x30334241: // ABGR2101010
+        case 0x30334258: // XBGR2101010
+            return VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+        // Multi-planar YUV, sampled through a VkSamplerYcbcrConversion
+        case 0x3231564e: // NV12
+            return VK_FORMAT_G8_B8R8_2PLANE_420_UNORM;
+        case 0x30313050: // P010
+            return VK_FORMAT_G10X6_B10X6R10X6_2PLANE_420_UNORM_3PACK16;
+        case 0x32315559: // YUV420
+            return VK_FORMAT_G8_B8_R8_3PLANE_420_UNORM;
         default:
             return VK_FORMAT_R8G8B8A8_UNORM; // Fallback
     }
@@ -63,24 +76,56 @@ void metal_dmabuf_destroy_buffer(struct metal_dmabuf_buffer *buffer) {
     }
 }
 
-// Import DMA-BUF from file descriptor
-struct metal_dmabuf_buffer *metal_dmabuf_import(int fd, uint32_t width, uint32_t height, uint32_t format, uint32_t stride) {
+// Import DMA-BUF from its planes. All planes must live in the dmabuf of
+// plane 0 (as with every producer we know of); their fds are only used for
+// the layout and closed here.
+struct metal_dmabuf_buffer *metal_dmabuf_import(const struct metal_dmabuf_plane *planes, uint32_t n_planes,
+                                                uint32_t width, uint32_t height, uint32_t format) {
+    int fd = planes[0].fd;
+    for (uint32_t i = 1; i < n_planes; i++) {
+        close(planes[i].fd);
+    }
+
     if (g_device == VK_NULL_HANDLE) {
         LOGE("Cannot import DMABUF: Vulkan device not initialized");
+        close(fd);
         return NULL;
     }
 
     struct metal_dmabuf_buffer *buffer = calloc(1, sizeof(struct metal_dmabuf_buffer));
-    if (!buffer) return NULL;
+    if (!buffer) {
+        close(fd);
+        return NULL;
+    }
 
     buffer->width = width;
     buffer->height = height;
     buffer->format = format;
-    buffer->stride = stride;
+    buffer->stride = planes[0].stride;
+    buffer->n_planes = n_planes;
+    for (uint32_t i = 0; i < n_planes; i++) {
+        buffer->offsets[i] = planes[i].offset;
+        buffer->strides[i] = planes[i].stride;
+    }
+
+    // Multi-planar images need the plane offsets and strides, which only an
+    // explicit (linear) DRM format modifier can describe
+    VkSubresourceLayout plane_layouts[METAL_DMABUF_MAX_PLANES] = {0};
+    for (uint32_t i = 0; i < n_planes; i++) {
+        plane_layouts[i].offset = planes[i].offset;
+        plane_layouts[i].rowPitch = planes[i].stride;
+    }
+    VkImageDrmFormatModifierExplicitCreateInfoEXT modifier_info = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_DRM_FORMAT_MODIFIER_EXPLICIT_CREATE_INFO_EXT,
+        .drmFormatModifier = 0, // DRM_FORMAT_MOD_LINEAR
+        .drmFormatModifierPlaneCount = n_planes,
+        .pPlaneLayouts = plane_layouts,
+    };
 
     // Create VkImage
     VkExternalMemoryImageCreateInfo ext_info = {
         .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO,
+        .pNext = n_planes > 1 ? &modifier_info : NULL,
         .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
     };
 
@@ -93,14 +138,16 @@ struct metal_dmabuf_buffer *metal_dmabuf_import(int fd, uint32_t width, uint32_t
         .mipLevels = 1,
         .arrayLayers = 1,
         .samples = VK_SAMPLE_COUNT_1_BIT,
-        .tiling = VK_IMAGE_TILING_OPTIMAL, // SwiftShader/Drivers usually prefer optimal for imported DMABUFs
+        // SwiftShader/Drivers usually prefer optimal for imported single-plane DMABUFs
+        .tiling = n_planes > 1 ? VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT : VK_IMAGE_TILING_OPTIMAL,
         .usage = VK_IMAGE_USAGE_SAMPLED_BIT, // We want to sample from it
         .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
     };
 
     if (vkCreateImage(g_device, &image_info, NULL, &buffer->image) != VK_SUCCESS) {
-        LOGE("Failed to create Vulkan image for DMABUF import");
+        LOGE("Failed to create Vulkan image for DMABUF import (%u planes)", n_planes);
+        close(fd);
         free(buffer);
         return NULL;
     }
@@ -131,6 +178,7 @@ struct metal_dmabuf_buffer *metal_dmabuf_import(int fd, uint32_t width, uint32_t
 
     if (vkAllocateMemory(g_device, &alloc_info, NULL, &buffer->memory) != VK_SUCCESS) {
         LOGE("Failed to allocate memory for DMABUF import");
+        close(fd); // Only a successful import takes ownership
         vkDestroyImage(g_device, buffer->image, NULL);
         free(buffer);
         return NULL;
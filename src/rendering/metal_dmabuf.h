@@ -27,6 +27,17 @@ typedef struct __IOSurface* IOSurfaceRef;
 // DMA-BUF emulation for macOS using IOSurface
 // Allows efficient buffer sharing between processes via Metal textures
 
+// zwp_linux_dmabuf_v1 allows up to four planes per buffer
+#define METAL_DMABUF_MAX_PLANES 4
+
+// One plane as added with zwp_linux_buffer_params_v1.add
+struct metal_dmabuf_plane {
+    int fd;
+    uint32_t offset;
+    uint32_t stride;
+    uint32_t height;  // Rows in this plane (chroma planes may be subsampled)
+};
+
 struct metal_dmabuf_buffer {
 #ifdef __ANDROID__
     VkImage image;
@@ -34,13 +45,23 @@ struct metal_dmabuf_buffer {
 #else
     IOSurfaceRef iosurface;
     id texture;  // id<MTLTexture> in Objective-C
+    id plane_textures[METAL_DMABUF_MAX_PLANES];  // Per-plane views of the IOSurface
 #endif
     uint32_t width;
     uint32_t height;
     uint32_t format;
-    uint32_t stride;
+    uint32_t stride;  // Of plane 0
     void *data;
     size_t size;
+
+    // Multi-planar formats (NV12, P010, YUV420) have 2 or 3 planes
+    uint32_t n_planes;
+    uint32_t offsets[METAL_DMABUF_MAX_PLANES];
+    uint32_t strides[METAL_DMABUF_MAX_PLANES];
+    // CPU mappings of each plane (headless only), NULL elsewhere. Plane i
+    // starts at plane_maps[i] + offsets[i].
+    void *plane_maps[METAL_DMABUF_MAX_PLANES];
+    size_t plane_map_sizes[METAL_DMABUF_MAX_PLANES];
 };
 
 // Create a DMA-BUF compatible buffer using IOSurface
@@ -49,6 +70,11 @@ struct metal_dmabuf_buffer *metal_dmabuf_create_buffer(uint32_t width, uint32_t
 // Get Metal texture from DMA-BUF buffer (returns id in Objective-C, void* in C)
 id metal_dmabuf_get_texture(struct metal_dmabuf_buffer *buffer, id device);
 
+// Texture of one plane for sampling in a shader: R8/RG8 (R16/RG16 for
+// P010) for luma and chroma planes, BGRA8 or BGR10A2 for RGB formats.
+// Created once per buffer; the buffer keeps it alive.
+id metal_dmabuf_get_plane_texture(struct metal_dmabuf_buffer *buffer, id device, uint32_t plane);
+
 // Release DMA-BUF buffer
 void metal_dmabuf_destroy_buffer(struct metal_dmabuf_buffer *buffer);
 
@@ -58,6 +84,8 @@ IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t width,
 // Get file descriptor for sharing IOSurface (for waypipe)
 int metal_dmabuf_get_fd(struct metal_dmabuf_buffer *buffer);
 
-// Import DMA-BUF buffer from file descriptor (socket with IOSurface ID)
-struct metal_dmabuf_buffer *metal_dmabuf_import(int fd, uint32_t width, uint32_t height, uint32_t format, uint32_t stride);
+// Import DMA-BUF buffer from its planes (on Apple platforms each fd is a
+// socket carrying the IOSurface ID). Takes ownership of every plane fd.
+struct metal_dmabuf_buffer *metal_dmabuf_import(const struct metal_dmabuf_plane *planes, uint32_t n_planes,
+                                                uint32_t width, uint32_t height, uint32_t format);
 
@@ -12,6 +12,16 @@
 // DMA-BUF emulation for macOS using IOSurface
 // This allows efficient buffer sharing between processes (like waypipe)
 
+// DRM fourcc codes of the formats with their own plane layout (this file is
+// also built into libgbm, so it does not use pixel_convert.h)
+#define METAL_DMABUF_FORMAT_NV12 0x3231564eu         // 'NV12'
+#define METAL_DMABUF_FORMAT_P010 0x30313050u         // 'P010'
+#define METAL_DMABUF_FORMAT_YUV420 0x32315559u       // 'YU12'
+#define METAL_DMABUF_FORMAT_ARGB2101010 0x30335241u  // 'AR30'
+#define METAL_DMABUF_FORMAT_XRGB2101010 0x30335258u  // 'XR30'
+#define METAL_DMABUF_FORMAT_ABGR2101010 0x30334241u  // 'AB30'
+#define METAL_DMABUF_FORMAT_XBGR2101010 0x30334258u  // 'XB30'
+
 struct metal_dmabuf_buffer *metal_dmabuf_create_buffer(uint32_t width, uint32_t height, uint32_t format) {
     struct metal_dmabuf_buffer *buffer = calloc(1, sizeof(*buffer));
     if (!buffer) return NULL;
@@ -46,14 +56,7 @@ id<MTLTexture> metal_dmabuf_get_texture(struct metal_dmabuf_buffer *buffer, id<M
     if (!buffer || !buffer->iosurface || !device) return nil;
     
     // Create Metal texture from IOSurface
-    MTLTextureDescriptor *textureDescriptor = [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:MTLPixelFormatBGRA8Unorm
-                                                                                                  width:buffer->width
-                                                                                                 height:buffer->height
-                                                                                              mipmapped:NO];
-    textureDescriptor.usage = MTLTextureUsageShaderRead | MTLTextureUsageRenderTarget;
-    textureDescriptor.storageMode = MTLStorageModeShared;
-    
-    id<MTLTexture> texture = [device newTextureWithDescriptor:textureDescriptor iosurface:buffer->iosurface plane:0];
+    id<MTLTexture> texture = metal_dmabuf_get_plane_texture(buffer, device, 0);
     
     if (texture) {
         buffer->texture = texture;
@@ -65,12 +68,62 @@ id<MTLTexture> metal_dmabuf_get_texture(struct metal_dmabuf_buffer *buffer, id<M
     return texture;
 }
 
+// Metal format of one plane. Luma and chroma planes are sampled as
+// normalized channels and converted to RGB in the fragment shader.
+static MTLPixelFormat metal_dmabuf_plane_format(uint32_t format, uint32_t plane) {
+    switch (format) {
+        case METAL_DMABUF_FORMAT_NV12:
+            return plane == 0 ? MTLPixelFormatR8Unorm : MTLPixelFormatRG8Unorm;
+        case METAL_DMABUF_FORMAT_P010:
+            return plane == 0 ? MTLPixelFormatR16Unorm : MTLPixelFormatRG16Unorm;
+        case METAL_DMABUF_FORMAT_YUV420:
+            return MTLPixelFormatR8Unorm;
+        case METAL_DMABUF_FORMAT_ARGB2101010:
+        case METAL_DMABUF_FORMAT_XRGB2101010:
+            return MTLPixelFormatBGR10A2Unorm;
+        case METAL_DMABUF_FORMAT_ABGR2101010:
+        case METAL_DMABUF_FORMAT_XBGR2101010:
+            return MTLPixelFormatRGB10A2Unorm;
+        default:
+            return MTLPixelFormatBGRA8Unorm;
+    }
+}
+
+id<MTLTexture> metal_dmabuf_get_plane_texture(struct metal_dmabuf_buffer *buffer, id<MTLDevice> device, uint32_t plane) {
+    if (!buffer || !buffer->iosurface || !device || plane >= METAL_DMABUF_MAX_PLANES) return nil;
+    if (buffer->plane_textures[plane]) return buffer->plane_textures[plane];
+    
+    // Single-plane IOSurfaces report a plane count of 0
+    size_t planeCount = IOSurfaceGetPlaneCount(buffer->iosurface);
+    NSUInteger width = planeCount > 0 ? IOSurfaceGetWidthOfPlane(buffer->iosurface, plane) : buffer->width;
+    NSUInteger height = planeCount > 0 ? IOSurfaceGetHeightOfPlane(buffer->iosurface, plane) : buffer->height;
+    if (plane > 0 && plane >= planeCount) return nil;
+    
+    MTLTextureDescriptor *textureDescriptor = [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:metal_dmabuf_plane_format(buffer->format, plane)
+                                                                                                  width:width
+                                                                                                 height:height
+                                                                                              mipmapped:NO];
+    textureDescriptor.usage = MTLTextureUsageShaderRead;
+    textureDescriptor.storageMode = MTLStorageModeShared;
+    
+    id<MTLTexture> texture = [device newTextureWithDescriptor:textureDescriptor iosurface:buffer->iosurface plane:plane];
+    if (!texture) {
+        NSLog(@"❌ Failed to create Metal texture for plane %u of IOSurface", plane);
+        return nil;
+    }
+    buffer->plane_textures[plane] = texture;
+    return texture;
+}
+
 void metal_dmabuf_destroy_buffer(struct metal_dmabuf_buffer *buffer) {
     if (!buffer) return;
     
     if (buffer->texture) {
         buffer->texture = nil;
     }
+    for (uint32_t i = 0; i < METAL_DMABUF_MAX_PLANES; i++) {
+        buffer->plane_textures[i] = nil;
+    }
     
     if (buffer->iosurface) {
         CFRelease(buffer->iosurface);
@@ -146,15 +199,37 @@ int metal_dmabuf_get_fd(struct metal_dmabuf_buffer *buffer) {
     return fds[0];
 }
 
-struct metal_dmabuf_buffer *metal_dmabuf_import(int fd, uint32_t width, uint32_t height, uint32_t format, uint32_t stride) {
-    if (fd < 0) return NULL;
-    
-    uint64_t surfaceID = 0;
-    ssize_t n = read(fd, &surfaceID, sizeof(surfaceID));
+static BOOL metal_dmabuf_read_surface_id(int fd, uint64_t *surfaceID) {
+    ssize_t n = read(fd, surfaceID, sizeof(*surfaceID));
     close(fd);
-    
-    if (n != sizeof(surfaceID)) {
+    if (n != sizeof(*surfaceID)) {
         NSLog(@"❌ Failed to read IOSurface ID from socket: %zd bytes read", n);
+        return NO;
+    }
+    return YES;
+}
+
+struct metal_dmabuf_buffer *metal_dmabuf_import(const struct metal_dmabuf_plane *planes, uint32_t n_planes,
+                                                uint32_t width, uint32_t height, uint32_t format) {
+    if (n_planes == 0 || n_planes > METAL_DMABUF_MAX_PLANES) return NULL;
+    
+    // Every plane fd carries the ID of the same IOSurface, whose planes hold
+    // the luma and chroma data (kCVPixelFormatType_420YpCbCr8BiPlanar and
+    // friends for NV12, P010 and YUV420)
+    uint64_t surfaceID = 0;
+    BOOL ok = YES;
+    for (uint32_t i = 0; i < n_planes; i++) {
+        uint64_t planeSurfaceID = 0;
+        if (!metal_dmabuf_read_surface_id(planes[i].fd, &planeSurfaceID)) {
+            ok = NO;
+        } else if (i == 0) {
+            surfaceID = planeSurfaceID;
+        } else if (planeSurfaceID != surfaceID) {
+            NSLog(@"❌ dmabuf plane %u refers to IOSurface %llu, plane 0 to %llu", i, planeSurfaceID, surfaceID);
+            ok = NO;
+        }
+    }
+    if (!ok) {
         return NULL;
     }
     
@@ -164,6 +239,12 @@ struct metal_dmabuf_buffer *metal_dmabuf_import(int fd, uint32_t width, uint32_t
         return NULL;
     }
     
+    if (n_planes > 1 && IOSurfaceGetPlaneCount(iosurface) < n_planes) {
+        NSLog(@"❌ IOSurface %llu has %zu planes, dmabuf has %u", surfaceID, IOSurfaceGetPlaneCount(iosurface), n_planes);
+        CFRelease(iosurface);
+        return NULL;
+    }
+    
     struct metal_dmabuf_buffer *buffer = calloc(1, sizeof(*buffer));
     if (!buffer) {
         CFRelease(iosurface);
@@ -174,8 +255,13 @@ struct metal_dmabuf_buffer *metal_dmabuf_import(int fd, uint32_t width, uint32_t
     buffer->width = width;
     buffer->height = height;
     buffer->format = format;
-    buffer->stride = stride;
+    buffer->stride = planes[0].stride;
+    buffer->n_planes = n_planes;
+    for (uint32_t i = 0; i < n_planes; i++) {
+        buffer->offsets[i] = planes[i].offset;
+        buffer->strides[i] = planes[i].stride;
+    }
     
-    NSLog(@"✅ Imported IOSurface DMA-BUF buffer: %dx%d (ID: %llu)", width, height, surfaceID);
+    NSLog(@"✅ Imported IOSurface DMA-BUF buffer: %dx%d, %u planes (ID: %llu)", width, height, n_planes, surfaceID);
     return buffer;
 }
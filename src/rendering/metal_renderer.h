@@ -14,13 +14,16 @@
 
 @class MetalSurface;
 @class VulkanRenderer;
+struct texture_pool_stats;
 
 @interface MetalRenderer : NSObject <MTKViewDelegate, RenderingBackend>
 
 @property (nonatomic, strong) MTKView *metalView;
 @property (nonatomic, strong) id<MTLDevice> device;
 @property (nonatomic, strong) id<MTLCommandQueue> commandQueue;
-@property (nonatomic, strong) id<MTLRenderPipelineState> pipelineState;
+@property (nonatomic, strong) id<MTLRenderPipelineState> pipelineState;  // No blending: opaque areas
+@property (nonatomic, strong) id<MTLRenderPipelineState> blendPipelineState;  // Premultiplied alpha over
+@property (nonatomic, strong) id<MTLRenderPipelineState> yuvPipelineState;  // Multi-planar YUV dmabufs
 @property (nonatomic, strong) NSMutableDictionary<NSNumber *, MetalSurface *> *surfaceTextures;
 @property (nonatomic, assign) struct metal_waypipe_context *waypipeContext;
 @property (nonatomic, strong) VulkanRenderer *vulkanRenderer;
@@ -29,6 +32,8 @@
 - (void)renderSurface:(struct wl_surface_impl *)surface;
 - (void)removeSurface:(struct wl_surface_impl *)surface;
 - (void)setNeedsDisplay;
+// Hit rate and resident bytes of the texture pool (texture_pool.h)
+- (void)getTexturePoolStats:(struct texture_pool_stats *)stats;
 #if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
 - (void)drawSurfacesInRect:(CGRect)dirtyRect;
 #else
@@ -37,3 +42,7 @@
 
 @end
 
+// Add and remove the wl_buffer destroy listeners of the texture cache
+// queued by the main thread. Event thread only, after surfaces were rendered.
+void metal_renderer_sync_buffer_listeners(void);
+
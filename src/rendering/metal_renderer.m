@@ -11,15 +11,39 @@
 #import <IOSurface/IOSurface.h>
 #endif
 #import <simd/simd.h>
+#include <pthread.h>
 #include "WawonaCompositor.h"
+#include "presentation-time-protocol.h"
 #include "logging.h"
+#include "pixel_convert.h"
+#include "scene.h"
+#include "texture_pool.h"
+#include "trace.h"
 #include "wayland_color_management.h"
-#include "wayland_viewporter.h"
+#include "wayland_linux_dmabuf.h"
 
-// Forward declaration
-#if !TARGET_OS_IPHONE && !TARGET_OS_SIMULATOR
-extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t width, uint32_t height, uint32_t stride, uint32_t format);
-#endif
+// Report a drawable's presentation time (CACurrentMediaTime base) to the
+// compositor on CLOCK_MONOTONIC, which frame callbacks and presentation
+// feedback are stamped with
+static void metal_report_presented(uint64_t frameSeq, CFTimeInterval presentedTime) {
+    if (presentedTime <= 0) {
+        return;  // Drawable was dropped, not presented
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t age_ns = (int64_t)((CACurrentMediaTime() - presentedTime) * 1e9);
+    int64_t now_ns = (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+    int64_t when_ns = now_ns - (age_ns > 0 ? age_ns : 0);
+    struct timespec when = {
+        .tv_sec = (time_t)(when_ns / 1000000000LL),
+        .tv_nsec = (long)(when_ns % 1000000000LL),
+    };
+    // Timestamp comes from the display hardware at scanout
+    wl_compositor_frame_presented(frameSeq, &when,
+                                  WP_PRESENTATION_FEEDBACK_KIND_VSYNC |
+                                  WP_PRESENTATION_FEEDBACK_KIND_HW_CLOCK |
+                                  WP_PRESENTATION_FEEDBACK_KIND_HW_COMPLETION);
+}
 
 // Custom MTKView subclass that allows window dragging
 @interface CompositorMTKView : MTKView
@@ -49,9 +73,21 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
 // Metal renderer implementation for full compositor rendering
 // Used when forwarding entire compositor (like Weston) via waypipe
 
-@interface MetalSurface : NSObject
+@class MetalBufferTexture;
+
+@interface MetalSurface : NSObject {
+@public
+    pixman_region32_t opaqueRegion;  // From the draw list, surface coordinates
+}
 @property (nonatomic, strong) id<MTLTexture> texture;  // Changed to strong for proper retention
+@property (nonatomic, strong) MetalBufferTexture *bufferTexture;  // Keeps texture out of the pool while shown
+@property (nonatomic, strong) NSArray<id<MTLTexture>> *chromaTextures;  // YUV dmabufs: texture is the luma plane
+@property (nonatomic, assign) uint32_t yuvFormat;  // Non-zero: drawn with yuvPipelineState
 @property (nonatomic, assign) CGRect frame;
+@property (nonatomic, assign) CGPoint origin;  // Output position from the compositor's draw list
+@property (nonatomic, assign) BOOL fillsView;  // Stretched over the view, origin is ignored
+@property (nonatomic, assign) BOOL frameIsSurfaceSized;  // Unscaled: opaqueRegion maps onto frame
+@property (nonatomic, assign) CGRect source;  // Buffer pixels shown (viewport crop), empty until listed
 @property (nonatomic, assign) struct wl_surface_impl *surface;
 @property (nonatomic, assign) void *lastBufferData;  // Track buffer to avoid unnecessary recreations
 @property (nonatomic, assign) int32_t lastWidth;
@@ -62,10 +98,37 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
 @property (nonatomic, assign) float u1;
 @property (nonatomic, assign) float vTop;
 @property (nonatomic, assign) float vBottom;
+- (void)updateTextureCoordinates;
 @end
 
 @implementation MetalSurface
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        pixman_region32_init(&opaqueRegion);
+    }
+    return self;
+}
+
+// Texture coordinates of the source box. Pooled textures may be larger than
+// the buffer, so they are relative to the texture size.
+- (void)updateTextureCoordinates {
+    id<MTLTexture> texture = self.texture;
+    if (!texture || texture.width == 0 || texture.height == 0) {
+        return;
+    }
+    CGRect source = self.source;
+    if (CGRectIsEmpty(source)) {
+        source = CGRectMake(0, 0, self.lastWidth, self.lastHeight);
+    }
+    self.u0 = (float)(CGRectGetMinX(source) / texture.width);
+    self.u1 = (float)(CGRectGetMaxX(source) / texture.width);
+    self.vTop = (float)(CGRectGetMinY(source) / texture.height);
+    self.vBottom = (float)(CGRectGetMaxY(source) / texture.height);
+}
+
 - (void)dealloc {
+    pixman_region32_fini(&opaqueRegion);
     if (_colorSpace) {
         CGColorSpaceRelease(_colorSpace);
     }
@@ -75,7 +138,280 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
 }
 @end
 
-@implementation MetalRenderer
+// Textures come from a size-bucketed pool (texture_pool.h), so resizing a
+// window reuses textures instead of allocating new ones
+#define METAL_TEXTURE_POOL_BUDGET (256u * 1024u * 1024u)
+
+// Matches YUVParams in metal_shaders.metal
+typedef struct {
+    float lumaOffset;
+    float chromaOffset;
+    float sampleScale;
+    uint32_t planeCount;
+} MetalYUVParams;
+
+static MetalYUVParams metal_yuv_params(uint32_t format, uint32_t planeCount) {
+    MetalYUVParams params = {16.0f / 255.0f, 128.0f / 255.0f, 1.0f, planeCount};
+    if (format == PIXEL_FORMAT_P010) {
+        // 10 bits in the high bits of each 16-bit sample
+        params.lumaOffset = 64.0f / 1023.0f;
+        params.chromaOffset = 512.0f / 1023.0f;
+        params.sampleScale = 65535.0f / 65472.0f;
+    }
+    return params;
+}
+
+// Position (normalized device coordinates) and texture coordinate
+typedef struct {
+    simd_float2 position;
+    simd_float2 texCoord;
+} MetalVertex;
+
+// Output rectangle (points) a surface is drawn at. A frame within a point
+// of the view size covers the whole view (nested compositors).
+static CGRect metal_surface_draw_frame(CGRect frame, CGSize viewSize) {
+    if (fabs(frame.size.width - viewSize.width) < 1.0 &&
+        fabs(frame.size.height - viewSize.height) < 1.0) {
+        return CGRectMake(0, 0, viewSize.width, viewSize.height);
+    }
+    return frame;
+}
+
+// Two triangles per rectangle (output points, clipped to the frame). The
+// texture coordinates are interpolated over the frame, so each rectangle
+// samples the part of the texture it covers. Returns the vertex count.
+static NSUInteger metal_append_rects(MetalVertex *out, const pixman_box32_t *rects, int nRects,
+                                     CGRect frame, CGSize viewSize, MetalSurface *metalSurface) {
+    float du = (metalSurface.u1 - metalSurface.u0) / (float)frame.size.width;
+    float dv = (metalSurface.vBottom - metalSurface.vTop) / (float)frame.size.height;
+    NSUInteger count = 0;
+    for (int i = 0; i < nRects; i++) {
+        CGFloat left = MAX(rects[i].x1, CGRectGetMinX(frame));
+        CGFloat right = MIN(rects[i].x2, CGRectGetMaxX(frame));
+        CGFloat top = MAX(rects[i].y1, CGRectGetMinY(frame));
+        CGFloat bottom = MIN(rects[i].y2, CGRectGetMaxY(frame));
+        if (left >= right || top >= bottom) {
+            continue;
+        }
+        // Wayland uses a top-left origin, Metal NDC a bottom-left one
+        float x0 = (float)(left / viewSize.width) * 2.0f - 1.0f;
+        float x1 = (float)(right / viewSize.width) * 2.0f - 1.0f;
+        float y0 = 1.0f - (float)(top / viewSize.height) * 2.0f;
+        float y1 = 1.0f - (float)(bottom / viewSize.height) * 2.0f;
+        float u0 = metalSurface.u0 + (float)(left - frame.origin.x) * du;
+        float u1 = metalSurface.u0 + (float)(right - frame.origin.x) * du;
+        float v0 = metalSurface.vTop + (float)(top - frame.origin.y) * dv;
+        float v1 = metalSurface.vTop + (float)(bottom - frame.origin.y) * dv;
+
+        MetalVertex quad[6] = {
+            {simd_make_float2(x0, y0), simd_make_float2(u0, v0)},
+            {simd_make_float2(x1, y0), simd_make_float2(u1, v0)},
+            {simd_make_float2(x0, y1), simd_make_float2(u0, v1)},
+            {simd_make_float2(x1, y0), simd_make_float2(u1, v0)},
+            {simd_make_float2(x1, y1), simd_make_float2(u1, v1)},
+            {simd_make_float2(x0, y1), simd_make_float2(u0, v1)},
+        };
+        memcpy(&out[count], quad, sizeof(quad));
+        count += 6;
+    }
+    return count;
+}
+
+static void *metal_pool_create_texture(void *user_data, uint32_t format, int32_t width, int32_t height) {
+    id<MTLDevice> device = (__bridge id<MTLDevice>)user_data;
+    MTLTextureDescriptor *descriptor =
+        [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:(MTLPixelFormat)format
+                                                           width:width
+                                                          height:height
+                                                       mipmapped:NO];
+    descriptor.usage = MTLTextureUsageShaderRead;
+    id<MTLTexture> texture = [device newTextureWithDescriptor:descriptor];
+    return texture ? (__bridge_retained void *)texture : NULL;
+}
+
+static void metal_pool_destroy_texture(void *user_data, void *texture) {
+    CFRelease(texture);
+}
+
+static const struct texture_pool_ops metal_pool_ops = {
+    .create = metal_pool_create_texture,
+    .destroy = metal_pool_destroy_texture,
+};
+
+// Texture cache keyed by wl_buffer. Double- and triple-buffering clients
+// alternate between a few buffers; each keeps its own texture, which is
+// brought up to date with the damage committed since that buffer was last
+// uploaded. Entries go away with the buffer (destroy listener), the surface,
+// or when a surface holds more than METAL_BUFFER_CACHE_MAX_PER_SURFACE.
+#define METAL_BUFFER_CACHE_MAX_PER_SURFACE 4
+
+// The buffer's destroy signal is emitted on the event thread, so its
+// listener is only added and removed there: entries are created and dropped
+// on the main thread, which queues the change in g_buffer_refs_pending for
+// metal_renderer_sync_buffer_listeners(). A ref is freed by whichever side
+// lets go of it last.
+enum metal_buffer_ref_state {
+    METAL_BUFFER_REF_ATTACH,     // Listener to be added (pending)
+    METAL_BUFFER_REF_LISTENING,  // Listener added, entry alive
+    METAL_BUFFER_REF_DETACH,     // Entry dropped, listener to be removed (pending)
+    METAL_BUFFER_REF_ORPHANED,   // No listener: the entry must not be reused
+};
+
+struct metal_buffer_ref {
+    struct wl_listener destroy_listener;
+    struct wl_list pending_link;  // g_buffer_refs_pending (ATTACH, DETACH)
+    enum metal_buffer_ref_state state;
+    struct wl_resource *buffer;
+    struct wl_surface_impl *surface;  // Surface the buffer was committed to
+    uint32_t commit_seq;              // Commit of surface that was rendered
+    void *renderer;  // MetalRenderer (unretained; drops all refs in dealloc)
+};
+
+static pthread_mutex_t g_buffer_refs_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct wl_list g_buffer_refs_pending = {&g_buffer_refs_pending, &g_buffer_refs_pending};
+
+// Entry side (main thread): drop the ref of an entry leaving the cache
+static void metal_buffer_ref_release(struct metal_buffer_ref *ref) {
+    pthread_mutex_lock(&g_buffer_refs_lock);
+    switch (ref->state) {
+    case METAL_BUFFER_REF_ATTACH:
+        wl_list_remove(&ref->pending_link);
+        free(ref);
+        break;
+    case METAL_BUFFER_REF_LISTENING:
+        ref->state = METAL_BUFFER_REF_DETACH;
+        wl_list_insert(g_buffer_refs_pending.prev, &ref->pending_link);
+        break;
+    case METAL_BUFFER_REF_ORPHANED:
+        free(ref);
+        break;
+    case METAL_BUFFER_REF_DETACH:
+    default:
+        break;
+    }
+    pthread_mutex_unlock(&g_buffer_refs_lock);
+}
+
+// Whether the entry's buffer may be gone without its destroy listener
+// having run, so its address could belong to a new buffer
+static BOOL metal_buffer_ref_is_orphaned(struct metal_buffer_ref *ref) {
+    pthread_mutex_lock(&g_buffer_refs_lock);
+    BOOL orphaned = ref->state == METAL_BUFFER_REF_ORPHANED;
+    pthread_mutex_unlock(&g_buffer_refs_lock);
+    return orphaned;
+}
+
+@interface MetalBufferTexture : NSObject {
+@public
+    pixman_region32_t staleDamage;  // Buffer damage committed since the last upload
+}
+@property (nonatomic, strong) id<MTLTexture> texture;  // At least width x height (pool bucket)
+@property (nonatomic, assign) struct texture_pool *pool;
+@property (nonatomic, assign) struct texture_pool_texture *pooled;  // Returned to pool on dealloc
+@property (nonatomic, assign) struct wl_surface_impl *surface;
+@property (nonatomic, assign) int32_t width;
+@property (nonatomic, assign) int32_t height;
+@property (nonatomic, assign) uint32_t format;
+@property (nonatomic, assign) uint64_t lastUsed;
+@property (nonatomic, assign) struct metal_buffer_ref *ref;
+// Called when the entry leaves the cache: a surface (MetalSurface) may keep
+// showing its texture after that, but not the buffer's destroy listener
+- (void)releaseRef;
+@end
+
+@implementation MetalBufferTexture
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        pixman_region32_init(&staleDamage);
+    }
+    return self;
+}
+
+- (void)releaseRef {
+    if (_ref) {
+        metal_buffer_ref_release(_ref);
+        _ref = NULL;
+    }
+}
+
+- (void)dealloc {
+    pixman_region32_fini(&staleDamage);
+    _texture = nil;
+    texture_pool_release(_pool, _pooled);
+    [self releaseRef];
+#if !__has_feature(objc_arc)
+    [super dealloc];
+#endif
+}
+@end
+
+@interface MetalRenderer ()
+- (void)forgetBuffer:(struct wl_resource *)buffer;
+@end
+
+// Runs on the event thread when the client destroys the buffer
+static void metal_buffer_handle_destroy(struct wl_listener *listener, void *data) {
+    (void)data;
+    struct metal_buffer_ref *ref = wl_container_of(listener, ref, destroy_listener);
+    pthread_mutex_lock(&g_buffer_refs_lock);
+    wl_list_remove(&ref->destroy_listener.link);
+    if (ref->state == METAL_BUFFER_REF_DETACH) {
+        // The entry is gone already (and maybe the renderer with it)
+        wl_list_remove(&ref->pending_link);
+        pthread_mutex_unlock(&g_buffer_refs_lock);
+        free(ref);
+        return;
+    }
+    ref->state = METAL_BUFFER_REF_ORPHANED;
+    struct wl_resource *buffer = ref->buffer;
+    MetalRenderer *renderer = (__bridge MetalRenderer *)ref->renderer;
+    pthread_mutex_unlock(&g_buffer_refs_lock);
+    [renderer forgetBuffer:buffer];
+}
+
+void metal_renderer_sync_buffer_listeners(void) {
+    pthread_mutex_lock(&g_buffer_refs_lock);
+    struct metal_buffer_ref *ref, *tmp;
+    wl_list_for_each_safe(ref, tmp, &g_buffer_refs_pending, pending_link) {
+        wl_list_remove(&ref->pending_link);
+        if (ref->state == METAL_BUFFER_REF_DETACH) {
+            wl_list_remove(&ref->destroy_listener.link);
+            free(ref);
+        } else if (ref->surface->commit_seq == ref->commit_seq &&
+                   ref->surface->buffer_resource == ref->buffer) {
+            // Still attached by the commit rendered, so alive: the compositor
+            // clears buffer_resource on the event thread before a buffer is
+            // freed. Removing the entry releases the ref before its surface
+            // goes away.
+            ref->destroy_listener.notify = metal_buffer_handle_destroy;
+            wl_resource_add_destroy_listener(ref->buffer, &ref->destroy_listener);
+            ref->state = METAL_BUFFER_REF_LISTENING;
+        } else {
+            // Committed again since it was rendered: the buffer may be gone
+            // and its address reused, so it cannot be touched, and the entry
+            // is dropped on its next lookup
+            ref->state = METAL_BUFFER_REF_ORPHANED;
+        }
+    }
+    pthread_mutex_unlock(&g_buffer_refs_lock);
+}
+
+@implementation MetalRenderer {
+    // Scratch for buffers converted to BGRA8 on upload (see pixel_convert.h)
+    uint8_t *_convertBuffer;
+    size_t _convertBufferSize;
+    // MetalBufferTexture by wl_buffer resource pointer
+    NSMutableDictionary<NSNumber *, MetalBufferTexture *> *_bufferTextures;
+    uint64_t _bufferTextureClock;
+    struct texture_pool *_texturePool;
+    // Surfaces in paint order, rebuilt from the compositor's draw list when
+    // its generation changes or a surface gains or loses its texture entry
+    NSArray<MetalSurface *> *_drawOrder;
+    uint32_t _drawListGeneration;
+    // Culling pass of the last frame (main thread)
+    struct scene _scene;
+}
 
 - (instancetype)initWithMetalView:(MTKView *)view {
     self = [super init];
@@ -89,6 +425,8 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
         
         _metalView.device = _device;
         _metalView.delegate = self;
+        _texturePool = texture_pool_create(&metal_pool_ops, (__bridge void *)_device, METAL_TEXTURE_POOL_BUDGET);
+        scene_init(&_scene);
         
         // Initialize Vulkan renderer if enabled and available
 #if HAVE_VULKAN
@@ -216,17 +554,9 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
             pipelineDescriptor.vertexFunction = vertexFunction;
             pipelineDescriptor.fragmentFunction = fragmentFunction;
             pipelineDescriptor.colorAttachments[0].pixelFormat = _metalView.colorPixelFormat;
-            // For nested compositors, surfaces are typically opaque - disable blending for better performance
-            // and to prevent white artifacts from blending with clear color
+            // Opaque areas (see scene.h) are drawn without blending; the
+            // blended variant below is used only where a surface has alpha
             pipelineDescriptor.colorAttachments[0].blendingEnabled = NO;
-            // If blending is needed later, use these settings:
-            // pipelineDescriptor.colorAttachments[0].blendingEnabled = YES;
-            // pipelineDescriptor.colorAttachments[0].rgbBlendOperation = MTLBlendOperationAdd;
-            // pipelineDescriptor.colorAttachments[0].alphaBlendOperation = MTLBlendOperationAdd;
-            // pipelineDescriptor.colorAttachments[0].sourceRGBBlendFactor = MTLBlendFactorOne;
-            // pipelineDescriptor.colorAttachments[0].sourceAlphaBlendFactor = MTLBlendFactorOne;
-            // pipelineDescriptor.colorAttachments[0].destinationRGBBlendFactor = MTLBlendFactorZero;
-            // pipelineDescriptor.colorAttachments[0].destinationAlphaBlendFactor = MTLBlendFactorZero;
             
             // Configure vertex descriptor to match our vertex layout
             MTLVertexDescriptor *vertexDescriptor = [[MTLVertexDescriptor alloc] init];
@@ -252,6 +582,32 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
             } else {
                 NSLog(@"✅ Metal render pipeline created successfully");
             }
+            
+            // Premultiplied alpha over, for the non-opaque parts of surfaces
+            pipelineDescriptor.colorAttachments[0].blendingEnabled = YES;
+            pipelineDescriptor.colorAttachments[0].rgbBlendOperation = MTLBlendOperationAdd;
+            pipelineDescriptor.colorAttachments[0].alphaBlendOperation = MTLBlendOperationAdd;
+            pipelineDescriptor.colorAttachments[0].sourceRGBBlendFactor = MTLBlendFactorOne;
+            pipelineDescriptor.colorAttachments[0].sourceAlphaBlendFactor = MTLBlendFactorOne;
+            pipelineDescriptor.colorAttachments[0].destinationRGBBlendFactor = MTLBlendFactorOneMinusSourceAlpha;
+            pipelineDescriptor.colorAttachments[0].destinationAlphaBlendFactor = MTLBlendFactorOneMinusSourceAlpha;
+            _blendPipelineState = [_device newRenderPipelineStateWithDescriptor:pipelineDescriptor error:&error];
+            if (!_blendPipelineState) {
+                NSLog(@"⚠️ Failed to create blend pipeline state: %@", error);
+            }
+            pipelineDescriptor.colorAttachments[0].blendingEnabled = NO;
+            
+            // Same pipeline with the YUV to RGB fragment shader for dmabufs
+            id<MTLFunction> yuvFunction = [library newFunctionWithName:@"fragmentShaderYUV"];
+            if (yuvFunction) {
+                pipelineDescriptor.fragmentFunction = yuvFunction;
+                _yuvPipelineState = [_device newRenderPipelineStateWithDescriptor:pipelineDescriptor error:&error];
+                if (!_yuvPipelineState) {
+                    NSLog(@"⚠️ Failed to create YUV pipeline state: %@", error);
+                }
+            } else {
+                NSLog(@"⚠️ fragmentShaderYUV function not found in Metal library");
+            }
         } else {
             NSLog(@"⚠️ Shader functions not found - using basic rendering");
             // Will use basic rendering without shaders
@@ -287,13 +643,157 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
     // Clear surfaces
     @synchronized(self) {
         _surfaceTextures = nil;
+        for (MetalBufferTexture *entry in [_bufferTextures objectEnumerator]) {
+            [entry releaseRef];
+        }
+        _bufferTextures = nil;
+        texture_pool_destroy(_texturePool);
+        _texturePool = NULL;
+        free(_convertBuffer);
+        _convertBuffer = NULL;
+        _convertBufferSize = 0;
     }
+    scene_fini(&_scene);
     
 #if !__has_feature(objc_arc)
     [super dealloc];
 #endif
 }
 
+// Grow-only scratch buffer; caller holds @synchronized(self)
+- (uint8_t *)convertBufferOfSize:(size_t)size {
+    if (size > _convertBufferSize) {
+        uint8_t *buffer = realloc(_convertBuffer, size);
+        if (!buffer) {
+            return NULL;
+        }
+        _convertBuffer = buffer;
+        _convertBufferSize = size;
+    }
+    return _convertBuffer;
+}
+
+// The cache methods below are called with @synchronized(self) held (the
+// destroy listener takes it itself)
+- (void)dropBufferTextureForKey:(NSNumber *)key {
+    [_bufferTextures[key] releaseRef];
+    [_bufferTextures removeObjectForKey:key];
+}
+
+- (void)forgetBuffer:(struct wl_resource *)buffer {
+    @synchronized(self) {
+        [self dropBufferTextureForKey:@((uintptr_t)buffer)];
+    }
+}
+
+// Fold this commit's damage into every cached buffer of the surface and
+// return the up-to-date-able texture of buffer, or nil if it has none of
+// the right geometry
+- (MetalBufferTexture *)bufferTextureFor:(struct wl_resource *)buffer
+                                 surface:(struct wl_surface_impl *)surface
+                                   width:(int32_t)width
+                                  height:(int32_t)height
+                                  format:(uint32_t)format
+                                  damage:(const pixman_region32_t *)damage {
+    for (MetalBufferTexture *entry in [_bufferTextures objectEnumerator]) {
+        if (entry.surface == surface) {
+            pixman_region32_union(&entry->staleDamage, &entry->staleDamage, damage);
+        }
+    }
+    NSNumber *key = @((uintptr_t)buffer);
+    MetalBufferTexture *entry = _bufferTextures[key];
+    if (entry && (entry.surface != surface || entry.width != width || entry.height != height ||
+                  entry.format != format || !entry.ref || metal_buffer_ref_is_orphaned(entry.ref))) {
+        [self dropBufferTextureForKey:key];
+        entry = nil;
+    }
+    entry.lastUsed = ++_bufferTextureClock;
+    return entry;
+}
+
+- (MetalBufferTexture *)cacheTexture:(struct texture_pool_texture *)pooled
+                          forBuffer:(struct wl_resource *)buffer
+             surface:(struct wl_surface_impl *)surface
+               width:(int32_t)width
+              height:(int32_t)height
+              format:(uint32_t)format {
+    if (!_bufferTextures) {
+        _bufferTextures = [[NSMutableDictionary alloc] init];
+    }
+
+    // Evict the least recently used buffer of a surface that keeps switching
+    NSUInteger count = 0;
+    NSNumber *oldestKey = nil;
+    uint64_t oldest = UINT64_MAX;
+    for (NSNumber *key in _bufferTextures) {
+        MetalBufferTexture *entry = _bufferTextures[key];
+        if (entry.surface == surface) {
+            count++;
+            if (entry.lastUsed < oldest) {
+                oldest = entry.lastUsed;
+                oldestKey = key;
+            }
+        }
+    }
+    if (count >= METAL_BUFFER_CACHE_MAX_PER_SURFACE && oldestKey) {
+        [self dropBufferTextureForKey:oldestKey];
+    }
+
+    MetalBufferTexture *entry = [[MetalBufferTexture alloc] init];
+    entry.texture = (__bridge id<MTLTexture>)pooled->texture;
+    entry.pool = _texturePool;
+    entry.pooled = pooled;
+    entry.surface = surface;
+    entry.width = width;
+    entry.height = height;
+    entry.format = format;
+    entry.lastUsed = ++_bufferTextureClock;
+
+    struct metal_buffer_ref *ref = calloc(1, sizeof(*ref));
+    if (!ref) {
+        return entry;  // Shown once, not cached
+    }
+    ref->state = METAL_BUFFER_REF_ATTACH;
+    ref->buffer = buffer;
+    ref->surface = surface;
+    ref->commit_seq = surface->commit_seq;
+    ref->renderer = (__bridge void *)self;
+    pthread_mutex_lock(&g_buffer_refs_lock);
+    wl_list_insert(g_buffer_refs_pending.prev, &ref->pending_link);
+    pthread_mutex_unlock(&g_buffer_refs_lock);
+
+    entry.ref = ref;
+    _bufferTextures[@((uintptr_t)buffer)] = entry;
+    return entry;
+}
+
+// Show an IOSurface-backed dmabuf by sampling its planes in place: there is
+// no upload, and YUV formats are converted to RGB by fragmentShaderYUV.
+// Returns the texture of plane 0, nil if the buffer cannot be shown.
+- (id<MTLTexture>)showDmabuf:(struct metal_dmabuf_buffer *)dmabuf onSurface:(MetalSurface *)metalSurface {
+    id<MTLTexture> planes[3] = {nil, nil, nil};
+    uint32_t planeCount = dmabuf->n_planes < 3 ? dmabuf->n_planes : 3;
+    if (planeCount > 1 && !_yuvPipelineState) {
+        log_warn("[METAL] ", "No YUV pipeline, cannot show %u-plane dmabuf\n", planeCount);
+        return nil;
+    }
+    for (uint32_t i = 0; i < planeCount; i++) {
+        planes[i] = metal_dmabuf_get_plane_texture(dmabuf, _device, i);
+        if (!planes[i]) {
+            return nil;
+        }
+    }
+    metalSurface.texture = planes[0];
+    metalSurface.chromaTextures = planeCount > 1 ? [NSArray arrayWithObjects:planes + 1 count:planeCount - 1] : nil;
+    metalSurface.yuvFormat = planeCount > 1 ? dmabuf->format : 0;
+    metalSurface.bufferTexture = nil;
+    metalSurface.lastBufferData = dmabuf->iosurface;
+    metalSurface.lastWidth = (int32_t)dmabuf->width;
+    metalSurface.lastHeight = (int32_t)dmabuf->height;
+    metalSurface.lastFormat = dmabuf->format;
+    return planes[0];
+}
+
 - (void)renderSurface:(struct wl_surface_impl *)surface {
     if (!surface || !surface->buffer_resource) {
         return;
@@ -314,8 +814,9 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
     void *data = NULL;
     struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(surface->buffer_resource);
     struct buffer_data *buf_data = NULL;
+    struct metal_dmabuf_buffer *dmabuf = NULL;
 
-    NSLog(@"[METAL RENDER] renderSurface called for surface %p", (void *)surface);
+    log_debug("[METAL] ", "renderSurface called for surface %p", (void *)surface);
     
     // First, try to handle as SHM buffer
     if (shm_buffer) {
@@ -327,6 +828,17 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
         
         wl_shm_buffer_begin_access(shm_buffer);
         data = wl_shm_buffer_get_data(shm_buffer);
+    } else if (is_dmabuf_buffer(surface->buffer_resource)) {
+        // IOSurface-backed dmabuf (waypipe, video clients): sampled in place
+        dmabuf = dmabuf_buffer_get(surface->buffer_resource);
+        if (!dmabuf || !dmabuf->iosurface) {
+            return;
+        }
+        width = (int32_t)dmabuf->width;
+        height = (int32_t)dmabuf->height;
+        stride = (int32_t)dmabuf->stride;
+        format = dmabuf->format;
+        data = dmabuf->iosurface;  // Identifies the buffer, never read on the CPU
     } else {
         // Not an SHM buffer - might be EGL buffer or custom buffer with buffer_data
         buf_data = wl_resource_get_user_data(surface->buffer_resource);
@@ -362,9 +874,17 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
                             ms = [[MetalSurface alloc] init];
                             ms.surface = surface;
                             _surfaceTextures[key] = ms;
+                            _drawOrder = nil;
                         }
                         ms.texture = vulkanTexture;
-                        ms.frame = CGRectMake(surface->x, surface->y, surface->width, surface->height);
+                        ms.bufferTexture = nil;
+                        ms.chromaTextures = nil;
+                        ms.yuvFormat = 0;
+                        ms.u0 = 0.0f;
+                        ms.u1 = 1.0f;
+                        ms.vTop = 0.0f;
+                        ms.vBottom = 1.0f;
+                        ms.frame = CGRectMake(ms.origin.x, ms.origin.y, surface->width, surface->height);
                         
                         // Update metadata to prevent unnecessary recreations if we were tracking it
                         ms.lastBufferData = NULL; // Not using CPU buffer
@@ -381,6 +901,7 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
                             surface->buffer_release_sent = true;
                         }
                     }
+                    wl_surface_clear_buffer_damage(surface);
                     return;
                 }
             }
@@ -408,11 +929,25 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
         }
         return;
     }
+    if (shm_buffer && !pixel_convert_shm_buffer_fits(format, width, height, stride)) {
+        log_error("[METAL] ", "Skipping wl_shm buffer %dx%d format 0x%x: stride %d does not fit its rows\n",
+                  width, height, format, stride);
+        wl_shm_buffer_end_access(shm_buffer);
+        return;
+    }
     
-    NSLog(@"[METAL RENDER] Buffer details: %dx%d stride=%d format=%d data=%p", width, height, stride, format, data);
+    log_debug("[METAL] ", "Buffer details: %dx%d stride=%d format=%d data=%p", width, height, stride, format, data);
+
+    // Formats other than ARGB8888/XRGB8888 are converted to BGRA8 on the CPU
+    // (damaged rectangles only when the texture is reused)
+    struct pixel_convert_source convertSource;
+    BOOL convert = !dmabuf && pixel_convert_needs_conversion(format) &&
+                   pixel_convert_source_init(&convertSource, format, data, width, height, stride,
+                                             (size_t)stride * (size_t)height);
 
-    // OPTIMIZED: Check if we can reuse existing texture
-    // Only recreate if buffer data pointer, dimensions, or format changed
+    // Reuse the texture cached for this wl_buffer (see MetalBufferTexture).
+    // A texture is only created for a buffer seen for the first time or one
+    // whose dimensions or format changed.
     NSNumber *key = [NSNumber numberWithUnsignedLongLong:(unsigned long long)surface];
     @synchronized(self) {
         if (!_surfaceTextures) {
@@ -420,91 +955,97 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
         }
         
         MetalSurface *metalSurface = _surfaceTextures[key];
-        BOOL needsNewTexture = YES;
-        
-        if (metalSurface && metalSurface.texture) {
-            // Check if buffer data, dimensions, or format changed
-            if (metalSurface.lastBufferData == data &&
-                metalSurface.lastWidth == width &&
-                metalSurface.lastHeight == height &&
-                metalSurface.lastFormat == format) {
-                // Buffer data pointer matches - reuse existing texture object
-                needsNewTexture = NO;
-                
-                // CRITICAL: For SHM buffers, we MUST re-upload data even if pointer is the same
-                // The client likely updated the content in place
-                // Only skip upload if we know for sure content hasn't changed (difficult for SHM)
-                // Since renderSurface is called on commit, we assume content changed
-                if (shm_buffer || (buf_data && buf_data->data)) {
-                    MTLRegion region = MTLRegionMake2D(0, 0, width, height);
-                    [metalSurface.texture replaceRegion:region
-                                            mipmapLevel:0
-                                              withBytes:data
-                                            bytesPerRow:stride];
+        MetalBufferTexture *cached = [self bufferTextureFor:surface->buffer_resource
+                                                    surface:surface
+                                                      width:width
+                                                     height:height
+                                                     format:format
+                                                     damage:wl_surface_get_buffer_damage(surface)];
+        BOOL needsNewTexture = (cached == nil);
+        
+        if (cached) {
+            // This buffer has a texture already: upload only what changed since
+            // it was last uploaded (buffer coordinates)
+            TRACE_SCOPE("buffer_upload");
+            int n_rects = 0;
+            const pixman_box32_t *rects = pixman_region32_rectangles(&cached->staleDamage, &n_rects);
+            for (int i = 0; i < n_rects; i++) {
+                int32_t rectWidth = rects[i].x2 - rects[i].x1;
+                int32_t rectHeight = rects[i].y2 - rects[i].y1;
+                MTLRegion region = MTLRegionMake2D(rects[i].x1, rects[i].y1, rectWidth, rectHeight);
+                const uint8_t *src = (const uint8_t *)data +
+                                     (size_t)rects[i].y1 * (size_t)stride +
+                                     (size_t)rects[i].x1 * 4;
+                NSUInteger srcStride = stride;
+                if (convert) {
+                    uint8_t *converted = [self convertBufferOfSize:(size_t)rectWidth * rectHeight * 4];
+                    if (!converted ||
+                        pixel_convert_rect(&convertSource, rects[i].x1, rects[i].y1, rectWidth,
+                                           rectHeight, converted, rectWidth * 4, 0) < 0) {
+                        continue;
+                    }
+                    src = converted;
+                    srcStride = (NSUInteger)rectWidth * 4;
                 }
+                [cached.texture replaceRegion:region
+                                  mipmapLevel:0
+                                    withBytes:src
+                                  bytesPerRow:srcStride];
             }
+            pixman_region32_clear(&cached->staleDamage);
         }
         
         if (!metalSurface) {
             metalSurface = [[MetalSurface alloc] init];
             metalSurface.surface = surface;
             _surfaceTextures[key] = metalSurface;
+            _drawOrder = nil;
         }
         
         id<MTLTexture> texture = nil;
         
-        if (needsNewTexture) {
-            // Create texture from buffer data
-            // For DMA-BUF/IOSurface, create IOSurface and Metal texture from it
-            // For regular buffers, create texture directly
-            
-            // Try to create IOSurface-based texture (for DMA-BUF support)
-#if !TARGET_OS_IPHONE && !TARGET_OS_SIMULATOR
-            IOSurfaceRef iosurface = metal_dmabuf_create_iosurface_from_data(data, width, height, stride, 0);
-            if (iosurface) {
-                // Create Metal texture from IOSurface
-                MTLTextureDescriptor *textureDescriptor = [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:MTLPixelFormatBGRA8Unorm
-                                                                                                              width:width
-                                                                                                             height:height
-                                                                                                          mipmapped:NO];
-                textureDescriptor.usage = MTLTextureUsageShaderRead;
-                textureDescriptor.storageMode = MTLStorageModeShared;
-                
-                texture = [_device newTextureWithDescriptor:textureDescriptor iosurface:iosurface plane:0];
-                CFRelease(iosurface);
-                
-                if (texture) {
-                    NSLog(@"[METAL] Created texture from IOSurface: %dx%d", width, height);
-                } else {
-                    NSLog(@"[METAL] Failed to create texture from IOSurface");
-                }
-            }
-#endif
-            
-            // Fallback to direct texture creation if IOSurface method failed
+        if (dmabuf) {
+            texture = [self showDmabuf:dmabuf onSurface:metalSurface];
             if (!texture) {
-                NSLog(@"[METAL] Creating standard Metal texture: %dx%d", width, height);
-                // Create Metal texture from buffer data directly
-                MTLTextureDescriptor *textureDescriptor = [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:MTLPixelFormatBGRA8Unorm
-                                                                                                              width:width
-                                                                                                             height:height
-                                                                                                          mipmapped:NO];
-                textureDescriptor.usage = MTLTextureUsageShaderRead;
-                
-                texture = [_device newTextureWithDescriptor:textureDescriptor];
-                if (!texture) {
-                    NSLog(@"❌ Failed to create Metal texture");
-                    return;
+                return;
+            }
+        } else if (needsNewTexture) {
+            TRACE_SCOPE("buffer_upload");
+            void *pixels = data;
+            int32_t pixelsStride = stride;
+            if (convert) {
+                uint8_t *converted = [self convertBufferOfSize:(size_t)width * height * 4];
+                if (converted &&
+                    pixel_convert_rect(&convertSource, 0, 0, width, height, converted, width * 4, 0) == 0) {
+                    pixels = converted;
+                    pixelsStride = width * 4;
                 }
-                
-                // Upload pixel data to texture
-                MTLRegion region = MTLRegionMake2D(0, 0, width, height);
-                [texture replaceRegion:region mipmapLevel:0 withBytes:data bytesPerRow:stride];
-                NSLog(@"[METAL] Created texture directly from buffer: %dx%d", width, height);
             }
+            // Take a texture of this size bucket from the pool and upload the
+            // buffer into its top-left corner
+            struct texture_pool_texture *pooled =
+                texture_pool_acquire(_texturePool, MTLPixelFormatBGRA8Unorm, width, height);
+            if (!pooled) {
+                NSLog(@"❌ Failed to create Metal texture");
+                return;
+            }
+            cached = [self cacheTexture:pooled
+                              forBuffer:surface->buffer_resource
+                                surface:surface
+                                  width:width
+                                 height:height
+                                 format:format];
+            texture = cached.texture;
+            MTLRegion region = MTLRegionMake2D(0, 0, width, height);
+            [texture replaceRegion:region mipmapLevel:0 withBytes:pixels bytesPerRow:pixelsStride];
+            log_debug("[METAL] ", "Uploaded %dx%d buffer into %lux%lu pooled texture", width, height,
+                      (unsigned long)texture.width, (unsigned long)texture.height);
             
             // Update texture and cache buffer info
             metalSurface.texture = texture;
+            metalSurface.bufferTexture = cached;
+            metalSurface.chromaTextures = nil;
+            metalSurface.yuvFormat = 0;
             metalSurface.lastBufferData = data;
             metalSurface.lastWidth = width;
             metalSurface.lastHeight = height;
@@ -533,18 +1074,21 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
                 }
             }
         } else {
-            // Reuse existing texture - no need to recreate
-            texture = metalSurface.texture;
+            // Show the cached texture of this buffer
+            texture = cached.texture;
+            metalSurface.texture = texture;
+            metalSurface.bufferTexture = cached;
+            metalSurface.chromaTextures = nil;
+            metalSurface.yuvFormat = 0;
+            metalSurface.lastBufferData = data;
         }
         
         // For nested compositors (like Weston), ALWAYS scale the surface to fill the entire Metal view
-        // Get the Metal view frame (points) to determine the target size
-        CGRect targetFrame = CGRectMake(surface->x, surface->y, width, height);
-        struct wl_viewport_impl *vp = wl_viewport_from_surface(surface);
-        if (vp && vp->has_destination) {
-            targetFrame.size.width = vp->dst_width;
-            targetFrame.size.height = vp->dst_height;
-        }
+        // Otherwise the buffer is drawn at the surface size (buffer scale and viewport applied)
+        CGRect targetFrame = CGRectMake(metalSurface.origin.x, metalSurface.origin.y,
+                                        surface->width > 0 ? surface->width : width,
+                                        surface->height > 0 ? surface->height : height);
+        BOOL fillsView = NO;
         if (_metalView) {
             CGRect viewBounds = _metalView.frame;  // Use frame.size (points) not bounds
             
@@ -566,7 +1110,7 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
             if (isSmallSurface) {
                 // This is likely a cursor or small overlay - never scale it
                 shouldScaleToFill = NO;
-                NSLog(@"[METAL] Small surface detected (%dx%d) - not scaling (likely cursor)", width, height);
+                log_debug("[METAL] ", "Small surface detected (%dx%d) - not scaling (likely cursor)", width, height);
             } else {
                 // For large surfaces, check if this should be scaled to fill
                 // Check if this is the largest surface (likely main output)
@@ -595,13 +1139,13 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
                     // Be more aggressive: if it's large and we don't have many large surfaces, scale it
                     if (totalLargeSurfaces == 0 || 
                         (thisSurfaceArea >= maxSurfaceArea && thisSurfaceArea > 10000) ||
-                        (surface->x == 0 && surface->y == 0 && thisSurfaceArea > 10000) ||
+                        (CGPointEqualToPoint(metalSurface.origin, CGPointZero) && thisSurfaceArea > 10000) ||
                         (totalLargeSurfaces <= 1 && thisSurfaceArea > 50000)) {
                         shouldScaleToFill = YES;
-                        NSLog(@"[METAL] Scaling large surface to fill: buffer=%dx%d (area=%ld, pos=%d,%d, totalLarge=%ld, maxArea=%ld)",
+                        log_debug("[METAL] ", "Scaling large surface to fill: buffer=%dx%d (area=%ld, pos=%d,%d, totalLarge=%ld, maxArea=%ld)",
                               width, height, (long)thisSurfaceArea, surface->x, surface->y, (long)totalLargeSurfaces, (long)maxSurfaceArea);
                     } else {
-                        NSLog(@"[METAL] Not scaling surface: buffer=%dx%d (area=%ld, pos=%d,%d, maxArea=%ld, totalLarge=%ld)",
+                        log_debug("[METAL] ", "Not scaling surface: buffer=%dx%d (area=%ld, pos=%d,%d, maxArea=%ld, totalLarge=%ld)",
                               width, height, (long)thisSurfaceArea, surface->x, surface->y, (long)maxSurfaceArea, (long)totalLargeSurfaces);
                     }
                 }
@@ -611,35 +1155,20 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
                 // Scale to fill entire view - this handles nested compositors like Weston
                 // The buffer will be stretched to fill the view
                 targetFrame = CGRectMake(0, 0, viewBounds.size.width, viewBounds.size.height);
-                NSLog(@"[METAL] Scaling surface to fill view: buffer=%dx%d -> view=%.0fx%.0f (surface at %d,%d, viewBounds=%.0fx%.0f)",
+                fillsView = YES;
+                log_debug("[METAL] ", "Scaling surface to fill view: buffer=%dx%d -> view=%.0fx%.0f (surface at %d,%d, viewBounds=%.0fx%.0f)",
                       width, height, viewBounds.size.width, viewBounds.size.height, 
                       surface->x, surface->y, viewBounds.size.width, viewBounds.size.height);
-            } else {
-                // For non-main surfaces, still ensure they don't exceed view bounds
-                CGFloat maxX = viewBounds.size.width;
-                CGFloat maxY = viewBounds.size.height;
-                if (targetFrame.origin.x + targetFrame.size.width > maxX) {
-                    targetFrame.size.width = maxX - targetFrame.origin.x;
-                }
-                if (targetFrame.origin.y + targetFrame.size.height > maxY) {
-                    targetFrame.size.height = maxY - targetFrame.origin.y;
-                }
             }
+            // Other surfaces keep their size: the part outside the view is
+            // clipped when drawing (scene.h)
         }
         metalSurface.frame = targetFrame;
-
-        // Set texture sampling coordinates (apply viewporter source crop if present)
-        float u0 = 0.0f, u1 = 1.0f, vTop = 0.0f, vBottom = 1.0f;
-        if (vp && vp->has_source) {
-            u0 = (float)(vp->src_x / (double)width);
-            u1 = (float)((vp->src_x + vp->src_width) / (double)width);
-            vTop = (float)(vp->src_y / (double)height);
-            vBottom = (float)((vp->src_y + vp->src_height) / (double)height);
-        }
-        metalSurface.u0 = u0;
-        metalSurface.u1 = u1;
-        metalSurface.vTop = vTop;
-        metalSurface.vBottom = vBottom;
+        metalSurface.fillsView = fillsView;
+        // The opaque region is in surface coordinates, which is what the
+        // frame is in unless it is stretched over the view
+        metalSurface.frameIsSurfaceSized = !fillsView;
+        [metalSurface updateTextureCoordinates];
     }
     
     // Release SHM buffer access if we used one
@@ -647,12 +1176,27 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
         wl_shm_buffer_end_access(shm_buffer);
     }
     
+    // The texture holds a copy now, so the client can reuse the buffer right
+    // away instead of waiting for the next attach. dmabufs are sampled in
+    // place and released when the next buffer is committed.
+    if (!dmabuf && !surface->buffer_release_sent && wl_resource_get_client(surface->buffer_resource)) {
+        wl_buffer_send_release(surface->buffer_resource);
+        surface->buffer_release_sent = true;
+    }
+    
+    // Texture now matches the committed content
+    wl_surface_clear_buffer_damage(surface);
+    
     // With continuous rendering enabled (enableSetNeedsDisplay=NO), 
     // we don't need to call setNeedsDisplay: - the view renders automatically
     // However, we can still trigger it if needed for immediate updates
     // For now, let continuous rendering handle it automatically
 }
 
+- (void)getTexturePoolStats:(struct texture_pool_stats *)stats {
+    texture_pool_get_stats(_texturePool, stats);
+}
+
 - (void)removeSurface:(struct wl_surface_impl *)surface {
     if (!surface || !self) return;
     
@@ -660,6 +1204,16 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
     @synchronized(self) {
         if (_surfaceTextures) {
             [_surfaceTextures removeObjectForKey:key];
+            _drawOrder = nil;
+        }
+        NSMutableArray<NSNumber *> *buffers = [NSMutableArray array];
+        for (NSNumber *buffer in _bufferTextures) {
+            if (_bufferTextures[buffer].surface == surface) {
+                [buffers addObject:buffer];
+            }
+        }
+        for (NSNumber *buffer in buffers) {
+            [self dropBufferTextureForKey:buffer];
         }
     }
 }
@@ -712,6 +1266,38 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
     }
 }
 
+// Surfaces in paint order with their output positions, taken from the
+// compositor's flattened surface tree. Only rebuilt when the tree or the set
+// of surfaces changed. Called with the registry lock and @synchronized(self)
+// held.
+- (NSArray<MetalSurface *> *)drawOrder {
+    struct wl_surface_draw_list list;
+    wl_compositor_get_draw_list(&list);
+    if (_drawOrder && list.generation == _drawListGeneration) {
+        return _drawOrder;
+    }
+
+    NSMutableArray<MetalSurface *> *order = [NSMutableArray arrayWithCapacity:(NSUInteger)list.count];
+    for (int i = 0; i < list.count; i++) {
+        const struct wl_surface_draw_entry *entry = &list.entries[i];
+        MetalSurface *metalSurface = _surfaceTextures[@((unsigned long long)entry->surface)];
+        if (!metalSurface) {
+            continue;
+        }
+        metalSurface.origin = CGPointMake(entry->x, entry->y);
+        metalSurface.source = CGRectMake(entry->src_x, entry->src_y, entry->src_width, entry->src_height);
+        pixman_region32_copy(&metalSurface->opaqueRegion, &entry->opaque);
+        if (!metalSurface.fillsView && entry->width > 0 && entry->height > 0) {
+            metalSurface.frame = CGRectMake(entry->x, entry->y, entry->width, entry->height);
+        }
+        [metalSurface updateTextureCoordinates];
+        [order addObject:metalSurface];
+    }
+    _drawOrder = [order copy];
+    _drawListGeneration = list.generation;
+    return _drawOrder;
+}
+
 // MTKViewDelegate
 - (void)drawInMTKView:(MTKView *)view {
     @autoreleasepool {
@@ -721,6 +1307,7 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
         if (!self || !_commandQueue) {
             return;
         }
+        TRACE_SCOPE("drawInMTKView");
         
         // Log first few draws to verify continuous rendering is working
         static int continuous_draw_count = 0;
@@ -729,14 +1316,18 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
             continuous_draw_count++;
         }
         
-        // Safely get a snapshot of surfaces to avoid race conditions
+        // Snapshot of the surfaces in paint order. The registry lock is
+        // taken first, as on the render path (renderSurface runs under it).
         NSArray<MetalSurface *> *surfaces = nil;
+        wl_compositor_lock_surfaces();
         @synchronized(self) {
-            if (!_surfaceTextures) {
-                return;
+            if (_surfaceTextures) {
+                surfaces = [self drawOrder];
             }
-            // Create a copy of the array to avoid issues if dictionary is modified during iteration
-            surfaces = [[_surfaceTextures allValues] copy];
+        }
+        wl_compositor_unlock_surfaces();
+        if (!surfaces) {
+            return;
         }
         
         if (!surfaces || surfaces.count == 0) {
@@ -818,111 +1409,138 @@ extern IOSurfaceRef metal_dmabuf_create_iosurface_from_data(void *data, uint32_t
         }
         
         // Draw all surfaces (using the snapshot we created earlier)
+        uint64_t frameSeq = wl_compositor_begin_frame();
     static int logCounter = 0;
     if (logCounter++ % 60 == 0) {
         NSLog(@"[METAL DRAW] drawInMTKView called. Surface count: %lu", (unsigned long)surfaces.count);
     }
 
-    for (MetalSurface *metalSurface in surfaces) {
-        // Validate surface is still valid
-        if (!metalSurface || !metalSurface.texture) {
-            if (logCounter % 60 == 1) {
-                NSLog(@"[METAL DRAW] Surface %p has no texture", (void *)metalSurface);
+        // CRITICAL: Use view.frame.size (points) not view.bounds.size for coordinate calculations
+        // MTKView automatically handles Retina scaling for drawableSize, but frame/bounds are in points
+        CGSize viewSize = view.frame.size;
+        
+        // Cull front to back (scene.h): surfaces hidden behind opaque ones
+        // are not drawn, and opaque areas are drawn without blending
+        scene_begin(&_scene);
+        for (MetalSurface *metalSurface in surfaces) {
+            // Validate surface is still valid
+            if (!metalSurface || !metalSurface.texture) {
+                if (logCounter % 60 == 1) {
+                    NSLog(@"[METAL DRAW] Surface %p has no texture", (void *)metalSurface);
+                }
+                continue;
             }
-            continue;
+            CGRect frame = metal_surface_draw_frame(metalSurface.frame, viewSize);
+            int32_t x = (int32_t)floor(CGRectGetMinX(frame));
+            int32_t y = (int32_t)floor(CGRectGetMinY(frame));
+            BOOL fullyOpaque = metalSurface.yuvFormat != 0 || pixel_convert_is_opaque(metalSurface.lastFormat);
+            scene_add(&_scene, (__bridge void *)metalSurface, x, y,
+                      (int32_t)ceil(CGRectGetMaxX(frame)) - x, (int32_t)ceil(CGRectGetMaxY(frame)) - y,
+                      metalSurface.frameIsSurfaceSized ? &metalSurface->opaqueRegion : NULL, fullyOpaque);
         }
+        pixman_region32_t viewRegion;
+        pixman_region32_init_rect(&viewRegion, 0, 0, (unsigned int)ceil(viewSize.width),
+                                  (unsigned int)ceil(viewSize.height));
+        scene_cull(&_scene, &viewRegion);
+        pixman_region32_fini(&viewRegion);
+        
+        // Use full-screen viewport (Metal uses normalized device coordinates)
+        // Use drawableSize for viewport (pixels) - MTKView handles Retina scaling automatically
+        MTLViewport viewport;
+        viewport.originX = 0;
+        viewport.originY = 0;
+        viewport.width = view.drawableSize.width;
+        viewport.height = view.drawableSize.height;
+        viewport.znear = 0.0;
+        viewport.zfar = 1.0;
+        [renderEncoder setViewport:viewport];
+        
+        pixman_region32_t blended;
+        pixman_region32_init(&blended);
+        for (int i = 0; i < _scene.count; i++) {
+            const struct scene_node *node = &_scene.nodes[i];
+            MetalSurface *metalSurface = (__bridge MetalSurface *)node->data;
+            if (node->occluded) {
+                // Not drawn, so not composited either: its frame callbacks
+                // wait until it shows again
+                continue;
+            }
 
-        if (logCounter % 60 == 1) {
-            NSLog(@"[METAL DRAW] Drawing surface %p: texture=%@ frame=%.0f,%.0f %.0fx%.0f", 
-                  (void *)metalSurface, metalSurface.texture, 
-                  metalSurface.frame.origin.x, metalSurface.frame.origin.y, 
-                  metalSurface.frame.size.width, metalSurface.frame.size.height);
-        }
-            
-            // Set up viewport for this surface
-            // CRITICAL: Use view.frame.size (points) not view.bounds.size for coordinate calculations
-            // MTKView automatically handles Retina scaling for drawableSize, but frame/bounds are in points
-            CGRect frame = metalSurface.frame;
-            CGSize viewSize = view.frame.size;  // Use frame.size (points) for coordinate calculations
-            
-            // Use full-screen viewport (Metal uses normalized device coordinates)
-            // Metal viewport: bottom-left origin, but we'll use full screen and transform vertices
-            // Use drawableSize for viewport (pixels) - MTKView handles Retina scaling automatically
-            MTLViewport viewport;
-            viewport.originX = 0;
-            viewport.originY = 0;
-            viewport.width = view.drawableSize.width;   // Use drawableSize (pixels) for viewport
-            viewport.height = view.drawableSize.height;  // MTKView handles Retina scaling
-            viewport.znear = 0.0;
-            viewport.zfar = 1.0;
-            [renderEncoder setViewport:viewport];
-            
-            // Bind texture
-            [renderEncoder setFragmentTexture:metalSurface.texture atIndex:0];
-            
-            // Create vertex data for a textured quad
-            // Vertices: position (x, y), texture coordinate (u, v)
-            // Positions are in normalized device coordinates (-1 to 1), then transformed to screen space
-            typedef struct {
-                simd_float2 position;
-                simd_float2 texCoord;
-            } Vertex;
-            
-            // Convert frame coordinates (points) to normalized device coordinates (-1 to 1)
-            // Wayland uses top-left origin, Metal NDC uses bottom-left origin
-            // Use viewSize (points) for coordinate calculations - this ensures correct scaling
-            float x0 = (frame.origin.x / viewSize.width) * 2.0f - 1.0f;
-            float x1 = ((frame.origin.x + frame.size.width) / viewSize.width) * 2.0f - 1.0f;
-            float y0 = 1.0f - ((frame.origin.y + frame.size.height) / viewSize.height) * 2.0f; // Flip Y
-            float y1 = 1.0f - (frame.origin.y / viewSize.height) * 2.0f; // Flip Y
-            
-            // Ensure we're using the full viewport (for nested compositors)
-            // Clamp coordinates to full screen if frame is close to view size (within 1 point tolerance)
-            if (fabs(frame.size.width - viewSize.width) < 1.0f && 
-                fabs(frame.size.height - viewSize.height) < 1.0f) {
-                // Surface fills the view - use full screen coordinates
-                x0 = -1.0f;
-                x1 = 1.0f;
-                y0 = -1.0f;
-                y1 = 1.0f;
+            CGRect frame = metal_surface_draw_frame(metalSurface.frame, viewSize);
+            if (logCounter % 60 == 1) {
+                NSLog(@"[METAL DRAW] Drawing surface %p: texture=%@ frame=%.0f,%.0f %.0fx%.0f", 
+                      (void *)metalSurface, metalSurface.texture, 
+                      frame.origin.x, frame.origin.y, frame.size.width, frame.size.height);
             }
             
-            // Create vertices for a quad covering the surface frame
-            // Texture coordinates: apply viewporter source crop and flip Y for Metal
-            Vertex vertices[4];
-            // Bottom-left (screen space)
-            vertices[0].position = simd_make_float2(x0, y0);
-            vertices[0].texCoord = simd_make_float2(metalSurface.u0, metalSurface.vBottom);
-            // Bottom-right (screen space)
-            vertices[1].position = simd_make_float2(x1, y0);
-            vertices[1].texCoord = simd_make_float2(metalSurface.u1, metalSurface.vBottom);
-            // Top-left (screen space)
-            vertices[2].position = simd_make_float2(x0, y1);
-            vertices[2].texCoord = simd_make_float2(metalSurface.u0, metalSurface.vTop);
-            // Top-right (screen space)
-            vertices[3].position = simd_make_float2(x1, y1);
-            vertices[3].texCoord = simd_make_float2(metalSurface.u1, metalSurface.vTop);
+            // Bind texture (YUV: luma, then chroma planes)
+            NSArray<id<MTLTexture>> *chromaTextures = metalSurface.chromaTextures;
+            BOOL yuv = metalSurface.yuvFormat && chromaTextures.count > 0;
+            if (yuv) {
+                [renderEncoder setFragmentTexture:metalSurface.texture atIndex:0];
+                [renderEncoder setFragmentTexture:chromaTextures[0] atIndex:1];
+                [renderEncoder setFragmentTexture:chromaTextures.lastObject atIndex:2];
+                MetalYUVParams yuvParams = metal_yuv_params(metalSurface.yuvFormat,
+                                                            (uint32_t)chromaTextures.count + 1);
+                [renderEncoder setFragmentBytes:&yuvParams length:sizeof(yuvParams) atIndex:0];
+            } else {
+                [renderEncoder setFragmentTexture:metalSurface.texture atIndex:0];
+            }
             
-            // Create vertex buffer
-            id<MTLBuffer> vertexBuffer = [_device newBufferWithBytes:vertices
-                                                               length:sizeof(vertices)
+            // One quad per visible rectangle: the opaque ones first, then
+            // the ones that blend with what is below
+            int nOpaque = 0, nBlended = 0;
+            const pixman_box32_t *opaqueRects = pixman_region32_rectangles(&node->visible_opaque, &nOpaque);
+            pixman_region32_subtract(&blended, &node->visible, &node->visible_opaque);
+            const pixman_box32_t *blendedRects = pixman_region32_rectangles(&blended, &nBlended);
+            NSUInteger maxVertices = (NSUInteger)(nOpaque + nBlended) * 6;
+            if (maxVertices == 0) {
+                continue;
+            }
+            id<MTLBuffer> vertexBuffer = [_device newBufferWithLength:maxVertices * sizeof(MetalVertex)
                                                               options:MTLResourceStorageModeShared];
+            if (!vertexBuffer) {
+                continue;
+            }
+            MetalVertex *vertices = vertexBuffer.contents;
+            NSUInteger opaqueCount = metal_append_rects(vertices, opaqueRects, nOpaque, frame, viewSize, metalSurface);
+            NSUInteger blendedCount = metal_append_rects(vertices + opaqueCount, blendedRects, nBlended,
+                                                         frame, viewSize, metalSurface);
+            [renderEncoder setVertexBuffer:vertexBuffer offset:0 atIndex:0];
             
-            if (vertexBuffer) {
-                // Set vertex buffer
-                [renderEncoder setVertexBuffer:vertexBuffer offset:0 atIndex:0];
-                
-                // Draw quad as triangle strip (4 vertices = 2 triangles)
-                [renderEncoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
+            id<MTLRenderPipelineState> opaquePipeline = yuv ? _yuvPipelineState : _pipelineState;
+            if (opaqueCount > 0 && opaquePipeline) {
+                [renderEncoder setRenderPipelineState:opaquePipeline];
+                [renderEncoder drawPrimitives:MTLPrimitiveTypeTriangle
                                   vertexStart:0
-                                  vertexCount:4];
+                                  vertexCount:opaqueCount];
+            }
+            // YUV surfaces are always fully opaque
+            id<MTLRenderPipelineState> blendPipeline = _blendPipelineState ?: _pipelineState;
+            if (blendedCount > 0 && !yuv && blendPipeline) {
+                [renderEncoder setRenderPipelineState:blendPipeline];
+                [renderEncoder drawPrimitives:MTLPrimitiveTypeTriangle
+                                  vertexStart:opaqueCount
+                                  vertexCount:blendedCount];
             }
+            
+            // Surface content is part of this frame - its frame callbacks may fire
+            wl_surface_mark_composited(metalSurface.surface);
         }
+        pixman_region32_fini(&blended);
         
         [renderEncoder endEncoding];
         
         id<CAMetalDrawable> drawable = view.currentDrawable;
         if (drawable) {
+            if (@available(macOS 10.15.4, iOS 10.3, *)) {
+                [drawable addPresentedHandler:^(id<MTLDrawable> presented) {
+                    metal_report_presented(frameSeq, presented.presentedTime);
+                }];
+            } else {
+                wl_compositor_frame_presented(frameSeq, NULL,
+                                              WP_PRESENTATION_FEEDBACK_KIND_VSYNC);
+            }
             [commandBuffer presentDrawable:drawable];
         }
         
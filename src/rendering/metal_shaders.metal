@@ -35,3 +35,40 @@ fragmentShader(RasterizerData in [[stage_in]],
     
     return color;
 }
+
+// Matches MetalYUVParams in metal_renderer.m
+struct YUVParams {
+    float lumaOffset;    // Black level
+    float chromaOffset;  // Zero chroma
+    float sampleScale;   // Maps samples to the full [0, 1] range of their bit depth
+    uint planeCount;     // 2: interleaved CbCr (NV12, P010), 3: separate Cb and Cr (YUV420)
+};
+
+// Multi-planar YUV dmabufs are sampled in place, one texture per plane, and
+// converted here (BT.601 limited range, as pixel_convert.c on the CPU)
+fragment float4
+fragmentShaderYUV(RasterizerData in [[stage_in]],
+                  texture2d<float> lumaTexture [[texture(0)]],
+                  texture2d<float> chromaTexture [[texture(1)]],
+                  texture2d<float> crTexture [[texture(2)]],
+                  constant YUVParams &params [[buffer(0)]])
+{
+    constexpr sampler textureSampler (mag_filter::linear,
+                                      min_filter::linear);
+    
+    float y = lumaTexture.sample(textureSampler, in.texCoord).r * params.sampleScale;
+    float2 c;
+    if (params.planeCount == 3) {
+        c = float2(chromaTexture.sample(textureSampler, in.texCoord).r,
+                   crTexture.sample(textureSampler, in.texCoord).r);
+    } else {
+        c = chromaTexture.sample(textureSampler, in.texCoord).rg;
+    }
+    
+    y = (y - params.lumaOffset) * (255.0 / 219.0);
+    c = (c * params.sampleScale - params.chromaOffset) * (255.0 / 224.0);
+    float3 rgb = float3(y + 1.402 * c.y,
+                        y - 0.344136 * c.x - 0.714136 * c.y,
+                        y + 1.772 * c.x);
+    return float4(saturate(rgb), 1.0);
+}
@@ -0,0 +1,583 @@
+#include "pixel_convert.h"
+#include "pixel_convert_kernels.h"
+#include "logging.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+
+// wl_shm aliases of ARGB8888 and XRGB8888
+#define PIXEL_SHM_FORMAT_ARGB8888 0u
+#define PIXEL_SHM_FORMAT_XRGB8888 1u
+
+enum pixel_layout {
+    PIXEL_LAYOUT_SWIZZLE32,
+    PIXEL_LAYOUT_SWIZZLE64,
+    PIXEL_LAYOUT_RGB565,
+    PIXEL_LAYOUT_RGB2101010,
+    PIXEL_LAYOUT_NV12,
+    PIXEL_LAYOUT_P010,
+    PIXEL_LAYOUT_YUV420,
+    PIXEL_LAYOUT_YUYV,
+};
+
+struct pixel_format_info {
+    uint32_t format;
+    enum pixel_layout layout;
+    uint8_t order[4];  // Source channel of output B, G, R, A (see pixel_convert_kernels.h)
+    bool opaque;
+    bool swap_rb;  // 2101010: red in the low bits
+    int32_t bytes_per_pixel;  // Of the first plane
+};
+
+static const struct pixel_format_info pixel_formats[] = {
+    {PIXEL_FORMAT_ARGB8888, PIXEL_LAYOUT_SWIZZLE32, {0, 1, 2, 3}, false, false, 4},
+    {PIXEL_FORMAT_XRGB8888, PIXEL_LAYOUT_SWIZZLE32, {0, 1, 2, 3}, true, false, 4},
+    {PIXEL_FORMAT_ABGR8888, PIXEL_LAYOUT_SWIZZLE32, {2, 1, 0, 3}, false, false, 4},
+    {PIXEL_FORMAT_XBGR8888, PIXEL_LAYOUT_SWIZZLE32, {2, 1, 0, 3}, true, false, 4},
+    {PIXEL_FORMAT_RGBA8888, PIXEL_LAYOUT_SWIZZLE32, {1, 2, 3, 0}, false, false, 4},
+    {PIXEL_FORMAT_RGBX8888, PIXEL_LAYOUT_SWIZZLE32, {1, 2, 3, 0}, true, false, 4},
+    {PIXEL_FORMAT_BGRA8888, PIXEL_LAYOUT_SWIZZLE32, {3, 2, 1, 0}, false, false, 4},
+    {PIXEL_FORMAT_BGRX8888, PIXEL_LAYOUT_SWIZZLE32, {3, 2, 1, 0}, true, false, 4},
+    {PIXEL_FORMAT_RGB565, PIXEL_LAYOUT_RGB565, {0, 0, 0, 0}, true, false, 2},
+    {PIXEL_FORMAT_ARGB2101010, PIXEL_LAYOUT_RGB2101010, {0, 0, 0, 0}, false, false, 4},
+    {PIXEL_FORMAT_XRGB2101010, PIXEL_LAYOUT_RGB2101010, {0, 0, 0, 0}, true, false, 4},
+    {PIXEL_FORMAT_ABGR2101010, PIXEL_LAYOUT_RGB2101010, {0, 0, 0, 0}, false, true, 4},
+    {PIXEL_FORMAT_XBGR2101010, PIXEL_LAYOUT_RGB2101010, {0, 0, 0, 0}, true, true, 4},
+    {PIXEL_FORMAT_ARGB16161616, PIXEL_LAYOUT_SWIZZLE64, {0, 1, 2, 3}, false, false, 8},
+    {PIXEL_FORMAT_XRGB16161616, PIXEL_LAYOUT_SWIZZLE64, {0, 1, 2, 3}, true, false, 8},
+    {PIXEL_FORMAT_ABGR16161616, PIXEL_LAYOUT_SWIZZLE64, {2, 1, 0, 3}, false, false, 8},
+    {PIXEL_FORMAT_XBGR16161616, PIXEL_LAYOUT_SWIZZLE64, {2, 1, 0, 3}, true, false, 8},
+    {PIXEL_FORMAT_NV12, PIXEL_LAYOUT_NV12, {0, 0, 0, 0}, true, false, 1},
+    {PIXEL_FORMAT_P010, PIXEL_LAYOUT_P010, {0, 0, 0, 0}, true, false, 2},
+    {PIXEL_FORMAT_YUV420, PIXEL_LAYOUT_YUV420, {0, 0, 0, 0}, true, false, 1},
+    {PIXEL_FORMAT_YUYV, PIXEL_LAYOUT_YUYV, {0, 0, 0, 0}, true, false, 2},
+};
+
+#define PIXEL_FORMAT_COUNT (sizeof(pixel_formats) / sizeof(pixel_formats[0]))
+
+// --- Scalar reference kernels ---
+
+static inline uint32_t
+load_le32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline int32_t
+clamp_255(int32_t value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+// BT.601 limited range, 8.8 fixed point. The SIMD kernels use the same
+// arithmetic in 32-bit lanes, so their results are bit identical.
+static inline uint32_t
+yuv_to_argb(int32_t y, int32_t u, int32_t v)
+{
+    int32_t c = 298 * (y - 16) + 128;
+    int32_t d = u - 128;
+    int32_t e = v - 128;
+    uint32_t r = (uint32_t)clamp_255((c + 409 * e) >> 8);
+    uint32_t g = (uint32_t)clamp_255((c - 100 * d - 208 * e) >> 8);
+    uint32_t b = (uint32_t)clamp_255((c + 516 * d) >> 8);
+    return 0xff000000u | (r << 16) | (g << 8) | b;
+}
+
+// c * a / 255, rounded
+static inline uint32_t
+mul_div_255(uint32_t c, uint32_t a)
+{
+    uint32_t t = c * a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+void
+pixel_convert_swizzle32_scalar(uint32_t *dst, const uint8_t *src, int32_t n,
+                               const uint8_t order[4], bool opaque)
+{
+    uint32_t alpha = opaque ? 0xff000000u : 0;
+    for (int32_t i = 0; i < n; i++) {
+        const uint8_t *p = src + (size_t)i * 4;
+        dst[i] = (uint32_t)p[order[0]] | ((uint32_t)p[order[1]] << 8) |
+                 ((uint32_t)p[order[2]] << 16) | ((uint32_t)p[order[3]] << 24) | alpha;
+    }
+}
+
+void
+pixel_convert_swizzle64_scalar(uint32_t *dst, const uint8_t *src, int32_t n,
+                               const uint8_t order[4], bool opaque)
+{
+    // Keep the high byte of each 16-bit channel
+    uint32_t alpha = opaque ? 0xff000000u : 0;
+    for (int32_t i = 0; i < n; i++) {
+        const uint8_t *p = src + (size_t)i * 8;
+        dst[i] = (uint32_t)p[order[0] * 2 + 1] | ((uint32_t)p[order[1] * 2 + 1] << 8) |
+                 ((uint32_t)p[order[2] * 2 + 1] << 16) | ((uint32_t)p[order[3] * 2 + 1] << 24) |
+                 alpha;
+    }
+}
+
+void
+pixel_convert_rgb565_scalar(uint32_t *dst, const uint8_t *src, int32_t n)
+{
+    for (int32_t i = 0; i < n; i++) {
+        uint32_t p = (uint32_t)src[i * 2] | ((uint32_t)src[i * 2 + 1] << 8);
+        uint32_t r = p >> 11;
+        uint32_t g = (p >> 5) & 0x3f;
+        uint32_t b = p & 0x1f;
+        r = (r << 3) | (r >> 2);
+        g = (g << 2) | (g >> 4);
+        b = (b << 3) | (b >> 2);
+        dst[i] = 0xff000000u | (r << 16) | (g << 8) | b;
+    }
+}
+
+void
+pixel_convert_rgb2101010_scalar(uint32_t *dst, const uint8_t *src, int32_t n, bool swap_rb,
+                                bool opaque)
+{
+    for (int32_t i = 0; i < n; i++) {
+        uint32_t p = load_le32(src + (size_t)i * 4);
+        uint32_t hi = (p >> 22) & 0xff;
+        uint32_t g = (p >> 12) & 0xff;
+        uint32_t lo = (p >> 2) & 0xff;
+        uint32_t a = opaque ? 0xff : (p >> 30) * 85;
+        uint32_t r = swap_rb ? lo : hi;
+        uint32_t b = swap_rb ? hi : lo;
+        dst[i] = (a << 24) | (r << 16) | (g << 8) | b;
+    }
+}
+
+void
+pixel_convert_nv12_scalar(uint32_t *dst, const uint8_t *y_row, const uint8_t *uv_row, int32_t x,
+                          int32_t n)
+{
+    for (int32_t i = 0; i < n; i++) {
+        int32_t column = x + i;
+        const uint8_t *uv = uv_row + (column & ~1);
+        dst[i] = yuv_to_argb(y_row[column], uv[0], uv[1]);
+    }
+}
+
+// P010 and YUV420 come from dmabuf video clients, which the GPU renderers
+// sample directly; they only have the scalar kernels
+
+// 10 bits in the high bits of 16-bit samples, truncated to 8 bits
+static void
+p010_scalar(uint32_t *dst, const uint8_t *y_row, const uint8_t *uv_row, int32_t x, int32_t n)
+{
+    for (int32_t i = 0; i < n; i++) {
+        int32_t column = x + i;
+        const uint8_t *uv = uv_row + (size_t)(column & ~1) * 2;
+        dst[i] = yuv_to_argb(y_row[(size_t)column * 2 + 1], uv[1], uv[3]);
+    }
+}
+
+static void
+yuv420_scalar(uint32_t *dst, const uint8_t *y_row, const uint8_t *u_row, const uint8_t *v_row,
+              int32_t x, int32_t n)
+{
+    for (int32_t i = 0; i < n; i++) {
+        int32_t column = x + i;
+        dst[i] = yuv_to_argb(y_row[column], u_row[column / 2], v_row[column / 2]);
+    }
+}
+
+void
+pixel_convert_yuyv_scalar(uint32_t *dst, const uint8_t *row, int32_t x, int32_t n)
+{
+    for (int32_t i = 0; i < n; i++) {
+        int32_t column = x + i;
+        const uint8_t *pair = row + (size_t)(column & ~1) * 2;
+        dst[i] = yuv_to_argb(row[(size_t)column * 2], pair[1], pair[3]);
+    }
+}
+
+void
+pixel_convert_premultiply_scalar(uint32_t *pixels, int32_t n)
+{
+    for (int32_t i = 0; i < n; i++) {
+        uint32_t p = pixels[i];
+        uint32_t a = p >> 24;
+        uint32_t r = mul_div_255((p >> 16) & 0xff, a);
+        uint32_t g = mul_div_255((p >> 8) & 0xff, a);
+        uint32_t b = mul_div_255(p & 0xff, a);
+        pixels[i] = (a << 24) | (r << 16) | (g << 8) | b;
+    }
+}
+
+const struct pixel_convert_kernels pixel_convert_scalar_kernels = {
+    .name = "scalar",
+    .swizzle32 = pixel_convert_swizzle32_scalar,
+    .swizzle64 = pixel_convert_swizzle64_scalar,
+    .rgb565 = pixel_convert_rgb565_scalar,
+    .rgb2101010 = pixel_convert_rgb2101010_scalar,
+    .nv12 = pixel_convert_nv12_scalar,
+    .yuyv = pixel_convert_yuyv_scalar,
+    .premultiply = pixel_convert_premultiply_scalar,
+};
+
+// --- Runtime dispatch ---
+
+static _Atomic(const struct pixel_convert_kernels *) g_kernels = NULL;
+static pthread_once_t g_kernels_once = PTHREAD_ONCE_INIT;
+
+static const struct pixel_convert_kernels *
+kernels_for_isa(enum pixel_convert_isa isa)
+{
+    switch (isa) {
+    case PIXEL_CONVERT_ISA_SCALAR:
+        return &pixel_convert_scalar_kernels;
+    case PIXEL_CONVERT_ISA_SSE41:
+        return pixel_convert_sse41_kernels();
+    case PIXEL_CONVERT_ISA_AVX2:
+        return pixel_convert_avx2_kernels();
+    case PIXEL_CONVERT_ISA_NEON:
+        return pixel_convert_neon_kernels();
+    case PIXEL_CONVERT_ISA_AUTO:
+    default: {
+        const struct pixel_convert_kernels *best = pixel_convert_avx2_kernels();
+        if (!best) {
+            best = pixel_convert_sse41_kernels();
+        }
+        if (!best) {
+            best = pixel_convert_neon_kernels();
+        }
+        return best ? best : &pixel_convert_scalar_kernels;
+    }
+    }
+}
+
+static void
+kernels_init(void)
+{
+    const struct pixel_convert_kernels *expected = NULL;
+    const struct pixel_convert_kernels *best = kernels_for_isa(PIXEL_CONVERT_ISA_AUTO);
+    // A pixel_convert_set_isa() call that raced us wins
+    if (atomic_compare_exchange_strong(&g_kernels, &expected, best)) {
+        log_info("[PIXEL] ", "Pixel conversion kernels: %s\n", best->name);
+    }
+}
+
+static const struct pixel_convert_kernels *
+kernels_get(void)
+{
+    pthread_once(&g_kernels_once, kernels_init);
+    return atomic_load_explicit(&g_kernels, memory_order_acquire);
+}
+
+bool
+pixel_convert_set_isa(enum pixel_convert_isa isa)
+{
+    const struct pixel_convert_kernels *kernels = kernels_for_isa(isa);
+    if (!kernels) {
+        return false;
+    }
+    pthread_once(&g_kernels_once, kernels_init);
+    atomic_store_explicit(&g_kernels, kernels, memory_order_release);
+    return true;
+}
+
+const char *
+pixel_convert_get_isa_name(void)
+{
+    return kernels_get()->name;
+}
+
+// --- Formats ---
+
+static const struct pixel_format_info *
+format_info(uint32_t format)
+{
+    if (format == PIXEL_SHM_FORMAT_ARGB8888) {
+        format = PIXEL_FORMAT_ARGB8888;
+    } else if (format == PIXEL_SHM_FORMAT_XRGB8888) {
+        format = PIXEL_FORMAT_XRGB8888;
+    }
+    for (size_t i = 0; i < PIXEL_FORMAT_COUNT; i++) {
+        if (pixel_formats[i].format == format) {
+            return &pixel_formats[i];
+        }
+    }
+    return NULL;
+}
+
+bool
+pixel_convert_is_supported(uint32_t format)
+{
+    return format_info(format) != NULL;
+}
+
+bool
+pixel_convert_needs_conversion(uint32_t format)
+{
+    const struct pixel_format_info *info = format_info(format);
+    return info && info->format != PIXEL_FORMAT_ARGB8888 && info->format != PIXEL_FORMAT_XRGB8888;
+}
+
+bool
+pixel_convert_is_opaque(uint32_t format)
+{
+    const struct pixel_format_info *info = format_info(format);
+    return info && info->opaque;
+}
+
+int
+pixel_convert_get_formats(const uint32_t **formats)
+{
+    // Everything single-planar in pixel_formats but ARGB8888 and XRGB8888:
+    // libwayland sizes a wl_shm buffer as stride * height, which leaves no
+    // room for chroma planes (NV12 and the like come through dmabuf)
+    static const uint32_t codes[] = {
+        PIXEL_FORMAT_ABGR8888,     PIXEL_FORMAT_XBGR8888,     PIXEL_FORMAT_RGBA8888,
+        PIXEL_FORMAT_RGBX8888,     PIXEL_FORMAT_BGRA8888,     PIXEL_FORMAT_BGRX8888,
+        PIXEL_FORMAT_RGB565,       PIXEL_FORMAT_ARGB2101010,  PIXEL_FORMAT_XRGB2101010,
+        PIXEL_FORMAT_ABGR2101010,  PIXEL_FORMAT_XBGR2101010,  PIXEL_FORMAT_ARGB16161616,
+        PIXEL_FORMAT_XRGB16161616, PIXEL_FORMAT_ABGR16161616, PIXEL_FORMAT_XBGR16161616,
+        PIXEL_FORMAT_YUYV,
+    };
+    *formats = codes;
+    return (int)(sizeof(codes) / sizeof(codes[0]));
+}
+
+static int
+layout_plane_count(enum pixel_layout layout)
+{
+    switch (layout) {
+    case PIXEL_LAYOUT_NV12:
+    case PIXEL_LAYOUT_P010:
+        return 2;
+    case PIXEL_LAYOUT_YUV420:
+        return 3;
+    case PIXEL_LAYOUT_SWIZZLE32:
+    case PIXEL_LAYOUT_SWIZZLE64:
+    case PIXEL_LAYOUT_RGB565:
+    case PIXEL_LAYOUT_RGB2101010:
+    case PIXEL_LAYOUT_YUYV:
+    default:
+        return 1;
+    }
+}
+
+// Bytes the kernels read from one row of plane at width pixels: chroma is
+// subsampled 2x horizontally and a YUYV or chroma pair is read whole
+static size_t
+layout_row_bytes(const struct pixel_format_info *info, int plane, int32_t width)
+{
+    size_t pairs = (size_t)(width + 1) / 2;
+    switch (info->layout) {
+    case PIXEL_LAYOUT_YUYV:
+        return pairs * 4;
+    case PIXEL_LAYOUT_NV12:
+        return plane == 0 ? (size_t)width : pairs * 2;
+    case PIXEL_LAYOUT_P010:
+        return plane == 0 ? (size_t)width * 2 : pairs * 4;
+    case PIXEL_LAYOUT_YUV420:
+        return plane == 0 ? (size_t)width : pairs;
+    case PIXEL_LAYOUT_SWIZZLE32:
+    case PIXEL_LAYOUT_SWIZZLE64:
+    case PIXEL_LAYOUT_RGB565:
+    case PIXEL_LAYOUT_RGB2101010:
+    default:
+        return (size_t)width * (size_t)info->bytes_per_pixel;
+    }
+}
+
+static bool
+layout_strides_fit(const struct pixel_format_info *info, int32_t width, int32_t height,
+                   const int32_t *strides, int n_planes)
+{
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+    for (int i = 0; i < n_planes; i++) {
+        if (strides[i] <= 0 || (size_t)strides[i] < layout_row_bytes(info, i, width)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The planes of a contiguous buffer (see pixel_convert_source_init): all
+// but YUV420 use the luma stride for chroma rows
+static void
+layout_contiguous_strides(const struct pixel_format_info *info, int32_t stride, int32_t *strides)
+{
+    strides[0] = strides[1] = stride;
+    strides[2] = 0;
+    if (info->layout == PIXEL_LAYOUT_YUV420) {
+        strides[1] = strides[2] = stride / 2;
+    }
+}
+
+static size_t
+layout_contiguous_size(const struct pixel_format_info *info, int32_t height,
+                       const int32_t *strides)
+{
+    size_t chroma_rows = (size_t)(height + 1) / 2;
+    size_t size = (size_t)strides[0] * (size_t)height;
+    for (int i = 1; i < layout_plane_count(info->layout); i++) {
+        size += (size_t)strides[i] * chroma_rows;
+    }
+    return size;
+}
+
+bool
+pixel_convert_shm_buffer_fits(uint32_t format, int32_t width, int32_t height, int32_t stride)
+{
+    const struct pixel_format_info *info = format_info(format);
+    if (!info || layout_plane_count(info->layout) != 1) {
+        return false;
+    }
+    return layout_strides_fit(info, width, height, &stride, 1);
+}
+
+bool
+pixel_convert_source_init(struct pixel_convert_source *source, uint32_t format, const void *data,
+                          int32_t width, int32_t height, int32_t stride, size_t size)
+{
+    const struct pixel_format_info *info = format_info(format);
+    if (!info || !data) {
+        return false;
+    }
+    int32_t strides[3];
+    layout_contiguous_strides(info, stride, strides);
+    int n_planes = layout_plane_count(info->layout);
+    if (!layout_strides_fit(info, width, height, strides, n_planes) ||
+        layout_contiguous_size(info, height, strides) > size) {
+        return false;
+    }
+    // Chroma planes follow the luma plane; YUV420 chroma rows are half as wide
+    const uint8_t *chroma = (const uint8_t *)data + (size_t)stride * (size_t)height;
+    const void *planes[3] = {data, chroma, NULL};
+    if (info->layout == PIXEL_LAYOUT_YUV420) {
+        planes[2] = chroma + (size_t)strides[1] * (size_t)((height + 1) / 2);
+    }
+    return pixel_convert_source_init_planes(source, format, width, height, planes, strides,
+                                            n_planes);
+}
+
+bool
+pixel_convert_source_init_planes(struct pixel_convert_source *source, uint32_t format,
+                                 int32_t width, int32_t height, const void *const *planes,
+                                 const int32_t *strides, int n_planes)
+{
+    const struct pixel_format_info *info = format_info(format);
+    if (!info || n_planes != layout_plane_count(info->layout) ||
+        !layout_strides_fit(info, width, height, strides, n_planes)) {
+        return false;
+    }
+    memset(source, 0, sizeof(*source));
+    source->format = format;
+    source->width = width;
+    source->height = height;
+    for (int i = 0; i < n_planes; i++) {
+        if (!planes[i]) {
+            return false;
+        }
+        source->planes[i] = planes[i];
+        source->strides[i] = strides[i];
+    }
+    return true;
+}
+
+// --- Conversion ---
+
+int
+pixel_convert_rect(const struct pixel_convert_source *source, int32_t x, int32_t y, int32_t width,
+                   int32_t height, void *dst, int32_t dst_stride, uint32_t flags)
+{
+    const struct pixel_format_info *info = format_info(source->format);
+    if (!info) {
+        return -1;
+    }
+
+    // Clip to the source, moving dst along with the rectangle origin
+    int32_t x0 = x < 0 ? 0 : x;
+    int32_t y0 = y < 0 ? 0 : y;
+    int32_t x1 = x + width > source->width ? source->width : x + width;
+    int32_t y1 = y + height > source->height ? source->height : y + height;
+    if (x1 <= x0 || y1 <= y0) {
+        return 0;
+    }
+    uint8_t *out_base = (uint8_t *)dst + (ptrdiff_t)(y0 - y) * dst_stride + (ptrdiff_t)(x0 - x) * 4;
+    int32_t n = x1 - x0;
+
+    const struct pixel_convert_kernels *kernels = kernels_get();
+    const uint8_t *plane = source->planes[0];
+    for (int32_t row = y0; row < y1; row++) {
+        uint32_t *out = (uint32_t *)(void *)(out_base + (ptrdiff_t)(row - y0) * dst_stride);
+        const uint8_t *line = plane + (size_t)row * (size_t)source->strides[0];
+        const uint8_t *pixels = line + (size_t)x0 * (size_t)info->bytes_per_pixel;
+
+        switch (info->layout) {
+        case PIXEL_LAYOUT_SWIZZLE32:
+            if (info->format == PIXEL_FORMAT_ARGB8888) {
+                memcpy(out, pixels, (size_t)n * 4);
+            } else {
+                kernels->swizzle32(out, pixels, n, info->order, info->opaque);
+            }
+            break;
+        case PIXEL_LAYOUT_SWIZZLE64:
+            kernels->swizzle64(out, pixels, n, info->order, info->opaque);
+            break;
+        case PIXEL_LAYOUT_RGB565:
+            kernels->rgb565(out, pixels, n);
+            break;
+        case PIXEL_LAYOUT_RGB2101010:
+            kernels->rgb2101010(out, pixels, n, info->swap_rb, info->opaque);
+            break;
+        case PIXEL_LAYOUT_NV12: {
+            const uint8_t *uv_row = (const uint8_t *)source->planes[1] +
+                                    (size_t)(row / 2) * (size_t)source->strides[1];
+            kernels->nv12(out, line, uv_row, x0, n);
+            break;
+        }
+        case PIXEL_LAYOUT_P010: {
+            const uint8_t *uv_row = (const uint8_t *)source->planes[1] +
+                                    (size_t)(row / 2) * (size_t)source->strides[1];
+            p010_scalar(out, line, uv_row, x0, n);
+            break;
+        }
+        case PIXEL_LAYOUT_YUV420: {
+            const uint8_t *u_row = (const uint8_t *)source->planes[1] +
+                                   (size_t)(row / 2) * (size_t)source->strides[1];
+            const uint8_t *v_row = (const uint8_t *)source->planes[2] +
+                                   (size_t)(row / 2) * (size_t)source->strides[2];
+            yuv420_scalar(out, line, u_row, v_row, x0, n);
+            break;
+        }
+        case PIXEL_LAYOUT_YUYV:
+            kernels->yuyv(out, line, x0, n);
+            break;
+        default:
+            return -1;
+        }
+
+        if ((flags & PIXEL_CONVERT_STRAIGHT_ALPHA) && !info->opaque) {
+            kernels->premultiply(out, n);
+        }
+    }
+    return 0;
+}
+
+int
+pixel_convert_region(const struct pixel_convert_source *source, const pixman_region32_t *region,
+                     void *dst_image, int32_t dst_stride, uint32_t flags)
+{
+    int n_rects = 0;
+    const pixman_box32_t *rects = pixman_region32_rectangles(region, &n_rects);
+    for (int i = 0; i < n_rects; i++) {
+        int32_t x = rects[i].x1 < 0 ? 0 : rects[i].x1;
+        int32_t y = rects[i].y1 < 0 ? 0 : rects[i].y1;
+        uint8_t *dst = (uint8_t *)dst_image + (size_t)y * (size_t)dst_stride + (size_t)x * 4;
+        if (pixel_convert_rect(source, x, y, rects[i].x2 - x, rects[i].y2 - y, dst, dst_stride,
+                               flags) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <pixman.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Pixel format conversion for CPU buffer uploads
+// Converts wl_shm / DRM fourcc buffers to premultiplied ARGB8888 (B, G, R, A
+// bytes in memory: MTLPixelFormatBGRA8Unorm, PIXMAN_a8r8g8b8, CoreGraphics
+// 32Little | PremultipliedFirst). Only the requested rectangles are touched,
+// so renderers convert just the damaged part of a buffer.
+//
+// Supported sources: 8888 channel orders, RGB565, 2101010, 16161616,
+// NV12, P010, YUV420 and YUYV (BT.601 limited range). Kernels are picked once at runtime
+// from the best of AVX2, SSE4.1, NEON and a scalar reference that defines
+// the expected output; all implementations produce identical pixels.
+
+#define PIXEL_FOURCC(a, b, c, d) \
+    ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+// DRM fourcc codes (wl_shm uses the same values except ARGB8888 = 0 and
+// XRGB8888 = 1, which are accepted as well)
+#define PIXEL_FORMAT_ARGB8888 PIXEL_FOURCC('A', 'R', '2', '4')
+#define PIXEL_FORMAT_XRGB8888 PIXEL_FOURCC('X', 'R', '2', '4')
+#define PIXEL_FORMAT_ABGR8888 PIXEL_FOURCC('A', 'B', '2', '4')
+#define PIXEL_FORMAT_XBGR8888 PIXEL_FOURCC('X', 'B', '2', '4')
+#define PIXEL_FORMAT_RGBA8888 PIXEL_FOURCC('R', 'A', '2', '4')
+#define PIXEL_FORMAT_RGBX8888 PIXEL_FOURCC('R', 'X', '2', '4')
+#define PIXEL_FORMAT_BGRA8888 PIXEL_FOURCC('B', 'A', '2', '4')
+#define PIXEL_FORMAT_BGRX8888 PIXEL_FOURCC('B', 'X', '2', '4')
+#define PIXEL_FORMAT_RGB565 PIXEL_FOURCC('R', 'G', '1', '6')
+#define PIXEL_FORMAT_ARGB2101010 PIXEL_FOURCC('A', 'R', '3', '0')
+#define PIXEL_FORMAT_XRGB2101010 PIXEL_FOURCC('X', 'R', '3', '0')
+#define PIXEL_FORMAT_ABGR2101010 PIXEL_FOURCC('A', 'B', '3', '0')
+#define PIXEL_FORMAT_XBGR2101010 PIXEL_FOURCC('X', 'B', '3', '0')
+#define PIXEL_FORMAT_ARGB16161616 PIXEL_FOURCC('A', 'R', '4', '8')
+#define PIXEL_FORMAT_XRGB16161616 PIXEL_FOURCC('X', 'R', '4', '8')
+#define PIXEL_FORMAT_ABGR16161616 PIXEL_FOURCC('A', 'B', '4', '8')
+#define PIXEL_FORMAT_XBGR16161616 PIXEL_FOURCC('X', 'B', '4', '8')
+#define PIXEL_FORMAT_NV12 PIXEL_FOURCC('N', 'V', '1', '2')
+#define PIXEL_FORMAT_P010 PIXEL_FOURCC('P', '0', '1', '0')
+#define PIXEL_FORMAT_YUV420 PIXEL_FOURCC('Y', 'U', '1', '2')
+#define PIXEL_FORMAT_YUYV PIXEL_FOURCC('Y', 'U', 'Y', 'V')
+
+// Conversion flags
+#define PIXEL_CONVERT_STRAIGHT_ALPHA (1u << 0)  // Source alpha is not premultiplied
+
+struct pixel_convert_source {
+    uint32_t format;
+    int32_t width;
+    int32_t height;
+    const void *planes[3];  // NV12/P010: Y and interleaved UV; YUV420: Y, U, V
+    int32_t strides[3];
+};
+
+enum pixel_convert_isa {
+    PIXEL_CONVERT_ISA_AUTO,
+    PIXEL_CONVERT_ISA_SCALAR,
+    PIXEL_CONVERT_ISA_SSE41,
+    PIXEL_CONVERT_ISA_AVX2,
+    PIXEL_CONVERT_ISA_NEON,
+};
+
+// Describe a contiguous buffer of size bytes. Multi-planar formats follow
+// the luma plane with the chroma plane at stride * height, same stride
+// (YUV420: U then V at stride / 2). Returns false if the format is not
+// supported, a row does not fit its stride or the planes do not fit size.
+bool pixel_convert_source_init(struct pixel_convert_source *source, uint32_t format,
+                               const void *data, int32_t width, int32_t height, int32_t stride,
+                               size_t size);
+// Describe a buffer whose planes are laid out independently (dmabuf).
+// Returns false if the format is not supported, n_planes does not match or
+// a row does not fit its plane's stride.
+bool pixel_convert_source_init_planes(struct pixel_convert_source *source, uint32_t format,
+                                      int32_t width, int32_t height, const void *const *planes,
+                                      const int32_t *strides, int n_planes);
+
+bool pixel_convert_is_supported(uint32_t format);
+// ARGB8888 and XRGB8888 are uploaded as is; everything else supported must
+// go through the converter for a BGRA8 destination
+bool pixel_convert_needs_conversion(uint32_t format);
+// Formats without an alpha channel (any X bits are ignored), whose pixels
+// can be drawn without blending
+bool pixel_convert_is_opaque(uint32_t format);
+// Formats to advertise on wl_shm (besides the mandatory ARGB8888/XRGB8888)
+int pixel_convert_get_formats(const uint32_t **formats);
+// Whether a wl_shm buffer can be read whole. libwayland only checks that
+// stride * height fits the pool and that stride >= width, in bytes against
+// pixels: rows of formats wider than a byte per pixel may overrun it, and
+// a multi-planar buffer has no room for its chroma. Renderers skip buffers
+// failing this before touching their pixels, converted or not.
+bool pixel_convert_shm_buffer_fits(uint32_t format, int32_t width, int32_t height,
+                                   int32_t stride);
+
+// Convert the rectangle at (x, y) of the source into dst, which points at
+// the destination pixel for (x, y). The rectangle is clipped to the source.
+// Returns 0 on success, -1 if the format is not supported.
+int pixel_convert_rect(const struct pixel_convert_source *source, int32_t x, int32_t y,
+                       int32_t width, int32_t height, void *dst, int32_t dst_stride,
+                       uint32_t flags);
+
+// Convert every rectangle of region into dst_image, a destination laid out
+// like the source (pixel (x, y) at dst_image + y * dst_stride + x * 4)
+int pixel_convert_region(const struct pixel_convert_source *source,
+                         const pixman_region32_t *region, void *dst_image, int32_t dst_stride,
+                         uint32_t flags);
+
+// Kernel selection. set_isa returns false if the ISA is not available on
+// this CPU (the current selection is kept). Used to compare implementations.
+bool pixel_convert_set_isa(enum pixel_convert_isa isa);
+const char *pixel_convert_get_isa_name(void);
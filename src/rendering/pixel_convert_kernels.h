@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Internal to pixel_convert*.c: one row kernel per source layout. Every
+// kernel writes n premultiplied ARGB8888 pixels to dst. Sources are byte
+// pointers with no alignment guarantee.
+//
+// order[] gives, for output B, G, R and A, the index of the source channel
+// (bytes for 8888, 16-bit words for 16161616). Opaque sources get alpha 0xff.
+
+struct pixel_convert_kernels {
+    const char *name;
+    void (*swizzle32)(uint32_t *dst, const uint8_t *src, int32_t n, const uint8_t order[4],
+                      bool opaque);
+    void (*swizzle64)(uint32_t *dst, const uint8_t *src, int32_t n, const uint8_t order[4],
+                      bool opaque);
+    void (*rgb565)(uint32_t *dst, const uint8_t *src, int32_t n);
+    void (*rgb2101010)(uint32_t *dst, const uint8_t *src, int32_t n, bool swap_rb, bool opaque);
+    // Chroma is subsampled horizontally: x is the column of dst[0] in the
+    // source row, so that odd starting columns pick the right chroma pair
+    void (*nv12)(uint32_t *dst, const uint8_t *y_row, const uint8_t *uv_row, int32_t x,
+                 int32_t n);
+    void (*yuyv)(uint32_t *dst, const uint8_t *row, int32_t x, int32_t n);
+    void (*premultiply)(uint32_t *pixels, int32_t n);
+};
+
+// Scalar reference (always available); SIMD kernels use these for edges
+extern const struct pixel_convert_kernels pixel_convert_scalar_kernels;
+
+void pixel_convert_swizzle32_scalar(uint32_t *dst, const uint8_t *src, int32_t n,
+                                    const uint8_t order[4], bool opaque);
+void pixel_convert_swizzle64_scalar(uint32_t *dst, const uint8_t *src, int32_t n,
+                                    const uint8_t order[4], bool opaque);
+void pixel_convert_rgb565_scalar(uint32_t *dst, const uint8_t *src, int32_t n);
+void pixel_convert_rgb2101010_scalar(uint32_t *dst, const uint8_t *src, int32_t n, bool swap_rb,
+                                     bool opaque);
+void pixel_convert_nv12_scalar(uint32_t *dst, const uint8_t *y_row, const uint8_t *uv_row,
+                               int32_t x, int32_t n);
+void pixel_convert_yuyv_scalar(uint32_t *dst, const uint8_t *row, int32_t x, int32_t n);
+void pixel_convert_premultiply_scalar(uint32_t *pixels, int32_t n);
+
+// SIMD kernel tables, NULL when not compiled for this architecture or not
+// supported by the running CPU
+const struct pixel_convert_kernels *pixel_convert_sse41_kernels(void);
+const struct pixel_convert_kernels *pixel_convert_avx2_kernels(void);
+const struct pixel_convert_kernels *pixel_convert_neon_kernels(void);
@@ -0,0 +1,225 @@
+#include "pixel_convert_kernels.h"
+#include <stddef.h>
+
+// NEON kernels (AArch64: Apple Silicon, iOS and arm64 Android, where NEON
+// is always present). vld4/vst4 deinterleave channels, so every swizzle is
+// a register permutation. Tails and odd chroma starts use the scalar kernels.
+
+#if defined(__aarch64__)
+
+#include <arm_neon.h>
+
+static void
+swizzle32_neon(uint32_t *dst, const uint8_t *src, int32_t n, const uint8_t order[4], bool opaque)
+{
+    int32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x4_t in = vld4q_u8(src + (size_t)i * 4);
+        uint8x16x4_t out;
+        out.val[0] = in.val[order[0]];
+        out.val[1] = in.val[order[1]];
+        out.val[2] = in.val[order[2]];
+        out.val[3] = opaque ? vdupq_n_u8(0xff) : in.val[order[3]];
+        vst4q_u8((uint8_t *)(dst + i), out);
+    }
+    pixel_convert_swizzle32_scalar(dst + i, src + (size_t)i * 4, n - i, order, opaque);
+}
+
+static void
+swizzle64_neon(uint32_t *dst, const uint8_t *src, int32_t n, const uint8_t order[4], bool opaque)
+{
+    int32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint16x8x4_t in = vld4q_u16((const uint16_t *)(const void *)(src + (size_t)i * 8));
+        uint8x8x4_t out;
+        out.val[0] = vshrn_n_u16(in.val[order[0]], 8);
+        out.val[1] = vshrn_n_u16(in.val[order[1]], 8);
+        out.val[2] = vshrn_n_u16(in.val[order[2]], 8);
+        out.val[3] = opaque ? vdup_n_u8(0xff) : vshrn_n_u16(in.val[order[3]], 8);
+        vst4_u8((uint8_t *)(dst + i), out);
+    }
+    pixel_convert_swizzle64_scalar(dst + i, src + (size_t)i * 8, n - i, order, opaque);
+}
+
+static void
+rgb565_neon(uint32_t *dst, const uint8_t *src, int32_t n)
+{
+    int32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t p = vld1q_u16((const uint16_t *)(const void *)(src + (size_t)i * 2));
+        uint16x8_t r = vshrq_n_u16(p, 11);
+        uint16x8_t g = vandq_u16(vshrq_n_u16(p, 5), vdupq_n_u16(0x3f));
+        uint16x8_t b = vandq_u16(p, vdupq_n_u16(0x1f));
+        uint8x8x4_t out;
+        out.val[0] = vmovn_u16(vorrq_u16(vshlq_n_u16(b, 3), vshrq_n_u16(b, 2)));
+        out.val[1] = vmovn_u16(vorrq_u16(vshlq_n_u16(g, 2), vshrq_n_u16(g, 4)));
+        out.val[2] = vmovn_u16(vorrq_u16(vshlq_n_u16(r, 3), vshrq_n_u16(r, 2)));
+        out.val[3] = vdup_n_u8(0xff);
+        vst4_u8((uint8_t *)(dst + i), out);
+    }
+    pixel_convert_rgb565_scalar(dst + i, src + (size_t)i * 2, n - i);
+}
+
+static void
+rgb2101010_neon(uint32_t *dst, const uint8_t *src, int32_t n, bool swap_rb, bool opaque)
+{
+    uint32x4_t mask8 = vdupq_n_u32(0xff);
+    int32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint32x4_t p = vld1q_u32((const uint32_t *)(const void *)(src + (size_t)i * 4));
+        uint32x4_t hi = vandq_u32(vshrq_n_u32(p, 22), mask8);
+        uint32x4_t g = vandq_u32(vshrq_n_u32(p, 12), mask8);
+        uint32x4_t lo = vandq_u32(vshrq_n_u32(p, 2), mask8);
+        uint32x4_t a = opaque ? mask8 : vmulq_n_u32(vshrq_n_u32(p, 30), 85);
+        uint32x4_t r = swap_rb ? lo : hi;
+        uint32x4_t b = swap_rb ? hi : lo;
+        uint32x4_t out = vorrq_u32(vorrq_u32(vshlq_n_u32(a, 24), vshlq_n_u32(r, 16)),
+                                   vorrq_u32(vshlq_n_u32(g, 8), b));
+        vst1q_u32(dst + i, out);
+    }
+    pixel_convert_rgb2101010_scalar(dst + i, src + (size_t)i * 4, n - i, swap_rb, opaque);
+}
+
+// One output channel of yuv_to_argb() (pixel_convert.c) for four pixels,
+// clamped to [0, 65535]; the final narrowing clamps to 255
+static inline uint16x4_t
+yuv_channel(int32x4_t c, int32x4_t d, int32x4_t e, int32_t kd, int32_t ke)
+{
+    int32x4_t sum = vmlaq_n_s32(vmlaq_n_s32(c, d, kd), e, ke);
+    return vqmovun_s32(vshrq_n_s32(sum, 8));
+}
+
+static inline int32x4_t
+widen_low(uint16x8_t v)
+{
+    return vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(v)));
+}
+
+static inline int32x4_t
+widen_high(uint16x8_t v)
+{
+    return vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(v)));
+}
+
+// Eight pixels into B, G, R
+static inline uint8x8x3_t
+yuv_to_bgr_neon(uint8x8_t y, uint8x8_t u, uint8x8_t v)
+{
+    uint16x8_t y16 = vmovl_u8(y);
+    uint16x8_t u16 = vmovl_u8(u);
+    uint16x8_t v16 = vmovl_u8(v);
+    int32x4_t c[2], d[2], e[2];
+    c[0] = vaddq_s32(vmulq_n_s32(vsubq_s32(widen_low(y16), vdupq_n_s32(16)), 298), vdupq_n_s32(128));
+    c[1] = vaddq_s32(vmulq_n_s32(vsubq_s32(widen_high(y16), vdupq_n_s32(16)), 298), vdupq_n_s32(128));
+    d[0] = vsubq_s32(widen_low(u16), vdupq_n_s32(128));
+    d[1] = vsubq_s32(widen_high(u16), vdupq_n_s32(128));
+    e[0] = vsubq_s32(widen_low(v16), vdupq_n_s32(128));
+    e[1] = vsubq_s32(widen_high(v16), vdupq_n_s32(128));
+
+    uint8x8x3_t bgr;
+    bgr.val[0] = vqmovn_u16(vcombine_u16(yuv_channel(c[0], d[0], e[0], 516, 0),
+                                         yuv_channel(c[1], d[1], e[1], 516, 0)));
+    bgr.val[1] = vqmovn_u16(vcombine_u16(yuv_channel(c[0], d[0], e[0], -100, -208),
+                                         yuv_channel(c[1], d[1], e[1], -100, -208)));
+    bgr.val[2] = vqmovn_u16(vcombine_u16(yuv_channel(c[0], d[0], e[0], 0, 409),
+                                         yuv_channel(c[1], d[1], e[1], 0, 409)));
+    return bgr;
+}
+
+// Sixteen pixels from Y and per-pair U/V (eight of each)
+static inline void
+store_yuv16_neon(uint32_t *dst, uint8x16_t y, uint8x8_t u, uint8x8_t v)
+{
+    uint8x8x2_t uu = vzip_u8(u, u);
+    uint8x8x2_t vv = vzip_u8(v, v);
+    uint8x8x3_t lo = yuv_to_bgr_neon(vget_low_u8(y), uu.val[0], vv.val[0]);
+    uint8x8x3_t hi = yuv_to_bgr_neon(vget_high_u8(y), uu.val[1], vv.val[1]);
+    uint8x16x4_t out;
+    out.val[0] = vcombine_u8(lo.val[0], hi.val[0]);
+    out.val[1] = vcombine_u8(lo.val[1], hi.val[1]);
+    out.val[2] = vcombine_u8(lo.val[2], hi.val[2]);
+    out.val[3] = vdupq_n_u8(0xff);
+    vst4q_u8((uint8_t *)dst, out);
+}
+
+static void
+nv12_neon(uint32_t *dst, const uint8_t *y_row, const uint8_t *uv_row, int32_t x, int32_t n)
+{
+    int32_t i = 0;
+    if (x & 1) {
+        pixel_convert_nv12_scalar(dst, y_row, uv_row, x, 1);
+        i = 1;
+    }
+    for (; i + 16 <= n; i += 16) {
+        int32_t column = x + i;
+        uint8x8x2_t uv = vld2_u8(uv_row + column);
+        store_yuv16_neon(dst + i, vld1q_u8(y_row + column), uv.val[0], uv.val[1]);
+    }
+    pixel_convert_nv12_scalar(dst + i, y_row, uv_row, x + i, n - i);
+}
+
+static void
+yuyv_neon(uint32_t *dst, const uint8_t *row, int32_t x, int32_t n)
+{
+    int32_t i = 0;
+    if (x & 1) {
+        pixel_convert_yuyv_scalar(dst, row, x, 1);
+        i = 1;
+    }
+    for (; i + 16 <= n; i += 16) {
+        // y0 u y1 v per pair: val[0]/val[2] are even/odd luma
+        uint8x8x4_t p = vld4_u8(row + (size_t)(x + i) * 2);
+        uint8x8x2_t y = vzip_u8(p.val[0], p.val[2]);
+        store_yuv16_neon(dst + i, vcombine_u8(y.val[0], y.val[1]), p.val[1], p.val[3]);
+    }
+    pixel_convert_yuyv_scalar(dst + i, row, x + i, n - i);
+}
+
+// c * a / 255 rounded, as mul_div_255(): (t + ((t + 128) >> 8) + 128) >> 8
+static inline uint8x8_t
+mul_div_255_neon(uint8x8_t c, uint8x8_t a)
+{
+    uint16x8_t t = vmull_u8(c, a);
+    return vraddhn_u16(t, vrshrq_n_u16(t, 8));
+}
+
+static void
+premultiply_neon(uint32_t *pixels, int32_t n)
+{
+    int32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint8x8x4_t p = vld4_u8((const uint8_t *)(pixels + i));
+        p.val[0] = mul_div_255_neon(p.val[0], p.val[3]);
+        p.val[1] = mul_div_255_neon(p.val[1], p.val[3]);
+        p.val[2] = mul_div_255_neon(p.val[2], p.val[3]);
+        vst4_u8((uint8_t *)(pixels + i), p);
+    }
+    pixel_convert_premultiply_scalar(pixels + i, n - i);
+}
+
+static const struct pixel_convert_kernels neon_kernels = {
+    .name = "neon",
+    .swizzle32 = swizzle32_neon,
+    .swizzle64 = swizzle64_neon,
+    .rgb565 = rgb565_neon,
+    .rgb2101010 = rgb2101010_neon,
+    .nv12 = nv12_neon,
+    .yuyv = yuyv_neon,
+    .premultiply = premultiply_neon,
+};
+
+const struct pixel_convert_kernels *
+pixel_convert_neon_kernels(void)
+{
+    return &neon_kernels;
+}
+
+#else
+
+const struct pixel_convert_kernels *
+pixel_convert_neon_kernels(void)
+{
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,391 @@
+#include "pixel_convert_kernels.h"
+#include <stddef.h>
+#include <string.h>
+
+// SSE4.1 and AVX2 kernels. Built without -msse4.1/-mavx2: each function
+// carries a target attribute and is only reached after a CPUID check, so the
+// binary still runs on any x86-64. Tails shorter than a vector, and chroma
+// that starts on an odd column, go through the scalar kernels.
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+// --- SSE4.1 ---
+
+TARGET_SSE41 static inline __m128i
+shuffle_mask_swizzle32(const uint8_t order[4])
+{
+    uint8_t mask[16];
+    for (int j = 0; j < 4; j++) {
+        for (int k = 0; k < 4; k++) {
+            mask[j * 4 + k] = (uint8_t)(j * 4 + order[k]);
+        }
+    }
+    return _mm_loadu_si128((const __m128i *)(const void *)mask);
+}
+
+TARGET_SSE41 static void
+swizzle32_sse41(uint32_t *dst, const uint8_t *src, int32_t n, const uint8_t order[4], bool opaque)
+{
+    __m128i shuffle = shuffle_mask_swizzle32(order);
+    __m128i alpha = _mm_set1_epi32(opaque ? (int32_t)0xff000000u : 0);
+    int32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(const void *)(src + (size_t)i * 4));
+        p = _mm_or_si128(_mm_shuffle_epi8(p, shuffle), alpha);
+        _mm_storeu_si128((__m128i *)(void *)(dst + i), p);
+    }
+    pixel_convert_swizzle32_scalar(dst + i, src + (size_t)i * 4, n - i, order, opaque);
+}
+
+TARGET_SSE41 static void
+swizzle64_sse41(uint32_t *dst, const uint8_t *src, int32_t n, const uint8_t order[4], bool opaque)
+{
+    // Two pixels per 16-byte load: gather the high byte of each channel
+    // into the low 8 bytes, then join two loads
+    uint8_t mask[16];
+    for (int j = 0; j < 2; j++) {
+        for (int k = 0; k < 4; k++) {
+            mask[j * 4 + k] = (uint8_t)(j * 8 + order[k] * 2 + 1);
+        }
+    }
+    memset(mask + 8, 0x80, 8);
+    __m128i shuffle = _mm_loadu_si128((const __m128i *)(const void *)mask);
+    __m128i alpha = _mm_set1_epi32(opaque ? (int32_t)0xff000000u : 0);
+    int32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const uint8_t *p = src + (size_t)i * 8;
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(const void *)p), shuffle);
+        __m128i b =
+            _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(const void *)(p + 16)), shuffle);
+        _mm_storeu_si128((__m128i *)(void *)(dst + i), _mm_or_si128(_mm_unpacklo_epi64(a, b), alpha));
+    }
+    pixel_convert_swizzle64_scalar(dst + i, src + (size_t)i * 8, n - i, order, opaque);
+}
+
+TARGET_SSE41 static void
+rgb565_sse41(uint32_t *dst, const uint8_t *src, int32_t n)
+{
+    __m128i mask5 = _mm_set1_epi16(0x1f);
+    __m128i mask6 = _mm_set1_epi16(0x3f);
+    __m128i alpha = _mm_set1_epi16((int16_t)0xff00);
+    int32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(const void *)(src + (size_t)i * 2));
+        __m128i r = _mm_srli_epi16(p, 11);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(p, 5), mask6);
+        __m128i b = _mm_and_si128(p, mask5);
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+        __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+        __m128i ra = _mm_or_si128(r, alpha);
+        _mm_storeu_si128((__m128i *)(void *)(dst + i), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i *)(void *)(dst + i + 4), _mm_unpackhi_epi16(bg, ra));
+    }
+    pixel_convert_rgb565_scalar(dst + i, src + (size_t)i * 2, n - i);
+}
+
+TARGET_SSE41 static void
+rgb2101010_sse41(uint32_t *dst, const uint8_t *src, int32_t n, bool swap_rb, bool opaque)
+{
+    __m128i mask8 = _mm_set1_epi32(0xff);
+    int32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(const void *)(src + (size_t)i * 4));
+        __m128i hi = _mm_and_si128(_mm_srli_epi32(p, 22), mask8);
+        __m128i g = _mm_and_si128(_mm_srli_epi32(p, 12), mask8);
+        __m128i lo = _mm_and_si128(_mm_srli_epi32(p, 2), mask8);
+        __m128i a = opaque ? mask8 : _mm_mullo_epi32(_mm_srli_epi32(p, 30), _mm_set1_epi32(85));
+        __m128i r = swap_rb ? lo : hi;
+        __m128i b = swap_rb ? hi : lo;
+        __m128i out = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(a, 24), _mm_slli_epi32(r, 16)),
+                                   _mm_or_si128(_mm_slli_epi32(g, 8), b));
+        _mm_storeu_si128((__m128i *)(void *)(dst + i), out);
+    }
+    pixel_convert_rgb2101010_scalar(dst + i, src + (size_t)i * 4, n - i, swap_rb, opaque);
+}
+
+// Same arithmetic as yuv_to_argb() in pixel_convert.c, four pixels at a time
+TARGET_SSE41 static inline __m128i
+yuv_to_argb_sse41(__m128i y, __m128i u, __m128i v)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i max = _mm_set1_epi32(255);
+    __m128i c = _mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(y, _mm_set1_epi32(16)), _mm_set1_epi32(298)),
+                              _mm_set1_epi32(128));
+    __m128i d = _mm_sub_epi32(u, _mm_set1_epi32(128));
+    __m128i e = _mm_sub_epi32(v, _mm_set1_epi32(128));
+    __m128i r = _mm_add_epi32(c, _mm_mullo_epi32(e, _mm_set1_epi32(409)));
+    __m128i g = _mm_sub_epi32(c, _mm_add_epi32(_mm_mullo_epi32(d, _mm_set1_epi32(100)),
+                                               _mm_mullo_epi32(e, _mm_set1_epi32(208))));
+    __m128i b = _mm_add_epi32(c, _mm_mullo_epi32(d, _mm_set1_epi32(516)));
+    r = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(r, 8), zero), max);
+    g = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(g, 8), zero), max);
+    b = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(b, 8), zero), max);
+    return _mm_or_si128(_mm_or_si128(_mm_set1_epi32((int32_t)0xff000000u), _mm_slli_epi32(r, 16)),
+                        _mm_or_si128(_mm_slli_epi32(g, 8), b));
+}
+
+TARGET_SSE41 static inline __m128i
+load_u32(const uint8_t *p)
+{
+    int32_t value;
+    memcpy(&value, p, sizeof(value));
+    return _mm_cvtsi32_si128(value);
+}
+
+TARGET_SSE41 static inline __m128i
+load_u64(const uint8_t *p)
+{
+    return _mm_loadl_epi64((const __m128i *)(const void *)p);
+}
+
+TARGET_SSE41 static void
+nv12_sse41(uint32_t *dst, const uint8_t *y_row, const uint8_t *uv_row, int32_t x, int32_t n)
+{
+    int32_t i = 0;
+    if (x & 1) {
+        pixel_convert_nv12_scalar(dst, y_row, uv_row, x, 1);
+        i = 1;
+    }
+    // u0 v0 u1 v1 -> u0 u0 u1 u1 / v0 v0 v1 v1 in 32-bit lanes
+    __m128i u_shuffle = _mm_setr_epi8(0, -1, -1, -1, 0, -1, -1, -1, 2, -1, -1, -1, 2, -1, -1, -1);
+    __m128i v_shuffle = _mm_setr_epi8(1, -1, -1, -1, 1, -1, -1, -1, 3, -1, -1, -1, 3, -1, -1, -1);
+    for (; i + 4 <= n; i += 4) {
+        int32_t column = x + i;
+        __m128i y = _mm_cvtepu8_epi32(load_u32(y_row + column));
+        __m128i uv = load_u32(uv_row + column);
+        __m128i out = yuv_to_argb_sse41(y, _mm_shuffle_epi8(uv, u_shuffle), _mm_shuffle_epi8(uv, v_shuffle));
+        _mm_storeu_si128((__m128i *)(void *)(dst + i), out);
+    }
+    pixel_convert_nv12_scalar(dst + i, y_row, uv_row, x + i, n - i);
+}
+
+TARGET_SSE41 static void
+yuyv_sse41(uint32_t *dst, const uint8_t *row, int32_t x, int32_t n)
+{
+    int32_t i = 0;
+    if (x & 1) {
+        pixel_convert_yuyv_scalar(dst, row, x, 1);
+        i = 1;
+    }
+    // y0 u0 y1 v0 y2 u1 y3 v1 -> 32-bit lanes
+    __m128i y_shuffle = _mm_setr_epi8(0, -1, -1, -1, 2, -1, -1, -1, 4, -1, -1, -1, 6, -1, -1, -1);
+    __m128i u_shuffle = _mm_setr_epi8(1, -1, -1, -1, 1, -1, -1, -1, 5, -1, -1, -1, 5, -1, -1, -1);
+    __m128i v_shuffle = _mm_setr_epi8(3, -1, -1, -1, 3, -1, -1, -1, 7, -1, -1, -1, 7, -1, -1, -1);
+    for (; i + 4 <= n; i += 4) {
+        __m128i p = load_u64(row + (size_t)(x + i) * 2);
+        __m128i out = yuv_to_argb_sse41(_mm_shuffle_epi8(p, y_shuffle), _mm_shuffle_epi8(p, u_shuffle),
+                                        _mm_shuffle_epi8(p, v_shuffle));
+        _mm_storeu_si128((__m128i *)(void *)(dst + i), out);
+    }
+    pixel_convert_yuyv_scalar(dst + i, row, x + i, n - i);
+}
+
+// c * a / 255 on 16-bit lanes, matching mul_div_255(); the alpha lane is
+// multiplied by 255 so it comes out unchanged
+TARGET_SSE41 static inline __m128i
+premultiply_half_sse41(__m128i c)
+{
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm_blend_epi16(a, _mm_set1_epi16(255), 0x88);
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(c, a), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+TARGET_SSE41 static void
+premultiply_sse41(uint32_t *pixels, int32_t n)
+{
+    int32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(const void *)(pixels + i));
+        __m128i lo = premultiply_half_sse41(_mm_cvtepu8_epi16(p));
+        __m128i hi = premultiply_half_sse41(_mm_unpackhi_epi8(p, _mm_setzero_si128()));
+        _mm_storeu_si128((__m128i *)(void *)(pixels + i), _mm_packus_epi16(lo, hi));
+    }
+    pixel_convert_premultiply_scalar(pixels + i, n - i);
+}
+
+static const struct pixel_convert_kernels sse41_kernels = {
+    .name = "sse4.1",
+    .swizzle32 = swizzle32_sse41,
+    .swizzle64 = swizzle64_sse41,
+    .rgb565 = rgb565_sse41,
+    .rgb2101010 = rgb2101010_sse41,
+    .nv12 = nv12_sse41,
+    .yuyv = yuyv_sse41,
+    .premultiply = premultiply_sse41,
+};
+
+// --- AVX2 ---
+
+TARGET_AVX2 static void
+swizzle32_avx2(uint32_t *dst, const uint8_t *src, int32_t n, const uint8_t order[4], bool opaque)
+{
+    // vpshufb works per 128-bit lane; both lanes use the same mask
+    __m128i mask = shuffle_mask_swizzle32(order);
+    __m256i shuffle = _mm256_broadcastsi128_si256(mask);
+    __m256i alpha = _mm256_set1_epi32(opaque ? (int32_t)0xff000000u : 0);
+    int32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)(const void *)(src + (size_t)i * 4));
+        p = _mm256_or_si256(_mm256_shuffle_epi8(p, shuffle), alpha);
+        _mm256_storeu_si256((__m256i *)(void *)(dst + i), p);
+    }
+    swizzle32_sse41(dst + i, src + (size_t)i * 4, n - i, order, opaque);
+}
+
+TARGET_AVX2 static void
+rgb2101010_avx2(uint32_t *dst, const uint8_t *src, int32_t n, bool swap_rb, bool opaque)
+{
+    __m256i mask8 = _mm256_set1_epi32(0xff);
+    int32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)(const void *)(src + (size_t)i * 4));
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi32(p, 22), mask8);
+        __m256i g = _mm256_and_si256(_mm256_srli_epi32(p, 12), mask8);
+        __m256i lo = _mm256_and_si256(_mm256_srli_epi32(p, 2), mask8);
+        __m256i a = opaque ? mask8 : _mm256_mullo_epi32(_mm256_srli_epi32(p, 30), _mm256_set1_epi32(85));
+        __m256i r = swap_rb ? lo : hi;
+        __m256i b = swap_rb ? hi : lo;
+        __m256i out = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(a, 24), _mm256_slli_epi32(r, 16)),
+                                      _mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+        _mm256_storeu_si256((__m256i *)(void *)(dst + i), out);
+    }
+    rgb2101010_sse41(dst + i, src + (size_t)i * 4, n - i, swap_rb, opaque);
+}
+
+TARGET_AVX2 static inline __m256i
+yuv_to_argb_avx2(__m256i y, __m256i u, __m256i v)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i max = _mm256_set1_epi32(255);
+    __m256i c = _mm256_add_epi32(
+        _mm256_mullo_epi32(_mm256_sub_epi32(y, _mm256_set1_epi32(16)), _mm256_set1_epi32(298)),
+        _mm256_set1_epi32(128));
+    __m256i d = _mm256_sub_epi32(u, _mm256_set1_epi32(128));
+    __m256i e = _mm256_sub_epi32(v, _mm256_set1_epi32(128));
+    __m256i r = _mm256_add_epi32(c, _mm256_mullo_epi32(e, _mm256_set1_epi32(409)));
+    __m256i g = _mm256_sub_epi32(c, _mm256_add_epi32(_mm256_mullo_epi32(d, _mm256_set1_epi32(100)),
+                                                     _mm256_mullo_epi32(e, _mm256_set1_epi32(208))));
+    __m256i b = _mm256_add_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(516)));
+    r = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(r, 8), zero), max);
+    g = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(g, 8), zero), max);
+    b = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(b, 8), zero), max);
+    return _mm256_or_si256(
+        _mm256_or_si256(_mm256_set1_epi32((int32_t)0xff000000u), _mm256_slli_epi32(r, 16)),
+        _mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+}
+
+TARGET_AVX2 static void
+nv12_avx2(uint32_t *dst, const uint8_t *y_row, const uint8_t *uv_row, int32_t x, int32_t n)
+{
+    int32_t i = 0;
+    if (x & 1) {
+        pixel_convert_nv12_scalar(dst, y_row, uv_row, x, 1);
+        i = 1;
+    }
+    // u0 v0 .. u3 v3 -> u0 u0 u1 u1 .. u3 u3 (bytes), then widened to 32 bits
+    __m128i u_shuffle = _mm_setr_epi8(0, 0, 2, 2, 4, 4, 6, 6, -1, -1, -1, -1, -1, -1, -1, -1);
+    __m128i v_shuffle = _mm_setr_epi8(1, 1, 3, 3, 5, 5, 7, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+    for (; i + 8 <= n; i += 8) {
+        int32_t column = x + i;
+        __m256i y = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(const void *)(y_row + column)));
+        __m128i uv = _mm_loadl_epi64((const __m128i *)(const void *)(uv_row + column));
+        __m256i u = _mm256_cvtepu8_epi32(_mm_shuffle_epi8(uv, u_shuffle));
+        __m256i v = _mm256_cvtepu8_epi32(_mm_shuffle_epi8(uv, v_shuffle));
+        _mm256_storeu_si256((__m256i *)(void *)(dst + i), yuv_to_argb_avx2(y, u, v));
+    }
+    nv12_sse41(dst + i, y_row, uv_row, x + i, n - i);
+}
+
+TARGET_AVX2 static void
+yuyv_avx2(uint32_t *dst, const uint8_t *row, int32_t x, int32_t n)
+{
+    int32_t i = 0;
+    if (x & 1) {
+        pixel_convert_yuyv_scalar(dst, row, x, 1);
+        i = 1;
+    }
+    __m128i y_shuffle = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1);
+    __m128i u_shuffle = _mm_setr_epi8(1, 1, 5, 5, 9, 9, 13, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+    __m128i v_shuffle = _mm_setr_epi8(3, 3, 7, 7, 11, 11, 15, 15, -1, -1, -1, -1, -1, -1, -1, -1);
+    for (; i + 8 <= n; i += 8) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(const void *)(row + (size_t)(x + i) * 2));
+        __m256i y = _mm256_cvtepu8_epi32(_mm_shuffle_epi8(p, y_shuffle));
+        __m256i u = _mm256_cvtepu8_epi32(_mm_shuffle_epi8(p, u_shuffle));
+        __m256i v = _mm256_cvtepu8_epi32(_mm_shuffle_epi8(p, v_shuffle));
+        _mm256_storeu_si256((__m256i *)(void *)(dst + i), yuv_to_argb_avx2(y, u, v));
+    }
+    yuyv_sse41(dst + i, row, x + i, n - i);
+}
+
+TARGET_AVX2 static inline __m256i
+premultiply_half_avx2(__m256i c)
+{
+    __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3)),
+                                       _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm256_blend_epi16(a, _mm256_set1_epi16(255), 0x88);
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(c, a), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+TARGET_AVX2 static void
+premultiply_avx2(uint32_t *pixels, int32_t n)
+{
+    // unpack/pack work per 128-bit lane, so the pixel order is preserved
+    __m256i zero = _mm256_setzero_si256();
+    int32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)(const void *)(pixels + i));
+        __m256i lo = premultiply_half_avx2(_mm256_unpacklo_epi8(p, zero));
+        __m256i hi = premultiply_half_avx2(_mm256_unpackhi_epi8(p, zero));
+        _mm256_storeu_si256((__m256i *)(void *)(pixels + i), _mm256_packus_epi16(lo, hi));
+    }
+    premultiply_sse41(pixels + i, n - i);
+}
+
+// 16161616 and RGB565 are bandwidth bound; the SSE4.1 versions are kept
+static const struct pixel_convert_kernels avx2_kernels = {
+    .name = "avx2",
+    .swizzle32 = swizzle32_avx2,
+    .swizzle64 = swizzle64_sse41,
+    .rgb565 = rgb565_sse41,
+    .rgb2101010 = rgb2101010_avx2,
+    .nv12 = nv12_avx2,
+    .yuyv = yuyv_avx2,
+    .premultiply = premultiply_avx2,
+};
+
+const struct pixel_convert_kernels *
+pixel_convert_sse41_kernels(void)
+{
+    return __builtin_cpu_supports("sse4.1") ? &sse41_kernels : NULL;
+}
+
+const struct pixel_convert_kernels *
+pixel_convert_avx2_kernels(void)
+{
+    return __builtin_cpu_supports("avx2") ? &avx2_kernels : NULL;
+}
+
+#else
+
+const struct pixel_convert_kernels *
+pixel_convert_sse41_kernels(void)
+{
+    return NULL;
+}
+
+const struct pixel_convert_kernels *
+pixel_convert_avx2_kernels(void)
+{
+    return NULL;
+}
+
+#endif
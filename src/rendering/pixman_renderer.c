@@ -0,0 +1,766 @@
+#include "pixman_renderer.h"
+#include "WawonaCompositor.h"
+#include "logging.h"
+#include "metal_dmabuf.h"
+#include "pixel_convert.h"
+#include "scene.h"
+#include "texture_pool.h"
+#include "trace.h"
+#include "wayland_linux_dmabuf.h"
+#include <math.h>
+#include <stdlib.h>
+#include <wayland-server-protocol.h>
+#include <wayland-server.h>
+
+// dmabuf formats are DRM fourcc codes. wl_shm uses the same codes except for
+// ARGB8888 (0) and XRGB8888 (1).
+#define PIXMAN_RENDERER_DRM_FORMAT_ARGB8888 0x34325241u  // 'AR24'
+#define PIXMAN_RENDERER_DRM_FORMAT_XRGB8888 0x34325258u  // 'XR24'
+
+// Same colour as the SurfaceRenderer background (0.1, 0.1, 0.2)
+#define PIXMAN_RENDERER_BACKGROUND 0xff1a1a33u
+
+// Idle pixel storage kept for reuse across resizes
+#define PIXMAN_RENDERER_POOL_BUDGET (64u * 1024u * 1024u)
+
+struct pixman_renderer_surface {
+    struct wl_list link;  // pixman_renderer::surfaces, bottom first
+    struct wl_surface_impl *surface;
+    pixman_image_t *image;  // Retained buffer contents, NULL while hidden
+    struct texture_pool_texture *storage;  // Pixels of image
+    int32_t x, y;           // Output rectangle the surface was last shown at
+    int32_t width, height;
+    int32_t buffer_width, buffer_height;  // Size of image
+    double src_x, src_y, src_width, src_height;  // Part of image scaled onto the rectangle
+    bool listed;            // In the last draw list (mapped); only listed surfaces are drawn
+    bool visible;           // Listed, shown and not fully occluded on the output
+    pixman_region32_t opaque;  // From the draw list, surface coordinates
+};
+
+struct pixman_renderer {
+    struct texture_pool *pool;  // 32bpp pixel storage shared by output and surfaces
+    pixman_image_t *output;
+    struct texture_pool_texture *output_storage;
+    pixman_region32_t damage;  // Output coordinates
+    struct wl_list surfaces;   // struct pixman_renderer_surface, bottom first
+    uint32_t stacking_generation;  // Draw list the stacking was last taken from
+    struct scene scene;        // Culling pass of the last repaint or visibility check
+    bool visibility_dirty;     // Entries' visible flags need a cull over the whole output
+    struct pixman_renderer_stats stats;
+};
+
+pixman_format_code_t
+pixman_renderer_format_from_fourcc(uint32_t format)
+{
+    switch (format) {
+    case WL_SHM_FORMAT_ARGB8888:
+    case PIXMAN_RENDERER_DRM_FORMAT_ARGB8888:
+        return PIXMAN_a8r8g8b8;
+    case WL_SHM_FORMAT_XRGB8888:
+    case PIXMAN_RENDERER_DRM_FORMAT_XRGB8888:
+        return PIXMAN_x8r8g8b8;
+    case WL_SHM_FORMAT_ABGR8888:
+        return PIXMAN_a8b8g8r8;
+    case WL_SHM_FORMAT_XBGR8888:
+        return PIXMAN_x8b8g8r8;
+    case WL_SHM_FORMAT_RGBA8888:
+        return PIXMAN_r8g8b8a8;
+    case WL_SHM_FORMAT_RGBX8888:
+        return PIXMAN_r8g8b8x8;
+    case WL_SHM_FORMAT_BGRA8888:
+        return PIXMAN_b8g8r8a8;
+    case WL_SHM_FORMAT_BGRX8888:
+        return PIXMAN_b8g8r8x8;
+    case WL_SHM_FORMAT_RGB565:
+        return PIXMAN_r5g6b5;
+    case WL_SHM_FORMAT_ARGB2101010:
+        return PIXMAN_a2r10g10b10;
+    case WL_SHM_FORMAT_XRGB2101010:
+        return PIXMAN_x2r10g10b10;
+    case WL_SHM_FORMAT_ABGR2101010:
+        return PIXMAN_a2b10g10r10;
+    case WL_SHM_FORMAT_XBGR2101010:
+        return PIXMAN_x2b10g10r10;
+    default:
+        return (pixman_format_code_t)0;
+    }
+}
+
+static void *
+pool_create_storage(void *user_data, uint32_t format, int32_t width, int32_t height)
+{
+    (void)user_data;
+    return pixman_image_create_bits_no_clear((pixman_format_code_t)format, width, height, NULL, 0);
+}
+
+static void
+pool_destroy_storage(void *user_data, void *texture)
+{
+    (void)user_data;
+    pixman_image_unref(texture);
+}
+
+static const struct texture_pool_ops pool_ops = {
+    .create = pool_create_storage,
+    .destroy = pool_destroy_storage,
+};
+
+// Exact-size image of the given format over pooled (bucket-size) storage,
+// so resizing reuses pixels instead of allocating new ones
+static pixman_image_t *
+renderer_image_acquire(struct pixman_renderer *renderer, pixman_format_code_t format,
+                       int32_t width, int32_t height, struct texture_pool_texture **storage)
+{
+    struct texture_pool_texture *pooled =
+        texture_pool_acquire(renderer->pool, PIXMAN_a8r8g8b8, width, height);
+    if (!pooled) {
+        return NULL;
+    }
+    pixman_image_t *bits = pooled->texture;
+    pixman_image_t *image = pixman_image_create_bits_no_clear(
+        format, width, height, pixman_image_get_data(bits), pixman_image_get_stride(bits));
+    if (!image) {
+        texture_pool_release(renderer->pool, pooled);
+        return NULL;
+    }
+    *storage = pooled;
+    return image;
+}
+
+static void
+renderer_image_release(struct pixman_renderer *renderer, pixman_image_t *image,
+                       struct texture_pool_texture *storage)
+{
+    pixman_image_unref(image);
+    texture_pool_release(renderer->pool, storage);
+}
+
+static struct pixman_renderer_surface *
+renderer_surface_find(struct pixman_renderer *renderer, struct wl_surface_impl *surface)
+{
+    struct pixman_renderer_surface *entry;
+    wl_list_for_each(entry, &renderer->surfaces, link) {
+        if (entry->surface == surface) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// New surfaces go on top and stay hidden until a draw list places them
+static struct pixman_renderer_surface *
+renderer_surface_get(struct pixman_renderer *renderer, struct wl_surface_impl *surface)
+{
+    struct pixman_renderer_surface *entry = renderer_surface_find(renderer, surface);
+    if (!entry) {
+        entry = calloc(1, sizeof(struct pixman_renderer_surface));
+        if (!entry) {
+            return NULL;
+        }
+        entry->surface = surface;
+        pixman_region32_init(&entry->opaque);
+        wl_list_insert(renderer->surfaces.prev, &entry->link);
+    }
+    return entry;
+}
+
+static void
+renderer_damage_rect(struct pixman_renderer *renderer, int32_t x, int32_t y, int32_t width,
+                     int32_t height)
+{
+    if (width > 0 && height > 0) {
+        pixman_region32_union_rect(&renderer->damage, &renderer->damage, x, y,
+                                   (unsigned int)width, (unsigned int)height);
+    }
+}
+
+// Hide the surface: drop its image and damage where it was shown
+static void
+renderer_surface_hide(struct pixman_renderer *renderer, struct pixman_renderer_surface *entry)
+{
+    if (entry->image) {
+        renderer_damage_rect(renderer, entry->x, entry->y, entry->width, entry->height);
+        renderer_image_release(renderer, entry->image, entry->storage);
+        entry->image = NULL;
+        entry->storage = NULL;
+    }
+    entry->buffer_width = 0;
+    entry->buffer_height = 0;
+}
+
+// Whether the source box maps onto the output rectangle one to one
+static bool
+renderer_surface_is_scaled(const struct pixman_renderer_surface *entry)
+{
+    return entry->src_width > entry->width || entry->src_width < entry->width ||
+           entry->src_height > entry->height || entry->src_height < entry->height ||
+           entry->src_x > floor(entry->src_x) || entry->src_y > floor(entry->src_y);
+}
+
+// Damage the output where a rectangle of the buffer is shown: through the
+// viewport scale, grown by a pixel when filtered since bilinear sampling
+// reaches into the neighbours
+static void
+renderer_damage_buffer_rect(struct pixman_renderer *renderer,
+                            const struct pixman_renderer_surface *entry, int32_t x, int32_t y,
+                            int32_t width, int32_t height)
+{
+    if (!renderer_surface_is_scaled(entry)) {
+        renderer_damage_rect(renderer, entry->x + x - (int32_t)entry->src_x,
+                             entry->y + y - (int32_t)entry->src_y, width, height);
+        return;
+    }
+    double scale_x = entry->width / entry->src_width;
+    double scale_y = entry->height / entry->src_height;
+    int32_t x1 = (int32_t)floor((x - entry->src_x) * scale_x) - 1;
+    int32_t y1 = (int32_t)floor((y - entry->src_y) * scale_y) - 1;
+    int32_t x2 = (int32_t)ceil((x + width - entry->src_x) * scale_x) + 1;
+    int32_t y2 = (int32_t)ceil((y + height - entry->src_y) * scale_y) + 1;
+    x1 = x1 > 0 ? x1 : 0;
+    y1 = y1 > 0 ? y1 : 0;
+    x2 = x2 < entry->width ? x2 : entry->width;
+    y2 = y2 < entry->height ? y2 : entry->height;
+    renderer_damage_rect(renderer, entry->x + x1, entry->y + y1, x2 - x1, y2 - y1);
+}
+
+// Resolve the committed buffer to CPU-visible pixels and its fourcc. wl_shm
+// buffers must be released with wl_buffer_end_shm_access() afterwards.
+static void *
+renderer_buffer_pixels(struct wl_resource *buffer, uint32_t *fourcc, int32_t *width,
+                       int32_t *height, int32_t *stride)
+{
+    struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(buffer);
+    if (shm_buffer) {
+        *fourcc = wl_shm_buffer_get_format(shm_buffer);
+        return wl_buffer_get_shm_data(buffer, width, height, stride);
+    }
+
+    // Only dmabufs mapped into our address space (headless) can be read here;
+    // IOSurface-backed ones have no CPU mapping. This is plane 0; see
+    // renderer_convert_source_init() for the others.
+    if (is_dmabuf_buffer(buffer)) {
+        struct metal_dmabuf_buffer *dmabuf = dmabuf_buffer_get(buffer);
+        if (dmabuf && dmabuf->plane_maps[0]) {
+            *fourcc = dmabuf->format;
+            *width = (int32_t)dmabuf->width;
+            *height = (int32_t)dmabuf->height;
+            *stride = (int32_t)dmabuf->strides[0];
+            return (uint8_t *)dmabuf->plane_maps[0] + dmabuf->offsets[0];
+        }
+    }
+    return NULL;
+}
+
+// wl_shm planes are contiguous; dmabuf planes each have their own mapping,
+// offset and stride
+static bool
+renderer_convert_source_init(struct pixel_convert_source *source, struct wl_resource *buffer,
+                             uint32_t fourcc, void *data, int32_t width, int32_t height,
+                             int32_t stride)
+{
+    struct metal_dmabuf_buffer *dmabuf = is_dmabuf_buffer(buffer) ? dmabuf_buffer_get(buffer) : NULL;
+    if (!dmabuf) {
+        return pixel_convert_source_init(source, fourcc, data, width, height, stride,
+                                         (size_t)stride * (size_t)height);
+    }
+    const void *planes[METAL_DMABUF_MAX_PLANES] = {NULL};
+    int32_t strides[METAL_DMABUF_MAX_PLANES] = {0};
+    for (uint32_t i = 0; i < dmabuf->n_planes; i++) {
+        planes[i] = (const uint8_t *)dmabuf->plane_maps[i] + dmabuf->offsets[i];
+        strides[i] = (int32_t)dmabuf->strides[i];
+    }
+    return pixel_convert_source_init_planes(source, fourcc, width, height, planes, strides,
+                                            (int)dmabuf->n_planes);
+}
+
+// Buffer contents as either a pixman image (formats pixman reads natively)
+// or a pixel_convert source (16161616, YUV, multi-planar dmabufs)
+struct renderer_upload_source {
+    pixman_image_t *image;
+    struct pixel_convert_source convert;
+};
+
+static void
+renderer_upload_rect(struct pixman_renderer *renderer, const struct renderer_upload_source *source,
+                     pixman_image_t *dst, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+    // Retained images are 32 bpp
+    renderer->stats.upload_bytes += (uint64_t)width * (uint64_t)height * 4u;
+    if (source->image) {
+        pixman_image_composite32(PIXMAN_OP_SRC, source->image, NULL, dst, x, y, 0, 0, x, y, width,
+                                 height);
+        return;
+    }
+    int32_t stride = pixman_image_get_stride(dst);
+    uint8_t *pixels = (uint8_t *)pixman_image_get_data(dst) + (size_t)y * (size_t)stride +
+                      (size_t)x * 4;
+    pixel_convert_rect(&source->convert, x, y, width, height, pixels, stride, 0);
+}
+
+// Copy the buffer into the retained image: only the damaged rectangles
+// unless the image is new or changed size or format
+static void
+renderer_surface_upload(struct pixman_renderer *renderer, struct pixman_renderer_surface *entry,
+                        struct wl_surface_impl *surface)
+{
+    struct wl_resource *buffer = surface->buffer_resource;
+    uint32_t fourcc = 0;
+    int32_t width = 0, height = 0, stride = 0;
+    void *data = renderer_buffer_pixels(buffer, &fourcc, &width, &height, &stride);
+    pixman_format_code_t format = data ? pixman_renderer_format_from_fourcc(fourcc)
+                                       : (pixman_format_code_t)0;
+    bool convert = data && format == 0 && pixel_convert_is_supported(fourcc);
+
+    // libwayland lets a wl_shm stride cover width bytes rather than pixels
+    bool fits = !wl_shm_buffer_get(buffer) ||
+                pixel_convert_shm_buffer_fits(fourcc, width, height, stride);
+    if (!data || (format == 0 && !convert) || width <= 0 || height <= 0 || !fits) {
+        if (data && format == 0 && !convert) {
+            log_warn("[RENDER] ", "Software renderer: unsupported buffer format\n");
+        } else if (data && !fits) {
+            log_warn("[RENDER] ", "Software renderer: wl_shm stride %d too small for %dx%d\n",
+                     stride, width, height);
+        }
+        renderer_surface_hide(renderer, entry);
+        wl_buffer_end_shm_access(buffer);
+        return;
+    }
+
+    struct renderer_upload_source src = {0};
+    if (convert) {
+        if (!renderer_convert_source_init(&src.convert, buffer, fourcc, data, width, height,
+                                          stride)) {
+            renderer_surface_hide(renderer, entry);
+            wl_buffer_end_shm_access(buffer);
+            return;
+        }
+    } else {
+        src.image = pixman_image_create_bits_no_clear(format, width, height, data, stride);
+        if (!src.image) {
+            wl_buffer_end_shm_access(buffer);
+            return;
+        }
+    }
+
+    // Opaque formats are kept without alpha so they composite as plain copies.
+    // Converted pixels come out premultiplied ARGB with alpha 0xff when opaque.
+    pixman_format_code_t image_format =
+        (convert || PIXMAN_FORMAT_A(format)) ? PIXMAN_a8r8g8b8 : PIXMAN_x8r8g8b8;
+    bool full_upload = !entry->image || entry->buffer_width != width ||
+                       entry->buffer_height != height ||
+                       pixman_image_get_format(entry->image) != image_format;
+
+    if (full_upload) {
+        renderer_surface_hide(renderer, entry);
+        entry->image = renderer_image_acquire(renderer, image_format, width, height, &entry->storage);
+        if (!entry->image) {
+            log_error("[RENDER] ", "Software renderer: failed to allocate %dx%d surface image\n",
+                      width, height);
+            if (src.image) {
+                pixman_image_unref(src.image);
+            }
+            wl_buffer_end_shm_access(buffer);
+            return;
+        }
+        entry->buffer_width = width;
+        entry->buffer_height = height;
+        renderer_upload_rect(renderer, &src, entry->image, 0, 0, width, height);
+        renderer_damage_rect(renderer, entry->x, entry->y, entry->width, entry->height);
+    } else {
+        int n_rects = 0;
+        const pixman_box32_t *rects =
+            pixman_region32_rectangles(wl_surface_get_buffer_damage(surface), &n_rects);
+        for (int i = 0; i < n_rects; i++) {
+            int32_t w = rects[i].x2 - rects[i].x1;
+            int32_t h = rects[i].y2 - rects[i].y1;
+            renderer_upload_rect(renderer, &src, entry->image, rects[i].x1, rects[i].y1, w, h);
+            renderer_damage_buffer_rect(renderer, entry, rects[i].x1, rects[i].y1, w, h);
+        }
+    }
+
+    renderer->stats.uploads++;
+    if (src.image) {
+        pixman_image_unref(src.image);
+    }
+    wl_buffer_end_shm_access(buffer);
+}
+
+struct pixman_renderer *
+pixman_renderer_create(int32_t width, int32_t height)
+{
+    struct pixman_renderer *renderer = calloc(1, sizeof(struct pixman_renderer));
+    if (!renderer) {
+        return NULL;
+    }
+    pixman_region32_init(&renderer->damage);
+    wl_list_init(&renderer->surfaces);
+    scene_init(&renderer->scene);
+    renderer->pool = texture_pool_create(&pool_ops, NULL, PIXMAN_RENDERER_POOL_BUDGET);
+
+    if (!renderer->pool || !pixman_renderer_resize(renderer, width, height)) {
+        texture_pool_destroy(renderer->pool);
+        scene_fini(&renderer->scene);
+        pixman_region32_fini(&renderer->damage);
+        free(renderer);
+        return NULL;
+    }
+    return renderer;
+}
+
+void
+pixman_renderer_destroy(struct pixman_renderer *renderer)
+{
+    if (!renderer) {
+        return;
+    }
+
+    struct pixman_renderer_surface *entry, *tmp;
+    wl_list_for_each_safe(entry, tmp, &renderer->surfaces, link) {
+        if (entry->image) {
+            renderer_image_release(renderer, entry->image, entry->storage);
+        }
+        pixman_region32_fini(&entry->opaque);
+        wl_list_remove(&entry->link);
+        free(entry);
+    }
+    if (renderer->output) {
+        renderer_image_release(renderer, renderer->output, renderer->output_storage);
+    }
+    texture_pool_destroy(renderer->pool);
+    scene_fini(&renderer->scene);
+    pixman_region32_fini(&renderer->damage);
+    free(renderer);
+}
+
+bool
+pixman_renderer_resize(struct pixman_renderer *renderer, int32_t width, int32_t height)
+{
+    if (!renderer || width <= 0 || height <= 0) {
+        return false;
+    }
+    if (renderer->output && pixman_image_get_width(renderer->output) == width &&
+        pixman_image_get_height(renderer->output) == height) {
+        return true;
+    }
+
+    // Within the same size bucket the current pixels are rewrapped at the
+    // new size; otherwise the storage comes from the pool
+    struct texture_pool_texture *storage = renderer->output_storage;
+    int32_t bucket_width, bucket_height;
+    texture_pool_bucket_size(width, height, &bucket_width, &bucket_height);
+    pixman_image_t *output;
+    if (storage && storage->width == bucket_width && storage->height == bucket_height) {
+        output = pixman_image_create_bits_no_clear(PIXMAN_x8r8g8b8, width, height,
+                                                   pixman_image_get_data(storage->texture),
+                                                   pixman_image_get_stride(storage->texture));
+    } else {
+        output = renderer_image_acquire(renderer, PIXMAN_x8r8g8b8, width, height, &storage);
+    }
+    if (!output) {
+        log_error("[RENDER] ", "Software renderer: failed to allocate %dx%d output\n", width,
+                  height);
+        return false;
+    }
+    if (renderer->output) {
+        pixman_image_unref(renderer->output);
+        if (renderer->output_storage != storage) {
+            texture_pool_release(renderer->pool, renderer->output_storage);
+        }
+    }
+    renderer->output = output;
+    renderer->output_storage = storage;
+    renderer->visibility_dirty = true;
+    pixman_renderer_damage_all(renderer);
+    return true;
+}
+
+void
+pixman_renderer_render_surface(struct pixman_renderer *renderer, struct wl_surface_impl *surface)
+{
+    if (!renderer || !surface) {
+        return;
+    }
+    TRACE_SCOPE("software_render_surface");
+
+    struct pixman_renderer_surface *entry = renderer_surface_get(renderer, surface);
+    if (!entry) {
+        return;
+    }
+    // Shown, hidden or maybe turned (non-)opaque
+    renderer->visibility_dirty = true;
+
+    struct wl_resource *buffer = surface->buffer_resource;
+    if (!buffer) {
+        renderer_surface_hide(renderer, entry);
+        return;
+    }
+
+    renderer_surface_upload(renderer, entry, surface);
+
+    // The contents are copied, so the client may reuse the buffer right away
+    wl_surface_clear_buffer_damage(surface);
+    if (!surface->buffer_release_sent) {
+        wl_buffer_send_release(buffer);
+        surface->buffer_release_sent = true;
+    }
+}
+
+void
+pixman_renderer_remove_surface(struct pixman_renderer *renderer, struct wl_surface_impl *surface)
+{
+    if (!renderer || !surface) {
+        return;
+    }
+
+    struct pixman_renderer_surface *entry = renderer_surface_find(renderer, surface);
+    if (entry) {
+        renderer_surface_hide(renderer, entry);
+        pixman_region32_fini(&entry->opaque);
+        wl_list_remove(&entry->link);
+        free(entry);
+    }
+}
+
+void
+pixman_renderer_update_stacking(struct pixman_renderer *renderer,
+                                const struct wl_surface_draw_list *list)
+{
+    if (!renderer || list->generation == renderer->stacking_generation) {
+        return;
+    }
+    TRACE_SCOPE("software_restack");
+    renderer->stacking_generation = list->generation;
+    renderer->visibility_dirty = true;
+
+    // Entries are reordered to match the list, so whatever ends up after the
+    // last listed one is unmapped. A surface that changes place, position or
+    // visibility damages both where it was and where it is now.
+    struct pixman_renderer_surface *entry;
+    struct wl_list *cursor = &renderer->surfaces;
+    for (int i = 0; i < list->count; i++) {
+        const struct wl_surface_draw_entry *draw = &list->entries[i];
+        entry = renderer_surface_get(renderer, draw->surface);
+        if (!entry) {
+            continue;
+        }
+        bool restacked = cursor->next != &entry->link;
+        bool moved = entry->x != draw->x || entry->y != draw->y ||
+                     entry->width != draw->width || entry->height != draw->height;
+        bool recropped = entry->src_x > draw->src_x || entry->src_x < draw->src_x ||
+                         entry->src_y > draw->src_y || entry->src_y < draw->src_y ||
+                         entry->src_width > draw->src_width || entry->src_width < draw->src_width ||
+                         entry->src_height > draw->src_height ||
+                         entry->src_height < draw->src_height;
+        if (restacked || moved || recropped || !entry->listed) {
+            if (entry->listed) {
+                renderer_damage_rect(renderer, entry->x, entry->y, entry->width, entry->height);
+            }
+            if (restacked) {
+                wl_list_remove(&entry->link);
+                wl_list_insert(cursor, &entry->link);
+            }
+            entry->x = draw->x;
+            entry->y = draw->y;
+            entry->width = draw->width;
+            entry->height = draw->height;
+            entry->src_x = draw->src_x;
+            entry->src_y = draw->src_y;
+            entry->src_width = draw->src_width;
+            entry->src_height = draw->src_height;
+            if (entry->width <= 0 || entry->height <= 0 || entry->src_width <= 0 ||
+                entry->src_height <= 0) {
+                // Size unknown to the compositor: the image as is
+                entry->width = entry->buffer_width;
+                entry->height = entry->buffer_height;
+                entry->src_x = 0.0;
+                entry->src_y = 0.0;
+                entry->src_width = entry->buffer_width;
+                entry->src_height = entry->buffer_height;
+            }
+            entry->listed = true;
+            renderer_damage_rect(renderer, entry->x, entry->y, entry->width, entry->height);
+        }
+        // Only changes how the surface is composited, not what it shows
+        pixman_region32_copy(&entry->opaque, &draw->opaque);
+        cursor = &entry->link;
+    }
+    for (struct wl_list *link = cursor->next; link != &renderer->surfaces; link = link->next) {
+        entry = wl_container_of(link, entry, link);
+        if (entry->listed) {
+            renderer_damage_rect(renderer, entry->x, entry->y, entry->width, entry->height);
+            entry->listed = false;
+        }
+    }
+}
+
+const pixman_region32_t *
+pixman_renderer_get_damage(const struct pixman_renderer *renderer)
+{
+    return renderer ? &renderer->damage : NULL;
+}
+
+void
+pixman_renderer_damage_all(struct pixman_renderer *renderer)
+{
+    if (renderer && renderer->output) {
+        renderer_damage_rect(renderer, 0, 0, pixman_image_get_width(renderer->output),
+                             pixman_image_get_height(renderer->output));
+    }
+}
+
+bool
+pixman_renderer_repaint(struct pixman_renderer *renderer, pixman_region32_t *repainted)
+{
+    if (!renderer) {
+        return false;
+    }
+
+    pixman_region32_intersect_rect(&renderer->damage, &renderer->damage, 0, 0,
+                                   (unsigned int)pixman_image_get_width(renderer->output),
+                                   (unsigned int)pixman_image_get_height(renderer->output));
+    if (!pixman_region32_not_empty(&renderer->damage)) {
+        return false;
+    }
+    TRACE_SCOPE("software_repaint");
+
+    pixman_color_t background = {
+        .red = (uint16_t)(((PIXMAN_RENDERER_BACKGROUND >> 16) & 0xff) * 0x101),
+        .green = (uint16_t)(((PIXMAN_RENDERER_BACKGROUND >> 8) & 0xff) * 0x101),
+        .blue = (uint16_t)((PIXMAN_RENDERER_BACKGROUND & 0xff) * 0x101),
+        .alpha = 0xffff,
+    };
+
+    // Cull within the damage: surfaces hidden behind opaque ones are
+    // skipped, and opaque areas are copied instead of blended
+    struct pixman_renderer_surface *entry;
+    scene_begin(&renderer->scene);
+    wl_list_for_each(entry, &renderer->surfaces, link) {
+        if (entry->image && entry->listed) {
+            bool fully_opaque = pixman_image_get_format(entry->image) == PIXMAN_x8r8g8b8;
+            scene_add(&renderer->scene, entry, entry->x, entry->y, entry->width, entry->height,
+                      &entry->opaque, fully_opaque);
+        }
+    }
+    scene_cull(&renderer->scene, &renderer->damage);
+
+    // The background only shows where no opaque surface covers the damage
+    int n_rects = 0;
+    pixman_box32_t *rects = pixman_region32_rectangles(&renderer->scene.uncovered, &n_rects);
+    pixman_image_fill_boxes(PIXMAN_OP_SRC, renderer->output, &background, n_rects, rects);
+
+    pixman_region32_t blended;
+    pixman_region32_init(&blended);
+    for (int i = 0; i < renderer->scene.count; i++) {
+        const struct scene_node *node = &renderer->scene.nodes[i];
+        if (node->occluded) {
+            continue;
+        }
+        entry = node->data;
+
+        // The viewport source box is either an integer offset into the image
+        // or scaled onto the output rectangle by a filtered transform
+        bool scaled = renderer_surface_is_scaled(entry);
+        int32_t src_x = scaled ? 0 : (int32_t)entry->src_x;
+        int32_t src_y = scaled ? 0 : (int32_t)entry->src_y;
+        if (scaled) {
+            pixman_transform_t transform;
+            pixman_transform_init_scale(&transform,
+                                        pixman_double_to_fixed(entry->src_width / entry->width),
+                                        pixman_double_to_fixed(entry->src_height / entry->height));
+            pixman_transform_translate(&transform, NULL, pixman_double_to_fixed(entry->src_x),
+                                       pixman_double_to_fixed(entry->src_y));
+            pixman_image_set_transform(entry->image, &transform);
+            pixman_image_set_filter(entry->image, PIXMAN_FILTER_BILINEAR, NULL, 0);
+            pixman_image_set_repeat(entry->image, PIXMAN_REPEAT_PAD);
+        }
+        if (pixman_region32_not_empty(&node->visible_opaque)) {
+            pixman_image_set_clip_region32(renderer->output, &node->visible_opaque);
+            pixman_image_composite32(PIXMAN_OP_SRC, entry->image, NULL, renderer->output, src_x,
+                                     src_y, 0, 0, entry->x, entry->y, entry->width, entry->height);
+        }
+        pixman_region32_subtract(&blended, &node->visible, &node->visible_opaque);
+        if (pixman_region32_not_empty(&blended)) {
+            pixman_image_set_clip_region32(renderer->output, &blended);
+            pixman_image_composite32(PIXMAN_OP_OVER, entry->image, NULL, renderer->output, src_x,
+                                     src_y, 0, 0, entry->x, entry->y, entry->width, entry->height);
+        }
+        if (scaled) {
+            pixman_image_set_transform(entry->image, NULL);
+            pixman_image_set_filter(entry->image, PIXMAN_FILTER_NEAREST, NULL, 0);
+            pixman_image_set_repeat(entry->image, PIXMAN_REPEAT_NONE);
+        }
+    }
+    pixman_region32_fini(&blended);
+    pixman_image_set_clip_region32(renderer->output, NULL);
+
+    if (repainted) {
+        pixman_region32_union(repainted, repainted, &renderer->damage);
+    }
+    pixman_region32_clear(&renderer->damage);
+    return true;
+}
+
+void
+pixman_renderer_mark_composited(struct pixman_renderer *renderer)
+{
+    if (!renderer) {
+        return;
+    }
+
+    // The repaint only culls within the damage: which surfaces the output
+    // shows at all is worked out over the whole output, when it may have
+    // changed
+    struct pixman_renderer_surface *entry;
+    if (renderer->visibility_dirty) {
+        TRACE_SCOPE("software_visibility");
+        pixman_region32_t area;
+        pixman_region32_init_rect(&area, 0, 0,
+                                  (unsigned int)pixman_image_get_width(renderer->output),
+                                  (unsigned int)pixman_image_get_height(renderer->output));
+        scene_begin(&renderer->scene);
+        wl_list_for_each(entry, &renderer->surfaces, link) {
+            entry->visible = false;
+            if (entry->image && entry->listed) {
+                bool fully_opaque = pixman_image_get_format(entry->image) == PIXMAN_x8r8g8b8;
+                scene_add(&renderer->scene, entry, entry->x, entry->y, entry->width,
+                          entry->height, &entry->opaque, fully_opaque);
+            }
+        }
+        scene_cull(&renderer->scene, &area);
+        pixman_region32_fini(&area);
+        for (int i = 0; i < renderer->scene.count; i++) {
+            const struct scene_node *node = &renderer->scene.nodes[i];
+            entry = node->data;
+            entry->visible = !node->occluded;
+        }
+        renderer->visibility_dirty = false;
+    }
+
+    // Hidden and fully occluded surfaces are not part of the frame: their
+    // frame callbacks wait until they show again
+    wl_list_for_each(entry, &renderer->surfaces, link) {
+        if (entry->visible) {
+            wl_surface_mark_composited(entry->surface);
+        }
+    }
+}
+
+pixman_image_t *
+pixman_renderer_get_image(const struct pixman_renderer *renderer)
+{
+    return renderer ? renderer->output : NULL;
+}
+
+void
+pixman_renderer_get_stats(const struct pixman_renderer *renderer,
+                          struct pixman_renderer_stats *stats)
+{
+    *stats = renderer->stats;
+}
+
+void
+pixman_renderer_get_pool_stats(const struct pixman_renderer *renderer,
+                               struct texture_pool_stats *stats)
+{
+    texture_pool_get_stats(renderer->pool, stats);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <pixman.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct texture_pool_stats;
+struct wl_surface_draw_list;
+struct wl_surface_impl;
+
+// Pixman software renderer
+// Plain C compositor behind the RenderingBackend surface/remove/draw contract.
+// Each surface keeps a retained copy of its buffer that is updated only in the
+// damaged rectangles, and the output image is repainted only where surfaces
+// changed since the last repaint. Used as the fallback when GPU buffer import
+// is unavailable and as the reference renderer of the headless backend.
+//
+// Not thread-safe: call everything from the thread that owns the renderer.
+// Surfaces are composited in draw list order at their draw list rectangle,
+// with the buffer scale and viewport crop and scale applied (bilinear when
+// scaled); buffer transforms are not applied.
+
+struct pixman_renderer_stats {
+    uint64_t uploads;       // Surface commits copied into retained images
+    uint64_t upload_bytes;  // Bytes written into retained images by those uploads
+};
+
+struct pixman_renderer;
+
+struct pixman_renderer *pixman_renderer_create(int32_t width, int32_t height);
+void pixman_renderer_destroy(struct pixman_renderer *renderer);
+
+// Resize the output. The whole output is damaged. Returns false if the new
+// output image cannot be allocated (the old one is kept).
+bool pixman_renderer_resize(struct pixman_renderer *renderer, int32_t width, int32_t height);
+
+// Copy the damaged part of the surface's committed buffer into its retained
+// image and damage the output where it changed. The buffer is released right
+// away and its damage cleared. A surface without a buffer is hidden.
+void pixman_renderer_render_surface(struct pixman_renderer *renderer, struct wl_surface_impl *surface);
+
+// Take the stacking and output rectangles from the compositor's draw list
+// (WawonaCompositor.h, read under wl_compositor_lock_surfaces). Only surfaces
+// in the list are drawn. Does nothing if the list did not change since the
+// last call.
+void pixman_renderer_update_stacking(struct pixman_renderer *renderer,
+                                     const struct wl_surface_draw_list *list);
+
+// Forget the surface (it is being destroyed) and damage the area it covered
+void pixman_renderer_remove_surface(struct pixman_renderer *renderer, struct wl_surface_impl *surface);
+
+// Output damage accumulated since the last repaint
+const pixman_region32_t *pixman_renderer_get_damage(const struct pixman_renderer *renderer);
+void pixman_renderer_damage_all(struct pixman_renderer *renderer);
+
+// Recomposite the damaged part of the output, bottom surface first. Surfaces
+// hidden behind opaque regions (scene.h) are skipped and opaque areas are
+// copied rather than blended. Adds the repainted region to `repainted` if
+// non-NULL. Returns false if there was no damage.
+bool pixman_renderer_repaint(struct pixman_renderer *renderer, pixman_region32_t *repainted);
+
+// Mark every surface the output shows, listed and not fully occluded, as
+// part of the current output frame (wl_surface_mark_composited), so its
+// frame callbacks may fire
+void pixman_renderer_mark_composited(struct pixman_renderer *renderer);
+
+// Output image, x8r8g8b8
+pixman_image_t *pixman_renderer_get_image(const struct pixman_renderer *renderer);
+
+// Pixman format of a wl_shm or DRM fourcc format code, 0 if unsupported
+pixman_format_code_t pixman_renderer_format_from_fourcc(uint32_t format);
+
+void pixman_renderer_get_stats(const struct pixman_renderer *renderer,
+                               struct pixman_renderer_stats *stats);
+
+// Pixel storage pool shared by the output and the surface images
+void pixman_renderer_get_pool_stats(const struct pixman_renderer *renderer,
+                                    struct texture_pool_stats *stats);
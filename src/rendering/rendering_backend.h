@@ -10,7 +10,7 @@
 struct wl_surface_impl;
 
 // Rendering Backend Interface
-// Abstract interface for different rendering backends (SurfaceRenderer, MetalRenderer, etc.)
+// Abstract interface for different rendering backends (SurfaceRenderer, MetalRenderer, SoftwareRenderer, etc.)
 
 @protocol RenderingBackend <NSObject>
 
@@ -36,7 +36,8 @@ struct wl_surface_impl;
 typedef NS_ENUM(NSInteger, RenderingBackendType) {
     RENDERING_BACKEND_SURFACE,    // SurfaceRenderer (Cocoa/UIKit drawing)
     RENDERING_BACKEND_METAL,      // MetalRenderer (Metal GPU rendering)
-    RENDERING_BACKEND_VULKAN      // VulkanRenderer (future implementation)
+    RENDERING_BACKEND_VULKAN,     // VulkanRenderer (future implementation)
+    RENDERING_BACKEND_SOFTWARE    // SoftwareRenderer (pixman CPU compositing)
 };
 
 // Rendering Backend Factory
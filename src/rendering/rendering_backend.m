@@ -1,6 +1,7 @@
 #import "rendering_backend.h"
 #import "surface_renderer.h"
 #import "metal_renderer.h"
+#import "software_renderer.h"
 
 @implementation RenderingBackendFactory
 
@@ -32,6 +33,9 @@
             NSLog(@"❌ Vulkan renderer not implemented yet");
             return nil;
             
+        case RENDERING_BACKEND_SOFTWARE:
+            return [[SoftwareRenderer alloc] initWithCompositorView:view];
+            
         default:
             NSLog(@"❌ Unknown rendering backend type: %ld", (long)type);
             return nil;
@@ -0,0 +1,105 @@
+#include "scene.h"
+#include "logging.h"
+#include "trace.h"
+#include <stdlib.h>
+
+void
+scene_init(struct scene *scene)
+{
+    scene->nodes = NULL;
+    scene->count = 0;
+    scene->capacity = 0;
+    pixman_region32_init(&scene->uncovered);
+}
+
+void
+scene_fini(struct scene *scene)
+{
+    for (int i = 0; i < scene->capacity; i++) {
+        pixman_region32_fini(&scene->nodes[i].opaque);
+        pixman_region32_fini(&scene->nodes[i].visible);
+        pixman_region32_fini(&scene->nodes[i].visible_opaque);
+    }
+    free(scene->nodes);
+    scene->nodes = NULL;
+    scene->count = 0;
+    scene->capacity = 0;
+    pixman_region32_fini(&scene->uncovered);
+}
+
+void
+scene_begin(struct scene *scene)
+{
+    scene->count = 0;
+}
+
+struct scene_node *
+scene_add(struct scene *scene, void *data, int32_t x, int32_t y, int32_t width, int32_t height,
+          const pixman_region32_t *opaque, bool fully_opaque)
+{
+    if (scene->count == scene->capacity) {
+        int capacity = scene->capacity > 0 ? scene->capacity * 2 : 16;
+        struct scene_node *nodes =
+            realloc(scene->nodes, (size_t)capacity * sizeof(struct scene_node));
+        if (!nodes) {
+            log_error("[SCENE] ", "Failed to grow the scene to %d nodes\n", capacity);
+            return NULL;
+        }
+        for (int i = scene->capacity; i < capacity; i++) {
+            pixman_region32_init(&nodes[i].opaque);
+            pixman_region32_init(&nodes[i].visible);
+            pixman_region32_init(&nodes[i].visible_opaque);
+        }
+        scene->nodes = nodes;
+        scene->capacity = capacity;
+    }
+
+    struct scene_node *node = &scene->nodes[scene->count++];
+    node->data = data;
+    node->box.x1 = x;
+    node->box.y1 = y;
+    node->box.x2 = x + (width > 0 ? width : 0);
+    node->box.y2 = y + (height > 0 ? height : 0);
+    node->occluded = false;
+
+    unsigned int w = (unsigned int)(node->box.x2 - x);
+    unsigned int h = (unsigned int)(node->box.y2 - y);
+    if (fully_opaque) {
+        pixman_region32_fini(&node->opaque);
+        pixman_region32_init_rect(&node->opaque, x, y, w, h);
+    } else if (opaque && pixman_region32_not_empty(opaque)) {
+        pixman_region32_intersect_rect(&node->opaque, opaque, 0, 0, w, h);
+        pixman_region32_translate(&node->opaque, x, y);
+    } else {
+        pixman_region32_clear(&node->opaque);
+    }
+    return node;
+}
+
+int
+scene_cull(struct scene *scene, const pixman_region32_t *area)
+{
+    TRACE_SCOPE("scene_cull");
+
+    // Front to back: uncovered shrinks by the opaque part of every node
+    pixman_region32_copy(&scene->uncovered, area);
+    int visible = 0;
+    for (int i = scene->count - 1; i >= 0; i--) {
+        struct scene_node *node = &scene->nodes[i];
+        pixman_region32_intersect_rect(&node->visible, &scene->uncovered, node->box.x1,
+                                       node->box.y1,
+                                       (unsigned int)(node->box.x2 - node->box.x1),
+                                       (unsigned int)(node->box.y2 - node->box.y1));
+        node->occluded = !pixman_region32_not_empty(&node->visible);
+        if (node->occluded) {
+            pixman_region32_clear(&node->visible_opaque);
+            continue;
+        }
+        visible++;
+        pixman_region32_intersect(&node->visible_opaque, &node->visible, &node->opaque);
+        pixman_region32_subtract(&scene->uncovered, &scene->uncovered, &node->visible_opaque);
+    }
+
+    TRACE_COUNTER("scene_occluded_surfaces", scene->count - visible);
+    return visible;
+}
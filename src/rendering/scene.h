@@ -0,0 +1,50 @@
+#pragma once
+
+#include <pixman.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Scene graph culling pass
+// Renderers add the surfaces they are about to draw bottom first, each with
+// its output rectangle and opaque region, then scene_cull() walks them front
+// to back: what the opaque parts of the nodes above cover is subtracted from
+// every node below. A node left with nothing visible is skipped; the visible
+// opaque part of a node can be drawn without blending and only the rest
+// needs to be blended over what is below.
+//
+// The node storage and regions are kept across frames, so a frame with the
+// same number of surfaces allocates nothing. Not thread-safe.
+
+struct scene_node {
+    void *data;                         // Renderer object of the surface
+    pixman_box32_t box;                 // Output rectangle
+    pixman_region32_t opaque;           // Output coordinates, within box
+    pixman_region32_t visible;          // Part of box not covered from above, within the area
+    pixman_region32_t visible_opaque;   // visible & opaque: drawn without blending
+    bool occluded;                      // visible is empty
+};
+
+struct scene {
+    struct scene_node *nodes;  // Bottom first
+    int count;
+    int capacity;
+    pixman_region32_t uncovered;  // Part of the area no opaque node covers (background)
+};
+
+void scene_init(struct scene *scene);
+void scene_fini(struct scene *scene);
+
+// Start a new frame (drops the nodes of the previous one)
+void scene_begin(struct scene *scene);
+
+// Add a surface above the previous ones. The rectangle is in output
+// coordinates; opaque (may be NULL) is in surface coordinates relative to
+// (x, y). A fully opaque node (a format without alpha) ignores opaque.
+// Returns NULL if the node cannot be allocated (the surface is left out).
+struct scene_node *scene_add(struct scene *scene, void *data, int32_t x, int32_t y,
+                             int32_t width, int32_t height, const pixman_region32_t *opaque,
+                             bool fully_opaque);
+
+// Compute the visible regions within area (typically the output or its
+// damage). Returns the number of nodes that are not occluded.
+int scene_cull(struct scene *scene, const pixman_region32_t *area);
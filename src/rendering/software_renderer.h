@@ -0,0 +1,32 @@
+#pragma once
+
+#if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
+#import <UIKit/UIKit.h>
+#else
+#import <Cocoa/Cocoa.h>
+#endif
+#import <CoreGraphics/CoreGraphics.h>
+#include "WawonaCompositor.h"
+
+// Software Renderer - pixman compositor (pixman_renderer.c) drawn into the
+// compositor view. Keeps one persistent output image and repaints only the
+// damaged part of it; used when GPU buffer import is unavailable.
+@interface SoftwareRenderer : NSObject <RenderingBackend>
+
+#if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
+@property (nonatomic, assign) UIView *compositorView;  // The view we draw into (assign for MRC compatibility)
+
+- (instancetype)initWithCompositorView:(UIView *)view;
+- (void)renderSurface:(struct wl_surface_impl *)surface;
+- (void)removeSurface:(struct wl_surface_impl *)surface;
+- (void)drawSurfacesInRect:(CGRect)dirtyRect;  // Called from drawRect:
+#else
+@property (nonatomic, assign) NSView *compositorView;  // The view we draw into (assign for MRC compatibility)
+
+- (instancetype)initWithCompositorView:(NSView *)view;
+- (void)renderSurface:(struct wl_surface_impl *)surface;
+- (void)removeSurface:(struct wl_surface_impl *)surface;
+- (void)drawSurfacesInRect:(NSRect)dirtyRect;  // Called from drawRect:
+#endif
+
+@end
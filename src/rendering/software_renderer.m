@@ -0,0 +1,155 @@
+#import "software_renderer.h"
+#include "WawonaCompositor.h"
+#include "pixman_renderer.h"
+#include "trace.h"
+#include <wayland-server-core.h>
+#include <wayland-server.h>
+
+@implementation SoftwareRenderer {
+    struct pixman_renderer *_renderer;
+    uint32_t _stackingGeneration;  // Draw list generation the view was invalidated for
+}
+
+#if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
+- (instancetype)initWithCompositorView:(UIView *)view {
+#else
+- (instancetype)initWithCompositorView:(NSView *)view {
+#endif
+    self = [super init];
+    if (self) {
+        _compositorView = view;
+        CGSize size = view ? view.bounds.size : CGSizeMake(800, 600);
+        _renderer = pixman_renderer_create(MAX((int32_t)size.width, 1), MAX((int32_t)size.height, 1));
+        if (!_renderer) {
+            NSLog(@"[RENDERER] ❌ Failed to create software renderer");
+#if !__has_feature(objc_arc)
+            [self release];
+#endif
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    pixman_renderer_destroy(_renderer);
+    _renderer = NULL;
+#if !__has_feature(objc_arc)
+    [super dealloc];
+#endif
+}
+
+- (void)renderSurface:(struct wl_surface_impl *)surface {
+    if (!surface) {
+        return;
+    }
+
+    // The render callback is async, so the surface may have been destroyed
+    // or its resource reused in the meantime
+    if (!surface->resource || wl_resource_get_user_data(surface->resource) != surface ||
+        !wl_resource_get_client(surface->resource)) {
+        [self removeSurface:surface];
+        return;
+    }
+
+    pixman_renderer_render_surface(_renderer, surface);
+    [self setNeedsDisplay];
+}
+
+- (void)removeSurface:(struct wl_surface_impl *)surface {
+    if (!surface) {
+        return;
+    }
+    pixman_renderer_remove_surface(_renderer, surface);
+    [self setNeedsDisplay];
+}
+
+#if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
+- (void)drawSurfacesInRect:(CGRect)dirtyRect {
+    CGContextRef cgContext = UIGraphicsGetCurrentContext();
+#else
+- (void)drawSurfacesInRect:(NSRect)dirtyRect {
+    CGContextRef cgContext = [[NSGraphicsContext currentContext] CGContext];
+#endif
+    if (!self.compositorView || !cgContext) {
+        return;
+    }
+    TRACE_SCOPE("software_draw");
+
+    // The output image tracks the view size (in points, like SurfaceRenderer)
+    CGSize size = self.compositorView.bounds.size;
+    pixman_renderer_resize(_renderer, MAX((int32_t)size.width, 1), MAX((int32_t)size.height, 1));
+
+    // Restack from the flattened surface tree (only when it changed)
+    wl_compositor_lock_surfaces();
+    struct wl_surface_draw_list list;
+    wl_compositor_get_draw_list(&list);
+    pixman_renderer_update_stacking(_renderer, &list);
+    wl_compositor_unlock_surfaces();
+
+    uint64_t frameSeq = wl_compositor_begin_frame();
+    pixman_renderer_repaint(_renderer, NULL);
+    pixman_renderer_mark_composited(_renderer);
+
+    // Wrap the output image without copying; it is only written on this thread
+    pixman_image_t *output = pixman_renderer_get_image(_renderer);
+    int width = pixman_image_get_width(output);
+    int height = pixman_image_get_height(output);
+    int stride = pixman_image_get_stride(output);
+    CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, pixman_image_get_data(output),
+                                                              (size_t)stride * (size_t)height, NULL);
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    // x8r8g8b8 is BGRX in memory on little-endian
+    CGImageRef image = CGImageCreate(width, height, 8, 32, stride, colorSpace,
+                                     kCGBitmapByteOrder32Little | kCGImageAlphaNoneSkipFirst,
+                                     provider, NULL, NO, kCGRenderingIntentDefault);
+    CGColorSpaceRelease(colorSpace);
+    CGDataProviderRelease(provider);
+
+    if (image) {
+        CGContextSaveGState(cgContext);
+        CGContextClipToRect(cgContext, dirtyRect);
+        // The view is flipped (top-left origin, like Wayland) but
+        // CGContextDrawImage expects bottom-left, so flip the image back
+        CGContextTranslateCTM(cgContext, 0, height);
+        CGContextScaleCTM(cgContext, 1.0, -1.0);
+        CGContextDrawImage(cgContext, CGRectMake(0, 0, width, height), image);
+        CGContextRestoreGState(cgContext);
+        CGImageRelease(image);
+    }
+
+    // CoreGraphics gives no presentation feedback; the frame goes out now
+    wl_compositor_frame_presented(frameSeq, NULL, 0);
+}
+
+// Invalidate only the damaged part of the view. A restack is only applied
+// (and its damage known) while drawing, and this may run with the surface
+// registry locked, so a changed draw list invalidates the whole view.
+- (void)setNeedsDisplay {
+    if (!self.compositorView) {
+        return;
+    }
+    uint32_t generation = wl_compositor_get_draw_list_generation();
+    if (generation != _stackingGeneration) {
+        _stackingGeneration = generation;
+#if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
+        [self.compositorView setNeedsDisplay];
+#else
+        [self.compositorView setNeedsDisplay:YES];
+#endif
+        return;
+    }
+    const pixman_region32_t *damage = pixman_renderer_get_damage(_renderer);
+    if (!pixman_region32_not_empty(damage)) {
+        return;
+    }
+    const pixman_box32_t *box = &damage->extents;
+    CGRect rect = CGRectMake(box->x1, box->y1, box->x2 - box->x1, box->y2 - box->y1);
+#if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
+    [self.compositorView setNeedsDisplayInRect:rect];
+#else
+    [self.compositorView setNeedsDisplayInRect:NSRectFromCGRect(rect)];
+#endif
+}
+
+@end
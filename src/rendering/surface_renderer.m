@@ -3,9 +3,10 @@
 #import <QuartzCore/QuartzCore.h>
 #include "WawonaCompositor.h"
 #include "apple_backend.h"
-#include "wayland_viewporter.h"
 #include "wayland_linux_dmabuf.h"
 #include "metal_dmabuf.h"
+#include "pixel_convert.h"
+#include "trace.h"
 #if !TARGET_OS_IPHONE && !TARGET_OS_SIMULATOR
 #include "egl_buffer_handler.h"
 #endif
@@ -14,13 +15,6 @@
 #include <wayland-server-protocol.h>
 #include <time.h>
 
-// Helper for timestamp
-static uint32_t get_time_in_milliseconds(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
-}
-
 // Surface image data - stores CGImage and position for drawing
 // OPTIMIZED: Cache CGImage to avoid recreating on every frame
 @interface SurfaceImage : NSObject
@@ -35,6 +29,8 @@ static uint32_t get_time_in_milliseconds(void) {
 @property (nonatomic, assign) int32_t lastWidth;
 @property (nonatomic, assign) int32_t lastHeight;
 @property (nonatomic, assign) uint32_t lastFormat;
+@property (nonatomic, assign) int32_t lastBufferWidth;   // Size of the cached image
+@property (nonatomic, assign) int32_t lastBufferHeight;
 @end
 
 @implementation SurfaceImage
@@ -49,11 +45,71 @@ static uint32_t get_time_in_milliseconds(void) {
 }
 @end
 
+// 8888 formats CoreGraphics can describe directly with a bitmap info
+static BOOL isCGNativeFormat(uint32_t format) {
+    switch (format) {
+        case WL_SHM_FORMAT_ARGB8888:
+        case WL_SHM_FORMAT_XRGB8888:
+        case PIXEL_FORMAT_ARGB8888:
+        case PIXEL_FORMAT_XRGB8888:
+        case PIXEL_FORMAT_ABGR8888:
+        case PIXEL_FORMAT_XBGR8888:
+        case PIXEL_FORMAT_RGBA8888:
+        case PIXEL_FORMAT_RGBX8888:
+        case PIXEL_FORMAT_BGRA8888:
+        case PIXEL_FORMAT_BGRX8888:
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+// Convert everything else (RGB565, 2101010, 16161616, YUV) to premultiplied
+// BGRA; the converted copy is handed to CFData without a second copy
+static CGImageRef createConvertedCGImage(void *data, int32_t width, int32_t height, int32_t stride, uint32_t format) {
+    struct pixel_convert_source source;
+    if (!pixel_convert_source_init(&source, format, data, width, height, stride,
+                                   (size_t)stride * (size_t)height)) {
+        return NULL;
+    }
+    size_t dstStride = (size_t)width * 4;
+    void *pixels = malloc(dstStride * (size_t)height);
+    if (!pixels) {
+        return NULL;
+    }
+    if (pixel_convert_rect(&source, 0, 0, width, height, pixels, (int32_t)dstStride, 0) < 0) {
+        free(pixels);
+        return NULL;
+    }
+    CFDataRef cfData = CFDataCreateWithBytesNoCopy(NULL, pixels, dstStride * (size_t)height, kCFAllocatorMalloc);
+    if (!cfData) {
+        free(pixels);
+        return NULL;
+    }
+    CGDataProviderRef provider = CGDataProviderCreateWithCFData(cfData);
+    CFRelease(cfData);
+    if (!provider) {
+        return NULL;
+    }
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGImageRef image = CGImageCreate(width, height, 8, 32, dstStride, colorSpace,
+                                     kCGBitmapByteOrder32Little | kCGImageAlphaPremultipliedFirst,
+                                     provider, NULL, NO, kCGRenderingIntentDefault);
+    CGDataProviderRelease(provider);
+    CGColorSpaceRelease(colorSpace);
+    return image;
+}
+
 // Helper to convert raw pixel data to CGImage
 static CGImageRef createCGImageFromData(void *data, int32_t width, int32_t height, int32_t stride, uint32_t format) {
     if (!data || width <= 0 || height <= 0 || stride <= 0) {
         return NULL;
     }
+    TRACE_SCOPE("buffer_upload");
+
+    if (!isCGNativeFormat(format) && pixel_convert_is_supported(format)) {
+        return createConvertedCGImage(data, width, height, stride, format);
+    }
     
     // Convert format to CGImage format
     // Note: macOS is little-endian, so ARGB8888/XRGB8888 formats are stored as BGRA in memory
@@ -308,10 +364,8 @@ static CGImageRef createCGImageFromData(void *data, int32_t width, int32_t heigh
                     // CALayer supports IOSurfaceRef as contents on macOS
                     NSLog(@"[RENDERER] Using zero-copy path for dmabuf (size: %dx%d)", dmabuf_buffer->width, dmabuf_buffer->height);
                     
-                    // Update surface dimensions from dmabuf buffer
-                    // CRITICAL: This must be done before rendering to ensure proper sizing
-                    surface->width = dmabuf_buffer->width;
-                    surface->height = dmabuf_buffer->height;
+                    // Buffer size; the surface size (scale and viewport
+                    // applied) is computed by the compositor on commit
                     surface->buffer_width = dmabuf_buffer->width;
                     surface->buffer_height = dmabuf_buffer->height;
                     
@@ -325,13 +379,8 @@ static CGImageRef createCGImageFromData(void *data, int32_t width, int32_t heigh
                     }
                     
                     // Update frame dimensions
-                    struct wl_viewport_impl *vp_dest = wl_viewport_from_surface(surface);
-                    CGFloat destW = dmabuf_buffer->width;
-                    CGFloat destH = dmabuf_buffer->height;
-                    if (vp_dest && vp_dest->has_destination) {
-                        destW = vp_dest->dst_width;
-                        destH = vp_dest->dst_height;
-                    }
+                    CGFloat destW = surface->width > 0 ? surface->width : dmabuf_buffer->width;
+                    CGFloat destH = surface->height > 0 ? surface->height : dmabuf_buffer->height;
                     CGFloat clampedWidth = (destW < maxWidth) ? destW : maxWidth;
                     CGFloat clampedHeight = (destH < maxHeight) ? destH : maxHeight;
                     surfaceImage.frame = CGRectMake(surface->x, surface->y, clampedWidth, clampedHeight);
@@ -371,13 +420,6 @@ static CGImageRef createCGImageFromData(void *data, int32_t width, int32_t heigh
                             surface->buffer_release_sent = true;
                         }
                     }
-                    
-                    // Send frame callback if requested
-                    if (surface->frame_callback) {
-                        wl_callback_send_done(surface->frame_callback, get_time_in_milliseconds());
-                        wl_resource_destroy(surface->frame_callback);
-                        surface->frame_callback = NULL;
-                    }
                     return;
             }
              } else if (buf_data && buf_data->data) {
@@ -452,35 +494,17 @@ static CGImageRef createCGImageFromData(void *data, int32_t width, int32_t heigh
                             if (surfaceImage.image) {
                                 CGImageRelease(surfaceImage.image);
                             }
-                            // Apply viewporter source cropping if present
-                            CGImageRef finalImage = placeholder_image;
-                            struct wl_viewport_impl *vp_crop = wl_viewport_from_surface(surface);
-                            if (vp_crop && vp_crop->has_source) {
-                                CGRect srcRect = CGRectMake(vp_crop->src_x, vp_crop->src_y, vp_crop->src_width, vp_crop->src_height);
-                                CGImageRef cropped = CGImageCreateWithImageInRect(placeholder_image, srcRect);
-                                if (cropped) {
-                                    CGImageRelease(finalImage);
-                                    finalImage = cropped;
-                                    placeholder_width = (int32_t)vp_crop->src_width;
-                                    placeholder_height = (int32_t)vp_crop->src_height;
-                                }
-                            }
-                            surfaceImage.image = CGImageRetain(finalImage);
+                            // The whole buffer is kept; the viewport source
+                            // crop is applied when drawing
+                            surfaceImage.image = CGImageRetain(placeholder_image);
+                            surfaceImage.lastWidth = placeholder_width;
+                            surfaceImage.lastHeight = placeholder_height;
                             
-                            // Update surface dimensions
-                            surface->width = placeholder_width;
-                            surface->height = placeholder_height;
                             surface->buffer_width = placeholder_width;
                             surface->buffer_height = placeholder_height;
                             
-                            // Apply viewporter destination sizing if present
-                            struct wl_viewport_impl *vp_dest = wl_viewport_from_surface(surface);
-                            CGFloat destW = placeholder_width;
-                            CGFloat destH = placeholder_height;
-                            if (vp_dest && vp_dest->has_destination) {
-                                destW = vp_dest->dst_width;
-                                destH = vp_dest->dst_height;
-                            }
+                            CGFloat destW = surface->width > 0 ? surface->width : placeholder_width;
+                            CGFloat destH = surface->height > 0 ? surface->height : placeholder_height;
                             CGFloat clampedWidth = (destW < maxWidth) ? destW : maxWidth;
                             CGFloat clampedHeight = (destH < maxHeight) ? destH : maxHeight;
                             surfaceImage.frame = CGRectMake(surface->x, surface->y, clampedWidth, clampedHeight);
@@ -549,10 +573,15 @@ static CGImageRef createCGImageFromData(void *data, int32_t width, int32_t heigh
         }
         return;
     }
+    if (shm_buffer && !pixel_convert_shm_buffer_fits(format, width, height, stride)) {
+        NSLog(@"[RENDERER] ⚠️ Skipping SHM buffer %dx%d format 0x%x: stride %d does not fit its rows",
+              width, height, format, stride);
+        wl_shm_buffer_end_access(shm_buffer);
+        return;
+    }
     
-    // Update surface dimensions
-    surface->width = width;
-    surface->height = height;
+    // Buffer size; the surface size (scale and viewport applied) is
+    // computed by the compositor on commit
     surface->buffer_width = width;
     surface->buffer_height = height;
     
@@ -568,11 +597,10 @@ static CGImageRef createCGImageFromData(void *data, int32_t width, int32_t heigh
         return;
     }
     
-    // CRITICAL: Always create a new CGImage from buffer data when renderSurface is called
-    // This is because renderSurface is only called on surface commit, which means
-    // there's NEW CONTENT in the buffer, even if the buffer pointer is the same.
+    // CRITICAL: Create a new CGImage whenever the commit carried damage.
     // Waypipe and other clients reuse buffers - same pointer, different content!
-    // The optimization to reuse images was causing stale content to be displayed.
+    // Comparing buffer pointers was causing stale content to be displayed, so
+    // the surface damage (not the pointer) decides whether the image is current.
     NSNumber *key = [NSNumber numberWithUnsignedLongLong:(unsigned long long)surface];
     SurfaceImage *surfaceImage = self.surfaceImages[key];
     
@@ -582,9 +610,33 @@ static CGImageRef createCGImageFromData(void *data, int32_t width, int32_t heigh
         self.surfaceImages[key] = surfaceImage;
     }
     
-    // Always create new CGImage from current buffer data
+    // CGImage is immutable, so partial updates are not possible here. But if the
+    // commit carried no damage and the geometry is unchanged, the cached image is
+    // still current and the copy can be skipped entirely.
+    if (surfaceImage.image &&
+        surfaceImage.lastBufferWidth == width &&
+        surfaceImage.lastBufferHeight == height &&
+        surfaceImage.lastFormat == format &&
+        !pixman_region32_not_empty(wl_surface_get_buffer_damage(surface))) {
+        if (shm_buffer) {
+            wl_shm_buffer_end_access(shm_buffer);
+        }
+        if (dmabuf_buffer && dmabuf_buffer->iosurface) {
+            IOSurfaceUnlock(dmabuf_buffer->iosurface, kIOSurfaceLockReadOnly, NULL);
+        }
+        if (surface->buffer_resource && !surface->buffer_release_sent) {
+            if (wl_resource_get_client(surface->buffer_resource)) {
+                wl_buffer_send_release(surface->buffer_resource);
+            }
+            surface->buffer_release_sent = true;
+        }
+        return;
+    }
+    
+    // Create new CGImage from current buffer data
     // This ensures we always show the latest content, even if buffer pointer is reused
     CGImageRef image = createCGImageFromData(data, width, height, stride, format);
+    wl_surface_clear_buffer_damage(surface);
     
     // End access if using standard SHM buffer (must be before using image)
     if (shm_buffer) {
@@ -594,23 +646,14 @@ static CGImageRef createCGImageFromData(void *data, int32_t width, int32_t heigh
         IOSurfaceUnlock(dmabuf_buffer->iosurface, kIOSurfaceLockReadOnly, NULL);
     }
     
-    // Update image (apply viewporter source crop if present) and cache buffer info
+    // Update image and cache buffer info. The whole buffer is kept: the
+    // viewport source crop is applied when drawing, not by copying here.
     if (surfaceImage.image) {
         CGImageRelease(surfaceImage.image);
     }
-    CGImageRef finalImage = image;
-    struct wl_viewport_impl *vp_crop = wl_viewport_from_surface(surface);
-    if (image && vp_crop && vp_crop->has_source) {
-        CGRect srcRect = CGRectMake(vp_crop->src_x, vp_crop->src_y, vp_crop->src_width, vp_crop->src_height);
-        CGImageRef cropped = CGImageCreateWithImageInRect(image, srcRect);
-        if (cropped) {
-            CGImageRelease(finalImage);
-            finalImage = cropped;
-            width = (int32_t)vp_crop->src_width;
-            height = (int32_t)vp_crop->src_height;
-        }
-    }
-    surfaceImage.image = finalImage ? CGImageRetain(finalImage) : NULL;
+    surfaceImage.image = image ? CGImageRetain(image) : NULL;
+    surfaceImage.lastBufferWidth = width;
+    surfaceImage.lastBufferHeight = height;
     surfaceImage.lastBufferData = data;
     surfaceImage.lastWidth = width;
     surfaceImage.lastHeight = height;
@@ -618,14 +661,9 @@ static CGImageRef createCGImageFromData(void *data, int32_t width, int32_t heigh
     
     if (surfaceImage && surfaceImage.image) {
         
-        // Apply viewporter destination sizing if present, then clamp to compositor window bounds
-        struct wl_viewport_impl *vp_dest = wl_viewport_from_surface(surface);
-        CGFloat destW = width;
-        CGFloat destH = height;
-        if (vp_dest && vp_dest->has_destination) {
-            destW = vp_dest->dst_width;
-            destH = vp_dest->dst_height;
-        }
+        // Surface size (viewport destination applied), clamped to compositor window bounds
+        CGFloat destW = surface->width > 0 ? surface->width : width;
+        CGFloat destH = surface->height > 0 ? surface->height : height;
         CGFloat clampedWidth = (destW < maxWidth) ? destW : maxWidth;
         CGFloat clampedHeight = (destH < maxHeight) ? destH : maxHeight;
         CGRect newFrame = CGRectMake(surface->x, surface->y, clampedWidth, clampedHeight);
@@ -748,13 +786,25 @@ static CGImageRef createCGImageFromData(void *data, int32_t width, int32_t heigh
         return;
     }
     
-    // Draw all surfaces
-    for (SurfaceImage *surfaceImage in [self.surfaceImages allValues]) {
+    // Draw all surfaces in paint order, at the positions of the flattened
+    // surface tree (subsurfaces are placed relative to their parents)
+    uint64_t frameSeq = wl_compositor_begin_frame();
+    wl_compositor_lock_surfaces();
+    struct wl_surface_draw_list list;
+    wl_compositor_get_draw_list(&list);
+    for (int i = 0; i < list.count; i++) {
+        const struct wl_surface_draw_entry *entry = &list.entries[i];
+        SurfaceImage *surfaceImage = self.surfaceImages[@((unsigned long long)entry->surface)];
         if (!surfaceImage.image || !surfaceImage.surface) {
             continue;
         }
         
+        // Destination quad of the surface (viewport destination applied)
         CGRect frame = surfaceImage.frame;
+        frame.origin = CGPointMake(entry->x, entry->y);
+        if (entry->width > 0 && entry->height > 0) {
+            frame.size = CGSizeMake(entry->width, entry->height);
+        }
         
         // Only draw if frame intersects dirty rect
 #if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
@@ -782,13 +832,35 @@ static CGImageRef createCGImageFromData(void *data, int32_t width, int32_t heigh
         CGContextTranslateCTM(cgContext, drawRect.origin.x, drawRect.origin.y + drawRect.size.height);
         CGContextScaleCTM(cgContext, 1.0, -1.0);
         
-        // Draw image at origin (0,0) after transformation
-        CGRect imageRect = CGRectMake(0, 0, drawRect.size.width, drawRect.size.height);
+        // The viewport source box (buffer pixels) is mapped onto the quad by
+        // scaling the whole image and clipping to the quad, which crops
+        // without copying the image
+        CGFloat imageWidth = (CGFloat)CGImageGetWidth(surfaceImage.image);
+        CGFloat imageHeight = (CGFloat)CGImageGetHeight(surfaceImage.image);
+        CGRect source = CGRectMake(0, 0, imageWidth, imageHeight);
+        if (entry->src_width > 0 && entry->src_height > 0) {
+            source = CGRectMake(entry->src_x, entry->src_y, entry->src_width, entry->src_height);
+        }
+        CGFloat scaleX = drawRect.size.width / source.size.width;
+        CGFloat scaleY = drawRect.size.height / source.size.height;
+        
+        // Draw after transformation; y runs up from the bottom of the quad
+        CGContextClipToRect(cgContext, CGRectMake(0, 0, drawRect.size.width, drawRect.size.height));
+        CGRect imageRect = CGRectMake(-source.origin.x * scaleX,
+                                      drawRect.size.height - (imageHeight - source.origin.y) * scaleY,
+                                      imageWidth * scaleX, imageHeight * scaleY);
         CGContextDrawImage(cgContext, imageRect, surfaceImage.image);
         
         // Restore graphics state
         CGContextRestoreGState(cgContext);
+        
+        // Surface content is part of this frame - its frame callbacks may fire
+        wl_surface_mark_composited(surfaceImage.surface);
     }
+    wl_compositor_unlock_surfaces();
+    
+    // CoreGraphics gives no presentation feedback; the frame goes out now
+    wl_compositor_frame_presented(frameSeq, NULL, 0);
 }
 
 #if TARGET_OS_IPHONE || TARGET_OS_SIMULATOR
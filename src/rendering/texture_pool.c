@@ -0,0 +1,196 @@
+#include "texture_pool.h"
+#include "logging.h"
+#include "trace.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+// Buckets below this size are not split further
+#define TEXTURE_POOL_MIN_BUCKET 64
+
+struct texture_pool {
+    const struct texture_pool_ops *ops;
+    void *user_data;
+    size_t budget_bytes;
+
+    pthread_mutex_t lock;
+    struct wl_list idle;  // struct texture_pool_texture, most recently used first
+    struct texture_pool_stats stats;
+};
+
+// Four buckets per power of two, so at most a quarter of each dimension is
+// unused. Sizes seen during an interactive resize mostly share a bucket.
+static int32_t
+bucket_dimension(int32_t size)
+{
+    if (size <= TEXTURE_POOL_MIN_BUCKET) {
+        return TEXTURE_POOL_MIN_BUCKET;
+    }
+    int32_t order = 31 - __builtin_clz((uint32_t)size);
+    int32_t step = (int32_t)1 << (order - 2);
+    return (size + step - 1) & ~(step - 1);
+}
+
+void
+texture_pool_bucket_size(int32_t width, int32_t height, int32_t *bucket_width,
+                         int32_t *bucket_height)
+{
+    *bucket_width = bucket_dimension(width);
+    *bucket_height = bucket_dimension(height);
+}
+
+static void
+pool_update_counters(struct texture_pool *pool)
+{
+    uint64_t acquires = pool->stats.hits + pool->stats.misses;
+    TRACE_COUNTER("texture_pool_resident_bytes", pool->stats.resident_bytes);
+    TRACE_COUNTER("texture_pool_idle_bytes", pool->stats.idle_bytes);
+    TRACE_COUNTER("texture_pool_hit_rate_pct", acquires ? pool->stats.hits * 100 / acquires : 0);
+}
+
+// Called with the lock held
+static void
+pool_free_texture(struct texture_pool *pool, struct texture_pool_texture *texture)
+{
+    wl_list_remove(&texture->link);
+    pool->stats.idle--;
+    pool->stats.idle_bytes -= texture->bytes;
+    pool->stats.resident_bytes -= texture->bytes;
+    pool->ops->destroy(pool->user_data, texture->texture);
+    free(texture);
+}
+
+// Called with the lock held
+static void
+pool_evict(struct texture_pool *pool, size_t budget_bytes)
+{
+    while (pool->stats.idle_bytes > budget_bytes && !wl_list_empty(&pool->idle)) {
+        struct texture_pool_texture *oldest =
+            wl_container_of(pool->idle.prev, oldest, link);
+        pool_free_texture(pool, oldest);
+        pool->stats.evictions++;
+    }
+}
+
+struct texture_pool *
+texture_pool_create(const struct texture_pool_ops *ops, void *user_data, size_t budget_bytes)
+{
+    struct texture_pool *pool = calloc(1, sizeof(struct texture_pool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->ops = ops;
+    pool->user_data = user_data;
+    pool->budget_bytes = budget_bytes;
+    pthread_mutex_init(&pool->lock, NULL);
+    wl_list_init(&pool->idle);
+    return pool;
+}
+
+void
+texture_pool_destroy(struct texture_pool *pool)
+{
+    if (!pool) {
+        return;
+    }
+    texture_pool_trim(pool);
+    if (pool->stats.in_use > 0) {
+        log_warn("[POOL] ", "Texture pool destroyed with %u textures in use\n", pool->stats.in_use);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+struct texture_pool_texture *
+texture_pool_acquire(struct texture_pool *pool, uint32_t format, int32_t width, int32_t height)
+{
+    int32_t bucket_width, bucket_height;
+    texture_pool_bucket_size(width, height, &bucket_width, &bucket_height);
+
+    pthread_mutex_lock(&pool->lock);
+    struct texture_pool_texture *texture;
+    wl_list_for_each(texture, &pool->idle, link) {
+        if (texture->format == format && texture->width == bucket_width &&
+            texture->height == bucket_height) {
+            wl_list_remove(&texture->link);
+            wl_list_init(&texture->link);
+            pool->stats.hits++;
+            pool->stats.idle--;
+            pool->stats.idle_bytes -= texture->bytes;
+            pool->stats.in_use++;
+            pool_update_counters(pool);
+            pthread_mutex_unlock(&pool->lock);
+            return texture;
+        }
+    }
+    pool->stats.misses++;
+    // Make room for the new texture out of the idle ones first
+    size_t bytes = (size_t)bucket_width * (size_t)bucket_height * 4;
+    pool_evict(pool, pool->budget_bytes > bytes ? pool->budget_bytes - bytes : 0);
+    pthread_mutex_unlock(&pool->lock);
+
+    texture = calloc(1, sizeof(struct texture_pool_texture));
+    if (!texture) {
+        return NULL;
+    }
+    texture->texture = pool->ops->create(pool->user_data, format, bucket_width, bucket_height);
+    if (!texture->texture) {
+        log_error("[POOL] ", "Failed to allocate %dx%d texture\n", bucket_width, bucket_height);
+        free(texture);
+        return NULL;
+    }
+    texture->format = format;
+    texture->width = bucket_width;
+    texture->height = bucket_height;
+    texture->bytes = bytes;
+    wl_list_init(&texture->link);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.in_use++;
+    pool->stats.resident_bytes += bytes;
+    pool_update_counters(pool);
+    pthread_mutex_unlock(&pool->lock);
+    return texture;
+}
+
+void
+texture_pool_release(struct texture_pool *pool, struct texture_pool_texture *texture)
+{
+    if (!texture) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.in_use--;
+    pool->stats.idle++;
+    pool->stats.idle_bytes += texture->bytes;
+    wl_list_insert(&pool->idle, &texture->link);
+    pool_evict(pool, pool->budget_bytes);
+    pool_update_counters(pool);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void
+texture_pool_trim(struct texture_pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool_evict(pool, 0);
+    pool_update_counters(pool);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void
+texture_pool_set_budget(struct texture_pool *pool, size_t budget_bytes)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->budget_bytes = budget_bytes;
+    pool_evict(pool, budget_bytes);
+    pool_update_counters(pool);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void
+texture_pool_get_stats(struct texture_pool *pool, struct texture_pool_stats *stats)
+{
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
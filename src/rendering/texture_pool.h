@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-util.h>
+
+// Texture pool
+// Recycles renderer textures (MTLTextures, pixman images, ...) by size
+// bucket so that resizing a window or cycling through client buffers does
+// not allocate and free a texture every frame. The pool only manages
+// bookkeeping; the backend allocates and frees its objects through
+// texture_pool_ops.
+//
+// Sizes are rounded up to a bucket (texture_pool_bucket_size): a texture
+// is at least as large as requested, and the caller uses the top-left
+// width x height of it. Idle textures are kept most recently used first
+// and evicted least recently used first once the idle bytes exceed the
+// budget. All pooled formats are 32 bits per pixel. Thread safe.
+
+struct texture_pool;
+
+struct texture_pool_ops {
+    // Allocate a texture of exactly width x height, NULL on failure
+    void *(*create)(void *user_data, uint32_t format, int32_t width, int32_t height);
+    void (*destroy)(void *user_data, void *texture);
+};
+
+struct texture_pool_texture {
+    void *texture;           // Backend object
+    uint32_t format;
+    int32_t width, height;   // Allocated (bucket) size
+    size_t bytes;
+    struct wl_list link;     // Idle list (private)
+};
+
+struct texture_pool_stats {
+    uint64_t hits;            // Acquires served from idle textures
+    uint64_t misses;          // Acquires that allocated
+    uint64_t evictions;       // Idle textures freed to stay in budget
+    size_t resident_bytes;    // In use + idle
+    size_t idle_bytes;
+    uint32_t in_use;
+    uint32_t idle;
+};
+
+struct texture_pool *texture_pool_create(const struct texture_pool_ops *ops, void *user_data,
+                                         size_t budget_bytes);
+// Frees idle textures; textures still in use must have been released
+void texture_pool_destroy(struct texture_pool *pool);
+
+void texture_pool_bucket_size(int32_t width, int32_t height, int32_t *bucket_width,
+                              int32_t *bucket_height);
+
+// A texture of at least width x height, NULL if allocation failed
+struct texture_pool_texture *texture_pool_acquire(struct texture_pool *pool, uint32_t format,
+                                                  int32_t width, int32_t height);
+void texture_pool_release(struct texture_pool *pool, struct texture_pool_texture *texture);
+
+// Free every idle texture (e.g. on memory pressure)
+void texture_pool_trim(struct texture_pool *pool);
+void texture_pool_set_budget(struct texture_pool *pool, size_t budget_bytes);
+void texture_pool_get_stats(struct texture_pool *pool, struct texture_pool_stats *stats);
@@ -20,11 +20,14 @@ extern NSString *const kWawonaPrefsTouchInputType;
 extern NSString *const kWawonaPrefsWaypipeRSSupport; // Deprecated - always enabled
 extern NSString *const kWawonaPrefsEnableTCPListener; // Deprecated - always enabled
 extern NSString *const kWawonaPrefsTCPListenerPort;
+extern NSString *const kWawonaPrefsTCPAcceptBacklog;
+extern NSString *const kWawonaPrefsTCPMaxConnectionsPerPeer;
 extern NSString *const kWawonaPrefsWaylandSocketDir;
 extern NSString *const kWawonaPrefsWaylandDisplayNumber;
 extern NSString *const kWawonaPrefsEnableVulkanDrivers;
 extern NSString *const kWawonaPrefsEnableEGLDrivers;
 extern NSString *const kWawonaPrefsEnableDmabuf;
+extern NSString *const kWawonaPrefsTraceEnabled;
 extern NSString *const kWawonaPrefsRespectSafeArea;
 // Waypipe configuration keys
 extern NSString *const kWawonaPrefsWaypipeDisplay;
@@ -114,6 +117,10 @@ extern NSString *const kWawonaPrefsWaypipeSecCtx;
 - (void)setEnableTCPListener:(BOOL)enabled;
 - (NSInteger)tcpListenerPort;
 - (void)setTCPListenerPort:(NSInteger)port;
+- (NSInteger)tcpAcceptBacklog;
+- (void)setTCPAcceptBacklog:(NSInteger)backlog;
+- (NSInteger)tcpMaxConnectionsPerPeer;
+- (void)setTCPMaxConnectionsPerPeer:(NSInteger)limit;
 
 // Wayland Configuration
 - (NSString *)waylandSocketDir;
@@ -131,6 +138,10 @@ extern NSString *const kWawonaPrefsWaypipeSecCtx;
 - (BOOL)dmabufEnabled;
 - (void)setDmabufEnabled:(BOOL)enabled;
 
+// Diagnostics
+- (BOOL)traceEnabled;
+- (void)setTraceEnabled:(BOOL)enabled;
+
 // Waypipe Configuration
 - (NSString *)waypipeDisplay;
 - (void)setWaypipeDisplay:(NSString *)display;
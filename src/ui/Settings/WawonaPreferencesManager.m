@@ -20,11 +20,14 @@ NSString *const kWawonaPrefsTouchInputType = @"TouchInputType";
 NSString *const kWawonaPrefsWaypipeRSSupport = @"WaypipeRSSupport"; // Deprecated - always enabled
 NSString *const kWawonaPrefsEnableTCPListener = @"EnableTCPListener"; // Deprecated - always enabled
 NSString *const kWawonaPrefsTCPListenerPort = @"TCPListenerPort";
+NSString *const kWawonaPrefsTCPAcceptBacklog = @"TCPAcceptBacklog";
+NSString *const kWawonaPrefsTCPMaxConnectionsPerPeer = @"TCPMaxConnectionsPerPeer";
 NSString *const kWawonaPrefsWaylandSocketDir = @"WaylandSocketDir";
 NSString *const kWawonaPrefsWaylandDisplayNumber = @"WaylandDisplayNumber";
 NSString *const kWawonaPrefsEnableVulkanDrivers = @"EnableVulkanDrivers";
 NSString *const kWawonaPrefsEnableEGLDrivers = @"EnableEGLDrivers";
 NSString *const kWawonaPrefsEnableDmabuf = @"EnableDmabuf";
+NSString *const kWawonaPrefsTraceEnabled = @"TraceEnabled";
 NSString *const kWawonaPrefsRespectSafeArea = @"RespectSafeArea";
 // Waypipe configuration keys
 NSString *const kWawonaPrefsWaypipeDisplay = @"WaypipeDisplay";
@@ -235,6 +238,13 @@ NSString *const kWawonaPrefsWaypipeSecCtx = @"WaypipeSecCtx";
     [defaults setInteger:0
                   forKey:kWawonaPrefsTCPListenerPort]; // 0 means dynamic
   }
+  if (![defaults objectForKey:kWawonaPrefsTCPAcceptBacklog]) {
+    [defaults setInteger:128 forKey:kWawonaPrefsTCPAcceptBacklog];
+  }
+  if (![defaults objectForKey:kWawonaPrefsTCPMaxConnectionsPerPeer]) {
+    [defaults setInteger:8
+                  forKey:kWawonaPrefsTCPMaxConnectionsPerPeer]; // 0 means unlimited
+  }
   if (![defaults objectForKey:kWawonaPrefsWaylandSocketDir]) {
     NSString *tmpDir = NSTemporaryDirectory();
     NSString *defaultDir =
@@ -253,6 +263,9 @@ NSString *const kWawonaPrefsWaypipeSecCtx = @"WaypipeSecCtx";
   if (![defaults objectForKey:kWawonaPrefsEnableDmabuf]) {
     [defaults setBool:YES forKey:kWawonaPrefsEnableDmabuf];
   }
+  if (![defaults objectForKey:kWawonaPrefsTraceEnabled]) {
+    [defaults setBool:NO forKey:kWawonaPrefsTraceEnabled];
+  }
   if (![defaults objectForKey:kWawonaPrefsTouchInputType]) {
     [defaults setObject:@"Multi-Touch" forKey:kWawonaPrefsTouchInputType];
   }
@@ -274,11 +287,14 @@ NSString *const kWawonaPrefsWaypipeSecCtx = @"WaypipeSecCtx";
   [defaults removeObjectForKey:kWawonaPrefsWaypipeRSSupport];
   [defaults removeObjectForKey:kWawonaPrefsEnableTCPListener];
   [defaults removeObjectForKey:kWawonaPrefsTCPListenerPort];
+  [defaults removeObjectForKey:kWawonaPrefsTCPAcceptBacklog];
+  [defaults removeObjectForKey:kWawonaPrefsTCPMaxConnectionsPerPeer];
   [defaults removeObjectForKey:kWawonaPrefsWaylandSocketDir];
   [defaults removeObjectForKey:kWawonaPrefsWaylandDisplayNumber];
   [defaults removeObjectForKey:kWawonaPrefsEnableVulkanDrivers];
   [defaults removeObjectForKey:kWawonaPrefsEnableEGLDrivers];
   [defaults removeObjectForKey:kWawonaPrefsEnableDmabuf];
+  [defaults removeObjectForKey:kWawonaPrefsTraceEnabled];
   [defaults synchronize];
   [self setDefaultsIfNeeded];
 }
@@ -441,6 +457,30 @@ NSString *const kWawonaPrefsWaypipeSecCtx = @"WaypipeSecCtx";
   [[NSUserDefaults standardUserDefaults] synchronize];
 }
 
+- (NSInteger)tcpAcceptBacklog {
+  return [[NSUserDefaults standardUserDefaults]
+      integerForKey:kWawonaPrefsTCPAcceptBacklog];
+}
+
+- (void)setTCPAcceptBacklog:(NSInteger)backlog {
+  [[NSUserDefaults standardUserDefaults]
+      setInteger:backlog
+          forKey:kWawonaPrefsTCPAcceptBacklog];
+  [[NSUserDefaults standardUserDefaults] synchronize];
+}
+
+- (NSInteger)tcpMaxConnectionsPerPeer {
+  return [[NSUserDefaults standardUserDefaults]
+      integerForKey:kWawonaPrefsTCPMaxConnectionsPerPeer];
+}
+
+- (void)setTCPMaxConnectionsPerPeer:(NSInteger)limit {
+  [[NSUserDefaults standardUserDefaults]
+      setInteger:limit
+          forKey:kWawonaPrefsTCPMaxConnectionsPerPeer];
+  [[NSUserDefaults standardUserDefaults] synchronize];
+}
+
 // Wayland Configuration
 - (NSString *)waylandSocketDir {
   NSString *dir = [[NSUserDefaults standardUserDefaults]
@@ -516,6 +556,18 @@ NSString *const kWawonaPrefsWaypipeSecCtx = @"WaypipeSecCtx";
   [[NSUserDefaults standardUserDefaults] synchronize];
 }
 
+// Diagnostics
+- (BOOL)traceEnabled {
+  return [[NSUserDefaults standardUserDefaults]
+      boolForKey:kWawonaPrefsTraceEnabled];
+}
+
+- (void)setTraceEnabled:(BOOL)enabled {
+  [[NSUserDefaults standardUserDefaults] setBool:enabled
+                                          forKey:kWawonaPrefsTraceEnabled];
+  [[NSUserDefaults standardUserDefaults] synchronize];
+}
+
 // New unified display methods
 - (BOOL)autoScale {
   // Check new key first, fallback to legacy key for migration